@@ -0,0 +1,212 @@
+/*
+ * bitmap.h
+ *
+ * A packed array of bits used by cascade
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2014-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_MODULE_QKD_CASCADE_BITMAP_H
+#define __QKD_MODULE_QKD_CASCADE_BITMAP_H
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+#include <vector>
+
+#include <inttypes.h>
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * a fixed size array of bits packed into 64 bit words
+ *
+ * This replaces std::set<uint64_t> and std::vector<bool> in
+ * cascade: membership tests are a single shift and mask, and
+ * counting or parity over a range of bits works on whole words.
+ */
+class bitmap {
+
+
+public:
+
+
+    /**
+     * ctor
+     *
+     * @param   nBits       number of bits (all cleared)
+     */
+    explicit bitmap(uint64_t nBits = 0) : m_nBits(nBits), m_cWords((nBits + 63) / 64, 0) {};
+
+
+    /**
+     * number of bits in the bitmap
+     *
+     * @return  number of bits
+     */
+    inline uint64_t bits() const { return m_nBits; }
+
+
+    /**
+     * number of bits set in the whole bitmap
+     *
+     * @return  number of bits set
+     */
+    inline uint64_t count() const {
+        uint64_t nCount = 0;
+        for (auto nWord : m_cWords) nCount += __builtin_popcountll(nWord);
+        return nCount;
+    }
+
+
+    /**
+     * number of bits set in a range
+     *
+     * @param   nOffset     first bit of the range
+     * @param   nSize       number of bits in the range
+     * @return  number of bits set in [nOffset, nOffset + nSize)
+     */
+    inline uint64_t count(uint64_t nOffset, uint64_t nSize) const {
+
+        uint64_t nCount = 0;
+        uint64_t nEnd = nOffset + nSize;
+
+        while ((nOffset < nEnd) && (nOffset % 64)) {
+            const uint64_t nBits = std::min<uint64_t>(64 - nOffset % 64, nEnd - nOffset);
+            nCount += __builtin_popcountll(range_word(nOffset, nBits));
+            nOffset += nBits;
+        }
+        for ( ; nOffset + 64 <= nEnd; nOffset += 64) nCount += __builtin_popcountll(m_cWords[nOffset / 64]);
+        if (nOffset < nEnd) nCount += __builtin_popcountll(range_word(nOffset, nEnd - nOffset));
+
+        return nCount;
+    }
+
+
+    /**
+     * invert a bit
+     *
+     * @param   nPos        position of the bit
+     */
+    inline void flip(uint64_t nPos) { m_cWords[nPos / 64] ^= (uint64_t(1) << (nPos % 64)); }
+
+
+    /**
+     * get a bit
+     *
+     * @param   nPos        position of the bit
+     * @return  the bit value
+     */
+    inline bool get(uint64_t nPos) const { return ((m_cWords[nPos / 64] >> (nPos % 64)) & 1) != 0; }
+
+
+    /**
+     * parity of a range
+     *
+     * @param   nOffset     first bit of the range
+     * @param   nSize       number of bits in the range
+     * @return  parity of [nOffset, nOffset + nSize)
+     */
+    inline bool parity(uint64_t nOffset, uint64_t nSize) const {
+
+        uint64_t nFold = 0;
+        uint64_t nEnd = nOffset + nSize;
+
+        while ((nOffset < nEnd) && (nOffset % 64)) {
+            const uint64_t nBits = std::min<uint64_t>(64 - nOffset % 64, nEnd - nOffset);
+            nFold ^= range_word(nOffset, nBits);
+            nOffset += nBits;
+        }
+        for ( ; nOffset + 64 <= nEnd; nOffset += 64) nFold ^= m_cWords[nOffset / 64];
+        if (nOffset < nEnd) nFold ^= range_word(nOffset, nEnd - nOffset);
+
+        return (__builtin_parityll(nFold) != 0);
+    }
+
+
+    /**
+     * set a bit
+     *
+     * @param   nPos        position of the bit
+     */
+    inline void set(uint64_t nPos) { m_cWords[nPos / 64] |= (uint64_t(1) << (nPos % 64)); }
+
+
+    /**
+     * set or clear a bit
+     *
+     * @param   nPos        position of the bit
+     * @param   bValue      the new bit value
+     */
+    inline void set(uint64_t nPos, bool bValue) {
+        if (bValue) set(nPos);
+        else m_cWords[nPos / 64] &= ~(uint64_t(1) << (nPos % 64));
+    }
+
+
+    /**
+     * the packed words: bit i is bit (i % 64) of word (i / 64)
+     *
+     * @return  the packed words
+     */
+    inline std::vector<uint64_t> const & words() const { return m_cWords; }
+
+
+private:
+
+
+    /**
+     * get the bits of a range within a single word
+     *
+     * @param   nOffset     first bit of the range
+     * @param   nBits       number of bits (1 - 64) not crossing a word boundary
+     * @return  the bits of the range, shifted down to bit 0
+     */
+    inline uint64_t range_word(uint64_t nOffset, uint64_t nBits) const {
+        uint64_t nWord = m_cWords[nOffset / 64] >> (nOffset % 64);
+        return (nBits == 64 ? nWord : nWord & ((uint64_t(1) << nBits) - 1));
+    }
+
+
+    /**
+     * number of bits
+     */
+    uint64_t m_nBits;
+
+
+    /**
+     * the packed bits
+     */
+    std::vector<uint64_t> m_cWords;
+
+};
+
+
+#endif
@@ -83,7 +83,7 @@ void frame::flip_bit(uint64_t pos) {
 
     // we flipped the bit as bob, assuming
     // now having a correct bit here
-    m_cCorrectedBits.insert(pos);
+    m_cCorrectedBits.set(pos);
 } 
 
 
@@ -119,7 +119,7 @@ void frame::notify_bit_change_remote(uint64_t pos) {
     // sanity check
     if (pos >= m_cKey.size() * 8) return;
 
-    m_cCorrectedBits.insert(pos);
+    m_cCorrectedBits.set(pos);
     for (auto cChecker : m_cCheckers) {
         cChecker->notify_bit_change_remote(pos);
     }
@@ -136,7 +136,7 @@ void frame::notify_correct_bit(uint64_t pos) {
     // sanity check
     if (pos >= m_cKey.size() * 8) return;
 
-    m_cCorrectBits.insert(pos);
+    m_cCorrectBits.set(pos);
     
     for (auto cChecker : m_cCheckers) {
         cChecker->notify_correct_bit(pos);
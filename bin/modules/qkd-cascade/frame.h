@@ -38,11 +38,13 @@
 // ------------------------------------------------------------
 // incs
 
-#include <set>
+#include <vector>
 
 // ait
 #include <qkd/key/key.h>
 
+#include "bitmap.h"
+
 
 // ------------------------------------------------------------
 // decl
@@ -66,7 +68,8 @@ public:
      *
      * @param   cKey        the keys we operate on
      */
-    frame(qkd::key::key & cKey) : m_cKey(cKey), m_nTransmittedMessages(0), m_nTransmittedParities(0) {}
+    frame(qkd::key::key & cKey) : m_cKey(cKey), m_cCorrectBits(cKey.size() * 8), m_cCorrectedBits(cKey.size() * 8), 
+            m_nTransmittedMessages(0), m_nTransmittedParities(0) {}
 
     
     /**
@@ -114,35 +117,19 @@ public:
     
    
     /**
-     * get indices of surely correct bits inside the frame
-     * 
-     * @return  set of indices of surely correct frame bits
-     */
-    std::set<uint64_t> & correct_bits() { return m_cCorrectBits; }
-
-
-    /**
-     * get indices of surely correct bits inside the frame
-     * 
-     * @return  set of indices of surely correct frame bits
-     */
-    std::set<uint64_t> const & correct_bits() const { return m_cCorrectBits; }
-
-
-    /**
-     * get indices of corrected bits inside the frame
+     * get surely correct bits inside the frame
      * 
-     * @return  set of indices of corrected frame bits
+     * @return  bitmap of surely correct frame bits
      */
-    std::set<uint64_t> & corrected_bits() { return m_cCorrectedBits; }
+    bitmap const & correct_bits() const { return m_cCorrectBits; }
 
 
     /**
-     * get indices of corrected bits inside the frame
+     * get corrected bits inside the frame
      * 
-     * @return  set of indices of correct frame bits
+     * @return  bitmap of corrected frame bits
      */
-    std::set<uint64_t> const & corrected_bits() const { return m_cCorrectedBits; }
+    bitmap const & corrected_bits() const { return m_cCorrectedBits; }
 
 
     /**
@@ -243,15 +230,15 @@ private:
 
 
     /**
-     *  set containing the indices of all frame bits that are known to be correct 
+     *  all frame bits that are known to be correct 
      */
-    std::set<uint64_t> m_cCorrectBits; 
+    bitmap m_cCorrectBits; 
 
 
     /**
-     *  set containing the indices of all frame bits that have been corrected
+     *  all frame bits that have been corrected
      */
-    std::set<uint64_t> m_cCorrectedBits; 
+    bitmap m_cCorrectedBits; 
 
 
     /**
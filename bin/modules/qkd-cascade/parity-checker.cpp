@@ -31,8 +31,8 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
 #include <exception>
-#include <list>
 
 // ait
 #include <qkd/common_macros.h>
@@ -67,25 +67,30 @@ parity_checker::parity_checker(
         std::vector<uint64_t> const & inv_perm, 
         std::vector<category> const & categories,     
         qkd::module::communicator cComm)
-    : m_cComm(cComm), m_cFrame(cFrame), perm(perm), inv_perm(inv_perm) {
+    : m_cComm(cComm), m_cFrame(cFrame), perm(perm), inv_perm(inv_perm), m_cCategories(categories), m_nOddParityBlocks(0) {
 
     is_bob = cComm.mod()->is_bob();
     uint64_t nKeySizeInBits = m_cFrame.key().size() * 8;
 
-    // based on the given permutation calculate
-    // the partial parity sums
-    partial_parity_sums.resize(nKeySizeInBits + 1);
-    partial_parity_sums[0] = false;
+    // gather the frame bits in permuted order
+    m_cBits = bitmap(nKeySizeInBits);
+    unsigned char const * nKey = m_cFrame.key().data().get();
     for (uint64_t i = 0; i < nKeySizeInBits; ++i) {
-        partial_parity_sums[i + 1] = partial_parity_sums[i] ^ m_cFrame.key().get_bit(inv_perm[i]);
+        if ((nKey[inv_perm[i] / 8] >> (inv_perm[i] % 8)) & 1) m_cBits.set(i);
     }
 
-    // insert indices of already known correct frame bits into this->m_cCorrectBits
-    std::set<uint64_t> const & cCorrectFrameBits = m_cFrame.correct_bits();
-    for (auto it = cCorrectFrameBits.begin(); it != cCorrectFrameBits.end(); ++it) {
-        m_cCorrectBits.insert(perm[*it]);
+    // permuted indices of already known correct frame bits
+    m_cCorrectBits = bitmap(nKeySizeInBits);
+    std::vector<uint64_t> const & cCorrectFrameBits = m_cFrame.correct_bits().words();
+    for (uint64_t i = 0; i < cCorrectFrameBits.size(); ++i) {
+        for (uint64_t nWord = cCorrectFrameBits[i]; nWord; nWord &= nWord - 1) {
+            m_cCorrectBits.set(perm[i * 64 + __builtin_ctzll(nWord)]);
+        }
     }
 
+    m_cBlockSizes.resize(nKeySizeInBits, 0);
+    m_cDiffParities = bitmap(nKeySizeInBits);
+
     // create the set of parity blocks to check
     // this is done according to the categories.
     // categories divide the whole range of bits
@@ -100,6 +105,7 @@ parity_checker::parity_checker(
         uint64_t nParityBlocks = (nCategorySize + k - 1) / k;
 
         std::vector<parity_block> cCalcBlocks;
+        cCalcBlocks.reserve(nParityBlocks);
 
     	// divide category into new blocks
         for (uint64_t i = 0; i < nParityBlocks; ++i) {
@@ -119,12 +125,13 @@ parity_checker::parity_checker(
 
     	// add to parity_blocks and odd_parity_blocks
         for (auto & cParityBlock : cCalcBlocks) {
-            m_cParityBlocks.insert(m_cParityBlocks.end(), cParityBlock);
+            m_cBlockSizes[cParityBlock.offset] = cParityBlock.size;
+            m_cDiffParities.set(cParityBlock.offset, cParityBlock.diffparity);
             if (cParityBlock.diffparity) {
 
                 // comparison in the calculation method found a parity mismatch
                 // this block is subject to further investigation
-                m_cOddParityBlocks.insert(m_cOddParityBlocks.end(), cParityBlock);
+                insert_odd_parity_block(cParityBlock);
             }
         }
 
@@ -156,135 +163,23 @@ bool parity_checker::calculate_block_diffparities(std::vector<parity_block> & cC
 
     // the number of parity bits we need to exchange
     unsigned int nExchangeParities = 0;
-   
-    // calculate number of parities that have to be exchanged and mark
-    // each block to validate
-    //
-    // we iterate over the parity blocks given and set the diffparity to true
-    // whenever we detect the need of parity exchange
-    //
-    for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end(); ++it) {
-
-        // sanity check: parity block offset + size may not exceed key length
-        if (it->offset + it->size > m_cFrame.key().size() * 8) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::calculate_block_diffparities: block position out of range";
-            return false;
-        }
-        
-        // if this block contains only correct bits, we know its diffparity sum is 0
-        if (count_correct_bits_in_block(it->offset, it->size) == it->size) {
-
-            // used as signal that we need not exchange this parity
-            it->diffparity = false; 
-        }
-        else {
-            // used as signal that we need to exchange this parity
-            it->diffparity = true; 
-            nExchangeParities++;
-        }
+    if (!mark_block_diffparities(cCalcBlocks, bTotalDiffParityMustBeEven, nExchangeParities)) {
+        return false;
     }
 
-    // anything to do at all? --> do not proceed if there ain't not parity block to check
-    if (nExchangeParities == 0) {
-        return true;
-    }
-    
-    // if the total parity must be even, we can exchange one parity less
-    // TODO: oliver: ask christoph/phillip why?
-    if (bTotalDiffParityMustBeEven) {
-        nExchangeParities--;
-    }
-    
     // exchange parities with peer
     std::vector<uint8_t> cExchangeParities;
     if (nExchangeParities > 0) { 
 
-        // walk over all given blocks
-        for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end() && (cExchangeParities.size() < nExchangeParities); ++it) {
-
-            // omit those blocks we do not need to exchange parities for
-            if (!it->diffparity) continue;
-
-		    // here starts the calculation of the parity of the block
-            // calculate block parity without including
-            // changes of frame bits after initialisation
-            bool bParity = partial_parity_sums[it->offset + it->size] ^ partial_parity_sums[it->offset]; 
-                
-            auto it1 = m_cChangedBits.lower_bound(it->offset);
-            auto it2 = m_cChangedBits.lower_bound(it->offset + it->size);
-            unsigned int nChangedBits  = std::distance(it1, it2);
-            
-            if ((nChangedBits % 2) != 0) {
-                // if nChangedBits is odd, the parity must be inverted
-                bParity ^= 1; 
-            }
-
-            // here ends the calculation of the parity of the block
-            cExchangeParities.push_back((uint8_t) bParity);
-            m_cFrame.add_transmitted_parities(1);
-        }
-        
-        // for two-party-mode, exchange parities in vector cExchangeParities and XOR them
-	    // TODO: we exchange a uint8 for each bit --> change to bit vector
-        std::vector<uint8_t> cRemoteParities;
-        
-        // send our parities 
-        qkd::utility::buffer cSendBuffer;
-        cSendBuffer << cExchangeParities;
-        m_cComm << cSendBuffer;
-
-        // recv remote parities
-        qkd::utility::buffer cRecvBuffer;
-        m_cComm >> cRecvBuffer;
-        cRecvBuffer.reset();
-        cRecvBuffer >> cRemoteParities;
-
-        // peer must have sent the same amount of bits
-        if (cRemoteParities.size() != cExchangeParities.size()) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "cascade parity exchange size mismatch with peer - protocol error";
+        get_block_parities(cCalcBlocks, nExchangeParities, cExchangeParities);
+        if (!exchange_parities(cExchangeParities)) {
             return false;
         }
-
-        // walk over all parities and compare remote with local ones
-        for (uint64_t i = 0; i < cExchangeParities.size(); ++i) {
-            cExchangeParities[i] ^= cRemoteParities[i];
-        }
-        
         m_cFrame.add_transmitted_messages(1); 
     }
 
     // write back our findings
-    bool bParitySum = false;
-    uint64_t j = 0;
-    for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end(); ++it) {
-
-        // not all bits of the block had been known --> we had to exchange the parity of this block
-        if (it->diffparity) {
-
-            // for all blocks (but the last block in case we have total even parity, i.e. 0)
-            if (j < nExchangeParities) {
-                
-                // now set really the parity difference of the block
-                it->diffparity = (bool) cExchangeParities[j]; 
-
-                // running parity sum, needed only in case we have total even parity
-                bParitySum ^= (bool) cExchangeParities[j];    
-
-                j++;
-            }
-            else {
-
-                // in the case the total sum of exchanged parities must be 0, 
-                // the last parity is equal to the running sum (0+0=0, 1+1=0)
-                it->diffparity = bParitySum;
-            }
-            
-            // add to list of correct bits if parity block size == 1
-            if (!it->diffparity && (it->size == 1) && (m_cCorrectBits.find(it->offset) == m_cCorrectBits.end())) {
-                m_cFrame.notify_correct_bit(inv_perm[it->offset]);
-            }
-        }
-    }
+    set_block_diffparities(cCalcBlocks, nExchangeParities, cExchangeParities.data());
     
     return true;
 }
@@ -297,7 +192,7 @@ bool parity_checker::calculate_block_diffparities(std::vector<parity_block> & cC
  *
  * @param   cCorrBlocks                 the parity blocks to be corrected        
  */
-void parity_checker::correct_blocks(std::set<parity_block, compare_odd_parity_block> const & cCorrBlocks) {
+void parity_checker::correct_blocks(std::vector<parity_block> const & cCorrBlocks) {
 
     // the idea: 
     //
@@ -313,160 +208,159 @@ void parity_checker::correct_blocks(std::set<parity_block, compare_odd_parity_bl
     //    split the block in 2 halves and proceed with either
     //    the first or the second half
 
-    std::list<std::set<parity_block, compare_parity_block>::iterator> cCorrBlocksIterators;
+    std::vector<parity_block> cBlocks;
+    cBlocks.reserve(cCorrBlocks.size());
     
-    // create a list of iterators to all cCorrBlocks
     // do sanity checks whether all blocks to be corrected exist and have different parity
     for (auto iter = cCorrBlocks.begin(); iter != cCorrBlocks.end(); ++iter) {
 
-        auto cParityBlockIterator = m_cParityBlocks.find(*iter);
-        if (cParityBlockIterator == m_cParityBlocks.end()) {
+        if ((iter->offset >= m_cBlockSizes.size()) || (m_cBlockSizes[iter->offset] == 0)) {
             qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: block not found!";
             return;
         }
-        if (!cParityBlockIterator->diffparity) {
+        if (!m_cDiffParities.get(iter->offset)) {
             qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: block has even parity!";
             return;
         }
         
         // the block is valid
-        cCorrBlocksIterators.push_back(cParityBlockIterator);
+        parity_block cParityBlock;
+        cParityBlock.offset = iter->offset;
+        cParityBlock.size = m_cBlockSizes[iter->offset];
+        cParityBlock.diffparity = true;
+        cBlocks.push_back(cParityBlock);
     }
 
     // container to hold parity subblocks to calculate
     std::vector<parity_block> cCalcBlocks;
+    cCalcBlocks.reserve(cBlocks.size());
 
     // as long as we have blocks to correct...
-    while (cCorrBlocksIterators.size() > 0) {       
+    while (cBlocks.size() > 0) {       
 
-        cCalcBlocks.clear();
+        // single bit blocks are done, for all others pick the half to check
+        correct_single_bit_blocks(cBlocks);
+        select_halves(cBlocks, cCalcBlocks);
 
-        // first and second half subblocks
-        parity_block cParityBlock1;
-        parity_block cParityBlock2;
+    	// now we have decided for which half we will calculate the parity
+        // ... do the exchange of parity bits with the peer!
+    	calculate_block_diffparities(cCalcBlocks, false);
 
-	    // optimization: detect sub-blocks where we know already the parity and single bit blocks
-        for (auto iti = cCorrBlocksIterators.begin(); iti != cCorrBlocksIterators.end(); ) {
+        // continue with the half of wrong parity
+        split_blocks(cBlocks, cCalcBlocks);
+    }
+}
 
-            // subblock is larger than 1 bit...
-            if ((*iti)->size > 1) {
 
-                // first half block
-                cParityBlock1.offset = (*iti)->offset;         
-                cParityBlock1.size = ((*iti)->size + 1) / 2;
+/**
+ * correct the odd parity blocks of several parity checkers at once
+ *
+ * the binary searches in the odd parity blocks of all the given 
+ * checkers advance in lockstep: the parities of all halves on one
+ * bisection level are sent in a single message to the peer.
+ *
+ * a bit corrected by one checker may turn blocks of the other 
+ * checkers odd or even: on each level we pick up the current odd 
+ * parity blocks, so even blocks leave and new odd blocks join the 
+ * search right away. we return when no checker has an odd parity 
+ * block left.
+ *
+ * @param   cCheckers                   the parity checkers
+ * @return  true if successful, false otherwise
+ */
+bool parity_checker::correct_blocks_batched(std::vector<parity_checker *> const & cCheckers) {
 
-                // second half block
-                cParityBlock2.offset = cParityBlock1.offset + cParityBlock1.size;  
-                cParityBlock2.size = (*iti)->size - cParityBlock1.size;
-                
-                uint64_t nCorrectBits = count_correct_bits_in_block(cParityBlock2.offset, cParityBlock2.size);
-
-                // in case the parity of the 2nd half is already known 
-                // let us work with the 2nd half (and later do nothing)
-                if (nCorrectBits == cParityBlock2.size) {
-                    cCalcBlocks.push_back(cParityBlock2);
-                }
-                else {
-                    // let us work on the first half
-                    cCalcBlocks.push_back(cParityBlock1);
-                }
-                iti++;
-            }
-            else {               
-
-                // single bit block ==> bit error
-                uint64_t nCorrectBitOffset = (*iti)->offset;
-                if (!is_bob) {
-
-                    // alice notes the bit as "changed remotely"
-                    m_cFrame.notify_bit_change_remote(inv_perm[nCorrectBitOffset]);
-                }
-                else {
-                    // bob actually flips the bit really
-                    m_cFrame.flip_bit(inv_perm[nCorrectBitOffset]);
-                }
-               
-                // mark the bit as been corrected
-                m_cFrame.notify_correct_bit(inv_perm[nCorrectBitOffset]);
-
-                // remove single bit blocks from the set of block to check
-                iti = cCorrBlocksIterators.erase(iti); 
-            }
-        } 
+    // the blocks under bisection and the halves to check of each checker
+    std::vector<std::vector<parity_block>> cBlocks(cCheckers.size());
+    std::vector<std::vector<parity_block>> cCalcBlocks(cCheckers.size());
+    std::vector<unsigned int> cExchangeParities(cCheckers.size(), 0);
 
-    	// now we have decided for which half we will calculate the parity
-        // ... do the exchange of parity bits with the peer!
-    	calculate_block_diffparities(cCalcBlocks, false);
+    while (true) {
 
-        // sanity check, whether we have not forgotten a block
-	    // TODO: how to proceed if the condition below holds true?
-        //       the method calculate_block_diffparities does not modify
-        //       the size of the cCalcBlocks vector, so why make this
-        //       check here, after network transmission?
-	    if (cCalcBlocks.size() != cCorrBlocksIterators.size()) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: unequal container sizes!";
+        // first do all single bit corrections of this level 
+        for (uint64_t i = 0; i < cCheckers.size(); ++i) {
+            cBlocks[i] = cCheckers[i]->get_odd_parity_blocks();
+            cCheckers[i]->correct_single_bit_blocks(cBlocks[i]);
         }
 
-        // 
-        auto it = cCalcBlocks.begin();
-        for (auto iti = cCorrBlocksIterators.begin(); iti != cCorrBlocksIterators.end(); ++iti) {
-
-            // first half block
-            cParityBlock1.offset = (*iti)->offset;        
-            cParityBlock1.size = ((*iti)->size + 1) / 2;
-
-            // second half block
-            cParityBlock2.offset = cParityBlock1.offset + cParityBlock1.size; 
-            cParityBlock2.size = (*iti)->size - cParityBlock1.size;
-
-            // explanation of following logical expression:
-	        // first term on the rhs means that we calculate parity of 2nd half,  
-            // 2nd term means that the parity of this half is different
-	        // parity of 1st half = EITHER first OR second term is true --> 
-	        // we calculated parity of 2nd half and the parity of 2nd half is NOT different --> 
-            // parity of 1st half differs
-	        // we did NOT calculate parity of the 2nd half (i.e. 1st half) 
-            // and the parity of this IS different --> parity of 1st differs
-	        cParityBlock1.diffparity = ((it->offset == cParityBlock2.offset) ^ it->diffparity); 
-            cParityBlock2.diffparity = !cParityBlock1.diffparity;
-
-	        // add single correct bit to set of correct bits (if not already contained)
-            if (!cParityBlock1.diffparity && (cParityBlock1.size == 1) && (m_cCorrectBits.find(cParityBlock1.offset) == m_cCorrectBits.end())) {
-
-                // single bit corrected in first half
-                m_cFrame.notify_correct_bit(inv_perm[cParityBlock1.offset]);
-            }
-            if (!cParityBlock2.diffparity && (cParityBlock2.size == 1) && (m_cCorrectBits.find(cParityBlock2.offset) == m_cCorrectBits.end())) {
-
-                // single bit corrected in second half
-                m_cFrame.notify_correct_bit(inv_perm[cParityBlock2.offset]);
-            }
+        // then collect the parities of the halves of all blocks odd now
+        bool bOddParityBlocks = false;
+        std::vector<uint8_t> cParities;
+        for (uint64_t i = 0; i < cCheckers.size(); ++i) {
 
-            // remove current parity block from the list of odd parity blocks
-            if (m_cOddParityBlocks.erase(**iti) != 1) {
-                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: could not erase **iti! (remove parity block from odd parity blocks)";
-            }
+            // single bit blocks turned odd meanwhile are corrected on the next level
+            cBlocks[i] = cCheckers[i]->get_odd_parity_blocks();
+            cBlocks[i].erase(std::remove_if(cBlocks[i].begin(), cBlocks[i].end(), 
+                    [](parity_block const & cParityBlock) { return (cParityBlock.size < 2); }), cBlocks[i].end());
 
-            // insert new odd parity block (either first or second)
-            // (insert returns a pair, the second part of which indicates success)
-            if (!m_cOddParityBlocks.insert(cParityBlock1.diffparity ? cParityBlock1 : cParityBlock2).second)             {
-                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: could not insert cParityBlock1/cParityBlock2!";
+            cCheckers[i]->select_halves(cBlocks[i], cCalcBlocks[i]);
+            if (!cCheckers[i]->mark_block_diffparities(cCalcBlocks[i], false, cExchangeParities[i])) {
+                return false;
             }
+            cCheckers[i]->get_block_parities(cCalcBlocks[i], cExchangeParities[i], cParities);
 
-            // update list of parity blocks of this parity checker
-            *iti = m_cParityBlocks.erase(*iti);          
-            *iti = m_cParityBlocks.insert(*iti, cParityBlock2);
-            *iti = m_cParityBlocks.insert(*iti, cParityBlock1);
+            bOddParityBlocks = bOddParityBlocks || cCheckers[i]->has_odd_parity_blocks();
+        }
+        if (!bOddParityBlocks) break;
 
-            // set *iti to block with wrong parity
-            if (cParityBlock2.diffparity) {
-                (*iti)++;
+        // one message for all
+        if (!cParities.empty()) {
+            if (!cCheckers.front()->exchange_parities(cParities)) {
+                return false;
             }
+            cCheckers.front()->m_cFrame.add_transmitted_messages(1); 
+        }
 
-            // move to next block to calculate
-            it++; 
-        } 
+        // write back and continue with the halves of wrong parity
+        uint64_t nParity = 0;
+        for (uint64_t i = 0; i < cCheckers.size(); ++i) {
+            cCheckers[i]->set_block_diffparities(cCalcBlocks[i], cExchangeParities[i], cParities.data() + nParity);
+            cCheckers[i]->split_blocks(cBlocks[i], cCalcBlocks[i]);
+            nParity += cExchangeParities[i];
+        }
     }
+
+    return true;
+}
+
+
+/**
+ * correct the single bit blocks 
+ *
+ * a single bit block of odd parity is a bit error: alice notes
+ * the bit as changed remotely, bob flips the bit. the corrected
+ * blocks are removed from cBlocks.
+ *
+ * @param   cBlocks                     the odd parity blocks under bisection
+ */
+void parity_checker::correct_single_bit_blocks(std::vector<parity_block> & cBlocks) {
+
+    // single bit blocks are dropped from cBlocks in place, preserving the order
+    auto iterKeep = cBlocks.begin();
+    for (auto iti = cBlocks.begin(); iti != cBlocks.end(); ++iti) {
+
+        // subblock is larger than 1 bit...
+        if (iti->size > 1) {
+            *iterKeep++ = *iti;
+            continue;
+        }
+
+        // single bit block ==> bit error
+        uint64_t nCorrectBitOffset = iti->offset;
+        if (!is_bob) {
+
+            // alice notes the bit as "changed remotely"
+            m_cFrame.notify_bit_change_remote(inv_perm[nCorrectBitOffset]);
+        }
+        else {
+            // bob actually flips the bit really
+            m_cFrame.flip_bit(inv_perm[nCorrectBitOffset]);
+        }
+       
+        // mark the bit as been corrected
+        m_cFrame.notify_correct_bit(inv_perm[nCorrectBitOffset]);
+    } 
+    cBlocks.erase(iterKeep, cBlocks.end());
 }
 
 
@@ -485,9 +379,198 @@ uint64_t parity_checker::count_correct_bits_in_block(uint64_t offset, uint64_t s
         return 0;
     }
     
-    auto it1 = m_cCorrectBits.lower_bound(offset);
-    auto it2 = m_cCorrectBits.lower_bound(offset + size);
-    return std::distance(it1, it2);
+    return m_cCorrectBits.count(offset, size);
+}
+
+
+/**
+ * exchange parities with the peer
+ *
+ * on return cParities holds the XOR of the local and the remote parities
+ *
+ * @param   cParities                   the local parities in, the differential parities out
+ * @return  true if successful, false otherwise
+ */
+bool parity_checker::exchange_parities(std::vector<uint8_t> & cParities) {
+
+    // for two-party-mode, exchange parities in vector cParities and XOR them
+    // TODO: we exchange a uint8 for each bit --> change to bit vector
+    std::vector<uint8_t> cRemoteParities;
+    
+    // send our parities 
+    qkd::utility::buffer cSendBuffer;
+    cSendBuffer << cParities;
+    m_cComm << cSendBuffer;
+
+    // recv remote parities
+    qkd::utility::buffer cRecvBuffer;
+    m_cComm >> cRecvBuffer;
+    cRecvBuffer.reset();
+    cRecvBuffer >> cRemoteParities;
+
+    // peer must have sent the same amount of bits
+    if (cRemoteParities.size() != cParities.size()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "cascade parity exchange size mismatch with peer - protocol error";
+        return false;
+    }
+
+    // walk over all parities and compare remote with local ones
+    for (uint64_t i = 0; i < cParities.size(); ++i) {
+        cParities[i] ^= cRemoteParities[i];
+    }
+
+    return true;
+}
+
+
+/**
+ * find the current parity block holding a bit
+ * 
+ * blocks evolve only by splitting into halves, so we start at the
+ * initial block of the category and descend the halves until we 
+ * hit an existing block.
+ *
+ * @param   nPos            permuted bit position
+ * @return  the parity block containing nPos
+ */
+parity_block parity_checker::find_block(uint64_t nPos) const {
+
+    parity_block cParityBlock;
+    cParityBlock.offset = 0;
+    cParityBlock.size = 0;
+    cParityBlock.diffparity = false;
+
+    // initial block of the category
+    uint64_t nCategoryOffset = 0;
+    for (auto & cCategory : m_cCategories) {
+        if (nPos < nCategoryOffset + cCategory.size) {
+            cParityBlock.offset = nCategoryOffset + ((nPos - nCategoryOffset) / cCategory.k) * cCategory.k;
+            cParityBlock.size = std::min<uint64_t>(cCategory.k, nCategoryOffset + cCategory.size - cParityBlock.offset);
+            break;
+        }
+        nCategoryOffset += cCategory.size;
+    }
+
+    // descend the halves
+    while ((cParityBlock.size > 1) && (m_cBlockSizes[cParityBlock.offset] != cParityBlock.size)) {
+        unsigned int nFirstHalf = (cParityBlock.size + 1) / 2;
+        if (nPos < cParityBlock.offset + nFirstHalf) {
+            cParityBlock.size = nFirstHalf;
+        }
+        else {
+            cParityBlock.offset += nFirstHalf;
+            cParityBlock.size -= nFirstHalf;
+        }
+    }
+    cParityBlock.diffparity = m_cDiffParities.get(cParityBlock.offset);
+
+    return cParityBlock;
+}
+
+
+/**
+ * append the local parities of the blocks to exchange
+ *
+ * @param   cCalcBlocks                 the parity blocks as marked by mark_block_diffparities
+ * @param   nExchangeParities           number of parities to exchange
+ * @param   cParities                   the local parities are appended here
+ */
+void parity_checker::get_block_parities(std::vector<parity_block> const & cCalcBlocks, unsigned int nExchangeParities, std::vector<uint8_t> & cParities) {
+
+    cParities.reserve(cParities.size() + nExchangeParities);
+
+    // walk over all given blocks
+    unsigned int nParities = 0;
+    for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end() && (nParities < nExchangeParities); ++it) {
+
+        // omit those blocks we do not need to exchange parities for
+        if (!it->diffparity) continue;
+
+        // the parity of the block on the current (permuted) frame bits
+        cParities.push_back((uint8_t)m_cBits.parity(it->offset, it->size));
+        m_cFrame.add_transmitted_parities(1);
+        nParities++;
+    }
+}
+
+
+/**
+ * get odd parity blocks
+ *
+ * all odd parity blocks do have at least 1 error bit
+ *
+ * @return  the odd parity blocks sorted by size and offset (compare_odd_parity_block)
+ */
+std::vector<parity_block> parity_checker::get_odd_parity_blocks() {
+    prune_odd_parity_blocks();
+    return m_cOddParityBlocks;
+}
+
+
+/**
+ * record a parity block as odd
+ *
+ * @param   cParityBlock    the parity block which turned odd
+ */
+void parity_checker::insert_odd_parity_block(parity_block const & cParityBlock) {
+
+    m_cOddParityBlocks.push_back(cParityBlock);
+    m_nOddParityBlocks++;
+
+    // don't let stale entries pile up
+    if (m_cOddParityBlocks.size() > 2 * m_nOddParityBlocks + 1024) prune_odd_parity_blocks();
+}
+
+
+/**
+ * mark the blocks we need to exchange parities for
+ *
+ * each block in cCalcBlocks which has not only surely correct bits 
+ * gets its diffparity set to true
+ *
+ * @param   cCalcBlocks                     set containing the parity blocks for which their parity shall be calculated
+ * @param   bTotalDiffParityMustBeEven      states whether the total differential parity sum of all blocks must be even 
+ * @param   nExchangeParities               on return: the number of parities to exchange
+ * @return  true if successful, false otherwise
+ */
+bool parity_checker::mark_block_diffparities(std::vector<parity_block> & cCalcBlocks, bool bTotalDiffParityMustBeEven, unsigned int & nExchangeParities) const {
+
+    nExchangeParities = 0;
+   
+    // calculate number of parities that have to be exchanged and mark
+    // each block to validate
+    //
+    // we iterate over the parity blocks given and set the diffparity to true
+    // whenever we detect the need of parity exchange
+    //
+    for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end(); ++it) {
+
+        // sanity check: parity block offset + size may not exceed key length
+        if (it->offset + it->size > m_cFrame.key().size() * 8) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::calculate_block_diffparities: block position out of range";
+            return false;
+        }
+        
+        // if this block contains only correct bits, we know its diffparity sum is 0
+        if (count_correct_bits_in_block(it->offset, it->size) == it->size) {
+
+            // used as signal that we need not exchange this parity
+            it->diffparity = false; 
+        }
+        else {
+            // used as signal that we need to exchange this parity
+            it->diffparity = true; 
+            nExchangeParities++;
+        }
+    }
+
+    // if the total parity must be even, we can exchange one parity less
+    // TODO: oliver: ask christoph/phillip why?
+    if (bTotalDiffParityMustBeEven && (nExchangeParities > 0)) {
+        nExchangeParities--;
+    }
+
+    return true;
 }
 
 
@@ -498,7 +581,7 @@ uint64_t parity_checker::count_correct_bits_in_block(uint64_t offset, uint64_t s
  */
 void parity_checker::notify_bit_change_local(uint64_t pos) {
     notify_bit_change_remote(pos);
-    m_cChangedBits.insert(perm[pos]);
+    m_cBits.flip(perm[pos]);
 }
 
 
@@ -513,49 +596,29 @@ void parity_checker::notify_bit_change_local(uint64_t pos) {
  */
 void parity_checker::notify_bit_change_remote(uint64_t pos) {   
 
-    // define a parity block element as search pattern 
-    // for our set of parity blocks defined
-    parity_block cParityBlockSearch;
-
-    cParityBlockSearch.offset = perm[pos];
-    cParityBlockSearch.size = 1;
-
-    // find first parity block whose offset is greater than cParityBlockSearch.offset
-    auto it = m_cParityBlocks.upper_bound(cParityBlockSearch); 
-
-    // if we decrement the iterator it, then it is now pointing 
-    // to the parity block that contains the bit with index cParityBlockSearch.offset
-    it--; 
+    // locate the parity block that contains the bit
+    parity_block cParityBlock = find_block(perm[pos]);
 
     // check if we have to right block at hand
-    if ((perm[pos] < it->offset) || (perm[pos] >= (it->offset + it->size))) {
+    if ((cParityBlock.size == 0) || (m_cBlockSizes[cParityBlock.offset] != cParityBlock.size)) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "unable to locate right parity block in parity checker for bit position";
         return;
     }
 
-    // copy, invert diffparity, erase original and insert updated block
-    // this has O(1) complexity as we use the return value of erase as hint for insert
-    parity_block cParityBlockNew;
-    cParityBlockNew.offset = it->offset;
-    cParityBlockNew.size = it->size;
-    cParityBlockNew.diffparity = (it->diffparity ^ 1);
-    it = m_cParityBlocks.erase(it);
-    m_cParityBlocks.insert(it, cParityBlockNew);
+    // invert diffparity
+    cParityBlock.diffparity = !cParityBlock.diffparity;
+    m_cDiffParities.set(cParityBlock.offset, cParityBlock.diffparity);
    
     // update odd_parity_blocks 
-    if (cParityBlockNew.diffparity) {
+    if (cParityBlock.diffparity) {
 
         // block has changed from even to odd parity: insert it into set to check
-        if (!m_cOddParityBlocks.insert(cParityBlockNew).second) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "unable to insert new parity block after remote change";
-        }
+        insert_odd_parity_block(cParityBlock);
     }
     else {
 
-        // block has changed from odd to even parity: remove from set to check
-        if (m_cOddParityBlocks.erase(cParityBlockNew) != 1) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "unable to erase parity block after remote change";
-        }
+        // block has changed from odd to even parity: the entry turned stale
+        m_nOddParityBlocks--;
     }
 }
 
@@ -566,6 +629,185 @@ void parity_checker::notify_bit_change_remote(uint64_t pos) {
  * @param   pos         position of the bit change
  */
 void parity_checker::notify_correct_bit(uint64_t pos) {
-    m_cCorrectBits.insert(perm[pos]);
+    m_cCorrectBits.set(perm[pos]);
+}
+
+
+/**
+ * drop stale and duplicate entries of the odd parity blocks and sort them
+ */
+void parity_checker::prune_odd_parity_blocks() {
+
+    auto iter = std::remove_if(m_cOddParityBlocks.begin(), m_cOddParityBlocks.end(), 
+            [&](parity_block const & cParityBlock) { return !is_odd_parity_block(cParityBlock); });
+    m_cOddParityBlocks.erase(iter, m_cOddParityBlocks.end());
+
+    std::sort(m_cOddParityBlocks.begin(), m_cOddParityBlocks.end(), compare_odd_parity_block());
+    iter = std::unique(m_cOddParityBlocks.begin(), m_cOddParityBlocks.end(), 
+            [](parity_block const & a, parity_block const & b) { return (a.offset == b.offset); });
+    m_cOddParityBlocks.erase(iter, m_cOddParityBlocks.end());
+
+    if (m_cOddParityBlocks.size() != m_nOddParityBlocks) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker: odd parity block bookkeeping mismatch";
+        m_nOddParityBlocks = m_cOddParityBlocks.size();
+    }
+}
+
+
+/**
+ * pick the half of each block to check next
+ *
+ * optimization: in case the parity of the 2nd half is already known 
+ * we check the 2nd half (and later do nothing), else the 1st half. 
+ *
+ * @param   cBlocks                     the odd parity blocks under bisection (all larger than 1 bit)
+ * @param   cCalcBlocks                 on return: the halves to check, one for each block
+ */
+void parity_checker::select_halves(std::vector<parity_block> const & cBlocks, std::vector<parity_block> & cCalcBlocks) const {
+
+    cCalcBlocks.clear();
+
+    // first and second half subblocks
+    parity_block cParityBlock1;
+    parity_block cParityBlock2;
+
+    for (auto iti = cBlocks.begin(); iti != cBlocks.end(); ++iti) {
+
+        // first half block
+        cParityBlock1.offset = iti->offset;         
+        cParityBlock1.size = (iti->size + 1) / 2;
+
+        // second half block
+        cParityBlock2.offset = cParityBlock1.offset + cParityBlock1.size;  
+        cParityBlock2.size = iti->size - cParityBlock1.size;
+        
+        uint64_t nCorrectBits = count_correct_bits_in_block(cParityBlock2.offset, cParityBlock2.size);
+
+        // in case the parity of the 2nd half is already known 
+        // let us work with the 2nd half (and later do nothing)
+        if (nCorrectBits == cParityBlock2.size) {
+            cCalcBlocks.push_back(cParityBlock2);
+        }
+        else {
+            // let us work on the first half
+            cCalcBlocks.push_back(cParityBlock1);
+        }
+    }
 }
 
+
+/**
+ * write back the differential parities after the exchange
+ *
+ * @param   cCalcBlocks                 the parity blocks as marked by mark_block_diffparities
+ * @param   nExchangeParities           number of parities exchanged
+ * @param   cDiffParities               the exchanged differential parities
+ */
+void parity_checker::set_block_diffparities(std::vector<parity_block> & cCalcBlocks, unsigned int nExchangeParities, uint8_t const * cDiffParities) {
+
+    bool bParitySum = false;
+    uint64_t j = 0;
+    for (auto it = cCalcBlocks.begin(); it != cCalcBlocks.end(); ++it) {
+
+        // not all bits of the block had been known --> we had to exchange the parity of this block
+        if (it->diffparity) {
+
+            // for all blocks (but the last block in case we have total even parity, i.e. 0)
+            if (j < nExchangeParities) {
+                
+                // now set really the parity difference of the block
+                it->diffparity = (bool) cDiffParities[j]; 
+
+                // running parity sum, needed only in case we have total even parity
+                bParitySum ^= (bool) cDiffParities[j];    
+
+                j++;
+            }
+            else {
+
+                // in the case the total sum of exchanged parities must be 0, 
+                // the last parity is equal to the running sum (0+0=0, 1+1=0)
+                it->diffparity = bParitySum;
+            }
+            
+            // add to list of correct bits if parity block size == 1
+            if (!it->diffparity && (it->size == 1) && !m_cCorrectBits.get(it->offset)) {
+                m_cFrame.notify_correct_bit(inv_perm[it->offset]);
+            }
+        }
+    }
+}
+
+
+/**
+ * split the blocks after the parities of the halves are known
+ *
+ * each block in cBlocks is replaced by its half of wrong parity 
+ *
+ * @param   cBlocks                     the odd parity blocks under bisection
+ * @param   cCalcBlocks                 the checked halves with their differential parity
+ */
+void parity_checker::split_blocks(std::vector<parity_block> & cBlocks, std::vector<parity_block> const & cCalcBlocks) {
+
+    // sanity check, whether we have not forgotten a block
+    // TODO: how to proceed if the condition below holds true?
+    //       the method calculate_block_diffparities does not modify
+    //       the size of the cCalcBlocks vector, so why make this
+    //       check here, after network transmission?
+    if (cCalcBlocks.size() != cBlocks.size()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "parity_checker::correct_blocks: unequal container sizes!";
+    }
+
+    // first and second half subblocks
+    parity_block cParityBlock1;
+    parity_block cParityBlock2;
+
+    auto it = cCalcBlocks.begin();
+    for (auto iti = cBlocks.begin(); iti != cBlocks.end(); ++iti) {
+
+        // first half block
+        cParityBlock1.offset = iti->offset;        
+        cParityBlock1.size = (iti->size + 1) / 2;
+
+        // second half block
+        cParityBlock2.offset = cParityBlock1.offset + cParityBlock1.size; 
+        cParityBlock2.size = iti->size - cParityBlock1.size;
+
+        // explanation of following logical expression:
+        // first term on the rhs means that we calculate parity of 2nd half,  
+        // 2nd term means that the parity of this half is different
+        // parity of 1st half = EITHER first OR second term is true --> 
+        // we calculated parity of 2nd half and the parity of 2nd half is NOT different --> 
+        // parity of 1st half differs
+        // we did NOT calculate parity of the 2nd half (i.e. 1st half) 
+        // and the parity of this IS different --> parity of 1st differs
+        cParityBlock1.diffparity = ((it->offset == cParityBlock2.offset) ^ it->diffparity); 
+        cParityBlock2.diffparity = !cParityBlock1.diffparity;
+
+        // add single correct bit to set of correct bits (if not already contained)
+        if (!cParityBlock1.diffparity && (cParityBlock1.size == 1) && !m_cCorrectBits.get(cParityBlock1.offset)) {
+
+            // single bit corrected in first half
+            m_cFrame.notify_correct_bit(inv_perm[cParityBlock1.offset]);
+        }
+        if (!cParityBlock2.diffparity && (cParityBlock2.size == 1) && !m_cCorrectBits.get(cParityBlock2.offset)) {
+
+            // single bit corrected in second half
+            m_cFrame.notify_correct_bit(inv_perm[cParityBlock2.offset]);
+        }
+
+        // split the block: the odd half replaces the current block in the odd parity blocks
+        m_cBlockSizes[cParityBlock1.offset] = cParityBlock1.size;
+        m_cBlockSizes[cParityBlock2.offset] = cParityBlock2.size;
+        m_cDiffParities.set(cParityBlock1.offset, cParityBlock1.diffparity);
+        m_cDiffParities.set(cParityBlock2.offset, cParityBlock2.diffparity);
+        m_nOddParityBlocks--;
+        insert_odd_parity_block(cParityBlock1.diffparity ? cParityBlock1 : cParityBlock2);
+
+        // continue with the block with wrong parity
+        *iti = (cParityBlock1.diffparity ? cParityBlock1 : cParityBlock2);
+
+        // move to next block to calculate
+        it++; 
+    } 
+}
@@ -39,6 +39,7 @@
 #include <qkd/module/communicator.h>
 #include <qkd/module/module.h>
 
+#include "bitmap.h"
 #include "category.h"
 #include "frame.h"
 
@@ -57,23 +58,6 @@ struct parity_block {
 };
 
 
-/**
- * A comparison class for parity blocks
- */
-class compare_parity_block {
-
-public:
-    
-    /**
-     * comparison function defining the strict weak ordering criterion. 
-     * Parity blocks are compared solely based on their offset
-     */
-    inline bool operator()(const parity_block & a, const parity_block & b) const { 
-        return (a.offset < b.offset); 
-    }
-};
-
-
 /**
  * Another comparison class for parity blocks, used for sorting odd parity blocks by size
  */
@@ -97,6 +81,12 @@ public:
  *
  * a parity checker is responsible to check the parities with its
  * peer instance in a single cascade step.
+ *
+ * all bookkeeping is done on flat arrays indexed by the permuted bit
+ * position: the frame bits themselves, the known correct bits and the 
+ * parity of each block are packed bitmaps, the size of each block is 
+ * stored at its offset. block parities are computed by popcount over 
+ * the packed (permuted) frame bits.
  */
 class parity_checker {
 
@@ -134,7 +124,22 @@ public:
      *
      * @param   cCorrBlocks                 the parity blocks to be corrected        
      */
-    void correct_blocks(std::set<parity_block, compare_odd_parity_block> const & cCorrBlocks);
+    void correct_blocks(std::vector<parity_block> const & cCorrBlocks);
+
+
+    /**
+     * correct the odd parity blocks of several parity checkers at once
+     *
+     * the binary searches in the odd parity blocks of all the given 
+     * checkers advance in lockstep: the parities of all halves on one
+     * bisection level are sent in a single message to the peer.
+     * odd parity blocks showing up meanwhile join the search, we
+     * return when no checker has an odd parity block left.
+     *
+     * @param   cCheckers                   the parity checkers
+     * @return  true if successful, false otherwise
+     */
+    static bool correct_blocks_batched(std::vector<parity_checker *> const & cCheckers);
 
 
     /**
@@ -142,9 +147,17 @@ public:
      *
      * all odd parity blocks do have at least 1 error bit
      *
-     * @return  const reference to odd_parity_blocks
+     * @return  the odd parity blocks sorted by size and offset (compare_odd_parity_block)
+     */
+    std::vector<parity_block> get_odd_parity_blocks();
+
+
+    /**
+     * check if there are odd parity blocks
+     *
+     * @return  true, if at least one parity block has odd parity
      */
-    std::set<parity_block, compare_odd_parity_block> const & get_odd_parity_blocks() const { return m_cOddParityBlocks; }
+    bool has_odd_parity_blocks() const { return (m_nOddParityBlocks > 0); }
 
 
     /**
@@ -193,6 +206,18 @@ private:
      * @return  true if successful, false otherwise
      */
     bool calculate_block_diffparities(std::vector<parity_block> & cCalcBlocks, bool bTotalDiffParityMustBeEven);
+
+
+    /**
+     * correct the single bit blocks 
+     *
+     * a single bit block of odd parity is a bit error: alice notes
+     * the bit as changed remotely, bob flips the bit. the corrected
+     * blocks are removed from cBlocks.
+     *
+     * @param   cBlocks                     the odd parity blocks under bisection
+     */
+    void correct_single_bit_blocks(std::vector<parity_block> & cBlocks);
     
    
      /**
@@ -203,6 +228,109 @@ private:
      * @return  number of surely correct bits inside the block
      */
     uint64_t count_correct_bits_in_block(uint64_t offset, uint64_t size) const;
+
+
+    /**
+     * exchange parities with the peer
+     *
+     * on return cParities holds the XOR of the local and the remote parities
+     *
+     * @param   cParities                   the local parities in, the differential parities out
+     * @return  true if successful, false otherwise
+     */
+    bool exchange_parities(std::vector<uint8_t> & cParities);
+
+
+    /**
+     * find the current parity block holding a bit
+     * 
+     * blocks evolve only by splitting into halves, so we start at the
+     * initial block of the category and descend the halves until we 
+     * hit an existing block.
+     *
+     * @param   nPos            permuted bit position
+     * @return  the parity block containing nPos
+     */
+    parity_block find_block(uint64_t nPos) const;
+
+
+    /**
+     * append the local parities of the blocks to exchange
+     *
+     * @param   cCalcBlocks                 the parity blocks as marked by mark_block_diffparities
+     * @param   nExchangeParities           number of parities to exchange
+     * @param   cParities                   the local parities are appended here
+     */
+    void get_block_parities(std::vector<parity_block> const & cCalcBlocks, unsigned int nExchangeParities, std::vector<uint8_t> & cParities);
+
+
+    /**
+     * record a parity block as odd
+     *
+     * @param   cParityBlock    the parity block which turned odd
+     */
+    void insert_odd_parity_block(parity_block const & cParityBlock);
+
+
+    /**
+     * mark the blocks we need to exchange parities for
+     *
+     * each block in cCalcBlocks which has not only surely correct bits 
+     * gets its diffparity set to true
+     *
+     * @param   cCalcBlocks                     set containing the parity blocks for which their parity shall be calculated
+     * @param   bTotalDiffParityMustBeEven      states whether the total differential parity sum of all blocks must be even 
+     * @param   nExchangeParities               on return: the number of parities to exchange
+     * @return  true if successful, false otherwise
+     */
+    bool mark_block_diffparities(std::vector<parity_block> & cCalcBlocks, bool bTotalDiffParityMustBeEven, unsigned int & nExchangeParities) const;
+
+
+    /**
+     * checks if a recorded odd parity block is still an odd parity block
+     *
+     * @param   cParityBlock    the parity block to check
+     * @return  true, if the block still exists and is odd
+     */
+    bool is_odd_parity_block(parity_block const & cParityBlock) const { 
+        return (m_cBlockSizes[cParityBlock.offset] == cParityBlock.size) && m_cDiffParities.get(cParityBlock.offset); 
+    }
+
+
+    /**
+     * drop stale and duplicate entries of the odd parity blocks and sort them
+     */
+    void prune_odd_parity_blocks();
+
+
+    /**
+     * pick the half of each block to check next
+     *
+     * @param   cBlocks                     the odd parity blocks under bisection (all larger than 1 bit)
+     * @param   cCalcBlocks                 on return: the halves to check, one for each block
+     */
+    void select_halves(std::vector<parity_block> const & cBlocks, std::vector<parity_block> & cCalcBlocks) const;
+
+
+    /**
+     * write back the differential parities after the exchange
+     *
+     * @param   cCalcBlocks                 the parity blocks as marked by mark_block_diffparities
+     * @param   nExchangeParities           number of parities exchanged
+     * @param   cDiffParities               the exchanged differential parities
+     */
+    void set_block_diffparities(std::vector<parity_block> & cCalcBlocks, unsigned int nExchangeParities, uint8_t const * cDiffParities);
+
+
+    /**
+     * split the blocks after the parities of the halves are known
+     *
+     * each block in cBlocks is replaced by its half of wrong parity 
+     *
+     * @param   cBlocks                     the odd parity blocks under bisection
+     * @param   cCalcBlocks                 the checked halves with their differential parity
+     */
+    void split_blocks(std::vector<parity_block> & cBlocks, std::vector<parity_block> const & cCalcBlocks);
  
 
 private:
@@ -239,35 +367,47 @@ private:
 
 
     /**
-     * partial parity sums for the frame passed at object initialisation 
-     * NOT updated for later frame corrections!) 
+     * the categories the frame has been divided into
+     */    
+    std::vector<category> m_cCategories;
+
+
+    /**
+     * the frame bits in permuted order (updated on frame corrections)
+     */    
+    bitmap m_cBits;
+
+
+    /**
+     * the permuted positions of all those frame bits that are known to be correct 
      */    
-    std::vector<bool> partial_parity_sums;                                
+    bitmap m_cCorrectBits;                                
 
 
     /**
-     * a set containing the positions of all those frame bits that were changed since initialisation 
+     * disjoint parity blocks covering the whole frame: the size of the 
+     * parity block starting at an offset or 0 if no block starts there
      */    
-    std::set<uint64_t> m_cChangedBits;                                
+    std::vector<unsigned int> m_cBlockSizes;
 
 
     /**
-     * a set containing the positions of all those frame bits that are known to be correct 
+     * the differential parity of the parity block starting at an offset
      */    
-    std::set<uint64_t> m_cCorrectBits;                                
+    bitmap m_cDiffParities;
 
 
     /**
-     * a set of disjoint parity blocks covering the whole frame 
+     * all odd parity blocks: this may hold stale entries of blocks which 
+     * turned even or have been split meanwhile (see is_odd_parity_block)
      */    
-    std::set<parity_block, compare_parity_block> m_cParityBlocks;           
+    std::vector<parity_block> m_cOddParityBlocks;   
 
 
     /**
-     * a set containing all odd parity blocks that are inside parity_blocks 
-     * this is a subset of m_cParityBlocks
+     * the real number of odd parity blocks
      */    
-    std::set<parity_block, compare_odd_parity_block> m_cOddParityBlocks;   
+    uint64_t m_nOddParityBlocks;
 
 };
 
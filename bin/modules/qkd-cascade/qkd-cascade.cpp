@@ -68,7 +68,7 @@ public:
     /**
      * ctor
      */
-    qkd_cascade_data() : nPasses(14) {
+    qkd_cascade_data() : bBatched(false), nPasses(14) {
         cAvgError = qkd::utility::average_technique::create("value", 10);
         cRandom = qkd::utility::random_source::create("");
     };
@@ -130,6 +130,7 @@ public:
     std::recursive_mutex cPropertyMutex;                      /**< property mutex */
 
     qkd::utility::average cAvgError;                          /**< the error rate averaged over the last samples */
+    bool bBatched;                                            /**< bisect the odd blocks of all passes in lockstep */
     uint64_t nPasses;                                         /**< number of passes */
     std::shared_ptr<qkd::utility::random_source> cRandom;     /**< random engine used */
 };
@@ -216,6 +217,21 @@ void qkd_cascade::apply_config(UNUSED std::string const & sURL, qkd::utility::pr
         std::string sKey = cEntry.first.substr(config_prefix().size());
 
         // module specific config here
+        if (sKey == "batched") {
+            if (cEntry.second == "true") {
+                set_batched(true);
+            }
+            else
+            if (cEntry.second == "false") {
+                set_batched(false);
+            }
+            else {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                        << ": at key \"" << cEntry.first 
+                        << "\" - can't parse value \"" << cEntry.second << "\".";
+            }
+        }
+        else
         if (sKey == "passes") {
             set_passes(atoll(cEntry.second.c_str()));
         }
@@ -226,6 +242,19 @@ void qkd_cascade::apply_config(UNUSED std::string const & sURL, qkd::utility::pr
 }
 
 
+/**
+ * get the batched bisection flag
+ * 
+ * @return  true, if the bisection is batched across all passes
+ */
+bool qkd_cascade::batched() const {
+    
+    // get exclusive access to properties
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    return d->bBatched;
+}
+
+
 /**
  * get the number of passes
  * 
@@ -324,6 +353,9 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
     // whole key in each pass
     std::vector<category> cCategories;
 
+    // fixed for the whole key: both peers must agree on this
+    const bool bBatched = batched();
+
     // this is the main cascade pass loop
     for (unsigned int step = 1; step <= passes(); ++step) {              
 
@@ -393,6 +425,24 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
                 return false;
             }
         }
+        else
+        if (bBatched) {
+
+            // bisect the known diff (odd) parity blocks of all 
+            // steps so far in lockstep until there is no more 
+            // odd parity block left to check
+            try {
+                std::vector<parity_checker *> cCheckers(cFrame.checkers().begin(), cFrame.checkers().begin() + step);
+                if (!parity_checker::correct_blocks_batched(cCheckers)) {
+                    return false;
+                }
+            }
+            catch (std::exception & e) {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                        << "exception caught while exchanging parities - " << e.what();
+                return false;
+            }
+        }
         else {
 
             // invoke parity checker correction on
@@ -404,7 +454,7 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
                 // pick first step with known odd parities
                 int corr_step = -1;
                 for (unsigned int i = 0; i < step; ++i) {
-                    if (cFrame.checkers()[i]->get_odd_parity_blocks().size() > 0) {
+                    if (cFrame.checkers()[i]->has_odd_parity_blocks()) {
                         corr_step = i;
                         break;
                     }
@@ -430,7 +480,8 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
 
     // fix key meta data
     cKey.meta().nDisclosedBits = cFrame.transmitted_parities();
-    cKey.meta().nErrorRate = (double)cFrame.corrected_bits().size() / ((double)cKey.size() * 8);
+    const uint64_t nCorrectedBits = cFrame.corrected_bits().count();
+    cKey.meta().nErrorRate = (double)nCorrectedBits / ((double)cKey.size() * 8);
     cKey.meta().eKeyState = qkd::key::key_state::KEY_STATE_CORRECTED;
 
     // output efficiency values
@@ -438,7 +489,7 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
         double nDisclosedRate = (double)cKey.meta().nDisclosedBits / ((double)cKey.size() * 8);
         qkd::utility::debug() 
             << "cascade done: " 
-            << "errors = " << cFrame.corrected_bits().size() << "/" << cKey.size() * 8
+            << "errors = " << nCorrectedBits << "/" << cKey.size() * 8
             << ", error rate = " << cKey.meta().nErrorRate 
             << ", disclosed = " << cKey.meta().nDisclosedBits << "/" << cKey.size() * 8 
             << ", efficiency = " << qkd::utility::shannon_efficiency(cKey.meta().nErrorRate, nDisclosedRate);
@@ -448,6 +499,19 @@ bool qkd_cascade::process(qkd::key::key & cKey, qkd::crypto::crypto_context & cI
 }
 
 
+/**
+ * set the batched bisection flag
+ * 
+ * @param   bBatched    the new batched bisection flag
+ */
+void qkd_cascade::set_batched(bool bBatched) {
+
+    // get exclusive access to properties
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->bBatched = bBatched;
+}
+
+
 /**
  * set the new number of passes
  * 
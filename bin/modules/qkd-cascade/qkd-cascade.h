@@ -55,6 +55,7 @@
  * 
  *      -name-                  -read/write-    -description-
  * 
+ *      batched                     R/W         bisect the odd blocks of all passes in lockstep
  *      passes                      R/W         number of confirmation passes
  * 
  */
@@ -64,6 +65,7 @@ class qkd_cascade : public qkd::module::module {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "at.ac.ait.qkd.cascade")
 
+    Q_PROPERTY(bool batched READ batched WRITE set_batched)              /**< get/set batched bisection */
     Q_PROPERTY(qulonglong passes READ passes WRITE set_passes)          /**< get/set number of confirmation passes */
 
        
@@ -76,6 +78,17 @@ public:
     qkd_cascade();
     
     
+    /**
+     * get the batched bisection flag
+     * 
+     * if set, the binary searches in the odd parity blocks of all
+     * passes advance in lockstep with one message per bisection level
+     * 
+     * @return  true, if the bisection is batched across all passes
+     */
+    bool batched() const;
+    
+    
     /**
      * get the number of passes
      * 
@@ -84,6 +97,16 @@ public:
     qulonglong passes() const;
     
     
+    /**
+     * set the batched bisection flag
+     * 
+     * both peers must run with the same setting
+     * 
+     * @param   bBatched    the new batched bisection flag
+     */
+    void set_batched(bool bBatched);
+    
+    
     /**
      * set the new number of passes
      * 
@@ -66,6 +66,7 @@ int main(int argc, char ** argv) {
     cOptions.add_options()("debug-message-flow", "enable message debug dump output on stderr");
     cOptions.add_options()("debug-key-sync", "enable key sync debug messages on stderr");
     cOptions.add_options()("help,h", "this page");
+    cOptions.add_options()("mode,m", boost::program_options::value<std::string>(), "how masks are passed: 'random' (sent in full) or 'seed' (expanded from a seed)");
     cOptions.add_options()("rounds,n", boost::program_options::value<uint64_t>()->default_value(10), "number of rounds to run");
     cOptions.add_options()("run,r", "run immediately");
     cOptions.add_options()("version,v", "print version string");
@@ -111,6 +112,9 @@ int main(int argc, char ** argv) {
     }
     if (cVariableMap.count("run")) cQKDConfirmation.start_later();
     cQKDConfirmation.set_rounds(cVariableMap["rounds"].as<uint64_t>());
+    if (cVariableMap.count("mode")) {
+        cQKDConfirmation.set_mode(QString::fromStdString(cVariableMap["mode"].as<std::string>()));
+    }
 
     cApp.connect(&cQKDConfirmation, SIGNAL(terminated()), SLOT(quit()));
     int nAppExit = cApp.exec();
@@ -33,9 +33,13 @@
 // incs
 
 #include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <openssl/evp.h>
 
 // ait
-#include <qkd/utility/bigint.h>
 #include <qkd/utility/syslog.h>
 
 #include "qkd-confirmation.h"
@@ -48,6 +52,19 @@
 #define MODULE_DESCRIPTION      "This is the qkd-confirmation QKD Module."
 #define MODULE_ORGANISATION     "(C)opyright 2012-2016 AIT Austrian Institute of Technology, http://www.ait.ac.at"
 
+// size of the seed in "seed" mode (an AES-128 key)
+#define SEED_SIZE               16
+
+// number of key bytes masked at once in "seed" mode
+#define SEED_CHUNK_SIZE         4096
+
+// set in the round count sent to bob if a mode byte follows
+// (plain "random" messages stay as they have always been)
+#define ROUNDS_MODE_FLAG        ((uint64_t)1 << 63)
+
+// upper bound of confirmation rounds bob accepts from alice
+#define MAX_ROUNDS              1024
+
 
 // ------------------------------------------------------------
 // decl
@@ -64,17 +81,24 @@ public:
     /**
      * ctor
      */
-    qkd_confirmation_data() : nBadKeys(0), nConfirmedKeys(0) {};
+    qkd_confirmation_data() : nBadKeys(0), nConfirmedKeys(0), eMode(confirmation_mode::CONFIRMATION_MODE_RANDOM) {};
     
     std::recursive_mutex cPropertyMutex;    /**< property mutex */
 
     std::atomic<uint64_t> nBadKeys;         /**< number of bad keys so far */
     std::atomic<uint64_t> nConfirmedKeys;   /**< number of confirmed keys so far */
+    confirmation_mode eMode;                /**< how the masks are passed */
     uint64_t nRounds;                       /**< number of confirmation rounds */
     
 };
 
 
+// fwd
+static uint64_t masked_fold(unsigned char const * nKey, unsigned char const * nMask, uint64_t nSize);
+static bool masked_parity(qkd::utility::memory const & cKey, qkd::utility::memory const & cMask);
+static std::list<bool> masked_parities(qkd::utility::memory const & cKey, qkd::utility::memory const & cSeed, uint64_t nRounds);
+
+
 // ------------------------------------------------------------
 // code
 
@@ -103,6 +127,10 @@ void qkd_confirmation::apply_config(UNUSED std::string const & sURL, qkd::utilit
         if (is_standard_config_key(cEntry.first)) continue;
         
         std::string sKey = cEntry.first.substr(config_prefix().size());
+        if (sKey == "mode") {
+            set_mode(QString::fromStdString(cEntry.second));
+        }
+        else
         if (sKey == "rounds") {
             set_rounds(atoll(cEntry.second.c_str()));
         }
@@ -137,6 +165,26 @@ qulonglong qkd_confirmation::confirmed_keys() const {
 }
 
 
+/**
+ * get how the random masks are passed to the peer
+ * 
+ * @return  "random" (masks are sent) or "seed" (masks are expanded from a seed)
+ */
+QString qkd_confirmation::mode() const {
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    switch (d->eMode) {
+        
+    case confirmation_mode::CONFIRMATION_MODE_SEED:
+        return "seed";
+        
+    case confirmation_mode::CONFIRMATION_MODE_RANDOM:
+    default:
+        return "random";
+    }
+}
+
+
 /**
  * module work
  * 
@@ -169,26 +217,55 @@ bool qkd_confirmation::process_alice(qkd::key::key & cKey, qkd::crypto::crypto_c
     
     qkd::module::message cMessage;
     uint64_t nRounds = rounds();
+    confirmation_mode eMode;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+        eMode = d->eMode;
+    }
     
-    qkd::utility::bigint cKeyBI = qkd::utility::bigint(cKey.data());
-
     cMessage.data() << cKey.id();
     cMessage.data() << cKey.size();
-    cMessage.data() << nRounds;
+    if (eMode == confirmation_mode::CONFIRMATION_MODE_RANDOM) {
+        cMessage.data() << nRounds;
+    }
+    else {
+        cMessage.data() << (uint64_t)(nRounds | ROUNDS_MODE_FLAG);
+        cMessage.data() << static_cast<unsigned char>(eMode);
+    }
 
     std::list<bool> cParities;
-    for (uint64_t i = 0; i < nRounds; i++) {
-        
-        // create a random bigint
-        qkd::utility::memory cMemory(cKey.data().size());
-        random() >> cMemory;
-        qkd::utility::bigint cBI(cMemory);
+    if (eMode == confirmation_mode::CONFIRMATION_MODE_SEED) {
         
-        cBI &= cKeyBI;
-        cParities.push_back(cBI.parity());
+        // both sides expand the masks from this seed
+        qkd::utility::memory cSeed(SEED_SIZE);
+        {
+            std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+            random() >> cSeed;
+        }
+        try {
+            cParities = masked_parities(cKey.data(), cSeed, nRounds);
+        }
+        catch (std::runtime_error const & cRuntimeError) {
+            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to expand confirmation masks: " << cRuntimeError.what();
+            return false;
+        }
+        cMessage.data() << cSeed;
+    }
+    else {
         
-        // record random memory in message
-        cMessage.data() << cMemory;
+        for (uint64_t i = 0; i < nRounds; i++) {
+            
+            // create a random mask
+            qkd::utility::memory cMemory(cKey.data().size());
+            {
+                std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+                random() >> cMemory;
+            }
+            cParities.push_back(masked_parity(cKey.data(), cMemory));
+            
+            // record random memory in message
+            cMessage.data() << cMemory;
+        }
     }
     
     // finalize parities in message to send
@@ -225,10 +302,12 @@ bool qkd_confirmation::process_alice(qkd::key::key & cKey, qkd::crypto::crypto_c
     
     // match?
     if (!bParitiesEqual) {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
         d->nBadKeys++;
         qkd::utility::syslog::info() << "confirmation for key " << cKey.id() << " failed";
     }
     else {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
         cKey.meta().eKeyState = qkd::key::key_state::KEY_STATE_CONFIRMED;
         d->nConfirmedKeys++;
         qkd::utility::debug() << "confirmation for key " << cKey.id() << " ok";
@@ -253,6 +332,7 @@ bool qkd_confirmation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto_con
     qkd::key::key_id nPeerKeyId = 0;
     uint64_t nPeerKeySize = 0;
     uint64_t nRounds = 0;
+    unsigned char nMode = confirmation_mode::CONFIRMATION_MODE_RANDOM;
     
     // recv data from alice
     try {
@@ -265,8 +345,22 @@ bool qkd_confirmation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto_con
     cMessage.data() >> nPeerKeyId;
     cMessage.data() >> nPeerKeySize;
     cMessage.data() >> nRounds;
+    if (nRounds & ROUNDS_MODE_FLAG) {
+        nRounds &= ~ROUNDS_MODE_FLAG;
+        cMessage.data() >> nMode;
+    }
     
-    set_rounds(nRounds);
+    // the round count is alice's choice for this key: bob's rounds property stays untouched
+    if (nRounds > MAX_ROUNDS) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "alice requests too many confirmation rounds: " << nRounds;
+        return false;
+    }
+    
+    // bob follows alice's mode for this key only: his own mode property stays untouched
+    if ((nMode != confirmation_mode::CONFIRMATION_MODE_RANDOM) && (nMode != confirmation_mode::CONFIRMATION_MODE_SEED)) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "alice uses unknown confirmation mode: " << (unsigned int)nMode;
+        return false;
+    }
     
     // sanity check
     if ((cKey.id() != nPeerKeyId) || (cKey.data().size() != nPeerKeySize)) {
@@ -276,15 +370,31 @@ bool qkd_confirmation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto_con
     
     // work on the received data
     std::list<bool> cParities;
-    qkd::utility::bigint cKeyBI = qkd::utility::bigint(cKey.data());
-    for (uint64_t i = 0; i < nRounds; i++) {
+    if (nMode == confirmation_mode::CONFIRMATION_MODE_SEED) {
         
-        qkd::utility::memory cMemory;
-        cMessage.data() >> cMemory;
+        qkd::utility::memory cSeed;
+        cMessage.data() >> cSeed;
+        if (cSeed.size() != SEED_SIZE) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "alice sent invalid confirmation seed size: " << cSeed.size();
+            return false;
+        }
+        
+        try {
+            cParities = masked_parities(cKey.data(), cSeed, nRounds);
+        }
+        catch (std::runtime_error const & cRuntimeError) {
+            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to expand confirmation masks: " << cRuntimeError.what();
+            return false;
+        }
+    }
+    else {
         
-        qkd::utility::bigint cBI(cMemory);
-        cBI &= cKeyBI;
-        cParities.push_back(cBI.parity());
+        for (uint64_t i = 0; i < nRounds; i++) {
+            
+            qkd::utility::memory cMemory;
+            cMessage.data() >> cMemory;
+            cParities.push_back(masked_parity(cKey.data(), cMemory));
+        }
     }
     
     // compare local and peer parities
@@ -312,10 +422,12 @@ bool qkd_confirmation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto_con
     
     // match?
     if (!bParitiesEqual) {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
         d->nBadKeys++;
         qkd::utility::syslog::info() << "confirmation for key " << cKey.id() << " failed";
     }
     else {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
         cKey.meta().eKeyState = qkd::key::key_state::KEY_STATE_CONFIRMED;
         d->nConfirmedKeys++;
         qkd::utility::debug() << "confirmation for key " << cKey.id() << " ok";
@@ -336,6 +448,34 @@ qulonglong qkd_confirmation::rounds() const {
 }
 
 
+/**
+ * set how the random masks are passed to the peer
+ * 
+ * This has only effect on alice: bob follows alice's choice.
+ * 
+ * @param   sMode       "random" or "seed"
+ */
+void qkd_confirmation::set_mode(QString sMode) {
+    
+    confirmation_mode eMode;
+    if (sMode == "random") {
+        eMode = confirmation_mode::CONFIRMATION_MODE_RANDOM;
+    }
+    else
+    if (sMode == "seed") {
+        eMode = confirmation_mode::CONFIRMATION_MODE_SEED;
+    }
+    else {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                << "refusing to set unknown confirmation mode: \"" << sMode.toStdString() << "\"";
+        return;
+    }
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->eMode = eMode;
+}
+
+
 /**
  * set the new number of confirmation rounds
  * 
@@ -346,3 +486,105 @@ void qkd_confirmation::set_rounds(qulonglong nRounds) {
     d->nRounds = nRounds;
 }
 
+
+/**
+ * XOR-folds the binary AND of key and mask into a single word
+ * 
+ * The parity of the returned word is the parity of key AND mask.
+ * 
+ * @param   nKey        the key bytes
+ * @param   nMask       the mask bytes
+ * @param   nSize       number of bytes
+ * @return  the XOR of all 64 bit words of key AND mask
+ */
+uint64_t masked_fold(unsigned char const * nKey, unsigned char const * nMask, uint64_t nSize) {
+    
+    uint64_t nFold = 0;
+    
+    uint64_t i = 0;
+    for ( ; i + sizeof(uint64_t) <= nSize; i += sizeof(uint64_t)) {
+        uint64_t nKeyWord;
+        uint64_t nMaskWord;
+        memcpy(&nKeyWord, nKey + i, sizeof(uint64_t));
+        memcpy(&nMaskWord, nMask + i, sizeof(uint64_t));
+        nFold ^= (nKeyWord & nMaskWord);
+    }
+    for ( ; i < nSize; ++i) nFold ^= (nKey[i] & nMask[i]);
+    
+    return nFold;
+}
+
+
+/**
+ * get the parity of key AND mask
+ * 
+ * A mask shorter than the key is considered padded with 0.
+ * 
+ * @param   cKey        the key
+ * @param   cMask       the mask
+ * @return  the parity of key AND mask
+ */
+bool masked_parity(qkd::utility::memory const & cKey, qkd::utility::memory const & cMask) {
+    return __builtin_parityll(masked_fold(cKey.get(), cMask.get(), std::min(cKey.size(), cMask.size())));
+}
+
+
+/**
+ * get the parities of the key AND the masks expanded from a seed
+ * 
+ * The mask of round i is the AES-128-CTR key stream with the seed as 
+ * key and i (big endian) in the upper half of the initial counter 
+ * block. The key is passed once in chunks: each chunk is masked by 
+ * all rounds before the next one is touched.
+ * 
+ * @param   cKey        the key
+ * @param   cSeed       the seed (SEED_SIZE bytes)
+ * @param   nRounds     number of masks
+ * @return  the parities of key AND mask for all rounds
+ */
+std::list<bool> masked_parities(qkd::utility::memory const & cKey, qkd::utility::memory const & cSeed, uint64_t nRounds) {
+    
+    if (cSeed.size() != SEED_SIZE) {
+        throw std::runtime_error("invalid confirmation seed size");
+    }
+    
+    // one counter mode stream per round
+    std::vector<std::shared_ptr<EVP_CIPHER_CTX>> cStreams;
+    for (uint64_t i = 0; i < nRounds; ++i) {
+        
+        std::shared_ptr<EVP_CIPHER_CTX> cStream(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+        if (!cStream) throw std::runtime_error("failed to create cipher context");
+        
+        unsigned char nCounter[16];
+        memset(nCounter, 0, sizeof(nCounter));
+        for (unsigned int j = 0; j < 8; ++j) nCounter[j] = static_cast<unsigned char>(i >> (56 - 8 * j));
+        
+        if (!EVP_EncryptInit_ex(cStream.get(), EVP_aes_128_ctr(), nullptr, cSeed.get(), nCounter)) {
+            throw std::runtime_error("failed to init AES-128-CTR");
+        }
+        cStreams.push_back(cStream);
+    }
+    
+    std::vector<uint64_t> cFolds(nRounds, 0);
+    
+    unsigned char nZero[SEED_CHUNK_SIZE];
+    unsigned char nMask[SEED_CHUNK_SIZE];
+    memset(nZero, 0, sizeof(nZero));
+    
+    for (uint64_t nOffset = 0; nOffset < cKey.size(); nOffset += SEED_CHUNK_SIZE) {
+        
+        const int nChunk = static_cast<int>(std::min<uint64_t>(SEED_CHUNK_SIZE, cKey.size() - nOffset));
+        for (uint64_t i = 0; i < nRounds; ++i) {
+            
+            int nEncrypted = 0;
+            EVP_EncryptUpdate(cStreams[i].get(), nMask, &nEncrypted, nZero, nChunk);
+            cFolds[i] ^= masked_fold(cKey.get() + nOffset, nMask, nChunk);
+        }
+    }
+    
+    std::list<bool> cParities;
+    for (auto nFold : cFolds) cParities.push_back(__builtin_parityll(nFold));
+    
+    return cParities;
+}
+
@@ -43,6 +43,16 @@
 // decl
 
 
+/**
+ * how are the random masks passed to the peer
+ */
+enum confirmation_mode : uint8_t {
+    
+    CONFIRMATION_MODE_RANDOM = 0,       /**< each random mask is sent in full */
+    CONFIRMATION_MODE_SEED = 1,         /**< a short seed is sent, both sides expand the masks with AES-CTR */
+};
+
+
 /**
  * The qkd-confirmation module ensures that the keys
  * are indeed equal on both sides
@@ -51,6 +61,11 @@
  * with a random number and publishing the parity of the result. This
  * is done ROUNDS time.
  * 
+ * In "random" mode each random mask is sent to the peer, hence the
+ * message is ROUNDS times the key size. In "seed" mode only a 128 bit
+ * seed is sent and both sides expand the masks with AES-128 in counter
+ * mode while streaming once over the key.
+ * 
  * The qkd-confirmation QKD module supports the "at.ac.ait.qkd.confirmation" Interface.
  * 
  * Properties of at.ac.ait.qkd.confirmation
@@ -61,6 +76,8 @@
  * 
  *      confirmed_keys               R          number of good keys (keys for which confirmation succeeded)
  * 
+ *      mode                        R/W         how the masks are passed: "random" or "seed"
+ * 
  *      rounds                      R/W         number of confirmation rounds
  * 
  */
@@ -72,6 +89,7 @@ class qkd_confirmation : public qkd::module::module {
 
     Q_PROPERTY(qulonglong bad_keys READ bad_keys)                       /**< absolute number of bad, unconfirmed keys so far */
     Q_PROPERTY(qulonglong confirmed_keys READ confirmed_keys)           /**< absolute number of confirmed keys so far */
+    Q_PROPERTY(QString mode READ mode WRITE set_mode)                   /**< get/set how the masks are passed */
     Q_PROPERTY(qulonglong rounds READ rounds WRITE set_rounds)          /**< get/set number of confirmation rounds */
 
 
@@ -102,6 +120,14 @@ public:
     qulonglong confirmed_keys() const;
     
     
+    /**
+     * get how the random masks are passed to the peer
+     * 
+     * @return  "random" (masks are sent) or "seed" (masks are expanded from a seed)
+     */
+    QString mode() const;
+    
+    
     /**
      * get the number of confirmation rounds
      * 
@@ -110,6 +136,16 @@ public:
     qulonglong rounds() const;
     
     
+    /**
+     * set how the random masks are passed to the peer
+     * 
+     * This has only effect on alice: bob follows alice's choice.
+     * 
+     * @param   sMode       "random" or "seed"
+     */
+    void set_mode(QString sMode);
+    
+    
     /**
      * set the new number of confirmation rounds
      * 
@@ -142,6 +178,14 @@ protected:
      */
     void apply_config(std::string const & sURL, qkd::utility::properties const & cConfig);
     
+    
+    /**
+     * keys are confirmed independently of each other: run with a worker pool
+     * 
+     * @return  always true
+     */
+    bool is_reentrant() const { return true; }
+    
 
 private:
     
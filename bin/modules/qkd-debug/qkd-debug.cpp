@@ -192,8 +192,8 @@ bool qkd_debug::process(qkd::key::key & cKey, UNUSED qkd::crypto::crypto_context
     ss << "\tbits:                \t" << nBits << "\n";
     ss << "\tdisclosed bits:      \t" << cKey.meta().nDisclosedBits << " (" << boost::format("%05.2f") % (nDisclosedBitsRate * 100.0) << "%)\n";
     ss << "\terror rate:          \t" << cKey.meta().nErrorRate << "\n";
-    ss << "\tauth-scheme-incoming:\t" << cKey.meta().sCryptoSchemeIncoming << "\n";
-    ss << "\tauth-scheme-outgoing:\t" << cKey.meta().sCryptoSchemeOutgoing << "\n";
+    ss << "\tauth-scheme-incoming:\t" << qkd::crypto::scheme(cKey.meta().sCryptoSchemeIncoming).str() << "\n";
+    ss << "\tauth-scheme-outgoing:\t" << qkd::crypto::scheme(cKey.meta().sCryptoSchemeOutgoing).str() << "\n";
     ss << "\tstate:               \t" << cKey.state_string() << "\n";
     
     // checksum
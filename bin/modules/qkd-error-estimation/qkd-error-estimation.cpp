@@ -33,9 +33,14 @@
 // ------------------------------------------------------------
 // incs
 
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <endian.h>
+
 // ait
 #include <qkd/utility/atof.h>
-#include <qkd/utility/bigint.h>
 #include <qkd/utility/syslog.h>
 
 #include "qkd-error-estimation.h"
@@ -48,6 +53,9 @@
 #define MODULE_DESCRIPTION      "This is the qkd-error-estimation QKD Module: it discloses some bits for error estimation."
 #define MODULE_ORGANISATION     "(C)opyright 2012-2016 AIT Austrian Institute of Technology, http://www.ait.ac.at"
 
+// number of random 64 bit words fetched at once from the random source
+#define RANDOM_BATCH            1024
+
 
 // ------------------------------------------------------------
 // decl
@@ -79,6 +87,17 @@ public:
 };
 
 
+// fwd
+static void copy_bits(unsigned char * nDestination, uint64_t nDestinationOffset, 
+        unsigned char const * nSource, uint64_t nSourceSize, uint64_t nSourceOffset, uint64_t nCount);
+static uint64_t count_errors(qkd::utility::memory const & cPublicLocal, qkd::utility::memory const & cPublicPeer);
+static bool decode_positions(std::vector<uint64_t> & cPositions, qkd::utility::memory const & cEncoded, uint64_t nBits);
+static qkd::utility::memory encode_positions(std::vector<uint64_t> const & cPositions);
+static qkd::utility::memory gather_bits(qkd::utility::memory const & cKey, std::vector<uint64_t> const & cPositions);
+static qkd::utility::memory remove_bits(qkd::utility::memory const & cKey, std::vector<uint64_t> const & cPositions);
+static std::vector<uint64_t> sample_positions(qkd::utility::random & cRandom, uint64_t nBits, double nDisclose);
+
+
 // ------------------------------------------------------------
 // code
 
@@ -210,25 +229,16 @@ bool qkd_error_estimation::process_alice(qkd::key::key & cKey, qkd::crypto::cryp
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "disclosing 100% of key for error estimation";
     }
     
-    // pick positions
-    qkd::utility::bigint cKeyBigint = qkd::utility::bigint(cKey.data());
-    uint64_t nBits = cKeyBigint.bits();
-    qkd::utility::bigint cMask(nBits);
-    cMask.clear();
-    
     // positions to disclose
-    std::list<uint64_t> cPositionsDisclosed;
-    for (uint64_t i = 0; i < nBits; i++) {
-        double nRandom = 0.0;
-        random() >> nRandom;
-        if (nRandom <= nDisclose) {
-            cPositionsDisclosed.push_back(i);
-            cMask.set(i, true);
-        }
+    uint64_t nBits = cKey.data().size() * 8;
+    std::vector<uint64_t> cPositionsDisclosed;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+        cPositionsDisclosed = sample_positions(random(), nBits, nDisclose);
     }
     
     // this is going public
-    qkd::utility::bigint cPublicLocal = cKeyBigint & cMask;
+    qkd::utility::memory cPublicLocal = gather_bits(cKey.data(), cPositionsDisclosed);
     
     // create message for peer
     qkd::module::message cMessage;
@@ -238,9 +248,9 @@ bool qkd_error_estimation::process_alice(qkd::key::key & cKey, qkd::crypto::cryp
     cMessage.data() << nBits;
     
     // send the disclosed positions
-    cMessage.data() << cPositionsDisclosed.size();
-    for (auto i : cPositionsDisclosed) cMessage.data() << i;
-    cMessage.data() << cPublicLocal.memory();
+    cMessage.data() << static_cast<uint64_t>(cPositionsDisclosed.size());
+    cMessage.data() << encode_positions(cPositionsDisclosed);
+    cMessage.data() << cPublicLocal;
     try {
         send(cKey.id(), cMessage, cOutgoingContext);
     }
@@ -259,13 +269,10 @@ bool qkd_error_estimation::process_alice(qkd::key::key & cKey, qkd::crypto::cryp
         return false;
     }
 
-    qkd::utility::memory cPublicPeerMemory;
-    cMessage.data() >> cPublicPeerMemory;
+    qkd::utility::memory cPublicPeer;
+    cMessage.data() >> cPublicPeer;
     
-    qkd::utility::bigint cPublicPeer(cPublicPeerMemory);
-    
-    qkd::utility::bigint cErrors = cPublicLocal ^ cPublicPeer;
-    uint64_t nErrorsDetected = cErrors.bits_set();
+    uint64_t nErrorsDetected = count_errors(cPublicLocal, cPublicPeer);
     cKey.meta().nErrorRate = (double)nErrorsDetected / (double)cPositionsDisclosed.size();
     
     // set new detected value
@@ -279,18 +286,7 @@ bool qkd_error_estimation::process_alice(qkd::key::key & cKey, qkd::crypto::cryp
     qkd::utility::debug() << "key #" << cKey.id() << ", disclosed bits = " << cPositionsDisclosed.size() << ", errors detected = " << nErrorsDetected << ", error rate = " << cKey.meta().nErrorRate;
     
     // modify key: extract discarded keybits
-    qkd::utility::bigint cNewKeyBigint(nBits - cPositionsDisclosed.size());
-    std::list<uint64_t>::iterator iter = cPositionsDisclosed.begin();
-    for (uint64_t i = 0, j = 0; i < nBits; i++) {
-        if (i == (*iter)) ++iter;
-        else {
-            cNewKeyBigint.set(j, cKeyBigint.get(i));
-            j++;
-        }
-    }
-    
-    // fix key data
-    cKey.data() = cNewKeyBigint.memory();
+    cKey.data() = remove_bits(cKey.data(), cPositionsDisclosed);
     
     return true;
 }
@@ -307,10 +303,7 @@ bool qkd_error_estimation::process_alice(qkd::key::key & cKey, qkd::crypto::cryp
 bool qkd_error_estimation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto_context & cIncomingContext, qkd::crypto::crypto_context & cOutgoingContext) {
 
     // prepare
-    qkd::utility::bigint cKeyBigint = qkd::utility::bigint(cKey.data());
-    uint64_t nBits = cKeyBigint.bits();
-    qkd::utility::bigint cMask(nBits);
-    cMask.clear();
+    uint64_t nBits = cKey.data().size() * 8;
 
     // read from peer
     qkd::module::message cMessage;
@@ -323,7 +316,7 @@ bool qkd_error_estimation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto
     }
     
     // positions to disclose
-    std::list<uint64_t> cPositionsDisclosed;
+    std::vector<uint64_t> cPositionsDisclosed;
     uint64_t nPeerBits = 0;
     uint64_t nPositionsDisclosed = 0;
     
@@ -339,25 +332,29 @@ bool qkd_error_estimation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto
     }
 
     // get the disclosed positions
+    qkd::utility::memory cPositionsEncoded;
     cMessage.data() >> nPositionsDisclosed;
-    for (uint64_t i = 0; i < nPositionsDisclosed; i++) {
-        uint64_t nPosition = 0;
-        cMessage.data() >> nPosition;
-        cPositionsDisclosed.push_back(nPosition);
-        cMask.set(nPosition, true);
+    cMessage.data() >> cPositionsEncoded;
+    if (nPositionsDisclosed > nBits) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "peer wants to disclose " << nPositionsDisclosed << " positions of key " << cKey.id() << " with " << nBits << " bits only";
+        return false;
+    }
+    cPositionsDisclosed.reserve(nPositionsDisclosed);
+    if (!decode_positions(cPositionsDisclosed, cPositionsEncoded, nBits) || (cPositionsDisclosed.size() != nPositionsDisclosed)) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "received invalid disclosed positions for key " << cKey.id();
+        return false;
     }
     
     // public peer disclosed key
-    qkd::utility::memory cPublicPeerMemory;
-    cMessage.data() >> cPublicPeerMemory;
-    qkd::utility::bigint cPublicPeer(cPublicPeerMemory);
+    qkd::utility::memory cPublicPeer;
+    cMessage.data() >> cPublicPeer;
     
     // this needs to be sent back to alice
-    qkd::utility::bigint cPublicLocal = cKeyBigint & cMask;
+    qkd::utility::memory cPublicLocal = gather_bits(cKey.data(), cPositionsDisclosed);
     
     // create message for peer
     cMessage = qkd::module::message();
-    cMessage.data() << cPublicLocal.memory();
+    cMessage.data() << cPublicLocal;
     try {
         send(cKey.id(), cMessage, cOutgoingContext);
     }
@@ -367,8 +364,7 @@ bool qkd_error_estimation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto
     }
     
     // calculate error
-    qkd::utility::bigint cErrors = cPublicLocal ^ cPublicPeer;
-    uint64_t nErrorsDetected = cErrors.bits_set();
+    uint64_t nErrorsDetected = count_errors(cPublicLocal, cPublicPeer);
     cKey.meta().nErrorRate = (double)nErrorsDetected / (double)cPositionsDisclosed.size();
 
     // set new detected value
@@ -382,18 +378,7 @@ bool qkd_error_estimation::process_bob(qkd::key::key & cKey, qkd::crypto::crypto
     qkd::utility::debug() << "key #" << cKey.id() << ", disclosed bits = " << cPositionsDisclosed.size() << ", errors detected = " << nErrorsDetected << ", error rate = " << cKey.meta().nErrorRate;
     
     // modify key: extract discarded keybits
-    qkd::utility::bigint cNewKeyBigint(nBits - cPositionsDisclosed.size());
-    std::list<uint64_t>::iterator iter = cPositionsDisclosed.begin();
-    for (uint64_t i = 0, j = 0; i < nBits; i++) {
-        if (i == (*iter)) ++iter;
-        else {
-            cNewKeyBigint.set(j, cKeyBigint.get(i));
-            j++;
-        }
-    }
-    
-    // fix key data
-    cKey.data() = cNewKeyBigint.memory();
+    cKey.data() = remove_bits(cKey.data(), cPositionsDisclosed);
     
     return true;
 }
@@ -415,3 +400,254 @@ void qkd_error_estimation::set_disclose(double nRatio) {
     d->nDisclose = nBoundedRatio;
 }
 
+
+/**
+ * copies a range of bits
+ * 
+ * Bit i of a memory area is bit (i % 8) of byte (i / 8). The 
+ * destination bits must be 0 before and the destination area 
+ * must hold at least 8 more bytes than needed.
+ * 
+ * @param   nDestination        the destination area
+ * @param   nDestinationOffset  the first bit to write
+ * @param   nSource             the source area
+ * @param   nSourceSize         size of the source area in bytes
+ * @param   nSourceOffset       the first bit to read
+ * @param   nCount              number of bits to copy
+ */
+void copy_bits(unsigned char * nDestination, uint64_t nDestinationOffset, 
+        unsigned char const * nSource, uint64_t nSourceSize, uint64_t nSourceOffset, uint64_t nCount) {
+    
+    while (nCount > 0) {
+        
+        // at most 56 bits: these fit into a 64 bit word at any bit offset
+        const uint64_t nChunk = std::min<uint64_t>(nCount, 56);
+        
+        uint64_t nWord = 0;
+        const uint64_t nSourceByte = nSourceOffset / 8;
+        memcpy(&nWord, nSource + nSourceByte, std::min<uint64_t>(sizeof(uint64_t), nSourceSize - nSourceByte));
+        nWord = (le64toh(nWord) >> (nSourceOffset % 8)) & ((uint64_t(1) << nChunk) - 1);
+        
+        uint64_t nTarget = 0;
+        const uint64_t nDestinationByte = nDestinationOffset / 8;
+        memcpy(&nTarget, nDestination + nDestinationByte, sizeof(uint64_t));
+        nTarget = htole64(le64toh(nTarget) | (nWord << (nDestinationOffset % 8)));
+        memcpy(nDestination + nDestinationByte, &nTarget, sizeof(uint64_t));
+        
+        nSourceOffset += nChunk;
+        nDestinationOffset += nChunk;
+        nCount -= nChunk;
+    }
+}
+
+
+/**
+ * counts the differing bits of the disclosed bits
+ * 
+ * @param   cPublicLocal        our disclosed bits
+ * @param   cPublicPeer         the peer's disclosed bits
+ * @return  number of bits differing
+ */
+uint64_t count_errors(qkd::utility::memory const & cPublicLocal, qkd::utility::memory const & cPublicPeer) {
+    
+    uint64_t nErrors = 0;
+    const uint64_t nSize = std::min(cPublicLocal.size(), cPublicPeer.size());
+    
+    uint64_t i = 0;
+    for ( ; i + sizeof(uint64_t) <= nSize; i += sizeof(uint64_t)) {
+        uint64_t nLocal;
+        uint64_t nPeer;
+        memcpy(&nLocal, cPublicLocal.get() + i, sizeof(uint64_t));
+        memcpy(&nPeer, cPublicPeer.get() + i, sizeof(uint64_t));
+        nErrors += __builtin_popcountll(nLocal ^ nPeer);
+    }
+    for ( ; i < nSize; ++i) nErrors += __builtin_popcount(cPublicLocal[i] ^ cPublicPeer[i]);
+    
+    return nErrors;
+}
+
+
+/**
+ * decodes the positions from a varint delta stream
+ * 
+ * @param   cPositions          the decoded positions
+ * @param   cEncoded            the encoded positions
+ * @param   nBits               number of bits in the key
+ * @return  true, if the stream is valid (all positions increasing and below nBits)
+ */
+bool decode_positions(std::vector<uint64_t> & cPositions, qkd::utility::memory const & cEncoded, uint64_t nBits) {
+    
+    cPositions.clear();
+    
+    uint64_t nPosition = 0;
+    uint64_t nDelta = 0;
+    unsigned int nShift = 0;
+    for (uint64_t i = 0; i < cEncoded.size(); ++i) {
+        
+        if (nShift >= 64) return false;
+        nDelta |= static_cast<uint64_t>(cEncoded[i] & 0x7f) << nShift;
+        if (cEncoded[i] & 0x80) {
+            nShift += 7;
+            continue;
+        }
+        
+        // first position is absolute, the following are the gaps to the previous plus 1
+        if (!cPositions.empty()) nPosition += nDelta + 1;
+        else nPosition = nDelta;
+        if ((nPosition < nDelta) || (nPosition >= nBits)) return false;
+        cPositions.push_back(nPosition);
+        
+        nDelta = 0;
+        nShift = 0;
+    }
+    
+    return (nShift == 0);
+}
+
+
+/**
+ * encodes the positions as a varint delta stream
+ * 
+ * The first position is sent as is, all others as the number of 
+ * skipped bits to the previous one. Each value is written in 7 bit 
+ * groups, least significant first, the high bit marks a following 
+ * group. For typical disclose ratios this is 1 - 2 bytes per 
+ * position.
+ * 
+ * @param   cPositions          strictly increasing positions
+ * @return  the encoded positions
+ */
+qkd::utility::memory encode_positions(std::vector<uint64_t> const & cPositions) {
+    
+    // first pass: size
+    uint64_t nSize = 0;
+    for (uint64_t i = 0; i < cPositions.size(); ++i) {
+        uint64_t nDelta = (i == 0 ? cPositions[0] : cPositions[i] - cPositions[i - 1] - 1);
+        do {
+            nSize++;
+            nDelta >>= 7;
+        } while (nDelta);
+    }
+    
+    // second pass: encode
+    qkd::utility::memory cEncoded(nSize);
+    unsigned char * nCursor = cEncoded.get();
+    for (uint64_t i = 0; i < cPositions.size(); ++i) {
+        uint64_t nDelta = (i == 0 ? cPositions[0] : cPositions[i] - cPositions[i - 1] - 1);
+        while (nDelta >= 0x80) {
+            *nCursor++ = static_cast<unsigned char>(nDelta | 0x80);
+            nDelta >>= 7;
+        }
+        *nCursor++ = static_cast<unsigned char>(nDelta);
+    }
+    
+    return cEncoded;
+}
+
+
+/**
+ * packs the key bits at the given positions
+ * 
+ * @param   cKey                the key
+ * @param   cPositions          the positions to pick
+ * @return  bit i is the key bit at cPositions[i]
+ */
+qkd::utility::memory gather_bits(qkd::utility::memory const & cKey, std::vector<uint64_t> const & cPositions) {
+    
+    qkd::utility::memory cBits((cPositions.size() + 7) / 8);
+    cBits.fill(0);
+    
+    for (uint64_t i = 0; i < cPositions.size(); ++i) {
+        const uint64_t nPosition = cPositions[i];
+        if ((cKey[nPosition / 8] >> (nPosition % 8)) & 1) cBits[i / 8] |= (1 << (i % 8));
+    }
+    
+    return cBits;
+}
+
+
+/**
+ * removes the bits at the given positions from the key
+ * 
+ * @param   cKey                the key
+ * @param   cPositions          the strictly increasing positions to remove
+ * @return  the remaining bits
+ */
+qkd::utility::memory remove_bits(qkd::utility::memory const & cKey, std::vector<uint64_t> const & cPositions) {
+    
+    const uint64_t nBits = cKey.size() * 8;
+    const uint64_t nRemaining = nBits - cPositions.size();
+    
+    qkd::utility::memory cResult((nRemaining + 7) / 8 + sizeof(uint64_t));
+    cResult.fill(0);
+    
+    // copy the runs between the removed positions
+    uint64_t nSource = 0;
+    uint64_t nDestination = 0;
+    for (uint64_t i = 0; i <= cPositions.size(); ++i) {
+        
+        const uint64_t nEnd = (i < cPositions.size() ? cPositions[i] : nBits);
+        copy_bits(cResult.get(), nDestination, cKey.get(), cKey.size(), nSource, nEnd - nSource);
+        nDestination += nEnd - nSource;
+        nSource = nEnd + 1;
+    }
+    
+    cResult.resize((nRemaining + 7) / 8);
+    return cResult;
+}
+
+
+/**
+ * picks the positions to disclose
+ * 
+ * Each of the nBits positions is picked independently with 
+ * probability nDisclose. Instead of drawing a random number for 
+ * each bit the gaps between picked positions are drawn: these 
+ * are geometrically distributed. The random numbers are fetched 
+ * from the random source in batches.
+ * 
+ * @param   cRandom             the random source
+ * @param   nBits               number of bits to pick from
+ * @param   nDisclose           the probability of a position to be picked
+ * @return  the picked positions in increasing order
+ */
+std::vector<uint64_t> sample_positions(qkd::utility::random & cRandom, uint64_t nBits, double nDisclose) {
+    
+    std::vector<uint64_t> cPositions;
+    if (nDisclose <= 0.0) return cPositions;
+    
+    if (nDisclose >= 1.0) {
+        cPositions.resize(nBits);
+        for (uint64_t i = 0; i < nBits; ++i) cPositions[i] = i;
+        return cPositions;
+    }
+    cPositions.reserve(nBits * nDisclose * 1.1 + 16);
+    
+    const double nLogSkip = std::log1p(-nDisclose);
+    
+    qkd::utility::memory cBatch(RANDOM_BATCH * sizeof(uint64_t));
+    uint64_t nBatchIndex = RANDOM_BATCH;
+    
+    uint64_t nPosition = 0;
+    while (true) {
+        
+        if (nBatchIndex == RANDOM_BATCH) {
+            cRandom >> cBatch;
+            nBatchIndex = 0;
+        }
+        uint64_t nRandom;
+        memcpy(&nRandom, cBatch.get() + nBatchIndex * sizeof(uint64_t), sizeof(uint64_t));
+        nBatchIndex++;
+        
+        // uniform in (0.0, 1.0] --> number of positions skipped
+        const double nUniform = ((nRandom >> 11) + 1) * (1.0 / 9007199254740992.0);
+        const double nSkip = std::floor(std::log(nUniform) / nLogSkip);
+        if (nSkip >= static_cast<double>(nBits - nPosition)) break;
+        
+        nPosition += static_cast<uint64_t>(nSkip);
+        cPositions.push_back(nPosition);
+        nPosition++;
+    }
+    
+    return cPositions;
+}
@@ -61,6 +61,11 @@
  *      new key length = 850
  *      number of error bits set in new key = 34 (==> 4% of 850)
  * 
+ * The disclosed positions are drawn by geometric skip sampling (one
+ * random number per disclosed bit, not per key bit) and are sent to
+ * bob as a varint encoded stream of gaps. The disclosed bits are sent 
+ * packed and compared word by word.
+ * 
  * 
  * The qkd-error-estimation QKD module supports the "at.ac.ait.qkd.errorestimation" Interface.
  * 
@@ -138,6 +143,14 @@ protected:
      */
     void apply_config(std::string const & sURL, qkd::utility::properties const & cConfig);
     
+    
+    /**
+     * the error rate of each key is estimated on its own: run with a worker pool
+     * 
+     * @return  always true
+     */
+    bool is_reentrant() const { return true; }
+    
 
 private:
     
@@ -0,0 +1,407 @@
+/*
+ * gf2x.cpp
+ *
+ * implementation file for polynomial arithmetic over GF(2)
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * polynomials over GF(2) are held as packed arrays of 64 bit words,
+ * bit i of word j being the coefficient of x^(64 * j + i). Addition
+ * is a plain XOR.
+ *
+ * Multiplication is done by Karatsuba recursion down to a schoolbook
+ * base case of 64 x 64 bit carry-less multiplications. The base case
+ * uses the PCLMULQDQ instruction if the CPU supports it; otherwise a
+ * portable 4-bit windowed multiplication is used.
+ *
+ * Unbalanced products are split into balanced chunks of the shorter
+ * operand's length.
+ */
+
+
+// ------------------------------------------------------------
+// defs
+
+#define GF2X_KARATSUBA_THRESHOLD    16      /**< below this number of words we do schoolbook multiplication */
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define GF2X_HAVE_PCLMUL
+#endif
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <endian.h>
+
+#ifdef GF2X_HAVE_PCLMUL
+#   include <cpuid.h>
+#   include <wmmintrin.h>
+#endif
+
+#include "gf2x.h"
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * a schoolbook multiplication of two polynomials of nWords each
+ */
+typedef void (* gf2x_basecase)(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords);
+
+
+// fwd
+static inline uint64_t bit_reverse(uint64_t x);
+static inline void clmul(uint64_t nA, uint64_t nB, uint64_t & nLow, uint64_t & nHigh);
+static void mul_basecase(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords);
+static gf2x_basecase mul_basecase_select();
+static void mul_karatsuba(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords, uint64_t * nScratch);
+static uint64_t mul_karatsuba_scratch(uint64_t nWords);
+
+#ifdef GF2X_HAVE_PCLMUL
+static void mul_basecase_pclmul(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords);
+#endif
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * reverses the bits of a word
+ *
+ * @param   x       input
+ * @return  x with bit i moved to bit 63 - i
+ */
+inline uint64_t bit_reverse(uint64_t x) {
+
+    x = ((x >> 1)  & UINT64_C(0x5555555555555555)) | ((x & UINT64_C(0x5555555555555555)) << 1);
+    x = ((x >> 2)  & UINT64_C(0x3333333333333333)) | ((x & UINT64_C(0x3333333333333333)) << 2);
+    x = ((x >> 4)  & UINT64_C(0x0f0f0f0f0f0f0f0f)) | ((x & UINT64_C(0x0f0f0f0f0f0f0f0f)) << 4);
+    x = ((x >> 8)  & UINT64_C(0x00ff00ff00ff00ff)) | ((x & UINT64_C(0x00ff00ff00ff00ff)) << 8);
+    x = ((x >> 16) & UINT64_C(0x0000ffff0000ffff)) | ((x & UINT64_C(0x0000ffff0000ffff)) << 16);
+
+    return (x >> 32) | (x << 32);
+}
+
+
+/**
+ * portable carry-less multiplication of two words
+ *
+ * @param   nA          first factor
+ * @param   nB          second factor
+ * @param   nLow        lower 64 bits of the product
+ * @param   nHigh       upper 64 bits of the product
+ */
+inline void clmul(uint64_t nA, uint64_t nB, uint64_t & nLow, uint64_t & nHigh) {
+
+    // multiples of nB with all 4 bit polynomials (top bits are lost here)
+    uint64_t nTable[16];
+    nTable[0] = 0;
+    nTable[1] = nB;
+    for (unsigned int i = 2; i < 16; i += 2) {
+        nTable[i] = nTable[i >> 1] << 1;
+        nTable[i + 1] = nTable[i] ^ nB;
+    }
+
+    uint64_t l = nTable[nA & 0x0f];
+    uint64_t h = 0;
+    for (unsigned int i = 4; i < 64; i += 4) {
+        uint64_t g = nTable[(nA >> i) & 0x0f];
+        l ^= g << i;
+        h ^= g >> (64 - i);
+    }
+
+    // repair the bits of nB shifted out of the table entries
+    h ^= (nA & (UINT64_C(0) - ((nB >> 63) & 1)) & UINT64_C(0xeeeeeeeeeeeeeeee)) >> 1;
+    h ^= (nA & (UINT64_C(0) - ((nB >> 62) & 1)) & UINT64_C(0xcccccccccccccccc)) >> 2;
+    h ^= (nA & (UINT64_C(0) - ((nB >> 61) & 1)) & UINT64_C(0x8888888888888888)) >> 3;
+
+    nLow = l;
+    nHigh = h;
+}
+
+
+/**
+ * checks if the carry-less multiply instruction (PCLMULQDQ) is used
+ *
+ * @return  true, if the hardware carry-less multiply is used
+ */
+bool gf2x_hardware_clmul() {
+#ifdef GF2X_HAVE_PCLMUL
+    return (mul_basecase_select() == mul_basecase_pclmul);
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * multiplies two polynomials over GF(2)
+ *
+ * @param   nResult         the product a * b
+ * @param   nA              first factor a
+ * @param   nWordsA         number of words of a
+ * @param   nB              second factor b
+ * @param   nWordsB         number of words of b
+ */
+void gf2x_mul(uint64_t * nResult, uint64_t const * nA, uint64_t nWordsA, uint64_t const * nB, uint64_t nWordsB) {
+
+    // b is the shorter operand
+    if (nWordsA < nWordsB) {
+        std::swap(nA, nB);
+        std::swap(nWordsA, nWordsB);
+    }
+
+    const uint64_t nWordsResult = nWordsA + nWordsB;
+    memset(nResult, 0, nWordsResult * sizeof(uint64_t));
+    if (nWordsB == 0) return;
+
+    std::vector<uint64_t> cScratch(mul_karatsuba_scratch(nWordsB));
+    std::vector<uint64_t> cProduct(2 * nWordsB);
+    std::vector<uint64_t> cChunk;
+
+    // multiply chunks of a of the size of b and add them up
+    for (uint64_t nOffset = 0; nOffset < nWordsA; nOffset += nWordsB) {
+
+        uint64_t const * nChunk = nA + nOffset;
+        if (nWordsA - nOffset < nWordsB) {
+            cChunk.assign(nWordsB, 0);
+            std::copy(nA + nOffset, nA + nWordsA, cChunk.begin());
+            nChunk = cChunk.data();
+        }
+
+        mul_karatsuba(cProduct.data(), nChunk, nB, nWordsB, cScratch.data());
+
+        const uint64_t nAdd = std::min<uint64_t>(2 * nWordsB, nWordsResult - nOffset);
+        for (uint64_t i = 0; i < nAdd; ++i) nResult[nOffset + i] ^= cProduct[i];
+    }
+}
+
+
+/**
+ * computes the Toeplitz hash of an input key directly over GF(2)
+ *
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   cInput          the input key
+ * @return  the hashed key (of the size of cShift)
+ */
+qkd::utility::memory gf2x_toeplitz(qkd::utility::memory const & cSeed,
+        qkd::utility::memory const & cShift,
+        qkd::utility::memory const & cInput) {
+
+    /*
+     * with u = |seed|shift| and k = |input| output bit t of the hash is
+     *
+     *      h_t = \sum_{m=0}^{k-1} k_m u_{t+m}
+     *
+     * if we reverse the input to r(x) = \sum_m k_m x^(K-1-m), where K is
+     * the input size padded to full words, then h_t is the coefficient of
+     * x^(t + K - 1) in the product u(x) * r(x).
+     */
+
+    qkd::utility::memory cResult(cShift.size());
+    cResult.fill(0);
+
+    const uint64_t nInputWords = (cInput.size() + 7) / 8;
+    const uint64_t nToeplitzWords = (cSeed.size() + cShift.size() + 7) / 8;
+    if (nInputWords == 0 || cShift.size() == 0) return cResult;
+
+    std::vector<uint64_t> cToeplitz(nToeplitzWords, 0);
+    memcpy(cToeplitz.data(), cSeed.get(), cSeed.size());
+    memcpy(reinterpret_cast<unsigned char *>(cToeplitz.data()) + cSeed.size(), cShift.get(), cShift.size());
+    for (auto & nWord : cToeplitz) nWord = le64toh(nWord);
+
+    std::vector<uint64_t> cReversed(nInputWords, 0);
+    memcpy(cReversed.data(), cInput.get(), cInput.size());
+    std::reverse(cReversed.begin(), cReversed.end());
+    for (auto & nWord : cReversed) nWord = bit_reverse(le64toh(nWord));
+
+    std::vector<uint64_t> cProduct(nToeplitzWords + nInputWords);
+    gf2x_mul(cProduct.data(), cToeplitz.data(), nToeplitzWords, cReversed.data(), nInputWords);
+
+    // pick the bits starting at x^(K - 1)
+    const uint64_t nResultWords = (cShift.size() + 7) / 8;
+    for (uint64_t i = 0; i < nResultWords; ++i) {
+
+        const uint64_t nWord = htole64((cProduct[nInputWords - 1 + i] >> 63) | (cProduct[nInputWords + i] << 1));
+        const uint64_t nBytes = std::min<uint64_t>(8, cShift.size() - i * 8);
+        memcpy(cResult.get() + i * 8, &nWord, nBytes);
+    }
+
+    return cResult;
+}
+
+
+/**
+ * portable schoolbook multiplication
+ *
+ * @param   nResult         the product (2 * nWords)
+ * @param   nA              first factor
+ * @param   nB              second factor
+ * @param   nWords          number of words of both factors
+ */
+void mul_basecase(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords) {
+
+    memset(nResult, 0, 2 * nWords * sizeof(uint64_t));
+    for (uint64_t i = 0; i < nWords; ++i) {
+        for (uint64_t j = 0; j < nWords; ++j) {
+            uint64_t nLow;
+            uint64_t nHigh;
+            clmul(nA[i], nB[j], nLow, nHigh);
+            nResult[i + j] ^= nLow;
+            nResult[i + j + 1] ^= nHigh;
+        }
+    }
+}
+
+
+#ifdef GF2X_HAVE_PCLMUL
+
+/**
+ * schoolbook multiplication with PCLMULQDQ
+ *
+ * @param   nResult         the product (2 * nWords)
+ * @param   nA              first factor
+ * @param   nB              second factor
+ * @param   nWords          number of words of both factors
+ */
+__attribute__((target("pclmul,sse2")))
+void mul_basecase_pclmul(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords) {
+
+    // sum up the products along each diagonal i + j = k in a register
+    __m128i cCarry = _mm_setzero_si128();
+    for (uint64_t k = 0; k < 2 * nWords - 1; ++k) {
+
+        __m128i cSum = cCarry;
+        const uint64_t nFirst = (k < nWords ? 0 : k - nWords + 1);
+        const uint64_t nLast = (k < nWords ? k : nWords - 1);
+        for (uint64_t i = nFirst; i <= nLast; ++i) {
+            const __m128i cA = _mm_set_epi64x(0, static_cast<long long>(nA[i]));
+            const __m128i cB = _mm_set_epi64x(0, static_cast<long long>(nB[k - i]));
+            cSum = _mm_xor_si128(cSum, _mm_clmulepi64_si128(cA, cB, 0x00));
+        }
+
+        uint64_t nSum[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(nSum), cSum);
+        nResult[k] = nSum[0];
+        cCarry = _mm_set_epi64x(0, static_cast<long long>(nSum[1]));
+    }
+
+    uint64_t nSum[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(nSum), cCarry);
+    nResult[2 * nWords - 1] = nSum[0];
+}
+
+#endif
+
+
+/**
+ * pick the schoolbook multiplication suitable for this CPU
+ *
+ * @return  the base case multiplication function
+ */
+gf2x_basecase mul_basecase_select() {
+
+    static gf2x_basecase const fBasecase = []() -> gf2x_basecase {
+#ifdef GF2X_HAVE_PCLMUL
+        unsigned int nEAX = 0;
+        unsigned int nEBX = 0;
+        unsigned int nECX = 0;
+        unsigned int nEDX = 0;
+        if (__get_cpuid(1, &nEAX, &nEBX, &nECX, &nEDX) && (nECX & bit_PCLMUL)) return mul_basecase_pclmul;
+#endif
+        return mul_basecase;
+    }();
+
+    return fBasecase;
+}
+
+
+/**
+ * Karatsuba multiplication of two polynomials of equal size
+ *
+ * @param   nResult         the product (2 * nWords)
+ * @param   nA              first factor
+ * @param   nB              second factor
+ * @param   nWords          number of words of both factors
+ * @param   nScratch        scratch space of mul_karatsuba_scratch(nWords) words
+ */
+void mul_karatsuba(uint64_t * nResult, uint64_t const * nA, uint64_t const * nB, uint64_t nWords, uint64_t * nScratch) {
+
+    if (nWords < GF2X_KARATSUBA_THRESHOLD) {
+        mul_basecase_select()(nResult, nA, nB, nWords);
+        return;
+    }
+
+    // a = a0 + a1 * x^(64 * nLow), same for b
+    const uint64_t nLow = (nWords + 1) / 2;
+    const uint64_t nHigh = nWords - nLow;
+
+    // z0 = a0 * b0 and z2 = a1 * b1 go straight into the result
+    mul_karatsuba(nResult, nA, nB, nLow, nScratch);
+    mul_karatsuba(nResult + 2 * nLow, nA + nLow, nB + nLow, nHigh, nScratch);
+
+    // z1 = (a0 + a1) * (b0 + b1) - z0 - z2
+    uint64_t * nSumA = nScratch;
+    uint64_t * nSumB = nScratch + nLow;
+    uint64_t * nMiddle = nScratch + 2 * nLow;
+    for (uint64_t i = 0; i < nLow; ++i) {
+        nSumA[i] = nA[i] ^ (i < nHigh ? nA[nLow + i] : 0);
+        nSumB[i] = nB[i] ^ (i < nHigh ? nB[nLow + i] : 0);
+    }
+    mul_karatsuba(nMiddle, nSumA, nSumB, nLow, nScratch + 4 * nLow);
+
+    for (uint64_t i = 0; i < 2 * nLow; ++i) nMiddle[i] ^= nResult[i];
+    for (uint64_t i = 0; i < 2 * nHigh; ++i) nMiddle[i] ^= nResult[2 * nLow + i];
+    for (uint64_t i = 0; i < 2 * nLow; ++i) nResult[nLow + i] ^= nMiddle[i];
+}
+
+
+/**
+ * number of words of scratch space needed for a Karatsuba multiplication
+ *
+ * @param   nWords          number of words of both factors
+ * @return  size of scratch space in words
+ */
+uint64_t mul_karatsuba_scratch(uint64_t nWords) {
+
+    uint64_t nScratch = 0;
+    while (nWords >= GF2X_KARATSUBA_THRESHOLD) {
+        nWords = (nWords + 1) / 2;
+        nScratch += 4 * nWords;
+    }
+
+    return nScratch;
+}
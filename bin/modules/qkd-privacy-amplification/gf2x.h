@@ -0,0 +1,105 @@
+/*
+ * gf2x.h
+ *
+ * polynomial arithmetic over GF(2) on packed 64 bit words
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_UTILITY_GF2X_H
+#define __QKD_UTILITY_GF2X_H
+
+
+// ------------------------------------------------------------
+// incs
+
+
+#ifndef __STDC_CONSTANT_MACROS
+#define __STDC_CONSTANT_MACROS
+#endif
+
+#include <inttypes.h>
+
+// ait
+#include <qkd/utility/memory.h>
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * checks if the carry-less multiply instruction (PCLMULQDQ) is used
+ *
+ * This is determined once at runtime. If the CPU does not support
+ * PCLMULQDQ a portable (but slower) implementation is used.
+ *
+ * @return  true, if the hardware carry-less multiply is used
+ */
+bool gf2x_hardware_clmul();
+
+
+/**
+ * multiplies two polynomials over GF(2)
+ *
+ * Bit i of word j of the arrays is the coefficient of x^(64 * j + i).
+ *
+ * The result array must hold nWordsA + nWordsB words and must not
+ * overlap with the input arrays.
+ *
+ * @param   nResult         the product a * b
+ * @param   nA              first factor a
+ * @param   nWordsA         number of words of a
+ * @param   nB              second factor b
+ * @param   nWordsB         number of words of b
+ */
+void gf2x_mul(uint64_t * nResult, uint64_t const * nA, uint64_t nWordsA, uint64_t const * nB, uint64_t nWordsB);
+
+
+/**
+ * computes the Toeplitz hash of an input key directly over GF(2)
+ *
+ * The Toeplitz matrix is defined by the concatenation |seed|shift|,
+ * row t of the matrix holds bits t ... t + |input| - 1 of this string.
+ *
+ * This yields bit-identical results to the NTT based cross-correlation
+ * of |00...00|shift|seed| and |00...00|input| taken modulo 2, but
+ * works on packed 64 bit words instead of one 32 bit field element
+ * per bit.
+ *
+ * |seed| + |shift| must be at least |input| + |shift| - 1.
+ *
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   cInput          the input key
+ * @return  the hashed key (of the size of cShift)
+ */
+qkd::utility::memory gf2x_toeplitz(qkd::utility::memory const & cSeed,
+        qkd::utility::memory const & cShift,
+        qkd::utility::memory const & cInput);
+
+
+#endif
+
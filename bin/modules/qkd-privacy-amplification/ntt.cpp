@@ -57,6 +57,10 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 
 // ------------------------------------------------------------
 // defs
@@ -72,12 +76,26 @@
 // #define MODULUS P13_20
 #define MODULUS P15_27
 
+// number of twiddle factors precomputed at once for a butterfly stage
+#define NTT_TILE                1024
+
+// below this length we don't bother to spawn threads
+#define NTT_PARALLEL_MIN_LOG2   14
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define NTT_HAVE_AVX2
+#endif
+
 
 // ------------------------------------------------------------
 // incs
 
 #include "ntt.h"
 
+#ifdef NTT_HAVE_AVX2
+#   include <immintrin.h>
+#endif
+
 
 // ------------------------------------------------------------
 // decl
@@ -190,14 +208,58 @@
 #endif
                 
 
+/**
+ * precomputed twiddle factors of a butterfly stage for NTT_TILE consecutive j
+ * 
+ * each factor w comes with its Shoup companion floor(w * 2^32 / p) 
+ * which allows for a multiplication modulo p without division.
+ */
+typedef struct {
+    
+    mod nRoot[NTT_TILE];                /**< w^j */
+    mod nRootShoup[NTT_TILE];           /**< Shoup companion of w^j */
+    mod nRoot2[NTT_TILE];               /**< w^(2j) */
+    mod nRoot2Shoup[NTT_TILE];          /**< Shoup companion of w^(2j) */
+    mod nRoot3[NTT_TILE];               /**< w^(3j) */
+    mod nRoot3Shoup[NTT_TILE];          /**< Shoup companion of w^(3j) */
+    
+} ntt_twiddles;
+
+
+/**
+ * a butterfly kernel: runs j = j0 ... j0 + nCount - 1 on blocks r0 ... r1 - 1 of a stage
+ */
+typedef void (* ntt_kernel)(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1);
+
+
 // fwd
 static inline mod mod_add(mod nModA, mod nModB);
 static inline mod mod_mul(mod nModA, mod nModB);
+static inline mod mod_mul_shoup(mod nModA, mod nModW, mod nModWShoup);
+static inline mod mod_pow(mod nModA, uint32_t nExponent);
+static inline mod mod_shoup(mod nModW);
 static inline mod mod_sub(mod nModA, mod nModB);
 static inline void mod_sum_diff(mod & nModA, mod & nModB);
-static inline void multiply_val(mod * nModVector, uint32_t nLengthOfVector, mod nMultiplier);
-static void ntt_dif4_core(mod * nArray, uint32_t nLog2Length);
-static void ntt_dit4_core_inv(mod * nArray, uint32_t nLog2Length);
+static void multiply_val(mod * nModVector, uint32_t nLengthOfVector, mod nMultiplier, unsigned int nThreads);
+static void ntt_dif4_core(mod * nArray, uint32_t nLog2Length, unsigned int nThreads);
+static void ntt_dif4_kernel(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1);
+static void ntt_dit4_core_inv(mod * nArray, uint32_t nLog2Length, unsigned int nThreads);
+static void ntt_dit4_kernel_inv(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1);
+static void ntt_stage(mod * nArray, uint32_t nLength, uint32_t nLog2ActLength, mod nDRoot, mod nImag, 
+        ntt_kernel fKernel, unsigned int nThreads);
+static void ntt_twiddles_init(ntt_twiddles & cTwiddles, mod nDRoot, uint32_t j0, uint32_t nCount);
+template <typename F> static void parallel_for(uint64_t nBegin, uint64_t nEnd, unsigned int nThreads, F const & fWork);
+
+#ifdef NTT_HAVE_AVX2
+static bool ntt_avx2();
+static void ntt_dif4_kernel_avx2(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1);
+static void ntt_dit4_kernel_inv_avx2(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1);
+#endif
 
     
 // ------------------------------------------------------------
@@ -271,6 +333,32 @@ void mod_from_bigint(mod * nModArray, qkd::utility::bigint const & cBI, bool bRe
 }
 
 
+/**
+ * copies a memory blob into an array consisting of mod variables for NTT.
+ * 
+ * this is the same as mod_from_bigint for qkd::utility::bigint(cMemory)
+ * but without converting the memory into a bigint first.
+ *
+ * @param   nModArray       the output array
+ * @param   cMemory         the input memory
+ * @param   bReverseOrder   whether order should be reversed during the copy
+ */
+void mod_from_memory(mod * nModArray, qkd::utility::memory const & cMemory, bool bReverseOrder) {
+
+    const uint64_t nBits = cMemory.size() * 8;
+    unsigned char const * nData = cMemory.get();
+    
+    if (!bReverseOrder) {
+        for (uint64_t i = 0, j = nBits - 1; i < nBits; i++, j--) {
+            nModArray[i] = (nData[j >> 3] >> (j & 0x07)) & 0x01;
+        }
+    } 
+    else {
+        for (uint64_t i = 0; i < nBits; i++) nModArray[i] = (nData[i >> 3] >> (i & 0x07)) & 0x01;
+    } 
+}
+
+
 /** 
  * Performs cyclic convolution with an ntt algorithm.
  * 
@@ -280,27 +368,38 @@ void mod_from_bigint(mod * nModArray, qkd::utility::bigint const & cBI, bool bRe
  * @param   nArray1         first input array and result array
  * @param   nArray2         second input array
  * @param   nLog2Length     base-2 log of array lengths (of both nArray1 and nArray2)
+ * @param   nThreads        number of threads to use
  */
-void ntt_convolution(mod * nArray1, mod * nArray2, const uint32_t nLog2Length) {
+void ntt_convolution(mod * nArray1, mod * nArray2, const uint32_t nLog2Length, unsigned int nThreads) {
     
     assert((int32_t)nLog2Length < g_nLdOrderPlus1);
-
-    // ntt of first array
-    ntt_dif4_core(nArray1, nLog2Length);
     
-    // ntt of second array
-    ntt_dif4_core(nArray2, nLog2Length);  
+    if (nLog2Length < NTT_PARALLEL_MIN_LOG2) nThreads = 1;
+    if (nThreads == 0) nThreads = 1;
+
+    // ntt of both arrays: these are independent
+    if (nThreads > 1) {
+        std::thread cSecond(ntt_dif4_core, nArray2, nLog2Length, nThreads / 2);
+        ntt_dif4_core(nArray1, nLog2Length, nThreads - nThreads / 2);
+        cSecond.join();
+    }
+    else {
+        ntt_dif4_core(nArray1, nLog2Length, 1);
+        ntt_dif4_core(nArray2, nLog2Length, 1);  
+    }
 
     const uint32_t nLength = (1UL << nLog2Length);
     
     // multiply transforms
-    for (uint32_t i = 0; i < nLength; ++i) nArray1[i] = mod_mul(nArray1[i], nArray2[i]);
+    parallel_for(0, nLength, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+        for (uint64_t i = nBegin; i < nEnd; ++i) nArray1[i] = mod_mul(nArray1[i], nArray2[i]);
+    });
 
     // inverse ntt of product
-    ntt_dit4_core_inv(nArray1, nLog2Length); 
+    ntt_dit4_core_inv(nArray1, nLog2Length, nThreads); 
 
     // normalize with 1 / (length of array)    
-    multiply_val(nArray1, nLength, g_nInverseOfPower2[nLog2Length]);
+    multiply_val(nArray1, nLength, g_nInverseOfPower2[nLog2Length], nThreads);
 }
 
 
@@ -337,6 +436,56 @@ inline mod mod_mul(mod nModA, mod nModB) {
 }
 
 
+/**
+ * multiplication in finite field with a precomputed factor (Shoup)
+ * 
+ * this yields the same as mod_mul(nModA, nModW) but does not divide.
+ *
+ * @param   nModA       first operand (may be up to 2^32 - 1)
+ * @param   nModW       second operand
+ * @param   nModWShoup  mod_shoup(nModW)
+ * @return  (nModA * nModW) modulo nModulus
+ */
+inline mod mod_mul_shoup(mod nModA, mod nModW, mod nModWShoup) {
+    
+    const mod nQ = static_cast<mod>((static_cast<longmod>(nModA) * nModWShoup) >> 32);
+    const mod nR = nModA * nModW - nQ * g_nModulus;
+    
+    return (nR >= g_nModulus ? nR - g_nModulus : nR);
+}
+
+
+/**
+ * exponentiation in finite field
+ *
+ * @param   nModA       base
+ * @param   nExponent   exponent
+ * @return  (nModA ^ nExponent) modulo nModulus
+ */
+inline mod mod_pow(mod nModA, uint32_t nExponent) {
+    
+    mod nResult = 1;
+    while (nExponent) {
+        if (nExponent & 1) nResult = mod_mul(nResult, nModA);
+        nModA = mod_mul(nModA, nModA);
+        nExponent >>= 1;
+    }
+    
+    return nResult;
+}
+
+
+/**
+ * the Shoup companion of a field element
+ *
+ * @param   nModW       field element
+ * @return  floor(nModW * 2^32 / nModulus)
+ */
+inline mod mod_shoup(mod nModW) {
+    return static_cast<mod>((static_cast<longmod>(nModW) << 32) / g_nModulus);
+}
+
+
 /**
  * subtraction in finite field
  *
@@ -373,12 +522,17 @@ inline void mod_sum_diff(mod & nModA, mod & nModB) {
  * @param   nModVector          input vector
  * @param   nLengthOfVector     length of vector
  * @param   nMultiplier         multiplier
+ * @param   nThreads            number of threads to use
  * @return  (nModVector*nMultiplier) modulo nModulus
  */
-inline void multiply_val(mod * nModVector, uint32_t nLengthOfVector, mod nMultiplier) {
-    for (uint32_t i = 0; i < nLengthOfVector; i++) {
-        nModVector[i] = mod_mul(nModVector[i], nMultiplier);
-    }
+void multiply_val(mod * nModVector, uint32_t nLengthOfVector, mod nMultiplier, unsigned int nThreads) {
+    
+    const mod nMultiplierShoup = mod_shoup(nMultiplier);
+    parallel_for(0, nLengthOfVector, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+        for (uint64_t i = nBegin; i < nEnd; i++) {
+            nModVector[i] = mod_mul_shoup(nModVector[i], nMultiplier, nMultiplierShoup);
+        }
+    });
 }
 
 
@@ -393,65 +547,80 @@ inline void multiply_val(mod * nModVector, uint32_t nLengthOfVector, mod nMultip
  *
  * @param   nArray          array of input/output values (length has to be power of 2 !!)
  * @param   nLog2Length     base-2 log of array length
+ * @param   nThreads        number of threads to use
  */
-void ntt_dif4_core(mod * nArray, uint32_t nLog2Length) {
+void ntt_dif4_core(mod * nArray, uint32_t nLog2Length, unsigned int nThreads) {
     
     const mod nLength = (1UL << nLog2Length);
 
     // 2^(2^19)=1 (mod 2^20 13 +1) --> nLdOrderPlus1=19+1=20.
     const mod nImag = g_nPower2RootsOfUnity[2]; 
-
-    uint32_t nLog2ActLength;
     
+    ntt_kernel fKernel = ntt_dif4_kernel;
+#ifdef NTT_HAVE_AVX2
+    if (ntt_avx2()) fKernel = ntt_dif4_kernel_avx2;
+#endif
+
     // log n loops
-    for (nLog2ActLength = nLog2Length; nLog2ActLength >= nLX; nLog2ActLength -= nLX) {
+    for (uint32_t nLog2ActLength = nLog2Length; nLog2ActLength >= nLX; nLog2ActLength -= nLX) {
+        ntt_stage(nArray, nLength, nLog2ActLength, g_nPower2RootsOfUnity[nLog2ActLength], nImag, fKernel, nThreads);
+    }
+
+    if (nLog2Length & 1) {
         
-        const mod nActLength = (1UL << nLog2ActLength);
-        const mod nActLength4 = (nActLength >> nLX);
-
-        const mod nDRoot = g_nPower2RootsOfUnity[nLog2ActLength];
-        mod nRoot = 1;
-        mod nRoot2 = 1;
-        mod nRoot3 = 1;
-        uint32_t j;
+        // n is not a power of 4, need a radix-2 step
+        parallel_for(0, nLength / 2, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+            for (uint64_t i = nBegin * 2; i < nEnd * 2; i += 2) mod_sum_diff(nArray[i], nArray[i + 1]);
+        });
+    }
+}
+
+
+/**
+ * Butterflies of a DIF radix-4 stage.
+ *
+ * @param   nArray          array of input/output values
+ * @param   nActLength      length of the current sub-transforms
+ * @param   j0              first j to work on
+ * @param   nCount          number of j to work on
+ * @param   cTwiddles       twiddle factors for j0 ... j0 + nCount - 1
+ * @param   nImag           the 4th root of unity
+ * @param   r0              first block of the stage to work on
+ * @param   r1              one past the last block of the stage to work on
+ */
+void ntt_dif4_kernel(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1) {
+    
+    const uint32_t nActLength4 = (nActLength >> nLX);
+    const mod nImagShoup = mod_shoup(nImag);
+    
+    for (uint32_t r = r0; r < r1; ++r) {
         
-        for (j=0; j < nActLength4; j++) {
+        for (uint32_t j = 0; j < nCount; ++j) {
             
-            for (uint32_t r = 0, i0 = j + r; r < nLength; r += nActLength, i0 += nActLength) {
-                
-                const uint32_t i1 = i0 + nActLength4;
-                const uint32_t i2 = i1 + nActLength4;
-                const uint32_t i3 = i2 + nActLength4;
+            const uint32_t i0 = r * nActLength + j0 + j;
+            const uint32_t i1 = i0 + nActLength4;
+            const uint32_t i2 = i1 + nActLength4;
+            const uint32_t i3 = i2 + nActLength4;
 
-                mod nA0 = nArray[i0];
-                mod nA1 = nArray[i1];
-                mod nA2 = nArray[i2];
-                mod nA3 = nArray[i3];
+            mod nA0 = nArray[i0];
+            mod nA1 = nArray[i1];
+            mod nA2 = nArray[i2];
+            mod nA3 = nArray[i3];
 
-                mod nT02 = mod_add(nA0, nA2);
-                mod nT13 = mod_add(nA1, nA3);
+            mod nT02 = mod_add(nA0, nA2);
+            mod nT13 = mod_add(nA1, nA3);
 
-                nArray[i0] = mod_add(nT02, nT13);
-                nArray[i1] = mod_mul(mod_sub(nT02, nT13), nRoot2);
+            nArray[i0] = mod_add(nT02, nT13);
+            nArray[i1] = mod_mul_shoup(mod_sub(nT02, nT13), cTwiddles.nRoot2[j], cTwiddles.nRoot2Shoup[j]);
 
-                nT02 = mod_sub(nA0, nA2);
-                nT13 = mod_mul(mod_sub(nA1, nA3), nImag);
-
-                nArray[i2] = mod_mul(mod_add(nT02, nT13), nRoot);
-                nArray[i3] = mod_mul(mod_sub(nT02, nT13), nRoot3);
-            }
+            nT02 = mod_sub(nA0, nA2);
+            nT13 = mod_mul_shoup(mod_sub(nA1, nA3), nImag, nImagShoup);
 
-            nRoot = mod_mul(nRoot, nDRoot);
-            nRoot2 = mod_mul(nRoot, nRoot);
-            nRoot3 = mod_mul(nRoot, nRoot2);
+            nArray[i2] = mod_mul_shoup(mod_add(nT02, nT13), cTwiddles.nRoot[j], cTwiddles.nRootShoup[j]);
+            nArray[i3] = mod_mul_shoup(mod_sub(nT02, nT13), cTwiddles.nRoot3[j], cTwiddles.nRoot3Shoup[j]);
         }
     }
-
-    if (nLog2Length & 1) {
-        
-        // n is not a power of 4, need a radix-2 step
-        for (uint32_t i = 0; i < nLength; i += 2) mod_sum_diff(nArray[i], nArray[i + 1]);
-    }
 }
 
 
@@ -462,60 +631,394 @@ void ntt_dif4_core(mod * nArray, uint32_t nLog2Length) {
  *
  * @param   nArray          array of input/output values (length has to be power of 2 !!)
  * @param   nLog2Length     base-2 log of array length
+ * @param   nThreads        number of threads to use
  */
-void ntt_dit4_core_inv(mod * nArray, uint32_t nLog2Length) {
+void ntt_dit4_core_inv(mod * nArray, uint32_t nLog2Length, unsigned int nThreads) {
     
     const uint32_t nLength = (1UL << nLog2Length);
 
     if (nLog2Length & 1) {
+        
         // n is not a power of 4, need a radix-2 step
-        for (uint32_t i = 0; i < nLength; i += 2) mod_sum_diff(nArray[i], nArray[i+1]);
+        parallel_for(0, nLength / 2, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+            for (uint64_t i = nBegin * 2; i < nEnd * 2; i += 2) mod_sum_diff(nArray[i], nArray[i + 1]);
+        });
     }
 
     const mod nImag = g_nPower2RootsOfUnity[g_nLdOrderPlus1 + 2];
+    
+    ntt_kernel fKernel = ntt_dit4_kernel_inv;
+#ifdef NTT_HAVE_AVX2
+    if (ntt_avx2()) fKernel = ntt_dit4_kernel_inv_avx2;
+#endif
 
     uint32_t nLog2ActLength = nLX + (nLog2Length & 1);
     for ( ; nLog2ActLength <= nLog2Length ; nLog2ActLength += nLX) {
-        
-        const uint32_t nActLength = (1UL << nLog2ActLength);
-        const uint32_t nActLength4 = (nActLength >> nLX);
+        ntt_stage(nArray, nLength, nLog2ActLength, g_nPower2RootsOfUnity[g_nLdOrderPlus1 + nLog2ActLength], nImag, fKernel, nThreads);
+    }
+}
 
-        const mod nDRoot = g_nPower2RootsOfUnity[g_nLdOrderPlus1 + nLog2ActLength];
-        mod nRoot = 1;
-        mod nRoot2 = 1;
-        mod nRoot3 = 1;
+
+/**
+ * Butterflies of an inverse DIT radix-4 stage.
+ *
+ * @param   nArray          array of input/output values
+ * @param   nActLength      length of the current sub-transforms
+ * @param   j0              first j to work on
+ * @param   nCount          number of j to work on
+ * @param   cTwiddles       twiddle factors for j0 ... j0 + nCount - 1
+ * @param   nImag           the inverse 4th root of unity
+ * @param   r0              first block of the stage to work on
+ * @param   r1              one past the last block of the stage to work on
+ */
+void ntt_dit4_kernel_inv(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1) {
+    
+    const uint32_t nActLength4 = (nActLength >> nLX);
+    const mod nImagShoup = mod_shoup(nImag);
+    
+    for (uint32_t r = r0; r < r1; ++r) {
         
-        for (uint32_t j = 0; j < nActLength4; j++) {
+        for (uint32_t j = 0; j < nCount; ++j) {
             
-            for (uint32_t r = 0, i0 = j + r; r < nLength; r += nActLength, i0 += nActLength) {
-                
-                const uint32_t i1 = i0 + nActLength4;
-                const uint32_t i2 = i1 + nActLength4;
-                const uint32_t i3 = i2 + nActLength4;
+            const uint32_t i0 = r * nActLength + j0 + j;
+            const uint32_t i1 = i0 + nActLength4;
+            const uint32_t i2 = i1 + nActLength4;
+            const uint32_t i3 = i2 + nActLength4;
+
+            mod nA0 = nArray[i0];
+            mod nA2 = mod_mul_shoup(nArray[i1], cTwiddles.nRoot2[j], cTwiddles.nRoot2Shoup[j]);
+            mod nA1 = mod_mul_shoup(nArray[i2], cTwiddles.nRoot[j], cTwiddles.nRootShoup[j]);
+            mod nA3 = mod_mul_shoup(nArray[i3], cTwiddles.nRoot3[j], cTwiddles.nRoot3Shoup[j]);
+
+            mod nT02 = mod_add(nA0, nA2);
+            mod nT13 = mod_add(nA1, nA3);
+
+            nArray[i0] = mod_add(nT02, nT13);
+            nArray[i2] = mod_sub(nT02, nT13);
+
+            nT02 = mod_sub(nA0, nA2);
+            nT13 = mod_mul_shoup(mod_sub(nA1, nA3), nImag, nImagShoup);
 
-                mod nA0 = nArray[i0];
-                mod nA2 = mod_mul(nArray[i1], nRoot2);
-                mod nA1 = mod_mul(nArray[i2], nRoot);
-                mod nA3 = mod_mul(nArray[i3], nRoot3);
+            nArray[i1] = mod_add(nT02, nT13);
+            nArray[i3] = mod_sub(nT02, nT13);
+        }
+    }
+}
+
+
+/**
+ * Runs a single radix-4 butterfly stage.
+ * 
+ * The stage consists of nLength / nActLength blocks, each with 
+ * nActLength / 4 butterflies j sharing the twiddle factors w^j, 
+ * w^(2j) and w^(3j). The j are cut into tiles of NTT_TILE for which 
+ * the twiddle factors are precomputed. Threads either work on 
+ * different tiles (first stages: few large blocks) or on different 
+ * blocks (last stages: many small blocks).
+ *
+ * @param   nArray          array of input/output values
+ * @param   nLength         length of the array
+ * @param   nLog2ActLength  base-2 log of the current sub-transform length
+ * @param   nDRoot          nActLength-th root of unity
+ * @param   nImag           the (inverse) 4th root of unity
+ * @param   fKernel         the butterfly kernel
+ * @param   nThreads        number of threads to use
+ */
+void ntt_stage(mod * nArray, uint32_t nLength, uint32_t nLog2ActLength, mod nDRoot, mod nImag, 
+        ntt_kernel fKernel, unsigned int nThreads) {
+    
+    const uint32_t nActLength = (1UL << nLog2ActLength);
+    const uint32_t nActLength4 = (nActLength >> nLX);
+    const uint32_t nBlocks = nLength / nActLength;
+    const uint32_t nTiles = (nActLength4 + NTT_TILE - 1) / NTT_TILE;
+    
+    auto fTile = [&](uint32_t nTile, uint32_t r0, uint32_t r1) {
+        
+        const uint32_t j0 = nTile * NTT_TILE;
+        const uint32_t nCount = std::min<uint32_t>(NTT_TILE, nActLength4 - j0);
+        
+        ntt_twiddles cTwiddles;
+        ntt_twiddles_init(cTwiddles, nDRoot, j0, nCount);
+        fKernel(nArray, nActLength, j0, nCount, cTwiddles, nImag, r0, r1);
+    };
+    
+    if ((nTiles >= nThreads) || (nBlocks == 1)) {
+        parallel_for(0, nTiles, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+            for (uint64_t nTile = nBegin; nTile < nEnd; ++nTile) fTile(nTile, 0, nBlocks);
+        });
+    }
+    else {
+        parallel_for(0, nBlocks, nThreads, [&](uint64_t nBegin, uint64_t nEnd) {
+            for (uint32_t nTile = 0; nTile < nTiles; ++nTile) fTile(nTile, nBegin, nEnd);
+        });
+    }
+}
+
+
+/**
+ * computes the twiddle factors for a tile of butterflies
+ *
+ * @param   cTwiddles       the twiddle factors to set
+ * @param   nDRoot          the root of unity of the stage
+ * @param   j0              first j of the tile
+ * @param   nCount          number of j of the tile
+ */
+void ntt_twiddles_init(ntt_twiddles & cTwiddles, mod nDRoot, uint32_t j0, uint32_t nCount) {
+    
+    mod nRoot = mod_pow(nDRoot, j0);
+    for (uint32_t j = 0; j < nCount; ++j) {
+        
+        const mod nRoot2 = mod_mul(nRoot, nRoot);
+        const mod nRoot3 = mod_mul(nRoot, nRoot2);
+        
+        cTwiddles.nRoot[j] = nRoot;
+        cTwiddles.nRootShoup[j] = mod_shoup(nRoot);
+        cTwiddles.nRoot2[j] = nRoot2;
+        cTwiddles.nRoot2Shoup[j] = mod_shoup(nRoot2);
+        cTwiddles.nRoot3[j] = nRoot3;
+        cTwiddles.nRoot3Shoup[j] = mod_shoup(nRoot3);
+        
+        nRoot = mod_mul(nRoot, nDRoot);
+    }
+}
+
+
+/**
+ * runs fWork(nChunkBegin, nChunkEnd) on nThreads chunks of [nBegin, nEnd)
+ *
+ * @param   nBegin          start of the range
+ * @param   nEnd            end of the range
+ * @param   nThreads        number of threads to use
+ * @param   fWork           the work to do on a chunk
+ */
+template <typename F> void parallel_for(uint64_t nBegin, uint64_t nEnd, unsigned int nThreads, F const & fWork) {
+    
+    const uint64_t nCount = nEnd - nBegin;
+    if ((nThreads <= 1) || (nCount < 2)) {
+        fWork(nBegin, nEnd);
+        return;
+    }
+    nThreads = std::min<uint64_t>(nThreads, nCount);
+    
+    std::vector<std::thread> cThreads;
+    for (unsigned int t = 1; t < nThreads; ++t) {
+        cThreads.push_back(std::thread(fWork, nBegin + nCount * t / nThreads, nBegin + nCount * (t + 1) / nThreads));
+    }
+    fWork(nBegin, nBegin + nCount / nThreads);
+    
+    for (auto & cThread : cThreads) cThread.join();
+}
 
-                mod nT02 = mod_add(nA0, nA2);
-                mod nT13 = mod_add(nA1, nA3);
 
-                nArray[i0] = mod_add(nT02, nT13);
-                nArray[i2] = mod_sub(nT02, nT13);
+#ifdef NTT_HAVE_AVX2
 
-                nT02 = mod_sub(nA0, nA2);
-                nT13 = mod_sub(nA1, nA3);
-                nT13 = mod_mul(nT13, nImag);
 
-                nArray[i1] = mod_add(nT02, nT13);
-                nArray[i3] = mod_sub(nT02, nT13);
+/**
+ * checks if we can run the AVX2 butterflies
+ * 
+ * @return  true, if the CPU supports AVX2
+ */
+bool ntt_avx2() {
+    static bool const bAVX2 = __builtin_cpu_supports("avx2");
+    return bAVX2;
+}
+
+
+/**
+ * addition of 8 field elements
+ */
+__attribute__((target("avx2")))
+static inline __m256i mod_add_avx2(__m256i nModA, __m256i nModB, __m256i nModulus) {
+    const __m256i nModC = _mm256_add_epi32(nModA, nModB);
+    return _mm256_min_epu32(nModC, _mm256_sub_epi32(nModC, nModulus));
+}
+
+
+/**
+ * subtraction of 8 field elements
+ */
+__attribute__((target("avx2")))
+static inline __m256i mod_sub_avx2(__m256i nModA, __m256i nModB, __m256i nModulus) {
+    const __m256i nModC = _mm256_sub_epi32(nModA, nModB);
+    return _mm256_min_epu32(nModC, _mm256_add_epi32(nModC, nModulus));
+}
+
+
+/**
+ * multiplication of 8 field elements with precomputed factors (Shoup)
+ */
+__attribute__((target("avx2")))
+static inline __m256i mod_mul_shoup_avx2(__m256i nModA, __m256i nModW, __m256i nModWShoup, __m256i nModulus) {
+    
+    // q = (a * w') >> 32, even and odd lanes separately
+    const __m256i nQEven = _mm256_srli_epi64(_mm256_mul_epu32(nModA, nModWShoup), 32);
+    const __m256i nQOdd = _mm256_mul_epu32(_mm256_srli_epi64(nModA, 32), _mm256_srli_epi64(nModWShoup, 32));
+    const __m256i nQ = _mm256_blend_epi32(nQEven, nQOdd, 0xAA);
+    
+    const __m256i nR = _mm256_sub_epi32(_mm256_mullo_epi32(nModA, nModW), _mm256_mullo_epi32(nQ, nModulus));
+    return _mm256_min_epu32(nR, _mm256_sub_epi32(nR, nModulus));
+}
+
+
+/**
+ * Butterflies of a DIF radix-4 stage with AVX2, 8 j at a time.
+ *
+ * This yields the very same values as ntt_dif4_kernel.
+ *
+ * @param   nArray          array of input/output values
+ * @param   nActLength      length of the current sub-transforms
+ * @param   j0              first j to work on
+ * @param   nCount          number of j to work on
+ * @param   cTwiddles       twiddle factors for j0 ... j0 + nCount - 1
+ * @param   nImag           the 4th root of unity
+ * @param   r0              first block of the stage to work on
+ * @param   r1              one past the last block of the stage to work on
+ */
+__attribute__((target("avx2")))
+void ntt_dif4_kernel_avx2(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1) {
+    
+    const uint32_t nActLength4 = (nActLength >> nLX);
+    const uint32_t nVectorCount = nCount & ~7u;
+    
+    const __m256i nModulus = _mm256_set1_epi32(static_cast<int>(g_nModulus));
+    const __m256i nImagV = _mm256_set1_epi32(static_cast<int>(nImag));
+    const __m256i nImagShoupV = _mm256_set1_epi32(static_cast<int>(mod_shoup(nImag)));
+    
+    for (uint32_t r = r0; r < r1; ++r) {
+        
+        for (uint32_t j = 0; j < nVectorCount; j += 8) {
+            
+            __m256i * i0 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j);
+            __m256i * i1 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + nActLength4);
+            __m256i * i2 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + 2 * nActLength4);
+            __m256i * i3 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + 3 * nActLength4);
+            
+            const __m256i nA0 = _mm256_loadu_si256(i0);
+            const __m256i nA1 = _mm256_loadu_si256(i1);
+            const __m256i nA2 = _mm256_loadu_si256(i2);
+            const __m256i nA3 = _mm256_loadu_si256(i3);
+            
+            __m256i nT02 = mod_add_avx2(nA0, nA2, nModulus);
+            __m256i nT13 = mod_add_avx2(nA1, nA3, nModulus);
+            
+            _mm256_storeu_si256(i0, mod_add_avx2(nT02, nT13, nModulus));
+            _mm256_storeu_si256(i1, mod_mul_shoup_avx2(mod_sub_avx2(nT02, nT13, nModulus), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot2 + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot2Shoup + j)), nModulus));
+            
+            nT02 = mod_sub_avx2(nA0, nA2, nModulus);
+            nT13 = mod_mul_shoup_avx2(mod_sub_avx2(nA1, nA3, nModulus), nImagV, nImagShoupV, nModulus);
+            
+            _mm256_storeu_si256(i2, mod_mul_shoup_avx2(mod_add_avx2(nT02, nT13, nModulus), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRootShoup + j)), nModulus));
+            _mm256_storeu_si256(i3, mod_mul_shoup_avx2(mod_sub_avx2(nT02, nT13, nModulus), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot3 + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot3Shoup + j)), nModulus));
+        }
+    }
+    
+    // the remaining butterflies
+    if (nVectorCount < nCount) {
+        
+        ntt_twiddles const * cRemaining = &cTwiddles;
+        ntt_twiddles cShifted;
+        if (nVectorCount) {
+            for (uint32_t j = nVectorCount; j < nCount; ++j) {
+                cShifted.nRoot[j - nVectorCount] = cTwiddles.nRoot[j];
+                cShifted.nRootShoup[j - nVectorCount] = cTwiddles.nRootShoup[j];
+                cShifted.nRoot2[j - nVectorCount] = cTwiddles.nRoot2[j];
+                cShifted.nRoot2Shoup[j - nVectorCount] = cTwiddles.nRoot2Shoup[j];
+                cShifted.nRoot3[j - nVectorCount] = cTwiddles.nRoot3[j];
+                cShifted.nRoot3Shoup[j - nVectorCount] = cTwiddles.nRoot3Shoup[j];
             }
+            cRemaining = &cShifted;
+        }
+        ntt_dif4_kernel(nArray, nActLength, j0 + nVectorCount, nCount - nVectorCount, *cRemaining, nImag, r0, r1);
+    }
+}
 
-            nRoot = mod_mul(nDRoot, nRoot);
-            nRoot2 = mod_mul(nRoot, nRoot);
-            nRoot3 = mod_mul(nRoot2, nRoot);
+
+/**
+ * Butterflies of an inverse DIT radix-4 stage with AVX2, 8 j at a time.
+ *
+ * This yields the very same values as ntt_dit4_kernel_inv.
+ *
+ * @param   nArray          array of input/output values
+ * @param   nActLength      length of the current sub-transforms
+ * @param   j0              first j to work on
+ * @param   nCount          number of j to work on
+ * @param   cTwiddles       twiddle factors for j0 ... j0 + nCount - 1
+ * @param   nImag           the inverse 4th root of unity
+ * @param   r0              first block of the stage to work on
+ * @param   r1              one past the last block of the stage to work on
+ */
+__attribute__((target("avx2")))
+void ntt_dit4_kernel_inv_avx2(mod * nArray, uint32_t nActLength, uint32_t j0, uint32_t nCount, 
+        ntt_twiddles const & cTwiddles, mod nImag, uint32_t r0, uint32_t r1) {
+    
+    const uint32_t nActLength4 = (nActLength >> nLX);
+    const uint32_t nVectorCount = nCount & ~7u;
+    
+    const __m256i nModulus = _mm256_set1_epi32(static_cast<int>(g_nModulus));
+    const __m256i nImagV = _mm256_set1_epi32(static_cast<int>(nImag));
+    const __m256i nImagShoupV = _mm256_set1_epi32(static_cast<int>(mod_shoup(nImag)));
+    
+    for (uint32_t r = r0; r < r1; ++r) {
+        
+        for (uint32_t j = 0; j < nVectorCount; j += 8) {
+            
+            __m256i * i0 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j);
+            __m256i * i1 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + nActLength4);
+            __m256i * i2 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + 2 * nActLength4);
+            __m256i * i3 = reinterpret_cast<__m256i *>(nArray + r * nActLength + j0 + j + 3 * nActLength4);
+            
+            const __m256i nA0 = _mm256_loadu_si256(i0);
+            const __m256i nA2 = mod_mul_shoup_avx2(_mm256_loadu_si256(i1), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot2 + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot2Shoup + j)), nModulus);
+            const __m256i nA1 = mod_mul_shoup_avx2(_mm256_loadu_si256(i2), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRootShoup + j)), nModulus);
+            const __m256i nA3 = mod_mul_shoup_avx2(_mm256_loadu_si256(i3), 
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot3 + j)),
+                    _mm256_loadu_si256(reinterpret_cast<__m256i const *>(cTwiddles.nRoot3Shoup + j)), nModulus);
+            
+            __m256i nT02 = mod_add_avx2(nA0, nA2, nModulus);
+            __m256i nT13 = mod_add_avx2(nA1, nA3, nModulus);
+            
+            _mm256_storeu_si256(i0, mod_add_avx2(nT02, nT13, nModulus));
+            _mm256_storeu_si256(i2, mod_sub_avx2(nT02, nT13, nModulus));
+            
+            nT02 = mod_sub_avx2(nA0, nA2, nModulus);
+            nT13 = mod_mul_shoup_avx2(mod_sub_avx2(nA1, nA3, nModulus), nImagV, nImagShoupV, nModulus);
+            
+            _mm256_storeu_si256(i1, mod_add_avx2(nT02, nT13, nModulus));
+            _mm256_storeu_si256(i3, mod_sub_avx2(nT02, nT13, nModulus));
         }
     }
+    
+    // the remaining butterflies
+    if (nVectorCount < nCount) {
+        
+        ntt_twiddles const * cRemaining = &cTwiddles;
+        ntt_twiddles cShifted;
+        if (nVectorCount) {
+            for (uint32_t j = nVectorCount; j < nCount; ++j) {
+                cShifted.nRoot[j - nVectorCount] = cTwiddles.nRoot[j];
+                cShifted.nRootShoup[j - nVectorCount] = cTwiddles.nRootShoup[j];
+                cShifted.nRoot2[j - nVectorCount] = cTwiddles.nRoot2[j];
+                cShifted.nRoot2Shoup[j - nVectorCount] = cTwiddles.nRoot2Shoup[j];
+                cShifted.nRoot3[j - nVectorCount] = cTwiddles.nRoot3[j];
+                cShifted.nRoot3Shoup[j - nVectorCount] = cTwiddles.nRoot3Shoup[j];
+            }
+            cRemaining = &cShifted;
+        }
+        ntt_dit4_kernel_inv(nArray, nActLength, j0 + nVectorCount, nCount - nVectorCount, *cRemaining, nImag, r0, r1);
+    }
 }
 
+
+#endif
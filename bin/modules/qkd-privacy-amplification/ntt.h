@@ -89,6 +89,19 @@ uint32_t ld_floor(uint32_t x);
 void mod_from_bigint(mod * nModArray, qkd::utility::bigint const & cBI, bool bReverseOrder);
 
 
+/**
+ * copies a memory blob into an array consisting of mod variables for NTT.
+ * 
+ * this is the same as mod_from_bigint for qkd::utility::bigint(cMemory)
+ * but without converting the memory into a bigint first.
+ *
+ * @param   nModArray       the output array
+ * @param   cMemory         the input memory
+ * @param   bReverseOrder   whether order should be reversed during the copy
+ */
+void mod_from_memory(mod * nModArray, qkd::utility::memory const & cMemory, bool bReverseOrder);
+
+
 /** 
  * Performs cyclic convolution with an ntt algorithm.
  * 
@@ -98,8 +111,9 @@ void mod_from_bigint(mod * nModArray, qkd::utility::bigint const & cBI, bool bRe
  * @param   nArray1         first input array and result array
  * @param   nArray2         second input array
  * @param   nLog2Length     base-2 log of array lengths (of both nArray1 and nArray2)
+ * @param   nThreads        number of threads to use (the result does not depend on this)
  */
-void ntt_convolution(mod * nArray1, mod * nArray2, const uint32_t nLog2Length);
+void ntt_convolution(mod * nArray1, mod * nArray2, const uint32_t nLog2Length, unsigned int nThreads = 1);
 
 
 #endif
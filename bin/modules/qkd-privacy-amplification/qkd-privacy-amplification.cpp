@@ -32,10 +32,16 @@
 // ------------------------------------------------------------
 // incs
 
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
 // ait
 #include <qkd/utility/atof.h>
 #include <qkd/utility/syslog.h>
 
+#include "gf2x.h"
 #include "ntt.h"
 #include "qkd-privacy-amplification.h"
 #include "qkd_privacy_amplification_dbus.h"
@@ -65,21 +71,56 @@ public:
      */
     qkd_privacy_amplification_data() : 
         eCalculationProcedure(calculation_procedure::CALCULATE_SECURITY_BITS), 
+        eHashEngine(hash_engine::HASH_ENGINE_NTT),
+        nBlockSize(0),
         nReductionRate(1.0),
-        nSecurityBits(0) {};
+        nSecurityBits(0),
+        nThreads(1) {};
     
     std::recursive_mutex cPropertyMutex;            /**< property mutex */
     
     calculation_procedure eCalculationProcedure;    /**< current calculation procedure */
+    hash_engine eHashEngine;                        /**< engine used for the Toeplitz hash */
+    uint64_t nBlockSize;                            /**< size of Toeplitz blocks in bits (0 = no blocks) */
     double nReductionRate;                          /**< reduction rate of the key */
     uint64_t nSecurityBits;                         /**< security bits introduced into PA */
+    uint64_t nThreads;                              /**< number of threads to work on blocks or the NTT */
     
 };
 
 
 // fwd
-bool perform(qkd::key::key & cKey, qkd::key::key const & cInput, qkd::utility::bigint const & cSeed, qkd::utility::bigint const & cShift);
+bool perform(qkd::key::key & cKey, 
+        qkd::key::key const & cInput, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift,
+        hash_engine eHashEngine,
+        uint64_t nBlockSize,
+        uint64_t nThreads);
 double tau(double nErrorRate);
+qkd::utility::memory toeplitz(hash_engine eHashEngine, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        std::vector<mod> & cNTTToeplitz,
+        std::vector<mod> & cNTTInput,
+        uint64_t nThreads);
+qkd::utility::memory toeplitz_blocked(hash_engine eHashEngine, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        uint64_t nBlockBytes,
+        uint64_t nThreads);
+qkd::utility::memory toeplitz_ntt(qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        std::vector<mod> & cNTTToeplitz,
+        std::vector<mod> & cNTTInput,
+        uint64_t nThreads);
+void toeplitz_window(qkd::utility::memory & cWindow, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        uint64_t nOffset);
 
 
 // ------------------------------------------------------------
@@ -119,6 +160,14 @@ void qkd_privacy_amplification::apply_config(UNUSED std::string const & sURL, qk
         
         std::string sKey = cEntry.first.substr(config_prefix().size());
         
+        if (sKey == "block_size") {
+            set_block_size(std::stoull(cEntry.second.c_str()));
+        }
+        else
+        if (sKey == "engine") {
+            set_engine(QString::fromStdString(cEntry.second));
+        }
+        else
         if (sKey == "reduction_rate") {
             set_reduction_rate(qkd::utility::atof(cEntry.second));
         }
@@ -126,6 +175,10 @@ void qkd_privacy_amplification::apply_config(UNUSED std::string const & sURL, qk
         if (sKey == "security_bits") {
             set_security_bits(std::stoull(cEntry.second.c_str()));
         }
+        else
+        if (sKey == "threads") {
+            set_threads(std::stoull(cEntry.second.c_str()));
+        }
         else {
             qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
                     << "found unknown key: \"" << cEntry.first << "\" - don't know how to handle this.";
@@ -134,6 +187,17 @@ void qkd_privacy_amplification::apply_config(UNUSED std::string const & sURL, qk
 }
 
 
+/**
+ * get the size of the Toeplitz blocks
+ * 
+ * @return  the size of the Toeplitz blocks in bits (0 = no blocks)
+ */
+qulonglong qkd_privacy_amplification::block_size() const {
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    return d->nBlockSize;
+}
+
+
 /**
  * get the current calculation procedure
  * 
@@ -148,6 +212,30 @@ qulonglong qkd_privacy_amplification::calculation() const {
 }
 
 
+/**
+ * get the engine used to compute the Toeplitz hash
+ * 
+ *  "ntt"   ==> number theoretical transform
+ *  "clmul" ==> carry-less multiplication over GF(2)
+ *
+ * @return  the current hash engine
+ */
+QString qkd_privacy_amplification::engine() const {
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    switch (d->eHashEngine) {
+        
+    case HASH_ENGINE_NTT:
+        return "ntt";
+        
+    case HASH_ENGINE_CLMUL:
+        return "clmul";
+    }
+    
+    return "";
+}
+
+
 /**
  * module work
  * 
@@ -166,6 +254,13 @@ bool qkd_privacy_amplification::process(qkd::key::key & cKey,
     uint64_t nSizeOfSeedKey = nKeyBits;
     double nReductionRate = reduction_rate();
     calculation_procedure eCalculationProcedure = (calculation_procedure)calculation();
+    hash_engine eHashEngine;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+        eHashEngine = d->eHashEngine;
+    }
+    uint64_t nBlockSize = block_size();
+    uint64_t nThreads = threads();
     
     if ((nSecurityBits == 0) && (nReductionRate == 1.0)) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
@@ -224,15 +319,21 @@ bool qkd_privacy_amplification::process(qkd::key::key & cKey,
             << " size (bits) = " << nKeyBits 
             << " error rate = " << cKey.meta().nErrorRate 
             << " disclosed bits = " << nDisclosedBits 
-            << " size of reduced key = " << nSizeOfShiftKey;
+            << " size of reduced key = " << nSizeOfShiftKey
+            << " engine = " << engine().toStdString()
+            << " block size = " << nBlockSize
+            << " threads = " << nThreads;
     
     qkd::utility::memory cSeed(nSizeOfSeedKey / 8);
     qkd::utility::memory cShift(nSizeOfShiftKey / 8);
     
     if (is_alice()) {
 
-        random() >> cSeed;
-        random() >> cShift;
+        {
+            std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+            random() >> cSeed;
+            random() >> cShift;
+        }
         qkd::module::message cMessage;
         cMessage.data() << cSeed;
         cMessage.data() << cShift;
@@ -268,7 +369,7 @@ bool qkd_privacy_amplification::process(qkd::key::key & cKey,
         }
     }
     
-    bool bPrivacyAmplification = perform(cKey, cKey, cSeed, cShift);
+    bool bPrivacyAmplification = perform(cKey, cKey, cSeed, cShift, eHashEngine, nBlockSize, nThreads);
     if (!bPrivacyAmplification) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "privacy amplification failed";
     }
@@ -306,6 +407,57 @@ qulonglong qkd_privacy_amplification::security_bits() const {
 }
 
 
+/**
+ * set the size of the Toeplitz blocks
+ * 
+ * @param   nBlockSize      the new size of Toeplitz blocks in bits (0 = no blocks)
+ */
+void qkd_privacy_amplification::set_block_size(qulonglong nBlockSize) {
+    
+    if (nBlockSize % 64) {
+        nBlockSize = (nBlockSize / 64 + 1) * 64;
+        qkd::utility::syslog::info() << __FILENAME__ << '@' << __LINE__ << ": " 
+                << "rounding Toeplitz block size up to " << nBlockSize << " bits";
+    }
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->nBlockSize = nBlockSize;
+}
+
+
+/**
+ * set the engine used to compute the Toeplitz hash
+ * 
+ *  "ntt"   ==> number theoretical transform
+ *  "clmul" ==> carry-less multiplication over GF(2)
+ *
+ * @param   sEngine     the new hash engine
+ */
+void qkd_privacy_amplification::set_engine(QString sEngine) {
+    
+    hash_engine eHashEngine;
+    if (sEngine == "ntt") {
+        eHashEngine = hash_engine::HASH_ENGINE_NTT;
+    }
+    else
+    if (sEngine == "clmul") {
+        eHashEngine = hash_engine::HASH_ENGINE_CLMUL;
+        if (!gf2x_hardware_clmul()) {
+            qkd::utility::syslog::info() << __FILENAME__ << '@' << __LINE__ << ": " 
+                    << "CPU lacks PCLMULQDQ - using portable carry-less multiplication";
+        }
+    }
+    else {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                << "refusing to set unknown privacy amplification engine: \"" << sEngine.toStdString() << "\"";
+        return;
+    }
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->eHashEngine = eHashEngine;
+}
+
+
 /**
  * set the reduction rate of the key
  * 
@@ -346,6 +498,33 @@ void qkd_privacy_amplification::set_security_bits(qulonglong nBits) {
 }
 
 
+/**
+ * set the number of threads working on Toeplitz blocks or the NTT
+ * 
+ * @param   nThreads        the new number of threads (0 = number of CPU cores)
+ */
+void qkd_privacy_amplification::set_threads(qulonglong nThreads) {
+    
+    if (nThreads == 0) {
+        nThreads = std::max<qulonglong>(std::thread::hardware_concurrency(), 1);
+    }
+    
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->nThreads = nThreads;
+}
+
+
+/**
+ * get the number of threads working on Toeplitz blocks or the NTT
+ * 
+ * @return  the number of threads working on Toeplitz blocks or the NTT
+ */
+qulonglong qkd_privacy_amplification::threads() const {
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    return d->nThreads;
+}
+
+
 /** 
  * performs the privacy amplification hash
  *
@@ -355,24 +534,203 @@ void qkd_privacy_amplification::set_security_bits(qulonglong nBits) {
  * @param   cInput          the original key
  * @param   cSeed           the seed data
  * @param   cShift          the shift key
+ * @param   eHashEngine     the engine to compute the Toeplitz hash
+ * @param   nBlockSize      size of a block in bits (0 for no blocks)
+ * @param   nThreads        number of threads to work on blocks or the NTT
  * @return  true for ok
  */
-bool perform(qkd::key::key & cKey, qkd::key::key const & cInput, qkd::utility::bigint const & cSeed, qkd::utility::bigint const & cShift) {
+bool perform(qkd::key::key & cKey, 
+        qkd::key::key const & cInput, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift,
+        hash_engine eHashEngine,
+        uint64_t nBlockSize,
+        uint64_t nThreads) {
+    
+    qkd::utility::memory cHash;
+    
+    const uint64_t nBlockBytes = nBlockSize / 8;
+    if ((nBlockBytes == 0) || ((cInput.data().size() <= nBlockBytes) && (cShift.size() <= nBlockBytes))) {
+        std::vector<mod> cNTTToeplitz;
+        std::vector<mod> cNTTInput;
+        cHash = toeplitz(eHashEngine, cSeed, cShift, cInput.data(), cNTTToeplitz, cNTTInput, nThreads);
+    }
+    else {
+        cHash = toeplitz_blocked(eHashEngine, cSeed, cShift, cInput.data(), nBlockBytes, nThreads);
+    }
+    
+    // the final key
+    cKey.meta() = cInput.meta();
+    cKey.data() = cHash;
+    
+    return true;
+}
+
+
+/**
+ * security coefficient tau
+ *
+ * @param   nErrorRate       error rate of the key
+ * @return  tau
+ */
+double tau(double nErrorRate) {
+    
+    // 1 - h(nErrorRate)
+    // where h is the binary entropy function
+    if (nErrorRate == 0.0) return 1.0;
+
+    // we want positive correlation!
+    if (nErrorRate > 0.5) return 0.0;   
+    
+    return 1 - (-nErrorRate * std::log2(nErrorRate) - (1 - nErrorRate) * log2(1 - nErrorRate));
+}
+
+
+/**
+ * computes the Toeplitz hash with the given engine
+ *
+ * the Toeplitz matrix is defined by |seed|shift|, the result has
+ * the size of the shift key.
+ * 
+ * @param   eHashEngine     the engine to use
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   cInput          the input key
+ * @param   cNTTToeplitz    scratch space for the NTT engine
+ * @param   cNTTInput       scratch space for the NTT engine
+ * @param   nThreads        number of threads for the NTT engine
+ * @return  the hash of cInput
+ */
+qkd::utility::memory toeplitz(hash_engine eHashEngine, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        std::vector<mod> & cNTTToeplitz,
+        std::vector<mod> & cNTTInput,
+        uint64_t nThreads) {
+    
+    switch (eHashEngine) {
+        
+    case HASH_ENGINE_CLMUL:
+        return gf2x_toeplitz(cSeed, cShift, cInput);
+        
+    case HASH_ENGINE_NTT:
+    default:
+        return toeplitz_ntt(cSeed, cShift, cInput, cNTTToeplitz, cNTTInput, nThreads);
+    }
+}
+
+
+/**
+ * computes the Toeplitz hash block by block (overlap-add)
+ *
+ * The Toeplitz matrix is cut into square blocks of nBlockBytes * 8 
+ * bits. Block (i, j) multiplied with input block j is itself a 
+ * Toeplitz hash defined by the section of |seed|shift| starting 
+ * at (i + j) * nBlockBytes. The results of a block row are added 
+ * up to yield output block i.
+ * 
+ * Each thread works on whole block rows, so the scratch space 
+ * needed is bounded by the block size and not by the key size.
+ * 
+ * @param   eHashEngine     the engine to use for a single block
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   cInput          the input key
+ * @param   nBlockBytes     size of a block in bytes
+ * @param   nThreads        number of threads to use
+ * @return  the hash of cInput
+ */
+qkd::utility::memory toeplitz_blocked(hash_engine eHashEngine, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        uint64_t nBlockBytes,
+        uint64_t nThreads) {
+    
+    const uint64_t nRows = (cShift.size() + nBlockBytes - 1) / nBlockBytes;
+    const uint64_t nColumns = (cInput.size() + nBlockBytes - 1) / nBlockBytes;
+    
+    qkd::utility::memory cResult(cShift.size());
+    cResult.fill(0);
+    
+    std::atomic<uint64_t> nNextRow(0);
+    auto cWorker = [&]() {
+        
+        // per thread resources, reused for all blocks
+        std::vector<mod> cNTTToeplitz;
+        std::vector<mod> cNTTInput;
+        qkd::utility::memory cBlockSeed(nBlockBytes);
+        qkd::utility::memory cBlockShift(nBlockBytes);
+        qkd::utility::memory cBlockInput(nBlockBytes);
+        qkd::utility::memory cRow(nBlockBytes);
+        
+        for (uint64_t i = nNextRow++; i < nRows; i = nNextRow++) {
+            
+            cRow.fill(0);
+            for (uint64_t j = 0; j < nColumns; ++j) {
+                
+                toeplitz_window(cBlockSeed, cSeed, cShift, (i + j) * nBlockBytes);
+                toeplitz_window(cBlockShift, cSeed, cShift, (i + j + 1) * nBlockBytes);
+                
+                const uint64_t nInputOffset = j * nBlockBytes;
+                const uint64_t nInputBytes = std::min(nBlockBytes, cInput.size() - nInputOffset);
+                cBlockInput.fill(0);
+                memcpy(cBlockInput.get(), cInput.get() + nInputOffset, nInputBytes);
+                
+                qkd::utility::memory cHash = toeplitz(eHashEngine, cBlockSeed, cBlockShift, cBlockInput, cNTTToeplitz, cNTTInput, 1);
+                for (uint64_t k = 0; k < nBlockBytes; ++k) cRow.get()[k] ^= cHash.get()[k];
+            }
+            
+            const uint64_t nResultOffset = i * nBlockBytes;
+            const uint64_t nResultBytes = std::min(nBlockBytes, cResult.size() - nResultOffset);
+            memcpy(cResult.get() + nResultOffset, cRow.get(), nResultBytes);
+        }
+    };
+    
+    std::vector<std::thread> cThreads;
+    for (uint64_t i = 1; (i < nThreads) && (i < nRows); ++i) cThreads.push_back(std::thread(cWorker));
+    cWorker();
+    for (auto & cThread : cThreads) cThread.join();
+    
+    return cResult;
+}
+
+
+/**
+ * computes the Toeplitz hash with a NTT
+ *
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   cInput          the input key
+ * @param   cNTTToeplitz    scratch space for the Toeplitz matrix
+ * @param   cNTTInput       scratch space for the input
+ * @param   nThreads        number of threads to run the NTT with
+ * @return  the hash of cInput
+ */
+qkd::utility::memory toeplitz_ntt(qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        qkd::utility::memory const & cInput,
+        std::vector<mod> & cNTTToeplitz,
+        std::vector<mod> & cNTTInput,
+        uint64_t nThreads) {
     
     // TODO: chris: please check
     
-    const uint64_t nSumBitCount = cSeed.bits() + cShift.bits();
+    const uint64_t nSeedBits = cSeed.size() * 8;
+    const uint64_t nShiftBits = cShift.size() * 8;
+    const uint64_t nSumBitCount = nSeedBits + nShiftBits;
     const uint64_t nNextLog2 = ld_ceil(nSumBitCount);
     const uint64_t nNTTLength = 1 << nNextLog2;
     const uint64_t nNumberZeroPaddingToeplitz = nNTTLength - nSumBitCount;
-    const uint64_t nNumberZeroPaddingInput = nNTTLength - cInput.data().size() * 8;
-
-    // needed resources
-    mod * nToeplitz = new mod[nNTTLength];
-    mod * nInput    = new mod[nNTTLength];
+    const uint64_t nNumberZeroPaddingInput = nNTTLength - cInput.size() * 8;
 
-    assert(nInput);
-    assert(nToeplitz);
+    // needed resources: without padding the last shift bit wraps 
+    // around to index 0, the extra slot keeps this write in bounds
+    cNTTToeplitz.resize(nNTTLength + 1);
+    cNTTInput.resize(nNTTLength);
+    mod * nToeplitz = cNTTToeplitz.data();
+    mod * nInput = cNTTInput.data();
 
     /*
      * convert all keys into elements of the finite field
@@ -420,13 +778,13 @@ bool perform(qkd::key::key & cKey, qkd::key::key const & cInput, qkd::utility::b
 
     // index i = 0 remains
     if (nNumberZeroPaddingToeplitz) nToeplitz[0] = 0;
-    else nToeplitz[0] =  cShift.get(cShift.bits() - 1);
+    else nToeplitz[0] = (cShift.get()[cShift.size() - 1] >> 7) & 0x01;
 
     // index i goes to N-i which is cSeed in reverse order with offset 1
-    mod_from_bigint(nToeplitz + 1, cSeed, true);
+    mod_from_memory(nToeplitz + 1, cSeed, true);
 
     // same as above with cShift
-    mod_from_bigint(nToeplitz + cSeed.bits() + 1, cShift, true);
+    mod_from_memory(nToeplitz + nSeedBits + 1, cShift, true);
 
     // now pad with zeros to reach a length which is a power of two, needed for NTT
     for (uint64_t i = nSumBitCount + 1; i < nNTTLength; i++) nToeplitz[i] = 0;
@@ -435,41 +793,43 @@ bool perform(qkd::key::key & cKey, qkd::key::key const & cInput, qkd::utility::b
     for (uint64_t i= 0; i < nNumberZeroPaddingInput; i++) nInput[i] = 0;
     
     // now insert the input key in plain order
-    mod_from_bigint(nInput + nNumberZeroPaddingInput, qkd::utility::bigint(cKey.data()), false);
+    mod_from_memory(nInput + nNumberZeroPaddingInput, cInput, false);
 
     // now do the actual calculation !!!
-    ntt_convolution(nToeplitz, nInput, nNextLog2);
+    ntt_convolution(nToeplitz, nInput, nNextLog2, nThreads);
     
     // collect the final bits
-    qkd::utility::bigint cBI(cShift.bits());
-    for (uint64_t i = 0; i < cShift.bits(); i++) cBI.set(i, (nToeplitz[i] & 0x1) != 0);
-    
-    // the final key
-    cKey.meta() = cInput.meta();
-    cKey.data() = cBI.memory();
-    
-    // clean up the mod arrays
-    delete [] nToeplitz;
-    delete [] nInput;
+    qkd::utility::memory cResult(cShift.size());
+    cResult.fill(0);
+    for (uint64_t i = 0; i < nShiftBits; i++) {
+        if (nToeplitz[i] & 0x1) cResult.get()[i >> 3] |= (1 << (i & 0x07));
+    }
     
-    return true;
+    return cResult;
 }
 
 
 /**
- * security coefficient tau
- *
- * @param   nErrorRate       error rate of the key
- * @return  tau
+ * copies a window out of the concatenation |seed|shift|
+ * 
+ * bytes beyond the end of |seed|shift| are set to 0.
+ * 
+ * @param   cWindow         the window to fill (its size is the window size)
+ * @param   cSeed           the seed data
+ * @param   cShift          the shift key
+ * @param   nOffset         byte offset of the window
  */
-double tau(double nErrorRate) {
+void toeplitz_window(qkd::utility::memory & cWindow, 
+        qkd::utility::memory const & cSeed, 
+        qkd::utility::memory const & cShift, 
+        uint64_t nOffset) {
     
-    // 1 - h(nErrorRate)
-    // where h is the binary entropy function
-    if (nErrorRate == 0.0) return 1.0;
-
-    // we want positive correlation!
-    if (nErrorRate > 0.5) return 0.0;   
-    
-    return 1 - (-nErrorRate * std::log2(nErrorRate) - (1 - nErrorRate) * log2(1 - nErrorRate));
+    for (uint64_t i = 0; i < cWindow.size(); ++i) {
+        
+        const uint64_t nPosition = nOffset + i;
+        if (nPosition < cSeed.size()) cWindow.get()[i] = cSeed.get()[nPosition];
+        else
+        if (nPosition - cSeed.size() < cShift.size()) cWindow.get()[i] = cShift.get()[nPosition - cSeed.size()];
+        else cWindow.get()[i] = 0;
+    }
 }
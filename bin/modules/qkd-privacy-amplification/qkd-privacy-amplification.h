@@ -53,6 +53,16 @@ enum calculation_procedure : uint8_t {
 };
 
 
+/**
+ * how do we compute the Toeplitz hash
+ */
+enum hash_engine : uint8_t {
+    
+    HASH_ENGINE_NTT = 0,                /**< number theoretical transform, one field element per bit */
+    HASH_ENGINE_CLMUL = 1,              /**< carry-less multiplication over GF(2) on packed 64 bit words */
+};
+
+
 /**
  * The qkd-privacy-amplification runs the QKD privacy amplification
  * to reduce Eve's knowledge by the information leaked from
@@ -64,12 +74,18 @@ enum calculation_procedure : uint8_t {
  * 
  *      -name-                  -read/write-    -description-
  * 
+ *      block_size                  R/W         size of Toeplitz blocks in bits (0 = one block for the whole key)
+ * 
  *      calculation                  R          current calculation procedure
  * 
+ *      engine                      R/W         engine used for the Toeplitz hash: "ntt" or "clmul"
+ * 
  *      reduction_rate              R/W         reduction of key: 0.0 => no final key, 1.0 => no reduction
  * 
  *      security_bits               R/W         number of security bits introduced into privacy amplification
  * 
+ *      threads                     R/W         number of threads working on Toeplitz blocks or the NTT
+ * 
  */
 class qkd_privacy_amplification : public qkd::module::module {
     
@@ -77,9 +93,12 @@ class qkd_privacy_amplification : public qkd::module::module {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "at.ac.ait.qkd.privacyamplification")
 
+    Q_PROPERTY(qulonglong block_size READ block_size WRITE set_block_size)                  /**< get/set the size of Toeplitz blocks */
     Q_PROPERTY(qulonglong calculation READ calculation)                                     /**< get current calculate procedure */
+    Q_PROPERTY(QString engine READ engine WRITE set_engine)                                 /**< get/set the Toeplitz hash engine */
     Q_PROPERTY(double reduction_rate READ reduction_rate WRITE set_reduction_rate)          /**< get/set reduction rate */
     Q_PROPERTY(qulonglong security_bits READ security_bits WRITE set_security_bits)         /**< get/set number of security bits */
+    Q_PROPERTY(qulonglong threads READ threads WRITE set_threads)                           /**< get/set number of threads on Toeplitz blocks or the NTT */
 
 
 public:
@@ -91,6 +110,20 @@ public:
     qkd_privacy_amplification();
     
     
+    /**
+     * get the size of the Toeplitz blocks
+     * 
+     * With a block size > 0 the Toeplitz matrix is cut into square blocks
+     * which are hashed one by one and added up (overlap-add). Thus
+     * the scratch memory needed is bounded by the block size and
+     * not by the key size and the blocks can be spread on several
+     * threads.
+     * 
+     * @return  the size of the Toeplitz blocks in bits (0 = no blocks)
+     */
+    qulonglong block_size() const;
+    
+    
     /**
      * get the current calculation procedure
      * 
@@ -102,6 +135,17 @@ public:
     qulonglong calculation() const;
     
     
+    /**
+     * get the engine used to compute the Toeplitz hash
+     * 
+     *  "ntt"   ==> number theoretical transform
+     *  "clmul" ==> carry-less multiplication over GF(2)
+     *
+     * @return  the current hash engine
+     */
+    QString engine() const;
+    
+    
     /**
      * get the reduction rate of the key
      * 
@@ -123,6 +167,30 @@ public:
     qulonglong security_bits() const;
     
     
+    /**
+     * set the size of the Toeplitz blocks
+     * 
+     * The block size is rounded up to a multiple of 64 bits.
+     * 
+     * @param   nBlockSize      the new size of Toeplitz blocks in bits (0 = no blocks)
+     */
+    void set_block_size(qulonglong nBlockSize);
+    
+    
+    /**
+     * set the engine used to compute the Toeplitz hash
+     * 
+     * both engines yield bit-identical results, so alice and bob
+     * may run different engines.
+     * 
+     *  "ntt"   ==> number theoretical transform
+     *  "clmul" ==> carry-less multiplication over GF(2)
+     *
+     * @param   sEngine     the new hash engine
+     */
+    void set_engine(QString sEngine);
+    
+    
     /**
      * set the reduction rate of the key
      * 
@@ -144,6 +212,25 @@ public:
     void set_security_bits(qulonglong nBits);
     
     
+    /**
+     * set the number of threads working on Toeplitz blocks or the NTT
+     * 
+     * Without blocks the NTT engine spreads its butterfly stages on 
+     * these threads. The result does not depend on the thread count.
+     * 
+     * @param   nThreads        the new number of threads (0 = number of CPU cores)
+     */
+    void set_threads(qulonglong nThreads);
+    
+    
+    /**
+     * get the number of threads working on Toeplitz blocks or the NTT
+     * 
+     * @return  the number of threads working on Toeplitz blocks or the NTT
+     */
+    qulonglong threads() const;
+    
+    
 protected:
     
     
@@ -155,6 +242,14 @@ protected:
      */
     void apply_config(std::string const & sURL, qkd::utility::properties const & cConfig);
     
+    
+    /**
+     * each key is amplified on its own: run with a worker pool
+     * 
+     * @return  always true
+     */
+    bool is_reentrant() const { return true; }
+    
 
 private:
     
@@ -0,0 +1,459 @@
+/*
+ * bases.cpp
+ * 
+ * base tables and sifting of the BB84 protocol
+ * 
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute 
+ * it and/or modify it under the terms of the GNU General Public License 
+ * as published by the Free Software Foundation, either version 3 of 
+ * the License, or (at your option) any later version.
+ * 
+ * The AIT QKD Software Suite is distributed in the hope that it will 
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty 
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite. 
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+
+#include <string.h>
+
+// ait
+#include <qkd/utility/random.h>
+
+#include "bases.h"
+
+
+// ------------------------------------------------------------
+// decl
+
+
+// fwd 
+static uint64_t dice(uint64_t nBits, uint8_t nDice);
+static bb84_base get_measurement(unsigned char nEvent);
+
+
+// ------------------------------------------------------------
+// vars
+
+
+/** 
+ * lookup table for the parity in a byte 
+ */
+static uint8_t const g_nParity[] = {
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //   0 -  15
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  16 -  31
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  32 -  47
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  48 -  63
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  64 -  79 
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  80 -  95
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  96 - 111  
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 112 - 127
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 128 - 143
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 144 - 159
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 160 - 175
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 176 - 191
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 192 - 207
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 208 - 223
+    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 224 - 239
+    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0      // 240 - 255
+};
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * convert the bases to key bits
+ * 
+ * the given basetable will be appended to the
+ * bits given of the first param. nPosition holds the
+ * position to write the next bit despite the size of the 
+ * bits-memory block.
+ * 
+ * The key bits are packed LSB first: bit i is found in 
+ * byte i / 8 at (1 << (i % 8)). Each byte of the base table 
+ * is sifted with 2 lookups (see sift_tables) and the key bits
+ * are collected in a 64 bit word written in 4 byte chunks.
+ * 
+ * @param   cBits           the key bits so far
+ * @param   nPosition       the position within cBits to write next
+ * @param   nBaseRatio      the ratio of good bases vs. all bases
+ * @param   bAlice          act as alice
+ * @param   cBases          the bases
+ * @param   cQuantumTable   the quantum event table
+ */
+void bases_to_bits(std::vector<unsigned char> & cBits, 
+        uint64_t & nPosition, 
+        double & nBaseRatio, 
+        bool bAlice, qkd::utility::memory const & cBases, 
+        qkd::utility::memory const & cQuantumTable) {
+    
+    // we have 4 bases in each byte encoded
+    uint64_t nBases = cBases.size() * 4;
+    
+    // room for all bits plus the last 4 byte chunk
+    cBits.resize((nPosition + nBases) / 8 + 8);
+    unsigned char * cOut = cBits.data() + nPosition / 8;
+    
+    // start with the bits of the last incomplete byte
+    unsigned int nPending = nPosition % 8;
+    uint64_t nPendingBits = cOut[0] & ((1u << nPending) - 1);
+    
+    uint8_t const * cSift = tables().sift;
+    uint8_t const nInvert = (bAlice ? 0x00 : 0x03);
+    uint64_t nSifted = 0;
+    
+    auto sift = [&](uint8_t nEntry) {
+        uint64_t nCount = (nEntry >> 2) & 0x03;
+        uint64_t nBits = nEntry & 0x03;
+        if (nEntry & 0x30) nBits = dice(nBits, (nEntry >> 4) & 0x03);
+        nBits ^= nInvert & ((1u << nCount) - 1);
+        nPendingBits |= nBits << nPending;
+        nPending += nCount;
+        nSifted += nCount;
+    };
+    
+    auto flush = [&]() {
+        cOut[0] = nPendingBits;
+        cOut[1] = nPendingBits >> 8;
+        cOut[2] = nPendingBits >> 16;
+        cOut[3] = nPendingBits >> 24;
+        cOut += 4;
+        nPendingBits >>= 32;
+        nPending -= 32;
+    };
+
+    unsigned char const * cBase = cBases.get();
+    unsigned char const * cQuantum = cQuantumTable.get();
+    
+    // a quantum table of odd size has no events for the very last base nibble
+    uint64_t nFull = std::min<uint64_t>(cBases.size(), cQuantumTable.size() / 2);
+    
+    for (uint64_t i = 0; i < nFull; i++) {
+        sift(cSift[((cBase[i] & 0xF0) << 4) | cQuantum[i * 2 + 0]]);
+        sift(cSift[((cBase[i] & 0x0F) << 8) | cQuantum[i * 2 + 1]]);
+        if (nPending >= 32) flush();
+    }
+    for (uint64_t i = nFull; i < cBases.size(); i++) {
+        if (i * 2 < cQuantumTable.size()) sift(cSift[((cBase[i] & 0xF0) << 4) | cQuantum[i * 2]]);
+        if (nPending >= 32) flush();
+    }
+    
+    for (unsigned int i = 0; i < (nPending + 7) / 8; i++) cOut[i] = nPendingBits >> (i * 8);
+    
+    nPosition += nSifted;
+    cBits.resize((nPosition + 7) / 8);
+    
+    if (!nBases) nBaseRatio = 0.0;
+    else nBaseRatio = nSifted / (double)nBases;
+}
+
+
+/**
+ * compress a base table
+ * 
+ * Most events of a quantum table usually carry no valid 
+ * measurement. Instead of 2 bits for each event the 
+ * compressed table holds the positions of the valid bases 
+ * and a single bit for each of them:
+ * 
+ *      N ........... number of valid bases
+ *      gap[N] ...... number of invalid bases before each valid base
+ *      rect[] ...... (N + 7) / 8 bytes: bit i set if valid base i 
+ *                    is rectilinear (LSB first)
+ * 
+ * N and the gaps are variable length integers: 7 bits per byte,
+ * the highest bit set if more bytes follow.
+ * 
+ * @param   cBases      the base table
+ * @return  the compressed base table
+ */
+qkd::utility::memory compress_base_table(qkd::utility::memory const & cBases) {
+    
+    std::vector<unsigned char> cGaps;
+    std::vector<unsigned char> cRect;
+    cGaps.reserve(cBases.size());
+    cRect.reserve(cBases.size() / 2 + 1);
+    
+    uint64_t nValid = 0;
+    uint64_t nGap = 0;
+    for (uint64_t i = 0; i < cBases.size(); i++) {
+        
+        if (!cBases[i]) {
+            nGap += 4;
+            continue;
+        }
+        
+        for (int j = 6; j >= 0; j -= 2) {
+            
+            bb84_base eBase = static_cast<bb84_base>((cBases[i] >> j) & 0x03);
+            if (eBase == bb84_base::BB84_BASE_INVALID) {
+                nGap++;
+                continue;
+            }
+            
+            for (; nGap >= 0x80; nGap >>= 7) cGaps.push_back((nGap & 0x7F) | 0x80);
+            cGaps.push_back(nGap);
+            nGap = 0;
+            
+            if ((nValid % 8) == 0) cRect.push_back(0);
+            if (eBase == bb84_base::BB84_BASE_RECTILINEAR) cRect.back() |= (1 << (nValid % 8));
+            nValid++;
+        }
+    }
+    
+    std::vector<unsigned char> cCount;
+    for (; nValid >= 0x80; nValid >>= 7) cCount.push_back((nValid & 0x7F) | 0x80);
+    cCount.push_back(nValid);
+    
+    qkd::utility::memory cCompressed(cCount.size() + cGaps.size() + cRect.size());
+    unsigned char * cOut = cCompressed.get();
+    cOut = std::copy(cCount.begin(), cCount.end(), cOut);
+    cOut = std::copy(cGaps.begin(), cGaps.end(), cOut);
+    std::copy(cRect.begin(), cRect.end(), cOut);
+    
+    return cCompressed;
+}
+
+
+/**
+ * decompress a base table
+ * 
+ * see compress_base_table() for the format
+ * 
+ * @param   cCompressed     the compressed base table
+ * @param   nSize           size of the base table in bytes
+ * @return  the base table (empty on malformed data)
+ */
+qkd::utility::memory decompress_base_table(qkd::utility::memory const & cCompressed, uint64_t nSize) {
+    
+    unsigned char const * cIn = cCompressed.get();
+    unsigned char const * cEnd = cIn + cCompressed.size();
+    
+    auto pop_varint = [&](uint64_t & nValue) -> bool {
+        nValue = 0;
+        for (unsigned int nShift = 0; (cIn < cEnd) && (nShift < 64); nShift += 7) {
+            unsigned char c = *cIn++;
+            nValue |= (uint64_t)(c & 0x7F) << nShift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    };
+    
+    uint64_t nValid = 0;
+    if (!pop_varint(nValid)) return qkd::utility::memory();
+    if (nValid > nSize * 4) return qkd::utility::memory();
+    
+    qkd::utility::memory cBases(nSize);
+    cBases.fill(0);
+    
+    // the rectilinear flags are at the end
+    if ((uint64_t)(cEnd - cIn) < (nValid + 7) / 8) return qkd::utility::memory();
+    unsigned char const * cRect = cEnd - (nValid + 7) / 8;
+    cEnd = cRect;
+
+    uint64_t nEvent = 0;
+    for (uint64_t i = 0; i < nValid; i++) {
+        
+        uint64_t nGap = 0;
+        if (!pop_varint(nGap)) return qkd::utility::memory();
+        if (nGap >= nSize * 4 - nEvent) return qkd::utility::memory();
+        nEvent += nGap;
+        
+        bb84_base eBase = bb84_base::BB84_BASE_DIAGONAL;
+        if (cRect[i / 8] & (1 << (i % 8))) eBase = bb84_base::BB84_BASE_RECTILINEAR;
+        cBases[nEvent / 4] |= static_cast<unsigned char>(eBase) << (6 - (nEvent % 4) * 2);
+        nEvent++;
+    }
+    if (cIn != cEnd) return qkd::utility::memory();
+    
+    return cBases;
+}
+
+
+/**
+ * role dices for some key bits
+ * 
+ * This is for events with an even number of clicks.
+ * 
+ * @param   nBits           the key bits
+ * @param   nDice           mask of the key bits to dice
+ * @return  the key bits with the diced bits set
+ */
+uint64_t dice(uint64_t nBits, uint8_t nDice) {
+    
+    for (unsigned int i = 0; i < 2; i++) {
+        
+        if (!(nDice & (1 << i))) continue;
+        
+        double nRandom = 0.0;
+        qkd::utility::random_source::source() >> nRandom;
+        if (nRandom >= 0.5) nBits |= (1 << i);
+        else nBits &= ~(1 << i);
+    }
+    
+    return nBits;
+}
+
+
+/**
+ * tests a single event of the Quantum table
+ * implements "squashing", Ref. arXiv:0804.3082 and following work by Luetgenhaus
+ *
+ * @param   nEvent          the event
+ * @return  a bb84 measurement
+ */
+bb84_base get_measurement(unsigned char nEvent) {
+
+    if (nEvent == 0x00) return bb84_base::BB84_BASE_INVALID;
+
+    bool bBaseDiag = (nEvent & 0x03);    // either e==0x01, 0x02, or 0x03
+    bool bBaseRect = (nEvent & 0x0C);    // either e==0x04, 0x08, or 0x0C
+
+    // clicks in both bases --> eliminate event [N. Luetkenhaus, priv.communic.]
+    if (bBaseRect & bBaseDiag) return bb84_base::BB84_BASE_INVALID;    
+
+    if (bBaseRect) return bb84_base::BB84_BASE_RECTILINEAR;
+    return bb84_base::BB84_BASE_DIAGONAL;
+}
+
+
+/**
+ * invalidate all bases which differ from the peer's
+ * 
+ * This runs on 8 bytes (32 bases) at once.
+ * 
+ * @param   cBases          our base table
+ * @param   cBasesPeer      the peer's base table (same size)
+ */
+void mask_different_bases(qkd::utility::memory & cBases, qkd::utility::memory const & cBasesPeer) {
+    
+    unsigned char * cBase = cBases.get();
+    unsigned char const * cBasePeer = cBasesPeer.get();
+    
+    uint64_t i = 0;
+    for (; i + 8 <= cBases.size(); i += 8) {
+        
+        uint64_t nBases = 0;
+        uint64_t nBasesPeer = 0;
+        memcpy(&nBases, cBase + i, 8);
+        memcpy(&nBasesPeer, cBasePeer + i, 8);
+        
+        // a single bit per differing base --> spread to both bits of the base
+        uint64_t nDiff = nBases ^ nBasesPeer;
+        nDiff = (nDiff | (nDiff >> 1)) & 0x5555555555555555ull;
+        nBases &= ~(nDiff * 3);
+        
+        memcpy(cBase + i, &nBases, 8);
+    }
+    for (; i < cBases.size(); i++) {
+        unsigned char nDiff = cBase[i] ^ cBasePeer[i];
+        nDiff = (nDiff | (nDiff >> 1)) & 0x55;
+        cBase[i] &= ~(nDiff * 3);
+    }
+}
+
+
+/**
+ * turn the quantum table (detector clicks) into a table of bases
+ * 
+ * The basis table tells which measurement has been done at which position
+ * in the quantum table 
+ * 
+ * a base table is memory block holding 4 bb84_base values in each byte
+ *
+ * @param   cQuantumTable       as received
+ * @return  bases table
+ */
+qkd::utility::memory quantum_table_to_base_table(qkd::utility::memory const & cQuantumTable) {
+    
+    // we have 4 detector bits for a base
+    // a base is 00, 01, 10 or 11
+    qkd::utility::memory cBases((cQuantumTable.size() + 1) / 2);
+    
+    uint8_t const * cMeasurement = tables().measurement;
+    unsigned char const * cQuantumEvent = cQuantumTable.get();
+    uint64_t nFull = cQuantumTable.size() / 2;
+    for (uint64_t i = 0; i < nFull; i++) {
+        cBases.get()[i] = (cMeasurement[cQuantumEvent[i * 2 + 0]] << 4) | cMeasurement[cQuantumEvent[i * 2 + 1]];
+    }
+    if (nFull < cBases.size()) cBases.get()[nFull] = cMeasurement[cQuantumEvent[nFull * 2]] << 4;
+
+    return cBases;
+}
+
+
+/**
+ * ctor
+ */
+sift_tables::sift_tables() {
+    
+    for (unsigned int nQuantum = 0; nQuantum < 256; nQuantum++) {
+        unsigned char nFirst = (unsigned char)get_measurement((nQuantum & 0xF0) >> 4);
+        unsigned char nSecond = (unsigned char)get_measurement(nQuantum & 0x0F);
+        measurement[nQuantum] = (nFirst << 2) | nSecond;
+    }
+    
+    for (unsigned int nBases = 0; nBases < 16; nBases++) {
+        for (unsigned int nQuantum = 0; nQuantum < 256; nQuantum++) {
+            
+            bb84_base eBase[2] = { 
+                static_cast<bb84_base>((nBases & 0x0C) >> 2), 
+                static_cast<bb84_base>(nBases & 0x03) 
+            };
+            unsigned char nEvent[2] = { 
+                static_cast<unsigned char>((nQuantum & 0xF0) >> 4), 
+                static_cast<unsigned char>(nQuantum & 0x0F) 
+            };
+            
+            uint8_t nBits = 0;
+            uint8_t nCount = 0;
+            uint8_t nDice = 0;
+            for (unsigned int i = 0; i < 2; i++) {
+                
+                if ((eBase[i] != bb84_base::BB84_BASE_DIAGONAL) && (eBase[i] != bb84_base::BB84_BASE_RECTILINEAR)) continue;
+                
+                // check if we have more than 1 click (that is: if we have an odd number of clicks though)
+                if (g_nParity[nEvent[i]]) {
+                    if (nEvent[i] & 0x55) nBits |= (1 << nCount);
+                }
+                else {
+                    nDice |= (1 << nCount);
+                }
+                nCount++;
+            }
+            
+            sift[(nBases << 8) | nQuantum] = nBits | (nCount << 2) | (nDice << 4);
+        }
+    }
+}
+
+
+/**
+ * get the sifting lookup tables
+ * 
+ * @return  the sifting lookup tables
+ */
+sift_tables const & tables() {
+    static sift_tables const cTables;
+    return cTables;
+}
@@ -0,0 +1,185 @@
+/*
+ * bases.h
+ * 
+ * base tables and sifting of the BB84 protocol
+ * 
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute 
+ * it and/or modify it under the terms of the GNU General Public License 
+ * as published by the Free Software Foundation, either version 3 of 
+ * the License, or (at your option) any later version.
+ * 
+ * The AIT QKD Software Suite is distributed in the hope that it will 
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty 
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite. 
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_MODULE_QKD_SIFTING_BB84_BASES_H
+#define __QKD_MODULE_QKD_SIFTING_BB84_BASES_H
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <inttypes.h>
+#include <vector>
+
+// ait
+#include <qkd/utility/memory.h>
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * an event measurement
+ */
+enum class bb84_base : uint8_t {
+    
+    BB84_BASE_INVALID = 0,          /**< irregular base measurement */
+    BB84_BASE_DIAGONAL,             /**< diagonal measurement */
+    BB84_BASE_RECTILINEAR           /**< rectilinear measurement */
+};
+
+
+/**
+ * the sifting lookup tables
+ * 
+ * sift[] is indexed by a nibble of the base table (2 bases) and the 
+ * quantum table byte holding the very same 2 events:
+ * 
+ *      index = (base nibble << 8) | quantum byte
+ * 
+ * Each entry tells the key bits these 2 events yield:
+ * 
+ *      bits 0-1 ... the key bits, the first event in bit 0
+ *      bits 2-3 ... number of key bits (0, 1 or 2)
+ *      bits 4-5 ... key bits to dice (even number of clicks)
+ * 
+ * measurement[] holds the 2 bases of the 2 events in a quantum
+ * table byte as a base table nibble.
+ */
+class sift_tables {
+    
+public:
+    
+    /**
+     * ctor
+     */
+    sift_tables();
+    
+    uint8_t sift[16 * 256];                 /**< key bits of a base nibble and a quantum byte */
+    uint8_t measurement[256];               /**< base nibble of a quantum byte */
+};
+
+
+/**
+ * convert the bases to key bits
+ * 
+ * the given basetable will be appended to the
+ * bits given of the first param. nPosition holds the
+ * position to write the next bit despite the size of the 
+ * bits-memory block.
+ * 
+ * The key bits are packed LSB first: bit i is found in 
+ * byte i / 8 at (1 << (i % 8)). Each byte of the base table 
+ * is sifted with 2 lookups (see sift_tables) and the key bits
+ * are collected in a 64 bit word written in 4 byte chunks.
+ * 
+ * @param   cBits           the key bits so far
+ * @param   nPosition       the position within cBits to write next
+ * @param   nBaseRatio      the ratio of good bases vs. all bases
+ * @param   bAlice          act as alice
+ * @param   cBases          the bases
+ * @param   cQuantumTable   the quantum event table
+ */
+void bases_to_bits(std::vector<unsigned char> & cBits, 
+        uint64_t & nPosition, 
+        double & nBaseRatio, 
+        bool bAlice, qkd::utility::memory const & cBases, 
+        qkd::utility::memory const & cQuantumTable);
+
+
+/**
+ * compress a base table
+ * 
+ * Most events of a quantum table usually carry no valid 
+ * measurement. Instead of 2 bits for each event the 
+ * compressed table holds the positions of the valid bases 
+ * and a single bit for each of them:
+ * 
+ *      N ........... number of valid bases
+ *      gap[N] ...... number of invalid bases before each valid base
+ *      rect[] ...... (N + 7) / 8 bytes: bit i set if valid base i 
+ *                    is rectilinear (LSB first)
+ * 
+ * N and the gaps are variable length integers: 7 bits per byte,
+ * the highest bit set if more bytes follow.
+ * 
+ * @param   cBases      the base table
+ * @return  the compressed base table
+ */
+qkd::utility::memory compress_base_table(qkd::utility::memory const & cBases);
+
+
+/**
+ * decompress a base table
+ * 
+ * see compress_base_table() for the format
+ * 
+ * @param   cCompressed     the compressed base table
+ * @param   nSize           size of the base table in bytes
+ * @return  the base table (empty on malformed data)
+ */
+qkd::utility::memory decompress_base_table(qkd::utility::memory const & cCompressed, uint64_t nSize);
+
+
+/**
+ * invalidate all bases which differ from the peer's
+ * 
+ * This runs on 8 bytes (32 bases) at once.
+ * 
+ * @param   cBases          our base table
+ * @param   cBasesPeer      the peer's base table (same size)
+ */
+void mask_different_bases(qkd::utility::memory & cBases, qkd::utility::memory const & cBasesPeer);
+
+
+/**
+ * turn the quantum table (detector clicks) into a table of bases
+ * 
+ * The basis table tells which measurement has been done at which position
+ * in the quantum table 
+ * 
+ * a base table is memory block holding 4 bb84_base values in each byte
+ *
+ * @param   cQuantumTable       as received
+ * @return  bases table
+ */
+qkd::utility::memory quantum_table_to_base_table(qkd::utility::memory const & cQuantumTable);
+
+
+/**
+ * get the sifting lookup tables
+ * 
+ * @return  the sifting lookup tables
+ */
+sift_tables const & tables();
+
+
+#endif
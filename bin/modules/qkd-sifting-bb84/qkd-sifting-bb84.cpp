@@ -31,13 +31,17 @@
 // ------------------------------------------------------------
 // incs
 
+#include <vector>
+
+#include <string.h>
+
 #include <boost/algorithm/string.hpp>
 
 // ait
-#include <qkd/utility/bigint.h>
 #include <qkd/utility/memory.h>
 #include <qkd/utility/syslog.h>
 
+#include "bases.h"
 #include "qkd-sifting-bb84.h"
 #include "qkd_sifting_bb84_dbus.h"
 
@@ -53,18 +57,6 @@
 // decl
 
 
-/**
- * an event measurement
- */
-enum class bb84_base : uint8_t {
-    
-    BB84_BASE_INVALID = 0,          /**< irregular base measurement */
-    BB84_BASE_DIAGONAL,             /**< diagonal measurement */
-    BB84_BASE_RECTILINEAR           /**< rectilinear measurement */
-};
-
-
-
 /**
  * the qkd-sifting-bb84 pimpl
  */
@@ -76,7 +68,7 @@ public:
     /**
      * ctor
      */
-    qkd_sifting_bb84_data() : nRawKeyLength(1024), nKeyId(1), nCurrentPosition(0) {
+    qkd_sifting_bb84_data() : nRawKeyLength(1024), bCompressBases(false), nKeyId(1), nCurrentPosition(0) {
         cAvgBaseRatio = qkd::utility::average_technique::create("value", 10);        
     };
     
@@ -84,48 +76,15 @@ public:
     
     qkd::utility::average cAvgBaseRatio;    /**< the average base ratio */
     uint64_t nRawKeyLength;                 /**< minimum length of raw key generated in bytes */
+    bool bCompressBases;                    /**< send compressed base tables */
     
     qkd::key::key_id nKeyId;                /**< current key id we work on */
-    qkd::utility::bigint cBits;             /**< the generated key bits so far */
+    std::vector<unsigned char> cBits;       /**< the generated key bits so far (packed, LSB first) */
     uint64_t nCurrentPosition;              /**< current bit position to write */
     
 };
 
 
-// fwd 
-static bool base_to_bit(bool & bBit, bb84_base eBase, unsigned char nQuantumEvent);
-static void bases_to_bits(qkd::utility::bigint & cBits, uint64_t & nPosition, double & nBaseRatio, bool bAlice, qkd::utility::memory const & cBases, qkd::utility::memory const & cQuantumTable);
-static bb84_base get_measurement(unsigned char nEvent);
-static qkd::utility::memory quantum_table_to_base_table(qkd::utility::memory const & cQuantumTable);
-
-
-// ------------------------------------------------------------
-// vars
-
-
-/** 
- * lookup table for the parity in a byte 
- */
-static uint8_t const g_nParity[] = {
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //   0 -  15
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  16 -  31
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  32 -  47
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  48 -  63
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     //  64 -  79 
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  80 -  95
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     //  96 - 111  
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 112 - 127
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 128 - 143
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 144 - 159
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 160 - 175
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 176 - 191
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,     // 192 - 207
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 208 - 223
-    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,     // 224 - 239
-    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0      // 240 - 255
-};
-
-
 // ------------------------------------------------------------
 // code
 
@@ -144,6 +103,9 @@ qkd_sifting_bb84::qkd_sifting_bb84() : qkd::module::module("bb84",
     set_rawkey_length(1024);
     set_key_id_pattern("0/0");
     
+    // build the lookup tables now rather than on the first key
+    tables();
+    
     new Bb84Adaptor(this);
 }
 
@@ -164,6 +126,21 @@ void qkd_sifting_bb84::apply_config(UNUSED std::string const & sURL, qkd::utilit
         std::string sKey = cEntry.first.substr(config_prefix().size());
         
         // module specific config here
+        if (sKey == "compress_bases") {
+            if (cEntry.second == "true") {
+                set_compress_bases(true);
+            }
+            else
+            if (cEntry.second == "false") {
+                set_compress_bases(false);
+            }
+            else {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                        << ": at key \"" << cEntry.first 
+                        << "\" - can't parse value \"" << cEntry.second << "\".";
+            }
+        }
+        else
         if (sKey == "key_id_pattern") {
             set_key_id_pattern(QString::fromStdString(cEntry.second));
         }
@@ -198,6 +175,17 @@ double qkd_sifting_bb84::base_ratio() const {
 }
 
 
+/**
+ * get the compressed base tables flag
+ * 
+ * @return  true, if base tables are sent compressed
+ */
+bool qkd_sifting_bb84::compress_bases() const {
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    return d->bCompressBases;
+}
+
+
 /**
  * get the current key id we are sifting
  * 
@@ -277,6 +265,7 @@ bool qkd_sifting_bb84::process_alice(qkd::key::key & cKey,
     cMessage.data() << cKey.id();
     cMessage.data() << cKey.size();
     cMessage.data() << (uint64_t)rawkey_length();
+    cMessage.data() << compress_bases();
 
     try {
         send(cKey.id(), cMessage, cOutgoingContext);
@@ -301,6 +290,11 @@ bool qkd_sifting_bb84::process_alice(qkd::key::key & cKey,
     qkd::utility::memory cBasesPeer;
     cMessage.data() >> cBasesPeer;
     
+    // bob tells if he agreed on compressed base tables
+    bool bCompressed = false;
+    if (!cMessage.data().eof()) cMessage.data() >> bCompressed;
+    if (bCompressed) cBasesPeer = decompress_base_table(cBasesPeer, cBases.size());
+    
     if (cBases.size() != cBasesPeer.size()) {
         qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " 
                 << "base tables differ - this must not happen";
@@ -308,17 +302,12 @@ bool qkd_sifting_bb84::process_alice(qkd::key::key & cKey,
         return false;
     }
 
-    for (unsigned int i = 0; i < cBases.size(); i++) {
-        
-        // different bases? --> Alice sets here resp. basis to invalid
-        if ((cBasesPeer.get()[i] & 0xC0) != (cBases.get()[i] & 0xC0)) cBases.get()[i] &= 0x3F;
-        if ((cBasesPeer.get()[i] & 0x30) != (cBases.get()[i] & 0x30)) cBases.get()[i] &= 0xCF;
-        if ((cBasesPeer.get()[i] & 0x0C) != (cBases.get()[i] & 0x0C)) cBases.get()[i] &= 0xF3;
-        if ((cBasesPeer.get()[i] & 0x03) != (cBases.get()[i] & 0x03)) cBases.get()[i] &= 0xFC;
-    }
+    // different bases? --> Alice sets here resp. basis to invalid
+    mask_different_bases(cBases, cBasesPeer);
     
     cMessage = qkd::module::message();
-    cMessage.data() << cBases;
+    if (bCompressed) cMessage.data() << compress_base_table(cBases);
+    else cMessage.data() << cBases;
     try {
         send(cKey.id(), cMessage, cOutgoingContext);
     }
@@ -348,13 +337,13 @@ bool qkd_sifting_bb84::process_alice(qkd::key::key & cKey,
     if (d->nCurrentPosition >= rawkey_length() * 8) {
         
         // create a new key: we cut the keybits at byte boundaries so max. 7 bits a lost
-        qkd::utility::memory cKeyBits = d->cBits.memory();
-        cKeyBits.resize(d->nCurrentPosition / 8);
+        qkd::utility::memory cKeyBits(d->nCurrentPosition / 8);
+        memcpy(cKeyBits.get(), d->cBits.data(), cKeyBits.size());
         cKey = qkd::key::key(d->nKeyId, cKeyBits);
         
         cKey.meta().eKeyState = qkd::key::key_state::KEY_STATE_SIFTED;
         d->nKeyId = qkd::key::key::counter().inc();
-        d->cBits = qkd::utility::bigint(d->nRawKeyLength);
+        d->cBits.clear();
         d->nCurrentPosition = 0;
         bForwardKey = true;
     }
@@ -395,6 +384,10 @@ bool qkd_sifting_bb84::process_bob(qkd::key::key & cKey,
     cMessage.data() >> nPeerSize;
     cMessage.data() >> nLength;
     
+    // alice asks for compressed base tables
+    bool bCompressed = false;
+    if (!cMessage.data().eof()) cMessage.data() >> bCompressed;
+    
     // check if we both have the same input
     if ((nPeerKeyId != cKey.id()) || (nPeerSize != cKey.size())) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
@@ -407,7 +400,9 @@ bool qkd_sifting_bb84::process_bob(qkd::key::key & cKey,
     
     qkd::utility::memory cBases = quantum_table_to_base_table(cKey.data());
     cMessage = qkd::module::message();
-    cMessage.data() << cBases;
+    if (bCompressed) cMessage.data() << compress_base_table(cBases);
+    else cMessage.data() << cBases;
+    cMessage.data() << bCompressed;
     try {
         send(cKey.id(), cMessage, cOutgoingContext);
     }
@@ -425,7 +420,16 @@ bool qkd_sifting_bb84::process_bob(qkd::key::key & cKey,
                 << "failed to receive message: " << cRuntimeError.what();
         return false;
     }
+    uint64_t nBasesSize = cBases.size();
     cMessage.data() >> cBases;
+    if (bCompressed) cBases = decompress_base_table(cBases, nBasesSize);
+    
+    if (cBases.size() != nBasesSize) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " 
+                << "base tables differ - this must not happen";
+        terminate();
+        return false;
+    }
 
     // convert the bases to bits
     double nBaseRatio = 1.0;
@@ -447,13 +451,13 @@ bool qkd_sifting_bb84::process_bob(qkd::key::key & cKey,
     if (d->nCurrentPosition >= rawkey_length() * 8) {
         
         // create a new key: we cut the keybits at byte boundaries so max. 7 bits a lost
-        qkd::utility::memory cKeyBits = d->cBits.memory();
-        cKeyBits.resize(d->nCurrentPosition / 8);
+        qkd::utility::memory cKeyBits(d->nCurrentPosition / 8);
+        memcpy(cKeyBits.get(), d->cBits.data(), cKeyBits.size());
         cKey = qkd::key::key(d->nKeyId, cKeyBits);
         
         cKey.meta().eKeyState = qkd::key::key_state::KEY_STATE_SIFTED;
         d->nKeyId = qkd::key::key::counter().inc();
-        d->cBits = qkd::utility::bigint(d->nRawKeyLength);
+        d->cBits.clear();
         d->nCurrentPosition = 0;
         bForwardKey = true;
     }
@@ -473,6 +477,19 @@ qulonglong qkd_sifting_bb84::rawkey_length() const {
 }
 
 
+/**
+ * set the compressed base tables flag
+ * 
+ * This is decided by alice. Bob follows what alice asks for.
+ * 
+ * @param   bCompress       send compressed base tables
+ */
+void qkd_sifting_bb84::set_compress_bases(bool bCompress) {
+    std::lock_guard<std::recursive_mutex> cLock(d->cPropertyMutex);
+    d->bCompressBases = bCompress;
+}
+
+
 /**
  * sets a new key id pattern as string
  * 
@@ -520,157 +537,5 @@ void qkd_sifting_bb84::set_rawkey_length(qulonglong nLength) {
     if (d->nRawKeyLength == nLength) return;
 
     d->nRawKeyLength = nLength;
-    d->cBits.resize(d->nRawKeyLength * 8);
+    d->cBits.reserve(d->nRawKeyLength + 8);
 }
-
-
-/**
- * convert a single base to a bit
- * 
- * @param   bBit            the bit to calculate
- * @param   eBase           the base
- * @param   nQuantumEvent   the quantum event
- * @return  true, if successfully detected
- */
-bool base_to_bit(bool & bBit, bb84_base eBase, unsigned char nQuantumEvent) {
-    
-    if ((eBase != bb84_base::BB84_BASE_DIAGONAL) && (eBase != bb84_base::BB84_BASE_RECTILINEAR)) return false;
-
-    // check if we have more than 1 click (that is: if we have an odd number of clicks though)
-    if (g_nParity[nQuantumEvent]) {
-        bBit = ((nQuantumEvent & 0x55) != 0);
-    }
-    else {
-        // role a dice
-        double nRandom = 0.0;
-        qkd::utility::random_source::source() >> nRandom;
-        bBit = (nRandom >= 0.5);
-    }
-    
-    return true;
-}
-
-    
-/**
- * convert the bases to key bits
- * 
- * the given basetable will be appended to the
- * bits given of the first param. nPosition holds the
- * position to write the next bit despite the size of the 
- * bits-memory block.
- * 
- * @param   cBits           the key bits so far
- * @param   nPosition       the position within cBits to write next
- * @param   nBaseRatio      the ratio of good bases vs. all bases
- * @param   bAlice          act as alice
- * @param   cBases          the bases
- * @param   cQuantumTable   the quantum event table
- */
-void bases_to_bits(qkd::utility::bigint & cBits, 
-        uint64_t & nPosition, 
-        double & nBaseRatio, 
-        bool bAlice, qkd::utility::memory const & cBases, 
-        qkd::utility::memory const & cQuantumTable) {
-    
-    // we have 4 bases in each byte encoded
-    uint64_t nBases = cBases.size() * 4;
-
-    if ((nPosition + nBases) > cBits.bits()) cBits.resize(nPosition + nBases);
-    
-    uint64_t nErrors = 0;
-    for (uint64_t i = 0; i < cBases.size(); i++) {
-        
-        bb84_base b0 = static_cast<bb84_base>((cBases[i] & 0xC0) >> 6);
-        bb84_base b1 = static_cast<bb84_base>((cBases[i] & 0x30) >> 4);
-        bb84_base b2 = static_cast<bb84_base>((cBases[i] & 0x0C) >> 2);
-        bb84_base b3 = static_cast<bb84_base>(cBases[i] & 0x03);
-        
-        bool bBit = false;
-        
-        // base 0
-        if (base_to_bit(bBit, b0, (cQuantumTable[i * 2 + 0] & 0xF0) >> 4)) {
-            if (!bAlice) bBit = !bBit;
-            cBits.set(nPosition++, bBit);
-        }
-        else nErrors++;
-        
-        // base 1
-        if (base_to_bit(bBit, b1, cQuantumTable[i * 2 + 0] & 0x0F)) {
-            if (!bAlice) bBit = !bBit;
-            cBits.set(nPosition++, bBit);
-        }
-        else nErrors++;
-        
-        // base 2
-        if (base_to_bit(bBit, b2, (cQuantumTable[i * 2 + 1] & 0xF0) >> 4)) {
-            if (!bAlice) bBit = !bBit;
-            cBits.set(nPosition++, bBit);
-        }
-        else nErrors++;
-
-        // base 3
-        if (base_to_bit(bBit, b3, cQuantumTable[i * 2 + 1] & 0x0F)) {
-            if (!bAlice) bBit = !bBit;
-            cBits.set(nPosition++, bBit);
-        }
-        else nErrors++;
-    }
-    
-    if (!nBases) nBaseRatio = 0.0;
-    else nBaseRatio = (nBases - nErrors) / (double)nBases;
-}
-
-
-/**
- * tests a single event of the Quantum table
- * implements "squashing", Ref. arXiv:0804.3082 and following work by Luetgenhaus
- *
- * @param   nEvent          the event
- * @return  a bb84 measurement
- */
-bb84_base get_measurement(unsigned char nEvent) {
-
-    if (nEvent == 0x00) return bb84_base::BB84_BASE_INVALID;
-
-    bool bBaseDiag = (nEvent & 0x03);    // either e==0x01, 0x02, or 0x03
-    bool bBaseRect = (nEvent & 0x0C);    // either e==0x04, 0x08, or 0x0C
-
-    // clicks in both bases --> eliminate event [N. Luetkenhaus, priv.communic.]
-    if (bBaseRect & bBaseDiag) return bb84_base::BB84_BASE_INVALID;    
-
-    if (bBaseRect) return bb84_base::BB84_BASE_RECTILINEAR;
-    return bb84_base::BB84_BASE_DIAGONAL;
-}
-
-
-/**
- * turn the quantum table (detector clicks) into a table of bases
- * 
- * The basis table tells which measurement has been done at which position
- * in the quantum table 
- * 
- * a base table is memory block holding 4 bb84_base values in each byte
- *
- * @param   cQuantumTable       as received
- * @return  bases table
- */
-qkd::utility::memory quantum_table_to_base_table(qkd::utility::memory const & cQuantumTable) {
-    
-    // we have 4 detector bits for a base
-    // a base is 00, 01, 10 or 11
-    qkd::utility::memory cBases((cQuantumTable.size() + 1) / 2);
-    
-    unsigned char const * cQuantumEvent = cQuantumTable.get();
-    for (uint64_t i = 0; i < cBases.size(); i++) {
-
-        unsigned char b0 = (unsigned char)get_measurement((cQuantumEvent[i * 2 + 0] & 0xF0) >> 4);
-        unsigned char b1 = (unsigned char)get_measurement(cQuantumEvent[i * 2 + 0] & 0x0F);
-        unsigned char b2 = (unsigned char)get_measurement((cQuantumEvent[i * 2 + 1] & 0xF0) >> 4);
-        unsigned char b3 = (unsigned char)get_measurement(cQuantumEvent[i * 2 + 1] & 0x0F);
-        
-        cBases.get()[i] = (b0 << 6) | (b1 << 4) | (b2 << 2) | b3;
-    }
-
-    return cBases;
-}
-
@@ -77,11 +77,19 @@
  * (see qkd::key::key_id_counter)
  * 
  * 
+ * With compress_bases set alice asks bob to exchange the base tables
+ * as a list of positions of valid bases plus a single bit telling the
+ * base for each of them instead of 2 bits for each event. This saves
+ * bandwidth whenever most of the events hold no valid measurement.
+ * Peers not knowing about this simply exchange plain base tables.
+ * 
+ * 
  * Properties of at.ac.ait.qkd.bb84
  * 
  *      -name-              -read/write-    -description-
  * 
  *      base_ratio               R          the moving average of the last good base ratio
+ *      compress_bases          R/W         send compressed base tables (decided by alice)
  *      current_id               R          the current key id we are sifting
  *      current_length           R          the current key length in bits we have sifted so far
  *      key_id_pattern          R/W         the key id pattern used (see qkd::key::key_id_counter)
@@ -96,6 +104,7 @@ class qkd_sifting_bb84 : public qkd::module::module {
     Q_CLASSINFO("D-Bus Interface", "at.ac.ait.qkd.bb84")
 
     Q_PROPERTY(double base_ratio READ base_ratio)                                           /**< get the moving average of good bases */
+    Q_PROPERTY(bool compress_bases READ compress_bases WRITE set_compress_bases)            /**< get/set compressed base tables */
     Q_PROPERTY(qulonglong current_id READ current_id)                                       /**< get the current key id we are sifting */
     Q_PROPERTY(qulonglong current_length READ current_length)                               /**< get the current key length in bits we have sifted so far */
     Q_PROPERTY(QString key_id_pattern READ key_id_pattern WRITE set_key_id_pattern)         /**< get/set key id pattern */
@@ -119,6 +128,14 @@ public:
     double base_ratio() const;
     
     
+    /**
+     * get the compressed base tables flag
+     * 
+     * @return  true, if base tables are sent compressed
+     */
+    bool compress_bases() const;
+    
+    
     /**
      * get the current key id we are sifting
      * 
@@ -155,6 +172,16 @@ public:
     qulonglong rawkey_length() const;
     
     
+    /**
+     * set the compressed base tables flag
+     * 
+     * This is decided by alice. Bob follows what alice asks for.
+     * 
+     * @param   bCompress       send compressed base tables
+     */
+    void set_compress_bases(bool bCompress);
+    
+    
     /**
      * sets a new key id pattern as string
      * 
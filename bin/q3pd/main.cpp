@@ -64,6 +64,7 @@ int main(int argc, char ** argv) {
     cOptions.add_options()("config,c", boost::program_options::value<std::string>(), "configuration file URL");
     cOptions.add_options()("debug,d", "enable debug output on stderr");
     cOptions.add_options()("help,h", "this page");
+    cOptions.add_options()("threads,t", "run each link on a thread of its own");
     cOptions.add_options()("version,v", "print version string");
     
     boost::program_options::options_description cArgs("Arguments");
@@ -124,7 +125,7 @@ int main(int argc, char ** argv) {
     std::string sConfigFileURL;
     if (cVariableMap.count("config")) sConfigFileURL = cVariableMap["config"].as<std::string>();
     
-    qkd::q3p::node cNode(QString::fromStdString(sId), QString::fromStdString(sConfigFileURL));
+    qkd::q3p::node cNode(QString::fromStdString(sId), QString::fromStdString(sConfigFileURL), cVariableMap.count("threads") > 0);
 
     cCoreApplication.exec();
     
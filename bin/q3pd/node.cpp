@@ -97,8 +97,9 @@ static node * g_cNode = nullptr;
  * 
  * @param   sId                 ID of the node
  * @param   sConfigFileURL      URL of the config file
+ * @param   bLinkThreads        run each link on a thread of its own
  */
-node::node(QString const & sId, QString const & sConfigFileURL) : QObject(), m_sConfigFile(sConfigFileURL), m_sId(sId) {
+node::node(QString const & sId, QString const & sConfigFileURL, bool bLinkThreads) : QObject(), m_sConfigFile(sConfigFileURL), m_sId(sId), m_bLinkThreads(bLinkThreads) {
     
     if (!g_cNode) g_cNode = this;
     
@@ -143,6 +144,7 @@ node::node(QString const & sId, QString const & sConfigFileURL) : QObject(), m_s
  * dtor
  */
 node::~node() {
+    close_links();
 }
 
 
@@ -209,6 +211,7 @@ void node::apply_link_config(std::string const & sLinkIdentifier, qkd::utility::
         std::string sIPSec;             /**< IPSec setting in config */
         std::string sInject;            /**< inject file in config */
         std::string sNIC;               /**< NIC addressing and routing */
+        std::string sShm;               /**< shared memory key ring size */
         
     } cLinkConfig;
     
@@ -223,6 +226,7 @@ void node::apply_link_config(std::string const & sLinkIdentifier, qkd::utility::
     cLinkConfig.sIPSec      = (cConfig.find("ipsec")        != cConfig.end() ? cConfig.at("ipsec") : "");
     cLinkConfig.sInject     = (cConfig.find("inject")       != cConfig.end() ? cConfig.at("inject") : "");
     cLinkConfig.sNIC        = (cConfig.find("nic")          != cConfig.end() ? cConfig.at("nic") : "");
+    cLinkConfig.sShm        = (cConfig.find("shm")          != cConfig.end() ? cConfig.at("shm") : "");
     
     if (cLinkConfig.sId.empty()) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
@@ -231,7 +235,7 @@ void node::apply_link_config(std::string const & sLinkIdentifier, qkd::utility::
     }
     
     QString sId = QString::fromStdString(cConfig.at("id"));
-    if (!create_link(QString::fromStdString(cLinkConfig.sId))) return;
+    if (!create_engine(QString::fromStdString(cLinkConfig.sId))) return;
     
     qkd::q3p::engine cEngine = qkd::q3p::engine_instance::get(sId);
     if (cEngine.get() == nullptr) {
@@ -243,6 +247,7 @@ void node::apply_link_config(std::string const & sLinkIdentifier, qkd::utility::
     apply_link_config_master(cEngine, cLinkConfig.sMaster);
     apply_link_config_db(cEngine, cLinkConfig.sDb);
     apply_link_config_inject(cEngine, cLinkConfig.sInject);
+    apply_link_config_shm(cEngine, cLinkConfig.sShm);
     
     QByteArray cSharedSecret;
     if (!cLinkConfig.sSecret.empty() && !cLinkConfig.sSecretFile.empty()) {
@@ -265,15 +270,18 @@ void node::apply_link_config(std::string const & sLinkIdentifier, qkd::utility::
     apply_link_config_nic(cEngine, cLinkConfig.sNIC);
     apply_link_config_ipsec(cEngine, cLinkConfig.sIPSec);
     
+    // from here on the engine may run on its own thread: only invoke
+    if (m_bLinkThreads) start_link_thread(cEngine);
+    
     if (cLinkConfig.sListenURI.size()) {
-        cEngine->listen(QString::fromStdString(cLinkConfig.sListenURI), cSharedSecret);
+        QMetaObject::invokeMethod(cEngine.get(), "listen", Q_ARG(QString, QString::fromStdString(cLinkConfig.sListenURI)), Q_ARG(QByteArray, cSharedSecret));
     }
     else {
         qkd::utility::syslog::info() << "config for '" << sLinkIdentifier << "': insufficient listener-config - not going to listen.";
     }
 
     if (cLinkConfig.sPeerURI.size()) {
-        cEngine->connect(QString::fromStdString(cLinkConfig.sPeerURI), cSharedSecret);
+        QMetaObject::invokeMethod(cEngine.get(), "connect", Q_ARG(QString, QString::fromStdString(cLinkConfig.sPeerURI)), Q_ARG(QByteArray, cSharedSecret));
     }
     else {
         qkd::utility::syslog::info() << "config for '" << sLinkIdentifier << "': insufficient peer-config - not going to connect peer.";
@@ -422,6 +430,47 @@ void node::apply_link_config_nic(qkd::q3p::engine & cEngine, std::string const &
 }    
 
 
+/**
+ * apply a link config: "shm"
+ * 
+ * @param   cEngine             the link instance
+ * @param   sValue              the value for "shm"
+ */
+void node::apply_link_config_shm(qkd::q3p::engine & cEngine, std::string const & sValue) const {
+    
+    if (sValue.empty()) {
+        return;
+    }
+    
+    uint64_t nSize = 0;
+    try {
+        nSize = std::stoull(sValue);
+    }
+    catch (...) {
+        qkd::utility::syslog::warning() << "failed to parse shared memory key ring size for '" << cEngine->id().toStdString() << "'";
+        return;
+    }
+    
+    cEngine->set_shm_size(nSize);
+}
+
+
+/**
+ * close all links and stop their threads
+ */
+void node::close_links() {
+    
+    qkd::q3p::engine_instance::close_all();
+    
+    for (auto cThread : m_cLinkThreads) {
+        cThread->quit();
+        cThread->wait();
+        delete cThread;
+    }
+    m_cLinkThreads.clear();
+}
+
+
 /**
  * create a set of config file hints
  * 
@@ -473,11 +522,12 @@ std::list<std::string> node::config_file_hints() const {
 
 
 /**
- * create a link instance
+ * create and register a link instance
  * 
  * @param   sName       name of the link
+ * @return  true, if the link has been created
  */
-bool node::create_link(QString const & sName) {
+bool node::create_engine(QString const & sName) {
     
     try {
         qkd::q3p::engine cEngine = qkd::q3p::engine_instance::create(id(), sName);
@@ -498,6 +548,24 @@ bool node::create_link(QString const & sName) {
 }
 
 
+/**
+ * create a link instance
+ * 
+ * @param   sName       name of the link
+ */
+bool node::create_link(QString const & sName) {
+    
+    if (!create_engine(sName)) return false;
+    
+    if (m_bLinkThreads) {
+        qkd::q3p::engine cEngine = qkd::q3p::engine_instance::get(sName);
+        start_link_thread(cEngine);
+    }
+    
+    return true;
+}
+
+
 /**
  * extract the link configurations based on a set of configuration entries
  * 
@@ -550,7 +618,7 @@ QStringList node::links() {
     
     QStringList cList;
     
-    qkd::q3p::engine_map const & cEngines = qkd::q3p::engine_instance::engines();
+    qkd::q3p::engine_map cEngines = qkd::q3p::engine_instance::engines();
     for (auto & iter : cEngines) {
         cList << iter.second->link_id();
     }
@@ -730,7 +798,7 @@ QStringList node::modules() {
  */
 void node::quit() {
     qkd::utility::syslog::info() << "received quit signal. shutting down ...";
-    qkd::q3p::engine_instance::close_all();
+    close_links();
     qApp->quit();
 }
 
@@ -759,6 +827,26 @@ void node::set_random_url(QString sRandomUrl) {
 }
 
 
+/**
+ * move a link to a thread of its own
+ * 
+ * The engine takes its timers, sockets and DBus object along.
+ * DBus calls to the link are then carried out on its thread.
+ * 
+ * @param   cEngine             the link instance
+ */
+void node::start_link_thread(qkd::q3p::engine & cEngine) {
+    
+    QThread * cThread = new QThread();
+    cThread->setObjectName(cEngine->link_id());
+    cThread->start();
+    cEngine->moveToThread(cThread);
+    m_cLinkThreads.push_back(cThread);
+    
+    qkd::utility::debug() << "link '" << cEngine->link_id().toStdString() << "' runs on a thread of its own";
+}
+
+
 /**
  * trigger a new log entry
  * 
@@ -36,10 +36,12 @@
 // incs
 
 #include <exception>
+#include <list>
 #include <string>
 
 // Qt
 #include <QtCore/QObject>
+#include <QtCore/QThread>
 #include <QtDBus/QtDBus>
 
 // ait
@@ -125,6 +127,11 @@ namespace q3p {
  * 
  * 
  * Note: a UNIX epoch timestamp counts the seconds since 1/1/1970.
+ * 
+ * With link threads enabled each link (engine) runs its sockets,
+ * protocols, timers and DBus object on a QThread of its own. Thus a
+ * busy link does not delay the others and the links scale with the
+ * number of cores.
  */
 class node : public QObject {
     
@@ -149,8 +156,9 @@ public:
      * 
      * @param   sId                 ID of the node
      * @param   sConfigFileURL      URL of the config file
+     * @param   bLinkThreads        run each link on a thread of its own
      */
-    node(QString const & sId, QString const & sConfigFileURL = "");
+    node(QString const & sId, QString const & sConfigFileURL = "", bool bLinkThreads = false);
     
     
     /**
@@ -410,6 +418,21 @@ private:
     void apply_link_config_nic(qkd::q3p::engine & cEngine, std::string const & sValue) const;
     
 
+    /**
+     * apply a link config: "shm"
+     * 
+     * @param   cEngine             the link instance
+     * @param   sValue              the value for "shm"
+     */
+    void apply_link_config_shm(qkd::q3p::engine & cEngine, std::string const & sValue) const;
+    
+    
+    /**
+     * close all links and stop their threads
+     */
+    void close_links();
+    
+
     /**
      * create a set of config file hints
      * 
@@ -418,6 +441,15 @@ private:
     std::list<std::string> config_file_hints() const;
     
     
+    /**
+     * create and register a link instance
+     * 
+     * @param   sName       name of the link
+     * @return  true, if the link has been created
+     */
+    bool create_engine(QString const & sName);
+    
+    
     /**
      * extract the link configurations based on a set of configuration entries
      * 
@@ -452,6 +484,14 @@ private:
      */
     QByteArray load_link_config_secret_file(std::string const & sValue) const;
     
+    
+    /**
+     * move a link to a thread of its own
+     * 
+     * @param   cEngine             the link instance
+     */
+    void start_link_thread(qkd::q3p::engine & cEngine);
+    
 
     /**
      * the config file we loaded
@@ -465,6 +505,18 @@ private:
     QString m_sId;
     
     
+    /**
+     * run each link on a thread of its own
+     */
+    bool m_bLinkThreads;
+    
+    
+    /**
+     * the threads the links run on
+     */
+    std::list<QThread *> m_cLinkThreads;
+    
+    
     /**
      * the random source
      */
@@ -42,11 +42,22 @@
 #include <QtDBus>
 
 // ait
+#include <qkd/q3p/shm.h>
 #include <qkd/utility/dbus.h>
 #include <qkd/utility/memory.h>
 #include <qkd/version.h>
 
 
+// ------------------------------------------------------------
+// defs
+
+
+/**
+ * maximum number of bytes read at once from shared memory
+ */
+#define MAX_SHM_READ        4096
+
+
 // ------------------------------------------------------------
 // decl
 
@@ -75,6 +86,7 @@ typedef std::list<mq> mq_list;
 
 
 void dump(QString sMQ, bool bHexOutput, uint64_t nMessages);
+void dump_shm(QString sMQ, bool bHexOutput, uint64_t nMessages);
 mq_list scan_dbus();
 mq_list scan_node(QString const & sNode);
 void show_list(mq_list const & cList);
@@ -145,6 +157,50 @@ void dump(QString sMQ, bool bHexOutput, uint64_t nMessages) {
 }
 
 
+/**
+ * dump the content of a shared memory key ring to stdout
+ * 
+ * Each message is a read of up to MAX_SHM_READ bytes.
+ * 
+ * @param   sMQ             name of the shared memory ring
+ * @param   bHexOutput      if true, the output is hex
+ * @param   nMessages       number of messages to read
+ */
+void dump_shm(QString sMQ, bool bHexOutput, uint64_t nMessages) {
+    
+    // check for infinite loop
+    bool bLoopInfinite = (nMessages == 0);
+    
+    qkd::q3p::shm cRing;
+    try {
+        cRing = qkd::q3p::shm_ring::open(sMQ.toStdString());
+    }
+    catch (std::exception & cException) {
+        std::cerr << "failed to open shared memory key ring: " << cException.what() << std::endl;
+        std::cerr << "please check if '" << sMQ.toStdString() << "' really names a valid shared memory key ring." << std::endl;
+        return;
+    }
+    
+    qkd::utility::memory cMessage(MAX_SHM_READ);
+    
+    // forever ... or we have enough
+    while (bLoopInfinite || (nMessages > 0)) {
+        
+        if (!cRing->wait(1)) continue;
+        
+        uint64_t nRead = cRing->read(cMessage.get(), MAX_SHM_READ);
+        if (nRead == 0) continue;
+        
+        // output
+        if (bHexOutput) std::cout << qkd::utility::memory::wrap(cMessage.get(), nRead).as_hex() << std::endl;
+        else fwrite(cMessage.get(), nRead, 1, stdout);
+        
+        // check if we have enough
+        if (nMessages) nMessages--;
+    }
+}
+
+
 /**
  * start
  * 
@@ -164,6 +220,7 @@ int main(int argc, char ** argv) {
     cOptions.add_options()("help,h", "this page");
     cOptions.add_options()("number,n", boost::program_options::value<uint64_t>(), "number of keys to withdraw from queue");
     cOptions.add_options()("scan,s", "scan system for available message queues");
+    cOptions.add_options()("shm,m", "read from the shared memory key ring instead of the message queue");
     cOptions.add_options()("version,v", "print version string");
     cOptions.add_options()("hex,x", "convert keys data to ascii hex strings");
     
@@ -208,11 +265,15 @@ int main(int argc, char ** argv) {
     QString sMQ;
     bool bHexOutput = false;
     bool bScanMQs = false;
+    bool bSharedMemory = false;
     uint64_t nMessages = 0;
     
     // check for "scan" set
     if (cVariableMap.count("scan")) bScanMQs = true;
     
+    // check for "shm" set
+    if (cVariableMap.count("shm")) bSharedMemory = true;
+    
     // check for "hex" set
     if (cVariableMap.count("hex")) bHexOutput = true;
     
@@ -243,7 +304,8 @@ int main(int argc, char ** argv) {
     }
     else {
         // dump the mq output to stdout
-        dump(sMQ, bHexOutput, nMessages);
+        if (bSharedMemory) dump_shm(sMQ, bHexOutput, nMessages);
+        else dump(sMQ, bHexOutput, nMessages);
     }
     
     return 0;
@@ -38,6 +38,7 @@
 #include <boost/program_options.hpp>
 
 // ait
+#include <qkd/crypto/scheme.h>
 #include <qkd/key/key.h>
 #include <qkd/version.h>
 
@@ -82,8 +83,8 @@ int dump(std::istream & cIn, std::ostream & cOut) {
         ss << "\tbits:                \t" << nBits << "\n";
         ss << "\tdisclosed bits:      \t" << cKey.meta().nDisclosedBits << " (" << boost::format("%05.2f") % (nDisclosedBitsRate * 100.0) << "%)\n";
         ss << "\terror rate:          \t" << cKey.meta().nErrorRate << "\n";
-        ss << "\tauth-scheme-incoming:\t" << cKey.meta().sCryptoSchemeIncoming << "\n";
-        ss << "\tauth-scheme-outgoing:\t" << cKey.meta().sCryptoSchemeOutgoing << "\n";
+        ss << "\tauth-scheme-incoming:\t" << qkd::crypto::scheme(cKey.meta().sCryptoSchemeIncoming).str() << "\n";
+        ss << "\tauth-scheme-outgoing:\t" << qkd::crypto::scheme(cKey.meta().sCryptoSchemeOutgoing).str() << "\n";
         ss << "\tstate:               \t" << cKey.state_string() << "\n";
         
         // checksum
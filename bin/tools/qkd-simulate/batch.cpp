@@ -0,0 +1,525 @@
+/*
+ * batch.cpp
+ *
+ * implements the headless batch mode of QKD simulate
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2013-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <string.h>
+
+// Qt
+#include <QtCore/QFile>
+#include <QtXml/QDomDocument>
+#include <QtXml/QDomElement>
+
+// 0MQ
+#include <zmq.h>
+
+// ait
+#include <qkd/utility/buffer.h>
+#include <qkd/utility/debug.h>
+#include <qkd/utility/random.h>
+
+#include "batch.h"
+#include "channel/channel_bb84.h"
+#include "channel/random_functions.h"
+#include "channel/ttm.h"
+#include "channel/detector/detection_modes.h"
+
+
+using namespace qkd::simulate;
+
+
+// ------------------------------------------------------------
+// defs
+
+#define BATCH_FILE_BUFFER       (1 << 20)       /**< stream buffer size of an output file */
+#define BATCH_PIPE_HWM          100             /**< high water mark (in keys) of an output pipe */
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * apply a single configuration value to a channel
+ *
+ * @param   cChannel        the channel to set up
+ * @param   sKey            the key as "section.name"
+ * @param   sValue          the value
+ * @return  false, if the key is unknown
+ * @throws  std::invalid_argument
+ * @throws  std::out_of_range
+ */
+static bool apply_value(channel & cChannel, std::string const & sKey, std::string const & sValue);
+
+
+/**
+ * create an outgoing pipe
+ *
+ * @param   cZMQContext     the ZMQ context
+ * @param   sPipe           the pipe out url
+ * @return  the ZMQ socket
+ * @throws  std::runtime_error
+ */
+static void * create_pipe(void * cZMQContext, std::string const & sPipe);
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * ctor
+ *
+ * @param   sConfigFile     path to the XML configuration
+ */
+batch::batch(std::string const & sConfigFile) : m_bPipe(false), m_cPipeAlice(nullptr), m_cPipeBob(nullptr) {
+
+    m_nBits = 0;
+    m_nKeysClaimed = 0;
+    m_nKeysWritten = 0;
+    m_bRun = false;
+
+    load(sConfigFile);
+
+    m_cZMQContext = zmq_ctx_new();
+    assert(m_cZMQContext != nullptr);
+}
+
+
+/**
+ * dtor
+ */
+batch::~batch() {
+    close_output();
+    if (m_cZMQContext) {
+        zmq_ctx_term(m_cZMQContext);
+        m_cZMQContext = nullptr;
+    }
+}
+
+
+/**
+ * apply the configuration to a channel
+ *
+ * @param   cChannel        the channel to set up
+ */
+void batch::apply(channel & cChannel) const {
+
+    // only event simulation yields keys: keep the TTM silent
+    cChannel.alice()->set_detection_mode(detection_mode::SYNC);
+    cChannel.bob()->set_detection_mode(detection_mode::SYNC);
+    cChannel.ttm().set_output_mode(ttm::OUTPUT_MODE_NONE);
+
+    for (auto const & cValue : m_cConfig) {
+        try {
+            apply_value(cChannel, cValue.first, cValue.second);
+        }
+        catch (std::exception & cException) {
+            throw std::invalid_argument("failed to set " + cValue.first + ": " + cException.what());
+        }
+    }
+
+    cChannel.update_delay_times();
+}
+
+
+/**
+ * apply a single configuration value to a channel
+ *
+ * @param   cChannel        the channel to set up
+ * @param   sKey            the key as "section.name"
+ * @param   sValue          the value
+ * @return  false, if the key is unknown
+ */
+bool apply_value(channel & cChannel, std::string const & sKey, std::string const & sValue) {
+
+    // source
+    if (sKey == "source.source_photon_rate") cChannel.source().set_photon_rate(std::stod(sValue));
+    else
+    if (sKey == "source.fiber_length") cChannel.fiber().set_length(std::stod(sValue));
+    else
+    if (sKey == "source.fiber_absorption_coeff") cChannel.fiber().set_absorption_coefficient(std::stod(sValue));
+    else
+    if (sKey == "source.source_signal_error_probability") cChannel.source().set_signal_error_probability(std::stod(sValue));
+    else
+    if (sKey == "source.sync_det_time_stnd_deviation") cChannel.set_sync_stnd_deviation(std::stod(sValue));
+    else
+    if (sKey == "source.multi_photon_rate") cChannel.source().set_multi_photon_rate(std::stod(sValue));
+    else
+    if (sKey == "source.noise_photon_rate") cChannel.fiber().set_noise_photon_rate(std::stod(sValue));
+    else
+    if (sKey == "source.simulation_end_time") cChannel.set_sim_end_time(std::stod(sValue));
+    else
+
+    // detectors: the time slot delay of alice is not used (as in the GUI)
+    if (sKey == "alice.detection_efficiency") cChannel.alice()->set_efficiency(std::stod(sValue));
+    else
+    if (sKey == "alice.dark_count_rate") cChannel.alice()->set_dark_count_rate(std::stod(sValue));
+    else
+    if (sKey == "alice.time_slot_width") cChannel.alice()->set_time_slot_width(std::stod(sValue));
+    else
+    if (sKey == "alice.time_slot_delay") {}
+    else
+    if (sKey == "alice.distance_indep_loss") cChannel.alice()->set_loss_rate(std::stod(sValue));
+    else
+    if (sKey == "alice.det_time_stnd_deviation") cChannel.alice()->set_photon_time_stnd_deviation(std::stod(sValue));
+    else
+    if (sKey == "alice.det_time_delay") cChannel.alice()->set_photon_time_delay(std::stod(sValue));
+    else
+    if (sKey == "alice.det_down_time") cChannel.alice()->set_down_time(std::stod(sValue));
+    else
+    if (sKey == "alice.table_size") cChannel.alice()->set_event_table_size(std::stoull(sValue));
+    else
+    if (sKey == "bob.detection_efficiency") cChannel.bob()->set_efficiency(std::stod(sValue));
+    else
+    if (sKey == "bob.dark_count_rate") cChannel.bob()->set_dark_count_rate(std::stod(sValue));
+    else
+    if (sKey == "bob.time_slot_width") cChannel.bob()->set_time_slot_width(std::stod(sValue));
+    else
+    if (sKey == "bob.time_slot_delay") cChannel.set_timeslot_center_shift(std::stod(sValue));
+    else
+    if (sKey == "bob.distance_indep_loss") cChannel.bob()->set_loss_rate(std::stod(sValue));
+    else
+    if (sKey == "bob.det_time_stnd_deviation") cChannel.bob()->set_photon_time_stnd_deviation(std::stod(sValue));
+    else
+    if (sKey == "bob.det_time_delay") cChannel.bob()->set_photon_time_delay(std::stod(sValue));
+    else
+    if (sKey == "bob.det_down_time") cChannel.bob()->set_down_time(std::stod(sValue));
+    else
+    if (sKey == "bob.table_size") cChannel.bob()->set_event_table_size(std::stoull(sValue));
+    else
+
+    // general: batch mode always runs sync pulse simulation and stops after N keys
+    if (sKey == "general.multi_photon_simulation") cChannel.source().set_multi_photons(sValue == "true");
+    else
+    if (sKey == "general.transmission_loss_simulation") cChannel.fiber().set_loss(sValue == "true");
+    else
+    if (sKey == "general.sync_pulse_simulation") {}
+    else
+    if (sKey == "general.inifinte_loop_simulation") {}
+    else
+
+    // output: handled by the batch itself
+    if (sKey.compare(0, 7, "output.") == 0) {}
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * close the outputs
+ */
+void batch::close_output() {
+
+    if (m_cPipeAlice) {
+        zmq_close(m_cPipeAlice);
+        m_cPipeAlice = nullptr;
+    }
+    if (m_cPipeBob) {
+        zmq_close(m_cPipeBob);
+        m_cPipeBob = nullptr;
+    }
+    if (m_cFileAlice.is_open()) m_cFileAlice.close();
+    if (m_cFileBob.is_open()) m_cFileBob.close();
+}
+
+
+/**
+ * create an outgoing pipe
+ *
+ * @param   cZMQContext     the ZMQ context
+ * @param   sPipe           the pipe out url
+ * @return  the ZMQ socket
+ */
+void * create_pipe(void * cZMQContext, std::string const & sPipe) {
+
+    void * cSocket = zmq_socket(cZMQContext, ZMQ_PUSH);
+    if (!cSocket) {
+        std::stringstream ss;
+        ss << "failed to create socket: " << strerror(zmq_errno());
+        throw std::runtime_error(ss.str());
+    }
+
+    int nHighWaterMark = BATCH_PIPE_HWM;
+    int nTimeoutPipe = -1;
+    int nLinger = 0;
+    if ((zmq_setsockopt(cSocket, ZMQ_SNDHWM, &nHighWaterMark, sizeof(nHighWaterMark)) == -1)
+            || (zmq_setsockopt(cSocket, ZMQ_SNDTIMEO, &nTimeoutPipe, sizeof(nTimeoutPipe)) == -1)
+            || (zmq_setsockopt(cSocket, ZMQ_LINGER, &nLinger, sizeof(nLinger)) == -1)
+            || (zmq_connect(cSocket, sPipe.c_str()) == -1)) {
+
+        std::stringstream ss;
+        ss << "failed to set up pipe " << sPipe << ": " << strerror(zmq_errno());
+        zmq_close(cSocket);
+        throw std::runtime_error(ss.str());
+    }
+
+    return cSocket;
+}
+
+
+/**
+ * get a configuration value
+ *
+ * @param   sKey            the key as "section.name"
+ * @return  the value or an empty string
+ */
+std::string batch::get(std::string const & sKey) const {
+    auto iter = m_cConfig.find(sKey);
+    if (iter == m_cConfig.end()) return std::string();
+    return (*iter).second;
+}
+
+
+/**
+ * load the configuration
+ *
+ * @param   sConfigFile     path to the XML configuration
+ */
+void batch::load(std::string const & sConfigFile) {
+
+    QFile cFile(QString::fromStdString(sConfigFile));
+    if (!cFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        throw std::runtime_error("failed to open " + sConfigFile);
+    }
+
+    QDomDocument cDomDoc;
+    QString sError;
+    int nLine = 0;
+    if (!cDomDoc.setContent(&cFile, &sError, &nLine)) {
+        std::stringstream ss;
+        ss << "failed to parse " << sConfigFile << " at line " << nLine << ": " << sError.toStdString();
+        throw std::runtime_error(ss.str());
+    }
+
+    QDomElement cRootElement = cDomDoc.documentElement();
+    if (cRootElement.tagName() != "qkd-simulate") {
+        throw std::runtime_error(sConfigFile + " is not a qkd-simulate configuration");
+    }
+
+    // flatten <section><name value="..." /></section> to "section.name"
+    for (QDomNode cNode = cRootElement.firstChild(); !cNode.isNull(); cNode = cNode.nextSibling()) {
+
+        QDomElement cElement = cNode.toElement();
+        if (cElement.isNull()) continue;
+
+        for (QDomNode cChild = cElement.firstChild(); !cChild.isNull(); cChild = cChild.nextSibling()) {
+
+            QDomElement cValue = cChild.toElement();
+            if (cValue.isNull()) continue;
+
+            std::string sKey = cElement.tagName().toStdString() + "." + cValue.tagName().toStdString();
+            if (!cValue.hasAttribute("value")) {
+                std::cerr << "found key \"" << sKey << "\" but with no value attribute" << std::endl;
+                continue;
+            }
+            m_cConfig[sKey] = cValue.attribute("value").toStdString();
+        }
+    }
+
+    if (get("general.sync_pulse_simulation") != "true") {
+        throw std::runtime_error("batch mode needs sync_pulse_simulation: free running simulation does not produce keys");
+    }
+
+    // drop unknown keys and check the values once on a probe channel
+    channel_bb84 cProbe;
+    for (auto iter = m_cConfig.begin(); iter != m_cConfig.end(); ) {
+        if (!apply_value(cProbe, (*iter).first, (*iter).second)) {
+            std::cerr << "unknown key \"" << (*iter).first << "\"" << std::endl;
+            iter = m_cConfig.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+    apply(cProbe);
+}
+
+
+/**
+ * open the outputs
+ */
+void batch::open_output() {
+
+    close_output();
+
+    m_bPipe = (get("output.event") != "file");
+    if (m_bPipe) {
+        m_cPipeAlice = create_pipe(m_cZMQContext, get("output.event_pipe_alice"));
+        m_cPipeBob = create_pipe(m_cZMQContext, get("output.event_pipe_bob"));
+        return;
+    }
+
+    m_cFileBufferAlice.resize(BATCH_FILE_BUFFER);
+    m_cFileAlice.rdbuf()->pubsetbuf(m_cFileBufferAlice.data(), m_cFileBufferAlice.size());
+    m_cFileAlice.open(get("output.event_file_alice"), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!m_cFileAlice.is_open()) throw std::runtime_error("failed to open " + get("output.event_file_alice"));
+
+    m_cFileBufferBob.resize(BATCH_FILE_BUFFER);
+    m_cFileBob.rdbuf()->pubsetbuf(m_cFileBufferBob.data(), m_cFileBufferBob.size());
+    m_cFileBob.open(get("output.event_file_bob"), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!m_cFileBob.is_open()) throw std::runtime_error("failed to open " + get("output.event_file_bob"));
+}
+
+
+/**
+ * run the simulation
+ *
+ * @param   nKeys           number of key pairs to generate
+ * @param   nThreads        number of parallel simulations
+ * @param   nSeed           seed of the first random stream
+ */
+void batch::run(uint64_t nKeys, unsigned int nThreads, uint64_t nSeed) {
+
+    using namespace std::chrono;
+
+    if (nThreads == 0) nThreads = 1;
+
+    open_output();
+
+    m_nBits = 0;
+    m_nKeysClaimed = 0;
+    m_nKeysWritten = 0;
+    m_sError.clear();
+    m_bRun = true;
+
+    // one channel and one random stream per thread
+    steady_clock::time_point cStart = steady_clock::now();
+    std::vector<std::thread> cThreads;
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        cThreads.emplace_back([this, nKeys, nSeed, i]() { worker(nKeys, nSeed + i); });
+    }
+
+    // report progress (on debug) until done
+    steady_clock::time_point cReport = cStart + seconds(1);
+    while (m_bRun && (m_nKeysWritten < nKeys)) {
+        std::this_thread::sleep_for(milliseconds(10));
+        if (steady_clock::now() >= cReport) {
+            double nSeconds = duration_cast<duration<double>>(steady_clock::now() - cStart).count();
+            qkd::utility::debug() << "keys: " << m_nKeysWritten << "/" << nKeys << ", " << (m_nBits / nSeconds) << " bits/s";
+            cReport += seconds(1);
+        }
+    }
+
+    for (auto & cThread : cThreads) cThread.join();
+    m_bRun = false;
+
+    // push out buffered key material before we report
+    if (m_cFileAlice.is_open()) m_cFileAlice.flush();
+    if (m_cFileBob.is_open()) m_cFileBob.flush();
+    double nSeconds = duration_cast<duration<double>>(steady_clock::now() - cStart).count();
+
+    if (!m_sError.empty()) throw std::runtime_error(m_sError);
+
+    std::cout << "generated " << m_nKeysWritten << " keys with "
+            << m_nBits << " bits in "
+            << nSeconds << " s: "
+            << (nSeconds > 0.0 ? m_nBits / nSeconds : 0.0) << " bits/s" << std::endl;
+}
+
+
+/**
+ * a single simulation thread
+ *
+ * @param   nKeys           number of key pairs to generate overall
+ * @param   nSeed           seed of this thread's random stream
+ */
+void batch::worker(uint64_t nKeys, uint64_t nSeed) {
+
+    try {
+
+        random_functions::set_thread_source(qkd::utility::random_source::create("linear-congruential:" + std::to_string(nSeed)));
+
+        channel_bb84 cChannel;
+        apply(cChannel);
+
+        while (m_bRun && (m_nKeysClaimed++ < nKeys)) {
+            write(cChannel.measure_unpaced());
+        }
+    }
+    catch (std::exception & cException) {
+        std::lock_guard<std::mutex> cLock(m_cOutputMutex);
+        if (m_sError.empty()) m_sError = cException.what();
+        m_bRun = false;
+    }
+}
+
+
+/**
+ * write a measurement to the outputs
+ *
+ * @param   cMeasurement    the measurement made
+ */
+void batch::write(measurement const & cMeasurement) {
+
+    uint64_t nBits = cMeasurement->key_alice().size() * 8;
+
+    if (m_bPipe) {
+
+        // serialize outside the lock
+        qkd::utility::buffer cBufferAlice;
+        cBufferAlice << cMeasurement->key_alice();
+        qkd::utility::buffer cBufferBob;
+        cBufferBob << cMeasurement->key_bob();
+
+        std::lock_guard<std::mutex> cLock(m_cOutputMutex);
+        if (zmq_send(m_cPipeAlice, cBufferAlice.get(), cBufferAlice.size(), 0) == -1) {
+            std::stringstream ss;
+            ss << "failed to send key to alice: " << strerror(zmq_errno());
+            throw std::runtime_error(ss.str());
+        }
+        if (zmq_send(m_cPipeBob, cBufferBob.get(), cBufferBob.size(), 0) == -1) {
+            std::stringstream ss;
+            ss << "failed to send key to bob: " << strerror(zmq_errno());
+            throw std::runtime_error(ss.str());
+        }
+    }
+    else {
+
+        std::lock_guard<std::mutex> cLock(m_cOutputMutex);
+        m_cFileAlice << cMeasurement->key_alice();
+        m_cFileBob << cMeasurement->key_bob();
+        if (!m_cFileAlice.good() || !m_cFileBob.good()) {
+            throw std::runtime_error("failed to write keys to the event files");
+        }
+    }
+
+    m_nBits += nBits;
+    m_nKeysWritten++;
+}
@@ -0,0 +1,272 @@
+/*
+ * batch.h
+ *
+ * declares the headless batch mode of QKD simulate
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2013-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_QKD_SIMULATE_BATCH_H_
+#define __QKD_QKD_SIMULATE_BATCH_H_
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <inttypes.h>
+
+// ait
+#include "channel/channel.h"
+#include "channel/measurement.h"
+
+
+// ------------------------------------------------------------
+// decl
+
+
+namespace qkd {
+
+namespace simulate {
+
+
+/**
+ * This runs the simulation without any GUI.
+ *
+ * The configuration file is the very same XML the GUI loads
+ * and saves. Only the event (sync pulse) simulation produces
+ * keys, so "sync_pulse_simulation" must be set.
+ *
+ * Each thread runs its own channel with its own random stream
+ * and does not wait for the simulated acquisition time. All
+ * key pairs are pushed into the event pipes or appended to the
+ * event files named in the <output> section.
+ */
+class batch {
+
+
+public:
+
+
+    /**
+     * ctor
+     *
+     * @param   sConfigFile     path to the XML configuration
+     * @throws  std::runtime_error
+     */
+    explicit batch(std::string const & sConfigFile);
+
+
+    /**
+     * copy ctor
+     */
+    batch(batch const & rhs) = delete;
+
+
+    /**
+     * dtor
+     */
+    ~batch();
+
+
+    /**
+     * run the simulation
+     *
+     * This returns when nKeys key pairs have been written.
+     *
+     * @param   nKeys           number of key pairs to generate
+     * @param   nThreads        number of parallel simulations
+     * @param   nSeed           seed of the first random stream
+     * @throws  std::runtime_error
+     */
+    void run(uint64_t nKeys, unsigned int nThreads, uint64_t nSeed);
+
+
+private:
+
+
+    /**
+     * apply the configuration to a channel
+     *
+     * @param   cChannel        the channel to set up
+     * @throws  std::invalid_argument
+     * @throws  std::out_of_range
+     */
+    void apply(channel & cChannel) const;
+
+
+    /**
+     * close the outputs
+     */
+    void close_output();
+
+
+    /**
+     * get a configuration value
+     *
+     * @param   sKey            the key as "section.name"
+     * @return  the value or an empty string
+     */
+    std::string get(std::string const & sKey) const;
+
+
+    /**
+     * load the configuration
+     *
+     * @param   sConfigFile     path to the XML configuration
+     * @throws  std::runtime_error
+     */
+    void load(std::string const & sConfigFile);
+
+
+    /**
+     * open the outputs
+     *
+     * @throws  std::runtime_error
+     */
+    void open_output();
+
+
+    /**
+     * a single simulation thread
+     *
+     * @param   nKeys           number of key pairs to generate overall
+     * @param   nSeed           seed of this thread's random stream
+     */
+    void worker(uint64_t nKeys, uint64_t nSeed);
+
+
+    /**
+     * write a measurement to the outputs
+     *
+     * @param   cMeasurement    the measurement made
+     * @throws  std::runtime_error
+     */
+    void write(measurement const & cMeasurement);
+
+
+    /**
+     * bits written so far (per side)
+     */
+    std::atomic<uint64_t> m_nBits;
+
+
+    /**
+     * key pairs claimed by the threads so far
+     */
+    std::atomic<uint64_t> m_nKeysClaimed;
+
+
+    /**
+     * key pairs written so far
+     */
+    std::atomic<uint64_t> m_nKeysWritten;
+
+
+    /**
+     * the configuration values as "section.name" --> value
+     */
+    std::map<std::string, std::string> m_cConfig;
+
+
+    /**
+     * the first error seen by a thread
+     */
+    std::string m_sError;
+
+
+    /**
+     * output stream for alice file
+     */
+    std::ofstream m_cFileAlice;
+
+
+    /**
+     * output stream for bob file
+     */
+    std::ofstream m_cFileBob;
+
+
+    /**
+     * stream buffer for alice file
+     */
+    std::vector<char> m_cFileBufferAlice;
+
+
+    /**
+     * stream buffer for bob file
+     */
+    std::vector<char> m_cFileBufferBob;
+
+
+    /**
+     * serializes writes to the outputs
+     */
+    std::mutex m_cOutputMutex;
+
+
+    /**
+     * push key pairs to pipes instead of files
+     */
+    bool m_bPipe;
+
+
+    /**
+     * outgoing 0MQ socket of the pipe for Alice
+     */
+    void * m_cPipeAlice;
+
+
+    /**
+     * outgoing 0MQ socket of the pipe for Bob
+     */
+    void * m_cPipeBob;
+
+
+    /**
+     * threads keep on running while this is true
+     */
+    std::atomic<bool> m_bRun;
+
+
+    /**
+     * our ZMQ context used
+     */
+    void * m_cZMQContext;
+};
+
+
+}
+
+}
+
+
+#endif
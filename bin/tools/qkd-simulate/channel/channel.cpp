@@ -140,6 +140,10 @@ void channel::detector_thread() {
         
     } while (is_looping() && is_simulation_running());
     
+    // release output files
+    if (m_cFileAlice.is_open()) m_cFileAlice.close();
+    if (m_cFileBob.is_open()) m_cFileBob.close();
+    
     m_bDetectorThreadRun = false;
 }
 
@@ -189,15 +193,15 @@ void channel::flush_measurement(qkd::simulate::measurement const &cMeasurement)
     }
     else {
         
+        // the files stay open until the detector thread ends
+        
         // file: alice
-        std::ofstream cFileAlice(get_file_alice(), std::ios_base::out | std::ios_base::app);
-        if (cFileAlice.good()) cFileAlice << cMeasurement->key_alice();
-        cFileAlice.close();
+        if (!m_cFileAlice.is_open()) m_cFileAlice.open(get_file_alice(), std::ios_base::out | std::ios_base::app);
+        if (m_cFileAlice.good()) m_cFileAlice << cMeasurement->key_alice();
         
         // file: bob
-        std::ofstream cFileBob(get_file_bob(), std::ios_base::out | std::ios_base::app);
-        if (cFileBob.good()) cFileBob << cMeasurement->key_alice();
-        cFileBob.close();
+        if (!m_cFileBob.is_open()) m_cFileBob.open(get_file_bob(), std::ios_base::out | std::ios_base::app);
+        if (m_cFileBob.good()) m_cFileBob << cMeasurement->key_bob();
     }
 }
 
@@ -406,6 +410,31 @@ measurement channel::measure() {
 }
 
 
+/**
+ * perform a measurement without the detector thread
+ * 
+ * @return  the measurement
+ */
+measurement channel::measure_unpaced() {
+    
+    if (is_simulation_running()) throw std::logic_error("channel::measure_unpaced: detector thread is running");
+    
+    // the event dispatch runs only as long as the simulation does
+    m_bDetectorThreadRun = true;
+    measurement cMeasurement;
+    try {
+        cMeasurement = measure_internal();
+    }
+    catch (...) {
+        m_bDetectorThreadRun = false;
+        throw;
+    }
+    m_bDetectorThreadRun = false;
+    
+    return cMeasurement;
+}
+
+
 /**
  * sets a pipe out 
  * 
@@ -250,6 +250,17 @@ public:
     measurement measure();
     
     
+    /**
+     * perform a measurement without the detector thread
+     * 
+     * This does not wait for the simulated acquisition time and
+     * is used to run many channels in parallel (batch mode).
+     * 
+     * @return  the measurement
+     */
+    measurement measure_unpaced();
+    
+    
     /**
      * get current round number
      * 
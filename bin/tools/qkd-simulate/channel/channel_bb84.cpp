@@ -35,6 +35,8 @@
 
 #include <math.h>
 
+#include <mutex>
+
 // ait
 #include "channel_bb84.h"
 #include "measurement_bb84.h"
@@ -45,6 +47,16 @@
 using namespace qkd::simulate;
 
 
+// ------------------------------------------------------------
+// vars
+
+
+/**
+ * guards the key id counter: batch mode measures in parallel
+ */
+static std::mutex g_cKeyIdMutex;
+
+
 // -----------------------------------------------------------------
 // code
 
@@ -94,7 +106,10 @@ measurement channel_bb84::measure_internal() {
         cMeasurementBB84->set_free_running(false);
         
         // get next key id
-        m_nKeyId = qkd::key::key::counter().inc();
+        {
+            std::lock_guard<std::mutex> cLock(g_cKeyIdMutex);
+            m_nKeyId = qkd::key::key::counter().inc();
+        }
         
         // setup final key pair
         cMeasurement->key_alice() = qkd::key::key(m_nKeyId, qkd::utility::memory(alice()->event_table_size()));
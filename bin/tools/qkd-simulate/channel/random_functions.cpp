@@ -42,6 +42,16 @@
 using namespace qkd::simulate;
 
 
+// ------------------------------------------------------------
+// vars
+
+
+/**
+ * the random source of the current thread (if any)
+ */
+static thread_local qkd::utility::random g_cThreadRandom;
+
+
 // -----------------------------------------------------------------
 // code
 
@@ -54,7 +64,7 @@ using namespace qkd::simulate;
 double random_functions::random_exponential(double nMu) {
     
     double nRandom = 0.0;
-    qkd::utility::random_source::source() >> nRandom;
+    source() >> nRandom;
     
     // avoid log(0.0) calculation afterwards
     if (nRandom == 0.0) nRandom = 1.0;
@@ -80,8 +90,8 @@ double random_functions::random_gaussian(double nMu, const double nSigma) {
     do {
 
         // choose nUniform1, nUniform2 in uniform square (-1,-1) to (+1,+1) 
-        qkd::utility::random_source::source() >> nUniform1;
-        qkd::utility::random_source::source() >> nUniform2;
+        source() >> nUniform1;
+        source() >> nUniform2;
         
         nUniform1 = -1 + 2 * nUniform1;
         nUniform2 = -1 + 2 * nUniform2;
@@ -102,7 +112,7 @@ double random_functions::random_uniform() {
     
     double nRandom = 0.0;
     
-    qkd::utility::random_source::source() >> nRandom;
+    source() >> nRandom;
     
     return nRandom;
 }
@@ -117,8 +127,29 @@ uint64_t random_functions::random_uniform_int(uint64_t nVals) {
     
     double nRandom = 0.0;
     
-    qkd::utility::random_source::source() >> nRandom;
+    source() >> nRandom;
     
     return (static_cast<uint64_t>(nRandom * (double) nVals) % nVals);
 }
 
+
+
+/**
+ * set the random source of the calling thread
+ * 
+ * @param   cRandom       the random source for this thread
+ */
+void random_functions::set_thread_source(qkd::utility::random cRandom) {
+    g_cThreadRandom = cRandom;
+}
+
+
+/**
+ * get the random source of the calling thread
+ * 
+ * @return  the random source to use
+ */
+qkd::utility::random_source & random_functions::source() {
+    if (g_cThreadRandom) return *g_cThreadRandom;
+    return *qkd::utility::random_source::source();
+}
@@ -39,6 +39,9 @@
 
 #include <inttypes.h>
 
+// ait
+#include <qkd/utility/random.h>
+
 
 // -----------------------------------------------------------------
 // decl
@@ -86,6 +89,29 @@ public:
      * @param   nVals         number of possible values
      */
     static uint64_t random_uniform_int(uint64_t nVals);
+    
+    
+    /**
+     * set the random source of the calling thread
+     * 
+     * Threads without a source of their own draw from the
+     * global qkd::utility::random_source::source(). Parallel
+     * simulations use this to get independent random streams.
+     * 
+     * @param   cRandom       the random source for this thread
+     */
+    static void set_thread_source(qkd::utility::random cRandom);
+    
+    
+private:
+    
+    
+    /**
+     * get the random source of the calling thread
+     * 
+     * @return  the random source to use
+     */
+    static qkd::utility::random_source & source();
 };
     
 }
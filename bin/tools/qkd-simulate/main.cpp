@@ -31,7 +31,11 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
+
+#include <time.h>
 
 #include <boost/program_options.hpp>
 
@@ -44,6 +48,7 @@
 #include <qkd/utility/debug.h>
 #include <qkd/version.h>
 
+#include "batch.h"
 #include "main_window.h"
 
 
@@ -67,8 +72,12 @@ int main(int argc, char ** argv) {
     
     // define program options
     boost::program_options::options_description cOptions(sApplication + "\n" + sDescription + "\n\n\t" + sSynopsis + "\n\nAllowed Options");
+    cOptions.add_options()("batch,b", boost::program_options::value<std::string>(), "run headless with the given configuration file (as saved by the GUI)");
     cOptions.add_options()("debug,d", "enable debug output on stderr");
     cOptions.add_options()("help,h", "this page");
+    cOptions.add_options()("keys,k", boost::program_options::value<uint64_t>()->default_value(1000), "number of keys to generate in batch mode");
+    cOptions.add_options()("seed,s", boost::program_options::value<uint64_t>(), "seed of the random streams in batch mode (default: current time)");
+    cOptions.add_options()("threads,t", boost::program_options::value<unsigned int>()->default_value(std::max(std::thread::hardware_concurrency(), 1u)), "number of parallel simulations in batch mode");
     cOptions.add_options()("version,v", "print version string");
     
     // construct overall options
@@ -103,6 +112,21 @@ int main(int argc, char ** argv) {
     
     // check for "debug" set
     if (cVariableMap.count("debug")) qkd::utility::debug::enabled() = true;
+    
+    // headless?
+    if (cVariableMap.count("batch")) {
+        
+        uint64_t nSeed = cVariableMap.count("seed") ? cVariableMap["seed"].as<uint64_t>() : time(nullptr);
+        try {
+            qkd::simulate::batch cBatch(cVariableMap["batch"].as<std::string>());
+            cBatch.run(cVariableMap["keys"].as<uint64_t>(), cVariableMap["threads"].as<unsigned int>(), nSeed);
+        }
+        catch (std::exception & cException) {
+            std::cerr << "batch simulation failed: " << cException.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
     // start Qt
     QApplication cApplication(argc, argv);
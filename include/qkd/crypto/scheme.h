@@ -66,6 +66,10 @@ namespace crypto {
  *          "evhash-96:02cc942de299:f4b0d86ffd53"
  *          "xor"
  *          "null"
+ * 
+ * Alternatively a scheme is initialized by the compact binary
+ * form returned by binary(). This is what the modules pass
+ * along with the keys in the key meta data.
  */
 class scheme {
 
@@ -81,6 +85,33 @@ public:
     explicit scheme(std::string const sScheme = "null");
     
     
+    /**
+     * ctor
+     * 
+     * @param   sName           the algorithm name
+     * @param   cInitKey        the init key
+     * @param   cState          the algorithm state
+     */
+    scheme(std::string const & sName, qkd::key::key const & cInitKey, qkd::utility::memory const & cState);
+    
+    
+    /**
+     * return a compact binary version of this scheme
+     * 
+     * The layout is:
+     * 
+     *      0x01 ............ marker (never the first char of a scheme string)
+     *      1 byte .......... length of the algorithm name
+     *      N bytes ......... algorithm name
+     *      2 bytes ......... length of the init key (big endian)
+     *      M bytes ......... init key
+     *      rest ............ state
+     * 
+     * @return  a string which can be used to create this scheme again
+     */
+    std::string binary() const;
+    
+    
     /**
      * returns the init key stored
      * 
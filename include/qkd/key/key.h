@@ -288,8 +288,8 @@ public:
         
         key_state eKeyState;                        /**< current key state */
         
-        std::string sCryptoSchemeIncoming;          /**< crypto context scheme string for this key for incoming communication during key distillation */
-        std::string sCryptoSchemeOutgoing;          /**< crypto context scheme string for this key for outgoing communication during key distillation */
+        std::string sCryptoSchemeIncoming;          /**< crypto context scheme (string or binary, see qkd::crypto::scheme) for this key for incoming communication during key distillation */
+        std::string sCryptoSchemeOutgoing;          /**< crypto context scheme (string or binary, see qkd::crypto::scheme) for this key for outgoing communication during key distillation */
         
         uint64_t nDisclosedBits;                    /**< number of disclosed bits during key distillation  */
         double nErrorRate;                          /**< error rate  */
@@ -558,9 +558,13 @@ public:
      * 
      * if we fail to read a key the key is equal to null()
      * 
+     * With bShareData set the key data is not copied but refers to
+     * the buffer's memory (see qkd::utility::buffer::pop_shared).
+     * 
      * @param   cBuffer     the buffer to read from
+     * @param   bShareData  share the key data with the buffer
      */
-    void read(qkd::utility::buffer & cBuffer);
+    void read(qkd::utility::buffer & cBuffer, bool bShareData = false);
 
 
     /**
@@ -659,6 +663,16 @@ private:
 };
 
 
+/**
+ * read a key_vector written by write_ranges()
+ * 
+ * @param   cBuffer     the buffer to read from
+ * @param   cKeys       receives the key ids
+ * @throws  std::out_of_range
+ */
+void read_ranges(qkd::utility::buffer & cBuffer, key_vector & cKeys);
+
+
 /**
  * subtract one key_vector from the other
  * 
@@ -669,6 +683,28 @@ private:
  * @return  a key vector containing all key_ids in lhs not in rhs
  */
 key_vector sub(key_vector const & lhs, key_vector const & rhs);
+
+
+/**
+ * write a key_vector as runs of consecutive key ids
+ * 
+ * This is the compact alternative to operator<<: a vector of 
+ * consecutive ids takes a few bytes regardless of its length.
+ * 
+ * Layout (all varints are unsigned LEB128):
+ * 
+ *      varint          number of runs
+ *      per run:
+ *          varint      start of the run - (end of previous run + 1), zigzag coded
+ *          varint      length of the run - 1
+ * 
+ * The order of the key ids is kept: unsorted vectors survive
+ * the round trip, they just take more room.
+ * 
+ * @param   cBuffer     the buffer to write to
+ * @param   cKeys       the key ids to write
+ */
+void write_ranges(qkd::utility::buffer & cBuffer, key_vector const & cKeys);
   
 
 }
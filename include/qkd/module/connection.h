@@ -165,15 +165,17 @@ public:
     /**
      * read a message
      *
-     * this call is blocking
+     * this call is blocking unless bWait is false: then it returns 
+     * at once if no message is pending
      * 
      * The given message object will be deleted with delete before assigning new values.
      * Therefore if message receive has been successful the message is not NULL
      * 
      * @param   cMessage            this will receive the message
+     * @param   bWait               wait for a message to arrive
      * @return  true, if we have received a message
      */
-    bool recv_message(qkd::module::message & cMessage);
+    bool recv_message(qkd::module::message & cMessage, bool bWait = true);
     
     
     /**
@@ -266,9 +268,10 @@ private:
      * 
      * @param   cPath       the path to receive from
      * @param   cMessage    the message to receive
+     * @param   bWait       wait for a message to arrive
      * @return  true, if we read a key
      */
-    bool recv_message(qkd::module::path & cPath, qkd::module::message & cMessage);
+    bool recv_message(qkd::module::path & cPath, qkd::module::message & cMessage, bool bWait);
     
     
     /**
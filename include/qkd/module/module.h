@@ -352,6 +352,12 @@ enum class module_type : uint8_t {
  * 
  *      -name-                      -read/write-         -description-
  * 
+ *      async_io                        R/W             read and write keys in separate I/O threads while processing
+ * 
+ *      batch_size                      R/W             maximum number of keys processed in a single workload
+ * 
+ *      batch_timeout                   R/W             milliseconds to wait for more keys to fill a workload
+ * 
  *      debug                           R/W             enable/disable debug output on stderr
  * 
  *      debug_message_flow              R/W             enable/disable debug of message flow particles on stderr
@@ -402,6 +408,8 @@ enum class module_type : uint8_t {
  * 
  *      url_pipe_out                    R/W             URL of outgoing Pipe
  * 
+ *      workers                         R/W             number of threads processing keys concurrently (reentrant modules only)
+ * 
  * 
  *      ---- statistics of a QKD module ----
  * 
@@ -450,6 +458,9 @@ class module : public QObject {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "at.ac.ait.qkd.module")
 
+    Q_PROPERTY(bool async_io READ async_io WRITE set_async_io)                                  /**< get/set read and write keys in separate I/O threads */
+    Q_PROPERTY(qulonglong batch_size READ batch_size WRITE set_batch_size)                      /**< get/set maximum number of keys in a single workload */
+    Q_PROPERTY(qulonglong batch_timeout READ batch_timeout WRITE set_batch_timeout)             /**< get/set milliseconds to wait for more keys to fill a workload */
     Q_PROPERTY(bool debug READ debug WRITE set_debug)                                           /**< get/set module debug flag */
     Q_PROPERTY(bool debug_message_flow READ debug_message_flow WRITE set_debug_message_flow)    /**< get/set module debug flag */
     Q_PROPERTY(QString description READ description)                                            /**< get the description of the module */
@@ -478,6 +489,7 @@ class module : public QObject {
     Q_PROPERTY(QString url_peer READ url_peer WRITE set_url_peer)                               /**< URL of the peer connection (where this module connected to) */
     Q_PROPERTY(QString url_pipe_in READ url_pipe_in WRITE set_url_pipe_in)                      /**< URL of incoming Pipe (serving endpoint) */
     Q_PROPERTY(QString url_pipe_out READ url_pipe_out WRITE set_url_pipe_out)                   /**< URL of outgoing Pipe */
+    Q_PROPERTY(qulonglong workers READ workers WRITE set_workers)                               /**< number of threads processing keys concurrently */
     
     Q_PROPERTY(qulonglong keys_incoming READ keys_incoming)                                     /**< total number of keys the module received so far */    
     Q_PROPERTY(qulonglong keys_outgoing READ keys_outgoing)                                     /**< total number of keys the module sent so far */    
@@ -577,6 +589,34 @@ public:
     }  
     
     
+    /**
+     * get the async I/O flag
+     * 
+     * If set, keys are read ahead and processed keys are written
+     * by separate I/O threads. This lets process() work on the
+     * next workload while the previous one is still written.
+     * 
+     * @return  true, if keys are read and written in separate I/O threads
+     */
+    bool async_io() const;
+
+
+    /**
+     * get the maximum number of keys in a single workload
+     * 
+     * @return  the maximum number of keys handed to process() at once
+     */
+    qulonglong batch_size() const;
+
+
+    /**
+     * get the time to wait for more keys to fill a workload
+     * 
+     * @return  the batch timeout in milliseconds
+     */
+    qulonglong batch_timeout() const;
+
+
     /**
      * most exact date of module birth (module process start)
      * 
@@ -1059,6 +1099,38 @@ public:
     virtual QString service_name() const;
     
 
+    /**
+     * set the async I/O flag
+     * 
+     * This is evaluated when the module starts working.
+     * 
+     * @param   bAsyncIO        read and write keys in separate I/O threads
+     */
+    void set_async_io(bool bAsyncIO);
+
+
+    /**
+     * set the maximum number of keys in a single workload
+     * 
+     * A value of 0 is treated as 1.
+     * 
+     * @param   nBatchSize      the new maximum number of keys handed to process() at once
+     */
+    void set_batch_size(qulonglong nBatchSize);
+
+
+    /**
+     * set the time to wait for more keys to fill a workload
+     * 
+     * Once the first key of a workload has been read, further keys are
+     * collected until either batch_size keys are present or this time 
+     * has elapsed.
+     * 
+     * @param   nBatchTimeout   the new batch timeout in milliseconds
+     */
+    void set_batch_timeout(qulonglong nBatchTimeout);
+
+
     /**
      * set the debug flag
      * 
@@ -1181,6 +1253,18 @@ public:
     virtual void set_url_pipe_out(QString sURL);
     
     
+    /**
+     * set the number of threads processing keys concurrently
+     * 
+     * This is only applied to modules which are reentrant and
+     * evaluated when the module starts working. A value of 0 
+     * is treated as 1.
+     * 
+     * @param   nWorkers    the new number of worker threads
+     */
+    void set_workers(qulonglong nWorkers);
+    
+    
     /**
      * runs and resumes the module as soon as possible
      * 
@@ -1339,6 +1423,14 @@ public:
     QString url_pipe_out() const;
     
     
+    /**
+     * get the number of threads processing keys concurrently
+     * 
+     * @return  the number of worker threads
+     */
+    qulonglong workers() const;
+    
+    
 public slots:
     
     
@@ -1440,6 +1532,9 @@ protected:
      *      module.ID.alice.url_peer
      *      module.ID.alice.url_pipe_in
      *      module.ID.alice.url_pipe_out
+     *      module.ID.async_io
+     *      module.ID.batch_size
+     *      module.ID.batch_timeout
      *      module.ID.bob.url_listen
      *      module.ID.bob.url_pipe_in
      *      module.ID.bob.url_pipe_out
@@ -1447,6 +1542,7 @@ protected:
      *      module.ID.random_url
      *      module.ID.synchronize_keys
      *      module.ID.synchronize_ttl
+     *      module.ID.workers
      * 
      * where ID is the module id as been resulted by the id() call.
      * 
@@ -1468,6 +1564,25 @@ protected:
     bool apply_standard_config(std::string const & sKey, std::string const & sValue);
     
    
+    /**
+     * check if the module can process several keys concurrently
+     * 
+     * A reentrant module keeps no state between keys besides 
+     * properties and statistics guarded by its own locks. Such a
+     * module may be run with a pool of worker threads (see 
+     * set_workers()): each key is processed by a worker of its
+     * own, messages from the peer are delivered by key id and the
+     * keys are forwarded in the order they have been read.
+     * Note that random() is shared by all workers and must be 
+     * guarded by the module.
+     * 
+     * Overwrite this to return true if your module qualifies.
+     * 
+     * @return  true, if process() may be called concurrently for different keys
+     */
+    virtual bool is_reentrant() const { return false; }
+    
+    
     /**
      * get the next key from the previous module
      * 
@@ -1744,6 +1859,30 @@ private:
     }
     
     
+    /**
+     * get the next key to process
+     * 
+     * This picks a key from the stash when synchronizing or reads 
+     * a new one from the previous module.
+     * 
+     * @param   cKey        this will receive the next key
+     * @return  true, if cKey is to be processed
+     */
+    bool next_key(qkd::key::key & cKey);
+
+
+    /**
+     * fill a workload with the next keys to process
+     * 
+     * This collects up to batch_size keys. After the first key
+     * further keys are waited for at most batch_timeout milliseconds.
+     * 
+     * @param   cWorkload   the workload to fill
+     * @return  number of keys placed into the workload
+     */
+    uint64_t read_workload(qkd::module::workload & cWorkload);
+
+
     /**
      * this is the entry point of the main thread worker
      */
@@ -1759,9 +1898,11 @@ private:
      * 
      * 1) as long we are PAUSED: wait
      * 2) exit if not RUNNING
-     * 3) get a key (if input Pipe has been specified)
+     * 3) get up to batch_size keys (if input Pipe has been specified)
      * 4) invoke process()
-     * 5) write key (if process return true)
+     * 5) write keys (if process return true)
+     *    with async_io set, keys are read ahead and written in separate
+     *    I/O threads while the next workload is processed
      * 6) return to 1
      * 
      * You may overwrite this method. But this changes module operation
@@ -72,6 +72,23 @@ public:
     zmq_msg() { if (zmq_msg_init(&m_cZMQMessage) == -1) throw std::runtime_error("unable to init 0MQ message"); }
     
     
+    /**
+     * ctor
+     * 
+     * the message takes the data without copying: 0MQ calls 
+     * cFree once the data is not needed anymore. If this ctor 
+     * throws cFree is not called.
+     * 
+     * @param   cData       the message data
+     * @param   nSize       size of the data
+     * @param   cFree       the 0MQ deallocation function
+     * @param   cHint       hint passed to cFree
+     */
+    zmq_msg(void * cData, size_t nSize, zmq_free_fn * cFree, void * cHint) { 
+        if (zmq_msg_init_data(&m_cZMQMessage, cData, nSize, cFree, cHint) == -1) throw std::runtime_error("unable to init 0MQ message"); 
+    }
+    
+    
     /**
      * copy ctor
      * 
@@ -312,6 +329,18 @@ public:
     int send(void * cBuffer, size_t nLength, int nZMQFlags = 0) { return zmq_send(m_cSocket, cBuffer, nLength, nZMQFlags); }
     
     
+    /**
+     * send a message over the path
+     * 
+     * on success the message is handed over to 0MQ and empty afterwards
+     * 
+     * @param   cMessage    the message to send
+     * @param   nZMQFlags   0MQ flags to use while sending
+     * @return  number of bytes sent or -1 for error
+     */
+    int send(zmq_msg & cMessage, int nZMQFlags = 0) { return zmq_msg_send(&cMessage.msg(), m_cSocket, nZMQFlags); }
+    
+    
     /**
      * get the ZMQ socket
      * 
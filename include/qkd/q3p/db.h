@@ -324,6 +324,50 @@ public:
     }
     
 
+    /**
+     * copy the key material of consecutive keys into a buffer
+     * 
+     * This copies the keys nKeyId ... nKeyId + nCount - 1 straight 
+     * from the DB into cBuffer, which must hold nCount * quantum() 
+     * bytes. The copy stops at the first key which is not valid.
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cBuffer     the buffer receiving the key material
+     * @return  number of keys copied
+     */
+    inline uint64_t get_range(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char * cBuffer) const { 
+        std::lock_guard<std::recursive_mutex> cLock(m_cMTX); 
+        return get_range_internal(nKeyId, nCount, cBuffer); 
+    }
+    
+
+    /**
+     * copy the key material of a list of keys into a buffer
+     * 
+     * Runs of consecutive key ids are copied in one go. cBuffer 
+     * must hold cKeys.size() * quantum() bytes. The copy stops at 
+     * the first key which is not valid.
+     * 
+     * @param   cKeys       the IDs of the keys
+     * @param   cBuffer     the buffer receiving the key material
+     * @return  number of keys copied
+     */
+    inline uint64_t get_range(qkd::key::key_vector const & cKeys, unsigned char * cBuffer) const { 
+        std::lock_guard<std::recursive_mutex> cLock(m_cMTX); 
+        uint64_t nCopied = 0;
+        for (uint64_t i = 0; i < cKeys.size(); ) {
+            uint64_t nRun = 1;
+            while ((i + nRun < cKeys.size()) && (cKeys[i + nRun] == cKeys[i] + nRun)) nRun++;
+            uint64_t nDone = get_range_internal(cKeys[i], nRun, cBuffer + nCopied * quantum_internal());
+            nCopied += nDone;
+            if (nDone < nRun) break;
+            i += nRun;
+        }
+        return nCopied;
+    }
+    
+
     /**
      * check if a given key has been injected
      * 
@@ -359,6 +403,25 @@ public:
     }
     
 
+    /**
+     * inserts a bunch of key material into the DB
+     * 
+     * cData holds nCount keys of quantum() bytes each. These are
+     * placed at spare places, a run of consecutive spare places is 
+     * filled with a single copy.
+     * 
+     * If the DB gets full, less than nCount keys are inserted.
+     * 
+     * @param   cData       the key material
+     * @param   nCount      number of keys in cData
+     * @return  the IDs of the new keys (in the order of cData)
+     */
+    inline qkd::key::key_vector insert_range(unsigned char const * cData, uint64_t nCount) { 
+        std::lock_guard<std::recursive_mutex> cLock(m_cMTX); 
+        return insert_range_internal(cData, nCount); 
+    }
+    
+
     /**
      * return a key counter associated with the key
      * 
@@ -494,6 +557,48 @@ public:
     }
     
 
+    /**
+     * set the key material of consecutive keys in the DB
+     * 
+     * This copies nCount * quantum() bytes of cData straight into
+     * the keys nKeyId ... nKeyId + nCount - 1.
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cData       the key material
+     * @return  number of keys set
+     */
+    inline uint64_t set_range(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char const * cData) { 
+        std::lock_guard<std::recursive_mutex> cLock(m_cMTX); 
+        return set_range_internal(nKeyId, nCount, cData); 
+    }
+    
+
+    /**
+     * set the key material of a list of keys in the DB
+     * 
+     * cData holds cKeys.size() * quantum() bytes. Runs of 
+     * consecutive key ids are set in one go.
+     * 
+     * @param   cKeys       the IDs of the keys
+     * @param   cData       the key material
+     * @return  number of keys set
+     */
+    inline uint64_t set_range(qkd::key::key_vector const & cKeys, unsigned char const * cData) { 
+        std::lock_guard<std::recursive_mutex> cLock(m_cMTX); 
+        uint64_t nSet = 0;
+        for (uint64_t i = 0; i < cKeys.size(); ) {
+            uint64_t nRun = 1;
+            while ((i + nRun < cKeys.size()) && (cKeys[i + nRun] == cKeys[i] + nRun)) nRun++;
+            uint64_t nDone = set_range_internal(cKeys[i], nRun, cData + nSet * quantum_internal());
+            nSet += nDone;
+            if (nDone < nRun) break;
+            i += nRun;
+        }
+        return nSet;
+    }
+    
+
     /**
      * set a given key to be in eventual sync
      * 
@@ -722,6 +827,19 @@ private:
     virtual qkd::key::key get_internal(qkd::key::key_id nKeyId) const = 0;
     
 
+    /**
+     * copy the key material of consecutive keys into a buffer
+     * 
+     * The copy stops at the first key which is not valid.
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cBuffer     the buffer receiving nCount * quantum() bytes
+     * @return  number of keys copied
+     */
+    virtual uint64_t get_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char * cBuffer) const = 0;
+    
+
     /**
      * inits the key-DB
      * 
@@ -761,6 +879,16 @@ private:
     virtual qkd::key::key_id insert_internal(qkd::key::key cKey) = 0;
     
 
+    /**
+     * inserts a bunch of key material into the DB
+     * 
+     * @param   cData       nCount * quantum() bytes of key material
+     * @param   nCount      number of keys in cData
+     * @return  the IDs of the new keys (in the order of cData)
+     */
+    virtual qkd::key::key_vector insert_range_internal(unsigned char const * cData, uint64_t nCount) = 0;
+    
+
     /**
      * return a key counter associated with the key
      * 
@@ -884,6 +1012,17 @@ private:
     virtual void set_internal(qkd::key::key const & cKey) = 0;
     
 
+    /**
+     * set the key material of consecutive keys in the DB
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cData       nCount * quantum() bytes of key material
+     * @return  number of keys set
+     */
+    virtual uint64_t set_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char const * cData) = 0;
+    
+
     /**
      * sets a new key count value
      * 
@@ -36,6 +36,7 @@
 // incs
 
 #include <exception>
+#include <list>
 #include <memory>
 #include <string>
 
@@ -149,6 +150,11 @@ enum class engine_state : uint8_t {
  * 
  *      -name-                      -description-
  * 
+ *      acquire()                   pull key material from the application buffer
+ *                                  (waits for key material off the engine's thread)
+ * 
+ *      acquire_latency()           latency statistics of key requests per application
+ * 
  *      close_db()                  closes the opened key DB
  *                                  one must be disconnected from the peer first
  * 
@@ -185,6 +191,12 @@ enum class engine_state : uint8_t {
  *                                  anything else but "").
  * 
  * 
+ * Keys read from the QKD pipeline are placed into a pickup store. The master 
+ * moves them in batches into the common store with the STORE protocol: each 
+ * pipeline key is cut into quantum() sized pieces and the slave is told which 
+ * common store ids have been assigned. Keys of the pickup store the slave has 
+ * not yet seen are retried on the next STORE round.
+ * 
  * The amount of keys managed by this KeyStore instance is specified by 
  * key_max - key_min. A single key has a fixed size of key_quantum in bytes.
  * Therefore the total amount of key material possible (in bytes) is
@@ -192,7 +204,7 @@ enum class engine_state : uint8_t {
  *          K = (key_max - key_min) * key_quantum
  * 
  */
-class engine_instance : public qkd::module::module {
+class engine_instance : public qkd::module::module, protected QDBusContext {
     
 
     Q_OBJECT
@@ -222,28 +234,76 @@ public:
     /**
      * request keys from the application buffer
      * 
-     * the given key material is extracted from the application buffers
-     * on both sides based on the given application identifier and size.
-     * 
-     * The method returns successfully if the requested key material has
-     * been placed into the cKeys object on both sides (local and remote).
+     * the given key material is extracted from the application buffer.
+     * The keys are agreed with the peer by the ACQUIRE protocol: the
+     * calls of an application are numbered on both sides (starting
+     * with 0 on each connection). The master picks the keys and sends
+     * the number of the call along, the slave hands the very same keys
+     * to its call with this number. Hence the n-th request of an 
+     * application on the master gets the same key material as the n-th 
+     * request of this application on the slave, even if calls in 
+     * between failed on either side.
+     * 
+     * Concurrent callers of the same application are served in the
+     * order of their arrival. A caller waits until the keys are agreed
+     * with the peer or the timeout has passed. Called on the engine's 
+     * own thread this runs a local event loop while waiting, so the 
+     * engine still talks to the peer and refills the application buffer.
      * 
      * the number of bytes requested must be a multiple of the application
      * buffer key quantum (usually 32 bits == 4 bytes).
      * 
      * the method fails:
      *  - if we lack a peer and/or if we have insufficient key material left in the application buffer
-     *  - if the peer didn't acquire keys within the timeout
+     *  - if the peer does not support the ACQUIRE protocol
+     *  - if the key material did not arrive within the timeout
+     *  - on the slave: if the master handed out a different amount of key material for the request
      * 
      * @param   cKeys           this will receive the key material (any previous content will be zapped)
      * @param   nAppId          the application id: this identifies the request on both sides
      * @param   nBytes          number of bytes requested
-     * @param   nTimeout        timeout in millisecond to wait for peer to acquire as well
+     * @param   nTimeout        timeout in millisecond to wait for key material
      * @return  true, if successful
      */
     bool acquire_keys(qkd::key::key_ring & cKeys, uint64_t nAppId, uint64_t nBytes, std::chrono::milliseconds nTimeout);
     
     
+    /**
+     * the slave answered an ACQUIRE request (master)
+     * 
+     * This is called by the ACQUIRE protocol. If the waiting
+     * acquire_keys() call gave up already the keys are released.
+     * 
+     * @param   nTicket         the request ticket
+     * @param   bGranted        the slave reserved the keys
+     * @return  true, if the keys are handed out (and the slave is to commit)
+     */
+    bool acquire_answer(uint64_t nTicket, bool bGranted);
+    
+    
+    /**
+     * the master committed keys for an application (slave)
+     * 
+     * This is called by the ACQUIRE protocol. The keys are handed
+     * out with the acquire_keys() call of the application with the
+     * same sequence number. If this call gave up already the keys
+     * are dropped: the master handed them out.
+     * 
+     * @param   nAppId          the application id
+     * @param   nSequence       the number of the call of the application
+     * @param   cKeys           the application buffer keys (reserved)
+     */
+    void acquire_grant(uint64_t nAppId, uint64_t nSequence, qkd::key::key_vector const & cKeys);
+    
+    
+    /**
+     * check if the peer supports the ACQUIRE protocol
+     * 
+     * @return  true, if application keys can be agreed with the peer
+     */
+    bool acquire_supported() const;
+    
+    
     /**
      * access to the current application buffer
      * 
@@ -319,8 +379,11 @@ public:
     
     /**
      * closes an engine
+     * 
+     * If the engine runs on a thread of its own, this
+     * is carried out on that thread and blocks until done.
      */
-    void close();
+    Q_INVOKABLE void close();
     
     
     /**
@@ -345,6 +408,18 @@ public:
     key_db const & common_store() const;
     
     
+    /**
+     * check if key id sets are sent as ranges
+     * 
+     * This is negotiated with the peer in the handshake. If set
+     * the key move protocols (LOAD, LOAD-REQUEST, STORE) use
+     * qkd::key::write_ranges() instead of plain id lists.
+     * 
+     * @return  true, if key id sets are sent as ranges
+     */
+    bool compact_key_ids() const;
+    
+    
     /**
      * configure the IPSec connection
      * 
@@ -373,6 +448,17 @@ public:
     static engine create(QString const & sNode, QString const & sId);
     
     
+    /**
+     * check if several packets are sent in a single DATA message
+     * 
+     * This is negotiated with the peer in the handshake. Else
+     * send_data() sends one DATA message per packet.
+     * 
+     * @return  true, if the peer takes DATA batches
+     */
+    bool data_batch() const;
+    
+    
     /**
      * check if we have an opened Key-DB
      * 
@@ -400,9 +486,9 @@ public:
     /**
      * list of known engines
      * 
-     * @return  the list of known engine instance
+     * @return  a copy of the list of known engine instance
      */
-    static engine_map const & engines();
+    static engine_map engines();
     
     
     /**
@@ -518,6 +604,36 @@ public:
     key_db const & outgoing_buffer() const;
     
     
+    /**
+     * the ids of the pipeline keys waiting in the pickup store
+     * 
+     * keys read from the QKD pipeline are kept in the pickup store
+     * until the STORE protocol moved them into the common store
+     * 
+     * @return  the ids of the keys in the pickup store (ascending)
+     */
+    qkd::key::key_vector pickup_keys() const;
+    
+    
+    /**
+     * place a pipeline key into the pickup store
+     * 
+     * if the pickup store is full, the oldest key is dropped
+     * 
+     * @param   cKey        the key to place
+     */
+    void pickup_put(qkd::key::key const & cKey);
+    
+    
+    /**
+     * remove a pipeline key from the pickup store
+     * 
+     * @param   nKeyId      the id of the key
+     * @return  the key removed (or qkd::key::key::null() if not present)
+     */
+    qkd::key::key pickup_take(qkd::key::key_id nKeyId);
+    
+    
     /**
      * a bunch of data from the peer has been received: handle this!
      * 
@@ -534,6 +650,17 @@ public:
     void send_data(qkd::utility::memory const & cData);
     
     
+    /**
+     * send a batch of packets to the peer
+     * 
+     * All packets are sent in a single DATA message if the peer
+     * takes DATA batches. Else each packet is sent on its own.
+     * 
+     * @param   cPackets    the packets to send
+     */
+    void send_data(std::list<qkd::utility::memory> const & cPackets);
+    
+    
     /**
      * set a new authentication scheme for incoming
      * 
@@ -552,6 +679,36 @@ public:
     void set_authentication_scheme_outgoing(QString const & sScheme);
     
     
+    /**
+     * set if the peer supports the ACQUIRE protocol
+     * 
+     * This is called by the handshake.
+     * 
+     * @param   bSupported      both sides support the ACQUIRE protocol
+     */
+    void set_acquire_supported(bool bSupported);
+    
+    
+    /**
+     * set if key id sets are sent as ranges
+     * 
+     * This is called by the handshake.
+     * 
+     * @param   bCompact        both sides support key id ranges
+     */
+    void set_compact_key_ids(bool bCompact);
+    
+    
+    /**
+     * set if several packets are sent in a single DATA message
+     * 
+     * This is called by the handshake.
+     * 
+     * @param   bBatch          both sides support DATA batches
+     */
+    void set_data_batch(bool bBatch);
+    
+    
     /**
      * set a new encryption scheme for incoming
      * 
@@ -598,6 +755,18 @@ public:
     void set_nic_ip4_remote(std::string const & sIP4);
     
     
+    /**
+     * set the size of the shared memory key ring
+     * 
+     * If not 0 application keys are delivered via a shared
+     * memory ring (see qkd::q3p::shm_ring) instead of the 
+     * message queue. This takes effect on the next connect.
+     * 
+     * @param   nSize   size of the ring in bytes (0 for the message queue)
+     */
+    void set_shm_size(uint64_t nSize);
+    
+    
     /**
      * sets the slave role on the engine
      * 
@@ -610,6 +779,14 @@ public:
     void set_slave(bool bSlave);
     
     
+    /**
+     * return the size of the shared memory key ring
+     * 
+     * @return  size of the shared memory key ring (0 if the message queue is used)
+     */
+    uint64_t shm_size() const;
+    
+    
     /**
      * check if we are slave keystore
      * 
@@ -621,6 +798,36 @@ public:
 public slots:
     
     
+    /**
+     * request keys from the application buffer (DBus)
+     * 
+     * This is acquire_keys() for DBus clients. The engine's thread 
+     * does not wait for the key material: the call is served on a 
+     * thread of its own which sends the DBus reply once done.
+     * 
+     * @param   nAppId          the application id
+     * @param   nBytes          number of bytes requested
+     * @param   nTimeout        timeout in milliseconds
+     * @return  the key material (empty on failure)
+     */
+    QByteArray acquire(qulonglong nAppId, qulonglong nBytes, qulonglong nTimeout);
+    
+    
+    /**
+     * latency statistics of acquire_keys() per application
+     * 
+     * The return list is a series of strings each one of
+     * the format:
+     * 
+     *      APPID;REQUESTS;FAILED;AVERAGE;MAXIMUM;
+     * 
+     * with latencies given in microseconds.
+     * 
+     * @return  a list of statistics, one per application
+     */
+    QStringList acquire_latency() const;
+    
+    
     /**
      * closes an opened key-DB
      */
@@ -715,6 +922,7 @@ public slots:
      * 1. LOAD (from the CommonStore keys into buffers)
      * 2. LOAD-REQUEST (from the CommonStore keys into a buffer)
      * 3. STORE (from the PickupStores into the CommonStore)
+     * 4. ACQUIRE (timeouts and expired application key grants)
      * 
      * You may trigger this call also via DBus
      */
@@ -776,6 +984,38 @@ protected:
 private slots:
     
     
+    /**
+     * acquire protocol failed
+     * 
+     * @param   nReason     reason why it failed (protocol::protocol_error code)
+     */
+    void acquire_failed(uint8_t nReason);
+    
+    
+    /**
+     * send an ACQUIRE request to the slave (master)
+     * 
+     * acquire_keys() queues this call to the engine's thread.
+     * 
+     * @param   nTicket     the request ticket
+     */
+    void acquire_request(qulonglong nTicket);
+    
+    
+    /**
+     * acquire protocol succeeded
+     */
+    void acquire_success();
+    
+    
+    /**
+     * the charge of a buffer or the common store changed
+     * 
+     * This schedules a refill of the buffers.
+     */
+    void charge_change();
+    
+    
     /**
      * data protocol failed
      * 
@@ -832,6 +1072,17 @@ private slots:
     void load_request_success();
     
     
+    /**
+     * refill the buffers from the common store
+     * 
+     * This runs LOAD and LOAD-REQUEST as soon as key material
+     * got consumed instead of waiting for the next timer tick.
+     * The message queue (or shared memory ring) is fed right 
+     * away with the keys arrived in the application buffer.
+     */
+    void refill();
+    
+    
     /**
      * a peer key store connects
      */
@@ -944,12 +1195,26 @@ private:
     explicit engine_instance(QString const & sNode, QString const & sId);
     
     
+    /**
+     * drop keys granted by the master the application never picked up (slave)
+     */
+    void acquire_expire();
+    
+    
     /**
      * calculate new state value
      */
     void calculate_state();
     
     
+    /**
+     * dispatch a message received from the peer
+     * 
+     * @param   cMessage        the message received
+     */
+    void dispatch(qkd::q3p::message & cMessage);
+    
+    
     /**
      * this is called whenever we have a key read from the qkd pipeline
      * 
@@ -99,7 +99,7 @@ namespace q3p {
  *      Z:              Compressed bit. If set the payload is compressed
  *      r:              reserved for future use
  *      Vers:           Q3P version field: ALWAYS 2 for this implementation
- *      Command:        Protocol Command (HANDSHAKE, DATA, LOAD, LOAD-REQUEST, STORE, ...)
+ *      Command:        Protocol Command (HANDSHAKE, DATA, LOAD, LOAD-REQUEST, STORE, ACQUIRE, ...)
  *      Channel:        Q3P Channel number
  *      E-KeyId:        start offset for the encryption key within the buffers
  *      A-KeyId:        start offset for the authentication key within the buffers
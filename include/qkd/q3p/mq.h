@@ -74,6 +74,10 @@ typedef std::shared_ptr<mq_instance> mq;
  * buffer at has the very same size as the application's buffer
  * quantum.
  * 
+ * If the engine has a shm_size() the keys are written into a
+ * shared memory ring of that size instead (see qkd::q3p::shm_ring).
+ * The ring has the same name as the message queue would have.
+ * 
  * The offered DBus interface is
  * 
  *      DBus Interface: "at.ac.ait.q3p.mq"
@@ -87,6 +91,8 @@ typedef std::shared_ptr<mq_instance> mq;
  * 
  *      paused              R           check if the message queue is currently paused
  * 
+ *      shared_memory       R           keys go into a shared memory ring
+ * 
  * 
  * Methods of at.ac.ait.q3p.mq
  * 
@@ -114,6 +120,7 @@ class mq_instance : public QObject {
     
     Q_PROPERTY(QString name READ name)                      /**< message queue name */
     Q_PROPERTY(bool paused READ paused)                     /**< production state of message queue */
+    Q_PROPERTY(bool shared_memory READ shared_memory)       /**< keys are delivered via shared memory */
     
 public:
     
@@ -157,6 +164,14 @@ public:
      * @return  true, if paused
      */
     inline bool paused() const { return m_bPaused; }
+    
+    
+    /**
+     * check if keys are delivered via a shared memory ring
+     * 
+     * @return  true, if keys go into shared memory instead of a message queue
+     */
+    bool shared_memory() const;
 
 
 signals:
@@ -206,6 +221,12 @@ public slots:
 private:
     
     
+    /**
+     * fill the shared memory ring with keys
+     */
+    void produce_shm();
+    
+    
     /**
      * the Q3P engine
      */
@@ -247,8 +247,10 @@ private:
     
     /**
      * the reader thread
+     * 
+     * @param   nFD         the file descriptor of the queue to read
      */
-    void reader();
+    void reader(int nFD);
     
     
     /**
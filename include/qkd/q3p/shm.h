@@ -0,0 +1,242 @@
+/*
+ * shm.h
+ *
+ * this file describes the Q3P shared memory key ring
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_Q3P_SHM_H_
+#define __QKD_Q3P_SHM_H_
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <memory>
+#include <string>
+
+#include <inttypes.h>
+
+
+// ------------------------------------------------------------
+// decls
+
+
+namespace qkd {
+
+namespace q3p {
+
+
+class shm_ring;
+typedef std::shared_ptr<shm_ring> shm;
+
+
+/**
+ * A key ring buffer in shared memory.
+ *
+ * This is an alternative to the message queue for local
+ * applications. The Q3P engine creates the ring with create()
+ * and copies key material straight from the application buffer
+ * into it. An application opens the ring by name with open()
+ * and pulls any amount of key material with read().
+ *
+ * The ring is a POSIX shared memory object (see shm_overview):
+ *
+ *      header ........ one page: magic, capacity and the
+ *                      read/write positions
+ *
+ *      key material .. capacity bytes used as a ring
+ *
+ * Key material is a plain byte stream: there are no message
+ * boundaries. Reading and writing do not involve any syscall.
+ * Only a reader waiting for key material on an empty ring
+ * sleeps on a futex within the header, which the writer wakes.
+ *
+ * There is one writer. Concurrent readers are safe, each byte
+ * is handed out once.
+ *
+ * Usage (application side):
+ *
+ *      qkd::q3p::shm cRing = qkd::q3p::shm_ring::open("/link_id");
+ *      unsigned char cKey[32];
+ *      while (cRing->wait(sizeof(cKey), 1000)) {
+ *          if (cRing->read(cKey, sizeof(cKey)) != sizeof(cKey)) continue;
+ *          ...
+ *      }
+ */
+class shm_ring {
+
+
+public:
+
+
+    /**
+     * dtor
+     *
+     * The writer removes the shared memory object.
+     */
+    ~shm_ring();
+
+
+    /**
+     * number of bytes ready to read
+     *
+     * @return  number of bytes of key material in the ring
+     */
+    uint64_t available() const;
+
+
+    /**
+     * the size of the ring
+     *
+     * @return  number of bytes the ring may hold
+     */
+    uint64_t capacity() const;
+
+
+    /**
+     * finish a write started with write_begin()
+     *
+     * @param   nSize       number of bytes placed into the ring
+     */
+    void commit(uint64_t nSize);
+
+
+    /**
+     * create a shared memory ring (writer side)
+     *
+     * An existing ring with the same name is replaced.
+     *
+     * @param   sName       name of the shared memory object (e.g. "/link_id")
+     * @param   nCapacity   minimum number of bytes the ring should hold
+     * @return  the new ring
+     * @throws  std::runtime_error
+     */
+    static shm create(std::string const & sName, uint64_t nCapacity);
+
+
+    /**
+     * number of bytes which can be written
+     *
+     * @return  number of bytes free in the ring
+     */
+    uint64_t free() const;
+
+
+    /**
+     * name of the shared memory object
+     *
+     * @return  the name of the shared memory object
+     */
+    inline std::string const & name() const { return m_sName; }
+
+
+    /**
+     * open an existing shared memory ring (reader side)
+     *
+     * @param   sName       name of the shared memory object (e.g. "/link_id")
+     * @return  the ring
+     * @throws  std::runtime_error
+     */
+    static shm open(std::string const & sName);
+
+
+    /**
+     * drop all key material in the ring
+     */
+    void purge();
+
+
+    /**
+     * read key material from the ring
+     *
+     * This does not block.
+     *
+     * @param   cBuffer     the buffer to fill
+     * @param   nSize       maximum number of bytes to read
+     * @return  number of bytes read
+     */
+    uint64_t read(unsigned char * cBuffer, uint64_t nSize);
+
+
+    /**
+     * wait until there is enough key material in the ring
+     *
+     * @param   nSize           number of bytes needed
+     * @param   nTimeoutMS      timeout in milliseconds (< 0 for no timeout)
+     * @return  true, if at least nSize bytes are available
+     */
+    bool wait(uint64_t nSize, int64_t nTimeoutMS = -1);
+
+
+    /**
+     * start writing into the ring
+     *
+     * This returns the largest free contiguous area of the ring.
+     * The caller places the key material there and calls commit().
+     *
+     * @param   nSize       on return: number of bytes free at the pointer
+     * @return  the start of the free area
+     */
+    unsigned char * write_begin(uint64_t & nSize);
+
+
+private:
+
+
+    /**
+     * ctor
+     *
+     * @param   sName       name of the shared memory object
+     * @param   bWriter     true for the writer side
+     */
+    shm_ring(std::string const & sName, bool bWriter);
+
+
+    /**
+     * name of the shared memory object
+     */
+    std::string m_sName;
+
+
+    /**
+     * true for the writer side
+     */
+    bool m_bWriter;
+
+
+    // pimpl
+    class shm_ring_data;
+    std::shared_ptr<shm_ring_data> d;
+};
+
+
+}
+
+}
+
+
+#endif
@@ -76,6 +76,7 @@
 #include <qkd/q3p/db.h>
 #include <qkd/q3p/engine.h>
 #include <qkd/q3p/message.h>
+#include <qkd/q3p/shm.h>
 
 // QKD module stuff
 #include <qkd/module/communicator.h>
@@ -260,6 +260,21 @@ public:
     }
     
     
+    /**
+     * get a memory from the current read/write position without copying
+     * 
+     * The memory returned refers to the memory area of this buffer
+     * (see memory::slice): modifying one modifies the other.
+     * 
+     * @param   m       the memory to get (out)
+     */
+    inline void pop_shared(qkd::utility::memory & m) { 
+        uint64_t nSize; pop(nSize); 
+        m = slice(m_nPosition, nSize); 
+        m_nPosition += nSize; 
+    }
+    
+    
     /**
      * get a string from the current read/write position
      * 
@@ -37,6 +37,7 @@
 
 #include <cstring>
 #include <exception>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -178,6 +179,21 @@ public:
     }
     
     
+    /**
+     * creates a memory object by adopting a memory area
+     * 
+     * the memory area is not copied. cRelease is called once the
+     * last reference to the memory area is gone. This lets a memory
+     * object own buffers of other allocators (e.g. 0MQ messages).
+     * 
+     * @param   cData       memory to be adopted
+     * @param   nSize       size of memory
+     * @param   cRelease    called with cData on release
+     * @return  a memory object
+     */
+    static memory adopt(value_t * cData, uint64_t nSize, std::function<void(value_t *)> cRelease);
+
+
     /**
      * give a hex representation of the memory
      *
@@ -374,6 +390,20 @@ public:
     inline uint64_t size() const { return m_nSize; }
 
 
+    /**
+     * get a part of the memory without copying
+     * 
+     * The returned memory object is shallow and refers to the
+     * very same memory area: it keeps the whole area alive.
+     * 
+     * @param   nOffset     offset of the part
+     * @param   nSize       size of the part
+     * @return  a memory object referring to the part
+     * @throws  std::out_of_range
+     */
+    memory slice(uint64_t nOffset, uint64_t nSize) const;
+
+
     /**
      * verify if there is just one reference to this object
      *
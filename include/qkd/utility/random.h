@@ -36,6 +36,7 @@
 // incs
 
 #include <exception>
+#include <limits>
 #include <memory>
 #include <string>
 
@@ -32,7 +32,6 @@
 // incs
 
 #include <map>
-#include <sstream>
 
 // ait
 #include <qkd/common_macros.h>
@@ -216,16 +215,7 @@ bool crypto_evhash::is_valid_input_key(qkd::key::key const & cKey) {
  * @return  a string holding the current scheme string
  */
 qkd::crypto::scheme crypto_evhash::scheme_internal() const {
-    
-    std::stringstream ss;
-    ss << "evhash-";
-    ss << d->m_cEvhash->block_size() * 8;
-    ss << ":";
-    ss << d->m_cKey.data().as_hex();
-    ss << ":";
-    ss << d->m_cEvhash->state().as_hex();
-    
-    return qkd::crypto::scheme(ss.str());
+    return qkd::crypto::scheme("evhash", d->m_cKey, d->m_cEvhash->state());
 }
 
 
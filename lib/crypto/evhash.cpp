@@ -29,10 +29,29 @@
  */
 
  
+// ------------------------------------------------------------
+// defs
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define EVHASH_HAVE_PCLMUL
+#endif
+
+
 // ------------------------------------------------------------
 // incs
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
 #include <arpa/inet.h>
+#include <endian.h>
+
+#ifdef EVHASH_HAVE_PCLMUL
+#   include <cpuid.h>
+#   include <wmmintrin.h>
+#endif
 
 #include "evhash.h"
 
@@ -41,6 +60,21 @@
 // defs
 
 
+/*
+ * Number of blocks processed with a single reduction by
+ * gf2_clmul. We precalculate alpha^1 ... alpha^EVHASH_LANES.
+ */
+#define EVHASH_LANES 8
+
+
+/*
+ * Number of keys whose precalculated tables are kept for
+ * further evhash instances. The least recently used key is
+ * dropped first.
+ */
+#define EVHASH_CACHE_SIZE 64
+
+
 /* 
  * Precalculation parameters - PRECALC_BITS must be a 
  * multiple of 8 and a divisor of BLOB_BITS - which probably
@@ -57,6 +91,15 @@
 // decl
 
 
+/**
+ * overwrite key material before the memory is released
+ * 
+ * @param   cMemory     the memory to wipe
+ * @param   nSize       number of bytes to wipe
+ */
+static void wipe(void * cMemory, std::size_t nSize);
+
+
 /**
  * this class represents a Galois Field 2
  *
@@ -539,7 +582,13 @@ public:
      * dtor
      */
     ~gf2_fast_alpha() {
-        if (m_cAlphaPow) delete [] m_cAlphaPow;
+        wipe(alpha, sizeof(alpha));
+        wipe(multiplication_table, sizeof(multiplication_table));
+        wipe(multiplication_table_2, sizeof(multiplication_table_2));
+        if (m_cAlphaPow) {
+            wipe(m_cAlphaPow, sizeof(alpha_pow) * MAX_POW);
+            delete [] m_cAlphaPow;
+        }
     }
 
 
@@ -800,6 +849,352 @@ private:
 };
 
 
+/**
+ * evaluation hash over a GF2 with carry-less multiplication
+ *
+ * This works for GF(2^64), GF(2^128) and GF(2^256) only: a field
+ * element is held in 64 bit words ("limbs") with the least 
+ * significant limb first. Multiplication is done with carry-less 
+ * multiplication of limbs (PCLMULQDQ if the CPU offers it, a
+ * portable version otherwise) followed by a reduction with the 
+ * modulus.
+ *
+ * Horner's rule is applied to EVHASH_LANES blocks at once:
+ *
+ *      t' = (t + m_1) * k^8 + m_2 * k^7 + ... + m_8 * k
+ *
+ * The 8 products are summed up unreduced and reduced once. As 
+ * this is the very same polynomial the tags are identical to 
+ * the ones of gf2_fast_alpha.
+ */
+template<unsigned int GF_BITS> class gf2_clmul {
+
+
+public:
+
+
+    static std::size_t const LIMBS = (GF_BITS % 64 == 0 ? GF_BITS / 64 : 1);
+    static std::size_t const BLOB_BYTES = GF_BITS / 8;
+
+
+    /**
+     * a field element: least significant limb first
+     */
+    typedef uint64_t limb_t[LIMBS];
+
+
+    /**
+     * ctor
+     *
+     * @param   nModulus        signature of the irreducible polynom
+     * @param   cKey            the key (alpha)
+     */
+    explicit gf2_clmul(unsigned int nModulus, qkd::utility::memory const & cKey) : m_nModulus(nModulus) {
+        
+        static_assert(GF_BITS % 64 == 0, "gf2_clmul needs a multiple of 64 bits");
+
+        m_fHorner = horner_portable;
+#ifdef EVHASH_HAVE_PCLMUL
+        if (has_pclmul()) m_fHorner = horner_pclmul;
+#endif
+
+        // k^1, k^2, ..., k^EVHASH_LANES
+        load(m_nPow[0], (unsigned char const *)cKey.get());
+        for (unsigned int i = 1; i < EVHASH_LANES; ++i) {
+            uint64_t nProduct[2 * LIMBS];
+            memset(nProduct, 0, sizeof(nProduct));
+            mul_add(nProduct, m_nPow[i - 1], m_nPow[0]);
+            reduce(m_nPow[i], nProduct, m_nModulus);
+        }
+    }
+
+
+    /**
+     * dtor
+     */
+    ~gf2_clmul() {
+        wipe(m_nPow, sizeof(m_nPow));
+    }
+
+
+    /**
+     * checks if the carry-less multiply instruction (PCLMULQDQ) is available
+     *
+     * @return  true, if the CPU has PCLMULQDQ
+     */
+    static bool has_pclmul() {
+
+        static bool const bPCLMUL = []() -> bool {
+#ifdef EVHASH_HAVE_PCLMUL
+            unsigned int nEAX = 0;
+            unsigned int nEBX = 0;
+            unsigned int nECX = 0;
+            unsigned int nEDX = 0;
+            return (__get_cpuid(1, &nEAX, &nEBX, &nECX, &nEDX) && (nECX & bit_PCLMUL));
+#else
+            return false;
+#endif
+        }();
+
+        return bPCLMUL;
+    }
+
+
+    /**
+     * apply Horner's rule for a series of blocks
+     *
+     * @param   nTag        the tag as gf2 blob (most significant word first)
+     * @param   cData       the blocks
+     * @param   nBlocks     number of blocks
+     */
+    void horner(unsigned int * nTag, char const * cData, uint64_t nBlocks) const {
+
+        static std::size_t const BLOB_INTS = GF_BITS / 32;
+
+        limb_t nLimbs;
+        for (unsigned int i = 0; i < LIMBS; ++i) {
+            nLimbs[i] = ((uint64_t)nTag[BLOB_INTS - 2 * i - 2] << 32) | nTag[BLOB_INTS - 2 * i - 1];
+        }
+
+        m_fHorner(nLimbs, m_nPow, m_nModulus, (unsigned char const *)cData, nBlocks);
+
+        for (unsigned int i = 0; i < LIMBS; ++i) {
+            nTag[BLOB_INTS - 2 * i - 2] = (unsigned int)(nLimbs[i] >> 32);
+            nTag[BLOB_INTS - 2 * i - 1] = (unsigned int)nLimbs[i];
+        }
+    }
+
+
+private:
+
+
+    /**
+     * a horner kernel
+     */
+    typedef void (* horner_kernel)(limb_t & nTag, limb_t const * nPow, uint64_t nModulus, unsigned char const * cData, uint64_t nBlocks);
+
+
+    /**
+     * portable carry-less multiplication of two words
+     *
+     * @param   nA          first factor
+     * @param   nB          second factor
+     * @param   nLow        lower 64 bits of the product
+     * @param   nHigh       upper 64 bits of the product
+     */
+    static inline void clmul(uint64_t nA, uint64_t nB, uint64_t & nLow, uint64_t & nHigh) {
+
+        // multiples of nB with all 4 bit polynomials (top bits are lost here)
+        uint64_t nTable[16];
+        nTable[0] = 0;
+        nTable[1] = nB;
+        for (unsigned int i = 2; i < 16; i += 2) {
+            nTable[i] = nTable[i >> 1] << 1;
+            nTable[i + 1] = nTable[i] ^ nB;
+        }
+
+        uint64_t l = nTable[nA & 0x0f];
+        uint64_t h = 0;
+        for (unsigned int i = 4; i < 64; i += 4) {
+            uint64_t g = nTable[(nA >> i) & 0x0f];
+            l ^= g << i;
+            h ^= g >> (64 - i);
+        }
+
+        // repair the bits of nB shifted out of the table entries
+        h ^= (nA & (UINT64_C(0) - ((nB >> 63) & 1)) & UINT64_C(0xeeeeeeeeeeeeeeee)) >> 1;
+        h ^= (nA & (UINT64_C(0) - ((nB >> 62) & 1)) & UINT64_C(0xcccccccccccccccc)) >> 2;
+        h ^= (nA & (UINT64_C(0) - ((nB >> 61) & 1)) & UINT64_C(0x8888888888888888)) >> 3;
+
+        nLow = l;
+        nHigh = h;
+    }
+
+
+    /**
+     * apply Horner's rule with portable carry-less multiplication
+     *
+     * @param   nTag        the tag
+     * @param   nPow        k^1 ... k^EVHASH_LANES
+     * @param   nModulus    signature of the irreducible polynom
+     * @param   cData       the blocks
+     * @param   nBlocks     number of blocks
+     */
+    static void horner_portable(limb_t & nTag, limb_t const * nPow, uint64_t nModulus, unsigned char const * cData, uint64_t nBlocks) {
+
+        limb_t nBlock;
+        uint64_t nProduct[2 * LIMBS];
+
+        while (nBlocks > 0) {
+
+            unsigned int nLanes = (nBlocks >= EVHASH_LANES ? EVHASH_LANES : 1);
+            memset(nProduct, 0, sizeof(nProduct));
+
+            for (unsigned int j = 0; j < nLanes; ++j) {
+                load(nBlock, cData + j * BLOB_BYTES);
+                if (j == 0) for (unsigned int i = 0; i < LIMBS; ++i) nBlock[i] ^= nTag[i];
+                mul_add(nProduct, nBlock, nPow[nLanes - 1 - j]);
+            }
+            reduce(nTag, nProduct, nModulus);
+
+            cData += nLanes * BLOB_BYTES;
+            nBlocks -= nLanes;
+        }
+    }
+
+
+#ifdef EVHASH_HAVE_PCLMUL
+
+    /**
+     * apply Horner's rule with PCLMULQDQ
+     *
+     * @param   nTag        the tag
+     * @param   nPow        k^1 ... k^EVHASH_LANES
+     * @param   nModulus    signature of the irreducible polynom
+     * @param   cData       the blocks
+     * @param   nBlocks     number of blocks
+     */
+    __attribute__((target("pclmul,sse2")))
+    static void horner_pclmul(limb_t & nTag, limb_t const * nPow, uint64_t nModulus, unsigned char const * cData, uint64_t nBlocks) {
+
+        limb_t nBlock;
+        uint64_t nProduct[2 * LIMBS];
+
+        // sums of the products along each diagonal i + j = k
+        __m128i cDiagonal[2 * LIMBS - 1];
+
+        while (nBlocks > 0) {
+
+            unsigned int nLanes = (nBlocks >= EVHASH_LANES ? EVHASH_LANES : 1);
+            for (unsigned int k = 0; k < 2 * LIMBS - 1; ++k) cDiagonal[k] = _mm_setzero_si128();
+
+            for (unsigned int j = 0; j < nLanes; ++j) {
+                load(nBlock, cData + j * BLOB_BYTES);
+                if (j == 0) for (unsigned int i = 0; i < LIMBS; ++i) nBlock[i] ^= nTag[i];
+                limb_t const & nFactor = nPow[nLanes - 1 - j];
+                for (unsigned int i = 0; i < LIMBS; ++i) {
+                    __m128i cA = _mm_cvtsi64_si128((long long)nBlock[i]);
+                    for (unsigned int l = 0; l < LIMBS; ++l) {
+                        __m128i cB = _mm_cvtsi64_si128((long long)nFactor[l]);
+                        cDiagonal[i + l] = _mm_xor_si128(cDiagonal[i + l], _mm_clmulepi64_si128(cA, cB, 0x00));
+                    }
+                }
+            }
+
+            memset(nProduct, 0, sizeof(nProduct));
+            for (unsigned int k = 0; k < 2 * LIMBS - 1; ++k) {
+                uint64_t nSum[2];
+                _mm_storeu_si128((__m128i *)nSum, cDiagonal[k]);
+                nProduct[k] ^= nSum[0];
+                nProduct[k + 1] ^= nSum[1];
+            }
+
+            // reduce: the upper half times the modulus folds into the lower half
+            __m128i cModulus = _mm_cvtsi64_si128((long long)nModulus);
+            uint64_t nFold[LIMBS + 1];
+            memset(nFold, 0, sizeof(nFold));
+            for (unsigned int i = 0; i < LIMBS; ++i) {
+                uint64_t nSum[2];
+                _mm_storeu_si128((__m128i *)nSum, _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)nProduct[LIMBS + i]), cModulus, 0x00));
+                nFold[i] ^= nSum[0];
+                nFold[i + 1] ^= nSum[1];
+            }
+            for (unsigned int i = 0; i < LIMBS; ++i) nTag[i] = nProduct[i] ^ nFold[i];
+            nTag[0] ^= (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)nFold[LIMBS]), cModulus, 0x00));
+
+            cData += nLanes * BLOB_BYTES;
+            nBlocks -= nLanes;
+        }
+    }
+
+#endif
+
+
+    /**
+     * read a block (big endian) into limbs
+     *
+     * @param   nLimbs      the limbs
+     * @param   cData       the block
+     */
+    static inline void load(limb_t & nLimbs, unsigned char const * cData) {
+        for (unsigned int i = 0; i < LIMBS; ++i) {
+            uint64_t nWord;
+            memcpy(&nWord, cData + (LIMBS - 1 - i) * 8, 8);
+            nLimbs[i] = be64toh(nWord);
+        }
+    }
+
+
+    /**
+     * add the unreduced product of two field elements
+     *
+     * @param   nProduct    the product to add to (2 * LIMBS)
+     * @param   nA          first factor
+     * @param   nB          second factor
+     */
+    static inline void mul_add(uint64_t * nProduct, limb_t const & nA, limb_t const & nB) {
+        for (unsigned int i = 0; i < LIMBS; ++i) {
+            for (unsigned int j = 0; j < LIMBS; ++j) {
+                uint64_t nLow;
+                uint64_t nHigh;
+                clmul(nA[i], nB[j], nLow, nHigh);
+                nProduct[i + j] ^= nLow;
+                nProduct[i + j + 1] ^= nHigh;
+            }
+        }
+    }
+
+
+    /**
+     * reduce a product
+     *
+     * With f(x) = x^GF_BITS + r(x) we have x^GF_BITS = r(x). r(x) 
+     * is less than 11 bits for all our fields, so two folds suffice.
+     *
+     * @param   nResult     the field element
+     * @param   nProduct    the product (2 * LIMBS)
+     * @param   nModulus    signature of the irreducible polynom: r(x)
+     */
+    static inline void reduce(limb_t & nResult, uint64_t const * nProduct, uint64_t nModulus) {
+
+        uint64_t nFold[LIMBS + 1];
+        memset(nFold, 0, sizeof(nFold));
+        for (unsigned int i = 0; i < LIMBS; ++i) {
+            uint64_t nLow;
+            uint64_t nHigh;
+            clmul(nProduct[LIMBS + i], nModulus, nLow, nHigh);
+            nFold[i] ^= nLow;
+            nFold[i + 1] ^= nHigh;
+        }
+        for (unsigned int i = 0; i < LIMBS; ++i) nResult[i] = nProduct[i] ^ nFold[i];
+
+        uint64_t nLow;
+        uint64_t nHigh;
+        clmul(nFold[LIMBS], nModulus, nLow, nHigh);
+        nResult[0] ^= nLow;
+    }
+
+
+    /**
+     * the horner kernel used
+     */
+    horner_kernel m_fHorner;
+
+
+    /**
+     * signature of the irreducible polynom
+     */
+    uint64_t m_nModulus;
+
+
+    /**
+     * k^1 ... k^EVHASH_LANES
+     */
+    limb_t m_nPow[EVHASH_LANES];
+
+};
+
+
 /**
  * this class combines a modulus and a key with a certain GF2 plus interface methods to use it neatly
  */
@@ -866,8 +1261,11 @@ public:
         }
 
         // create the GF2 implementation with bit width, modulus and precalulcation tables
-        m_cGF2 = new gf2_fast_alpha<GF_BITS>(nModulus, bTwoStepPrecalculation, cKey.data());
+        m_cGF2 = std::shared_ptr<gf2_fast_alpha<GF_BITS> const>(new gf2_fast_alpha<GF_BITS>(nModulus, bTwoStepPrecalculation, cKey.data()));
         m_cGF2->blob_set_value(m_cTag, 0);
+        
+        // fields of 64 bit words are hashed with carry-less multiplication
+        if ((GF_BITS % 64) == 0) m_cClmul = std::shared_ptr<gf2_clmul_t const>(new gf2_clmul_t(nModulus, cKey.data()));
 
         m_cRemainder = new char[block_size()];
         m_nRemainderBytes = 0;
@@ -878,7 +1276,6 @@ public:
      * dtor
      */
     virtual ~evhash_impl() {
-        delete m_cGF2;
         delete [] m_cRemainder;
     }
 
@@ -921,6 +1318,14 @@ public:
     unsigned int block_size() const { return GF_BITS / 8; }
 
 
+    /**
+     * create a new instance with the same key and an empty tag
+     *
+     * @return  a new evhash sharing the precalculated tables
+     */
+    evhash fresh() const { return evhash(new evhash_impl<GF_BITS>(m_cGF2, m_cClmul)); }
+
+
     /**
      * get the final tag
      *
@@ -1035,6 +1440,15 @@ public:
         }
         
         // walk over all blocks
+        if (m_cClmul && (nLeft >= block_size())) {
+            
+            uint64_t nBlocks = nLeft / block_size();
+            m_cClmul->horner(m_cTag, data, nBlocks);
+            m_nBlocks += nBlocks;
+            
+            data += nBlocks * block_size();
+            nLeft -= nBlocks * block_size();
+        }
         while (nLeft >= block_size()) {
             
             update_block(data);
@@ -1058,6 +1472,26 @@ public:
 private:
 
 
+    /**
+     * carry-less multiplication for this GF2 (if suitable)
+     */
+    typedef gf2_clmul<GF_BITS % 64 == 0 ? GF_BITS : 64> gf2_clmul_t;
+
+
+    /**
+     * ctor
+     *
+     * @param   cGF2        the precalculated GF2 tables
+     * @param   cClmul      the precalculated carry-less multiplication (or NULL)
+     */
+    evhash_impl(std::shared_ptr<gf2_fast_alpha<GF_BITS> const> cGF2, std::shared_ptr<gf2_clmul_t const> cClmul) 
+            : m_cGF2(cGF2), m_cClmul(cClmul), m_nBlocks(0), m_cRemainder(nullptr), m_nRemainderBytes(0) {
+        
+        m_cGF2->blob_set_value(m_cTag, 0);
+        m_cRemainder = new char[block_size()];
+    }
+
+
     /**
      * adds a single block to the algorithm
      * 
@@ -1070,19 +1504,30 @@ private:
         // --- the hashing ---
         // Horner Rule: tag_n = (tag_(n-1) + m) * k
 
-        typename gf2_fast_alpha<GF_BITS>::blob_t coefficient;
-        m_cGF2->blob_from_memory(coefficient, data);
-        m_cGF2->add(m_cTag, coefficient, m_cTag);
-        m_cGF2->times_alpha(m_cTag, m_cTag);
+        if (m_cClmul) {
+            m_cClmul->horner(m_cTag, data, 1);
+        }
+        else {
+            typename gf2_fast_alpha<GF_BITS>::blob_t coefficient;
+            m_cGF2->blob_from_memory(coefficient, data);
+            m_cGF2->add(m_cTag, coefficient, m_cTag);
+            m_cGF2->times_alpha(m_cTag, m_cTag);
+        }
 
         m_nBlocks++;
     }
 
     
     /**
-     * the GF2 to work on
+     * the GF2 to work on (shared by all instances of the same key)
      */
-    gf2_fast_alpha<GF_BITS> * m_cGF2;
+    std::shared_ptr<gf2_fast_alpha<GF_BITS> const> m_cGF2;
+
+
+    /**
+     * carry-less multiplication for 64, 128 and 256 bit (or NULL)
+     */
+    std::shared_ptr<gf2_clmul_t const> m_cClmul;
 
 
     /**
@@ -1122,24 +1567,74 @@ private:
  * The size of the init key also determines the size of the
  * ev-hash
  * 
+ * The precalculated tables of the last EVHASH_CACHE_SIZE keys
+ * are kept: a new instance for one of these keys merely gets a
+ * fresh tag.
+ * 
  * @param   cKey        init key to create the evhash with
  * @return  an evaluation hash instance
  */
 evhash evhash_abstract::create(qkd::key::key const & cKey) {
     
+    // most recently used first, keyed by the SHA1 of the init key
+    typedef std::list<std::pair<std::string, evhash>> evhash_cache;
+    static evhash_cache cCache;
+    static std::map<std::string, evhash_cache::iterator> cCacheIndex;
+    static std::mutex cCacheMutex;
+    
+    std::string sKeyHash = cKey.data().checksum("sha1").as_hex();
+    
+    std::lock_guard<std::mutex> cLock(cCacheMutex);
+    auto cIter = cCacheIndex.find(sKeyHash);
+    if (cIter != cCacheIndex.end()) {
+        cCache.splice(cCache.begin(), cCache, (*cIter).second);
+        return (*cIter).second->second->fresh();
+    }
+    
+    evhash cEvhash;
     switch (cKey.size() * 8) {
         
     case 32:
-        return evhash(new evhash_impl<32>(cKey));
+        cEvhash = evhash(new evhash_impl<32>(cKey));
+        break;
     case 64:
-        return evhash(new evhash_impl<64>(cKey));
+        cEvhash = evhash(new evhash_impl<64>(cKey));
+        break;
     case 96:
-        return evhash(new evhash_impl<96>(cKey));
+        cEvhash = evhash(new evhash_impl<96>(cKey));
+        break;
     case 128:
-        return evhash(new evhash_impl<128>(cKey));
+        cEvhash = evhash(new evhash_impl<128>(cKey));
+        break;
     case 256:
-        return evhash(new evhash_impl<256>(cKey));
+        cEvhash = evhash(new evhash_impl<256>(cKey));
+        break;
+    default:
+        throw std::invalid_argument("no evhash available for this key size");
+    }
+    
+    cCache.push_front(std::make_pair(sKeyHash, cEvhash));
+    cCacheIndex[sKeyHash] = cCache.begin();
+    
+    // the tables of the evicted key are wiped with its last instance
+    if (cCache.size() > EVHASH_CACHE_SIZE) {
+        cCacheIndex.erase(cCache.back().first);
+        cCache.pop_back();
     }
     
-    throw std::invalid_argument("no evhash available for this key size");
+    return cEvhash->fresh();
+}
+
+
+/**
+ * overwrite key material before the memory is released
+ * 
+ * @param   cMemory     the memory to wipe
+ * @param   nSize       number of bytes to wipe
+ */
+void wipe(void * cMemory, std::size_t nSize) {
+    
+    // volatile: a memset right before a free may be optimized away
+    volatile unsigned char * c = (volatile unsigned char *)cMemory;
+    while (nSize--) *c++ = 0;
 }
@@ -113,6 +113,16 @@ public:
     static evhash create(qkd::key::key const & cKey);
 
 
+    /**
+     * create a new instance with the same key and an empty tag
+     * 
+     * The new instance shares the precalculated tables.
+     *
+     * @return  a new evaluation hash instance
+     */
+    virtual evhash fresh() const = 0;
+
+
     /**
      * get the final tag
      *
@@ -33,6 +33,8 @@
 
 #include <sstream>
 
+#include <endian.h>
+
 #include <boost/algorithm/string.hpp>
 
 // ait
@@ -47,6 +49,12 @@
 using namespace qkd::crypto;
 
 
+// ------------------------------------------------------------
+// defs
+
+#define SCHEME_BINARY_MARKER    0x01        /**< first byte of a binary scheme */
+
+
 // ------------------------------------------------------------
 // code
 
@@ -63,6 +71,33 @@ scheme::scheme(std::string const sScheme) {
     m_cInitKey = qkd::key::key();
     m_cState = qkd::utility::memory();
     
+    // compact binary scheme
+    if (!sScheme.empty() && (sScheme[0] == SCHEME_BINARY_MARKER)) {
+        
+        unsigned char const * cData = (unsigned char const *)sScheme.data();
+        uint64_t nSize = sScheme.size();
+        
+        if (nSize < 2) return;
+        uint64_t nNameSize = cData[1];
+        uint64_t nPosition = 2;
+        if (nPosition + nNameSize + 2 > nSize) return;
+        std::string sName((char const *)cData + nPosition, nNameSize);
+        nPosition += nNameSize;
+        
+        uint16_t nKeySize = 0;
+        memcpy(&nKeySize, cData + nPosition, sizeof(nKeySize));
+        nKeySize = be16toh(nKeySize);
+        nPosition += sizeof(nKeySize);
+        if (nPosition + nKeySize > nSize) return;
+        
+        m_sName = sName;
+        m_cInitKey.data() = qkd::utility::memory::duplicate(cData + nPosition, nKeySize);
+        nPosition += nKeySize;
+        if (nPosition < nSize) m_cState = qkd::utility::memory::duplicate(cData + nPosition, nSize - nPosition);
+        
+        return;
+    }
+    
     // get the tokens
     std::vector<std::string> sTokenScheme;
     boost::split(sTokenScheme, sScheme, boost::is_any_of(":"));
@@ -109,6 +144,44 @@ scheme::scheme(std::string const sScheme) {
 }
 
 
+/**
+ * ctor
+ * 
+ * @param   sName           the algorithm name
+ * @param   cInitKey        the init key
+ * @param   cState          the algorithm state
+ */
+scheme::scheme(std::string const & sName, qkd::key::key const & cInitKey, qkd::utility::memory const & cState) 
+        : m_cInitKey(cInitKey), m_sName(sName), m_cState(cState) {
+}
+
+
+/**
+ * return a compact binary version of this scheme
+ * 
+ * @return  a string which can be used to create this scheme again
+ */
+std::string scheme::binary() const {
+    
+    if (m_sName.size() > 255) throw std::length_error("crypto scheme name too long");
+    if (m_cInitKey.size() > 0xffff) throw std::length_error("crypto scheme init key too long");
+    
+    std::string res;
+    res.reserve(4 + m_sName.size() + m_cInitKey.size() + m_cState.size());
+    
+    res.push_back((char)SCHEME_BINARY_MARKER);
+    res.push_back((char)m_sName.size());
+    res.append(m_sName);
+    
+    uint16_t nKeySize = htobe16((uint16_t)m_cInitKey.size());
+    res.append((char const *)&nKeySize, sizeof(nKeySize));
+    if (m_cInitKey.size()) res.append((char const *)m_cInitKey.data().get(), m_cInitKey.size());
+    if (m_cState.size()) res.append((char const *)m_cState.get(), m_cState.size());
+    
+    return res;
+}
+
+
 /**
  * return a stringified version of this scheme
  * 
@@ -32,6 +32,8 @@
 // incs
 
 #include <iostream>
+#include <limits>
+#include <vector>
 
 
 // ait
@@ -40,6 +42,29 @@
 using namespace qkd::key;
 
 
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * read an unsigned LEB128 varint
+ * 
+ * @param   cBuffer     the buffer to read from
+ * @return  the value read
+ * @throws  std::out_of_range
+ */
+static uint64_t pop_varint(qkd::utility::buffer & cBuffer);
+
+
+/**
+ * write an unsigned LEB128 varint
+ * 
+ * @param   cBuffer     the buffer to write to
+ * @param   nValue      the value to write
+ */
+static void push_varint(qkd::utility::buffer & cBuffer, uint64_t nValue);
+
+
 // ------------------------------------------------------------
 // code
 
@@ -55,6 +80,42 @@ qkd::key::key::key_id_counter & qkd::key::key::counter() {
 }
 
 
+/**
+ * read an unsigned LEB128 varint
+ * 
+ * @param   cBuffer     the buffer to read from
+ * @return  the value read
+ */
+uint64_t pop_varint(qkd::utility::buffer & cBuffer) {
+    
+    uint64_t nValue = 0;
+    for (unsigned int nShift = 0; nShift < 64; nShift += 7) {
+        unsigned char nByte = 0;
+        cBuffer.pop(nByte);
+        nValue |= (uint64_t)(nByte & 0x7f) << nShift;
+        if ((nByte & 0x80) == 0) return nValue;
+    }
+    
+    throw std::out_of_range("varint too long");
+}
+
+
+/**
+ * write an unsigned LEB128 varint
+ * 
+ * @param   cBuffer     the buffer to write to
+ * @param   nValue      the value to write
+ */
+void push_varint(qkd::utility::buffer & cBuffer, uint64_t nValue) {
+    
+    while (nValue >= 0x80) {
+        cBuffer.push((unsigned char)(nValue | 0x80));
+        nValue >>= 7;
+    }
+    cBuffer.push((unsigned char)nValue);
+}
+
+
 /**
  * read from a buffer
  * 
@@ -96,10 +157,9 @@ void qkd::key::key::meta_data::read(std::istream & cStream) {
     cStream.read((char *)&nIncomingSchemeLength, sizeof(nIncomingSchemeLength));
     nIncomingSchemeLength = be64toh(nIncomingSchemeLength);
     if (nIncomingSchemeLength) {
-        char * sIncomingScheme = new char[nIncomingSchemeLength + 1];
+        char * sIncomingScheme = new char[nIncomingSchemeLength];
         cStream.read(sIncomingScheme, nIncomingSchemeLength);
-        sIncomingScheme[nIncomingSchemeLength] = 0;
-        this->sCryptoSchemeIncoming = sIncomingScheme;
+        this->sCryptoSchemeIncoming = std::string(sIncomingScheme, nIncomingSchemeLength);
         delete [] sIncomingScheme;
     }
     else this->sCryptoSchemeIncoming = std::string();
@@ -109,10 +169,9 @@ void qkd::key::key::meta_data::read(std::istream & cStream) {
     cStream.read((char *)&nOutgoingSchemeLength, sizeof(nOutgoingSchemeLength));
     nOutgoingSchemeLength = be64toh(nOutgoingSchemeLength);
     if (nOutgoingSchemeLength) {
-        char * sOutgoingScheme = new char[nOutgoingSchemeLength + 1];
+        char * sOutgoingScheme = new char[nOutgoingSchemeLength];
         cStream.read(sOutgoingScheme, nOutgoingSchemeLength);
-        sOutgoingScheme[nOutgoingSchemeLength] = 0;
-        this->sCryptoSchemeOutgoing = sOutgoingScheme;
+        this->sCryptoSchemeOutgoing = std::string(sOutgoingScheme, nOutgoingSchemeLength);
         delete [] sOutgoingScheme;
     }
     else this->sCryptoSchemeOutgoing = std::string();
@@ -167,12 +226,18 @@ void qkd::key::key::meta_data::write(std::ostream & cStream) const {
  * if we fail to read a key the key is equal to null()
  * 
  * @param   cBuffer     the buffer to read from
+ * @param   bShareData  share the key data with the buffer
  */
-void qkd::key::key::read(qkd::utility::buffer & cBuffer) {
+void qkd::key::key::read(qkd::utility::buffer & cBuffer, bool bShareData) {
     
     cBuffer >> m_nId;
     m_cMeta.read(cBuffer);
-    cBuffer >> m_cData;
+    if (bShareData) {
+        cBuffer.pop_shared(m_cData);
+    }
+    else {
+        cBuffer >> m_cData;
+    }
     
     // record timestamp
     m_cMeta.cTimestampRead = std::chrono::high_resolution_clock::now();
@@ -288,6 +353,35 @@ void qkd::key::key::write(std::ostream & cStream) const {
 }
 
 
+/**
+ * read a key_vector written by write_ranges()
+ * 
+ * @param   cBuffer     the buffer to read from
+ * @param   cKeys       receives the key ids
+ */
+void qkd::key::read_ranges(qkd::utility::buffer & cBuffer, qkd::key::key_vector & cKeys) {
+    
+    cKeys.clear();
+    
+    uint64_t nRuns = pop_varint(cBuffer);
+    int64_t nNext = 0;
+    for (uint64_t i = 0; i < nRuns; ++i) {
+        
+        uint64_t nDelta = pop_varint(cBuffer);
+        int64_t nStart = nNext + (int64_t)((nDelta >> 1) ^ (~(nDelta & 1) + 1));
+        uint64_t nLength = pop_varint(cBuffer) + 1;
+        
+        // the run must lie within the key id space
+        if ((nStart < 0) || ((uint64_t)nStart + nLength - 1 > std::numeric_limits<qkd::key::key_id>::max())) {
+            throw std::out_of_range("key id run out of range");
+        }
+        
+        for (uint64_t j = 0; j < nLength; ++j) cKeys.push_back((qkd::key::key_id)(nStart + j));
+        nNext = nStart + nLength;
+    }
+}
+
+
 /**
  * subtract one key_vector from the other
  * 
@@ -342,3 +436,32 @@ qkd::key::key_vector qkd::key::sub(qkd::key::key_vector const & lhs, qkd::key::k
 }
   
 
+
+/**
+ * write a key_vector as runs of consecutive key ids
+ * 
+ * @param   cBuffer     the buffer to write to
+ * @param   cKeys       the key ids to write
+ */
+void qkd::key::write_ranges(qkd::utility::buffer & cBuffer, qkd::key::key_vector const & cKeys) {
+    
+    // collect the runs as (start, length)
+    std::vector<std::pair<qkd::key::key_id, uint64_t>> cRuns;
+    for (auto nKeyId : cKeys) {
+        if (!cRuns.empty() && ((uint64_t)cRuns.back().first + cRuns.back().second == nKeyId)) {
+            cRuns.back().second++;
+        }
+        else {
+            cRuns.push_back(std::pair<qkd::key::key_id, uint64_t>(nKeyId, 1));
+        }
+    }
+    
+    push_varint(cBuffer, cRuns.size());
+    int64_t nNext = 0;
+    for (auto const & cRun : cRuns) {
+        int64_t nDelta = (int64_t)cRun.first - nNext;
+        push_varint(cBuffer, ((uint64_t)nDelta << 1) ^ (uint64_t)(nDelta >> 63));
+        push_varint(cBuffer, cRun.second - 1);
+        nNext = (int64_t)cRun.first + cRun.second;
+    }
+}
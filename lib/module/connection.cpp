@@ -33,6 +33,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <memory>
 
 // boost
 #include <boost/tokenizer.hpp>
@@ -41,6 +42,7 @@
 #include <QtCore/QString>
 #include <QtCore/QUrl>
 
+#include <qkd/common_macros.h>
 #include <qkd/exception/connection_error.h>
 #include <qkd/exception/network_error.h>
 #include <qkd/utility/buffer.h>
@@ -107,6 +109,15 @@ private:
 };
 
 
+/**
+ * release a buffer handed over to 0MQ
+ * 
+ * @param   cData       the data sent
+ * @param   cHint       the qkd::utility::buffer holding the data
+ */
+static void release_buffer(void * cData, void * cHint);
+
+
 // ------------------------------------------------------------
 // code
 
@@ -328,8 +339,8 @@ bool connection::read_key(qkd::module::path & cPath, qkd::key::key & cKey) {
         return true;
     }
     
-    zmq_msg m;
-    int nRead = cPath.recv(m);
+    std::shared_ptr<zmq_msg> cMsg(new zmq_msg);
+    int nRead = cPath.recv(*cMsg);
     if (nRead == -1) {
 
         // EAGAIN and EINTR are not critical
@@ -342,8 +353,11 @@ bool connection::read_key(qkd::module::path & cPath, qkd::key::key & cKey) {
         throw qkd::exception::network_error(ss.str());
     }
 
-    qkd::utility::buffer cData = qkd::utility::buffer(qkd::utility::memory::wrap((unsigned char *)m.data(), m.size()));
-    cData >> cKey;
+    // the key data stays in the 0MQ message buffer (no copy): 
+    // the message is closed when the last reference to the key data is gone
+    qkd::utility::buffer cData = qkd::utility::buffer(qkd::utility::memory::adopt((unsigned char *)cMsg->data(), cMsg->size(), 
+            [cMsg](qkd::utility::memory::value_t *) {}));
+    cKey.read(cData, true);
 
     return true;
 }
@@ -360,10 +374,13 @@ bool connection::read_key(qkd::module::path & cPath, qkd::key::key & cKey) {
  * This call waits explicitly for the next message been of type eType. If this
  * is NOT the case an exception is thrown.
  * 
+ * With bWait set to false this returns at once if no message is pending.
+ * 
  * @param   cMessage            this will receive the message
+ * @param   bWait               wait for a message to arrive
  * @return  true, if we have received a message
  */
-bool connection::recv_message(qkd::module::message & cMessage) {
+bool connection::recv_message(qkd::module::message & cMessage, bool bWait) {
 
     if ((d->m_eType != connection_type::LISTEN) && (d->m_eType != connection_type::PEER)) {
         throw qkd::exception::connection_error("Not a listen nor a peer connection to receive message from.");
@@ -377,7 +394,7 @@ bool connection::recv_message(qkd::module::message & cMessage) {
         return false;
     }
     
-    return recv_message(*(d->m_cPaths.front()), cMessage);
+    return recv_message(*(d->m_cPaths.front()), cMessage, bWait);
 }
 
 
@@ -386,9 +403,10 @@ bool connection::recv_message(qkd::module::message & cMessage) {
  * 
  * @param   cPath       the path to receive from
  * @param   cMessage    the message to receive
+ * @param   bWait       wait for a message to arrive
  * @return  true, if we read a key
  */
-bool connection::recv_message(qkd::module::path & cPath, qkd::module::message & cMessage) {
+bool connection::recv_message(qkd::module::path & cPath, qkd::module::message & cMessage, bool bWait) {
     
     if (cPath.is_void()) return false;
     if (cPath.is_stdin()) {
@@ -403,7 +421,10 @@ bool connection::recv_message(qkd::module::path & cPath, qkd::module::message &
         if (nReadHeader == -1) {
 
             // EAGAIN and EINTR are not critical
-            if (zmq_errno() == EAGAIN) continue;
+            if (zmq_errno() == EAGAIN) {
+                if (!bWait) return false;
+                continue;
+            }
             if (zmq_errno() == EINTR) return false;
 
             std::stringstream ss;
@@ -647,13 +668,18 @@ bool connection::write_key(qkd::module::path & cPath, qkd::key::key const & cKey
         return true;
     }
     
-    qkd::utility::buffer cBuffer;
-    cBuffer << cKey;
+    // serialize into a buffer of proper size and hand it over to 0MQ (no copy): 
+    // 0MQ releases the buffer once the message is sent
+    std::unique_ptr<qkd::utility::buffer> cBuffer(new qkd::utility::buffer);
+    cBuffer->reserve(cKey.size() + 1024);
+    (*cBuffer) << cKey;
+    zmq_msg cMsg(cBuffer->get(), cBuffer->size(), release_buffer, cBuffer.get());
+    cBuffer.release();
 
     int nWritten = 0;
     do {
         
-        nWritten = cPath.send(cBuffer.get(), cBuffer.size());
+        nWritten = cPath.send(cMsg);
         if (nWritten == -1) {
 
             // EAGAIN: currently we are not able to send: try again
@@ -728,3 +754,13 @@ int connection::zmq_socket_type() const {
     return -1;
 }
 
+
+/**
+ * release a buffer handed over to 0MQ
+ * 
+ * @param   cData       the data sent
+ * @param   cHint       the qkd::utility::buffer holding the data
+ */
+void release_buffer(UNUSED void * cData, void * cHint) {
+    delete static_cast<qkd::utility::buffer *>(cHint);
+}
@@ -33,6 +33,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <fstream>
 
 #include <boost/program_options.hpp>
@@ -165,6 +166,9 @@ void module::apply_config(UNUSED std::string const & sURL, UNUSED qkd::utility::
  *      module.ID.alice.url_peer
  *      module.ID.alice.url_pipe_in
  *      module.ID.alice.url_pipe_out
+ *      module.ID.async_io
+ *      module.ID.batch_size
+ *      module.ID.batch_timeout
  *      module.ID.bob.url_listen
  *      module.ID.bob.url_pipe_in
  *      module.ID.bob.url_pipe_out
@@ -172,6 +176,7 @@ void module::apply_config(UNUSED std::string const & sURL, UNUSED qkd::utility::
  *      module.ID.random_url
  *      module.ID.synchronize_keys
  *      module.ID.synchronize_ttl
+ *      module.ID.workers
  * 
  * where ID is the module id as been resulted by the id() call.
  * 
@@ -216,6 +221,21 @@ bool module::apply_standard_config(std::string const & sKey, std::string const &
             return true;
         }
     }
+    else
+    if (sSubKey == "async_io") {
+        set_async_io(!((sValue == "0") || (sValue == "no") || (sValue == "off") || (sValue == "false")));
+        return true;
+    }
+    else
+    if (sSubKey == "batch_size") {
+        set_batch_size(std::stoll(sValue));
+        return true;
+    }
+    else
+    if (sSubKey == "batch_timeout") {
+        set_batch_timeout(std::stoll(sValue));
+        return true;
+    }
     else 
     if (sSubKey == "bob.url_listen") {
         if (is_bob()) {
@@ -262,12 +282,47 @@ bool module::apply_standard_config(std::string const & sKey, std::string const &
         set_terminate_after(std::stoll(sValue));
         return true;
     }
+    else
+    if (sSubKey == "workers") {
+        set_workers(std::stoll(sValue));
+        return true;
+    }
     
     // here it is a known key but not applicable.
     return true;
 }
 
 
+/**
+ * get the async I/O flag
+ * 
+ * @return  true, if keys are read and written in separate I/O threads
+ */
+bool module::async_io() const {
+    return d->bAsyncIO;
+}
+
+
+/**
+ * get the maximum number of keys in a single workload
+ * 
+ * @return  the maximum number of keys handed to process() at once
+ */
+qulonglong module::batch_size() const {
+    return d->nBatchSize;
+}
+
+
+/**
+ * get the time to wait for more keys to fill a workload
+ * 
+ * @return  the batch timeout in milliseconds
+ */
+qulonglong module::batch_timeout() const {
+    return d->nBatchTimeout;
+}
+
+
 /**
  * most exact date of module birth
  * 
@@ -591,6 +646,9 @@ bool module::is_standard_config_key(std::string const & sKey) const {
     if (sSubKey == "alice.url_peer") return true;
     if (sSubKey == "alice.url_pipe_in") return true;
     if (sSubKey == "alice.url_pipe_out")  return true;
+    if (sSubKey == "async_io") return true;
+    if (sSubKey == "batch_size") return true;
+    if (sSubKey == "batch_timeout") return true;
     if (sSubKey == "bob.url_listen") return true;
     if (sSubKey == "bob.url_pipe_in") return true;
     if (sSubKey == "bob.url_pipe_out") return true;
@@ -599,6 +657,7 @@ bool module::is_standard_config_key(std::string const & sKey) const {
     if (sSubKey == "synchronize_keys") return true;
     if (sSubKey == "synchronize_ttl") return true;
     if (sSubKey == "terminate_after") return true;
+    if (sSubKey == "workers") return true;
     
     return false;
 }
@@ -632,6 +691,58 @@ void module::join() const {
 }
 
 
+/**
+ * get the next key to process
+ * 
+ * This picks a key from the stash when synchronizing or reads 
+ * a new one from the previous module.
+ * 
+ * @param   cKey        this will receive the next key
+ * @return  true, if cKey is to be processed
+ */
+bool module::next_key(qkd::key::key & cKey) {
+    
+    cKey = qkd::key::key::null();
+    if (is_synchronizing()) {
+        try {
+            synchronize();
+            cKey = d->cStash->pick();
+        }
+        catch (std::exception const & e) {
+            qkd::utility::debug() << "Caugth exception while key-sync: " << e.what();
+            cKey = qkd::key::key::null();
+        }
+    }
+    if (!cKey.is_null()) {
+        qkd::utility::debug() << "key #" << cKey.id() << " is present at peer - picked";
+        return true;
+    }
+    
+    if (d->reading_ahead()) {
+        if (!d->pick_read_key(cKey)) return false;
+    }
+    else {
+        if (!read(cKey)) return false;
+    }
+    
+    if (!accept(cKey)) {
+        qkd::utility::debug() << "key " << cKey.id() << " is not accepted by this module";
+        return false;
+    }
+    
+    qkd::module::module_state eState = get_state();
+    while (eState == qkd::module::module_state::STATE_READY) eState = wait_for_state_change(eState);
+    if (eState != qkd::module::module_state::STATE_RUNNING) return false;
+    
+    if (is_synchronizing()) {
+        d->cStash->push(cKey);
+        return false;
+    }
+    
+    return true;
+}
+
+
 /**
  * return the organisation/creator of the module
  * 
@@ -753,6 +864,67 @@ bool module::read(qkd::key::key & cKey) {
 }
 
 
+/**
+ * fill a workload with the next keys to process
+ * 
+ * This collects up to batch_size keys. After the first key
+ * further keys are waited for at most batch_timeout milliseconds.
+ * 
+ * @param   cWorkload   the workload to fill
+ * @return  number of keys placed into the workload
+ */
+uint64_t module::read_workload(qkd::module::workload & cWorkload) {
+    
+    // a void input pipe yields a single NULL key for each workload
+    uint64_t nBatchSize = d->cConPipeIn->is_void() ? 1 : batch_size();
+    uint64_t nTerminateAfter = d->nTerminateAfter;
+    if ((nTerminateAfter != 0) && (nTerminateAfter < nBatchSize)) nBatchSize = nTerminateAfter;
+    
+    uint64_t nKeys = 0;
+    std::chrono::steady_clock::time_point cDeadline;
+    while (nKeys < nBatchSize) {
+        
+        if ((nKeys > 0) && (std::chrono::steady_clock::now() >= cDeadline)) break;
+        
+        qkd::key::key cKey;
+        if (!next_key(cKey)) {
+            if ((nKeys == 0) || (get_state() != qkd::module::module_state::STATE_RUNNING)) break;
+            continue;
+        }
+        if (nKeys == 0) cDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(batch_timeout());
+        
+        // create crypto context for retrieved key
+        qkd::crypto::crypto_context cIncomingContext = qkd::crypto::context::null_context();
+        qkd::crypto::crypto_context cOutgoingContext = qkd::crypto::context::null_context();
+        try {
+            if (!cKey.meta().sCryptoSchemeIncoming.empty()) {
+                qkd::crypto::scheme cScheme(cKey.meta().sCryptoSchemeIncoming);
+                cIncomingContext = qkd::crypto::engine::create(cScheme);
+            }
+        }
+        catch (...) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                    << ": failed to create incoming crypto context for key";
+        }
+        try {
+            if (!cKey.meta().sCryptoSchemeOutgoing.empty()) {
+                qkd::crypto::scheme cScheme(cKey.meta().sCryptoSchemeOutgoing);
+                cOutgoingContext = qkd::crypto::engine::create(cScheme);
+            }
+        }
+        catch (...) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                    << ": failed to create outgoing crypto context for key";
+        }
+        
+        cWorkload.push_back(qkd::module::work(cKey, cIncomingContext, cOutgoingContext));
+        nKeys++;
+    }
+    
+    return nKeys;
+}
+
+
 /**
  * read a message from the peer module
  * 
@@ -817,7 +989,7 @@ bool module::recv(qkd::key::key_id nKeyId,
         throw std::logic_error("Cannot determine where to receive from (nor alice neither bob).");
     }
     
-    if (!cCon->recv_message(cMessage)) {
+    if (!d->recv_message(cCon, nKeyId, cMessage)) {
         return false;
     }
     if (is_dying_state()) return false;
@@ -1014,7 +1186,7 @@ bool module::send(qkd::key::key_id nKeyId,
     if (is_bob()) cCon = d->cConListen;
     
     cMessage.key_id() = nKeyId;
-    if (!cCon->send_message(cMessage, nPath)) return false;
+    if (!d->send_message(cCon, cMessage, nPath)) return false;
     d->debug_message(true, cMessage);
     
     cAuthContext << cMessage.data();
@@ -1049,6 +1221,40 @@ QString module::service_name() const {
 }
 
 
+/**
+ * set the async I/O flag
+ * 
+ * This is evaluated when the module starts working.
+ * 
+ * @param   bAsyncIO        read and write keys in separate I/O threads
+ */
+void module::set_async_io(bool bAsyncIO) {
+    d->bAsyncIO = bAsyncIO;
+}
+
+
+/**
+ * set the maximum number of keys in a single workload
+ * 
+ * A value of 0 is treated as 1.
+ * 
+ * @param   nBatchSize      the new maximum number of keys handed to process() at once
+ */
+void module::set_batch_size(qulonglong nBatchSize) {
+    d->nBatchSize = std::max<qulonglong>(nBatchSize, 1);
+}
+
+
+/**
+ * set the time to wait for more keys to fill a workload
+ * 
+ * @param   nBatchTimeout   the new batch timeout in milliseconds
+ */
+void module::set_batch_timeout(qulonglong nBatchTimeout) {
+    d->nBatchTimeout = nBatchTimeout;
+}
+
+
 /**
  * set the debug message particle flow flag
  * 
@@ -1269,6 +1475,16 @@ void module::set_url_pipe_out(QString sURL) {
 }
 
 
+/**
+ * set the number of threads processing keys concurrently
+ * 
+ * @param   nWorkers    the new number of worker threads
+ */
+void module::set_workers(qulonglong nWorkers) {
+    d->nWorkers = std::max<qulonglong>(nWorkers, 1);
+}
+
+
 /**
  * runs and resumes the module as soon as possible
  * 
@@ -1526,6 +1742,16 @@ module_state module::wait_for_state_change(module_state eWorkingState) const {
 }
 
 
+/**
+ * get the number of threads processing keys concurrently
+ * 
+ * @return  the number of worker threads
+ */
+qulonglong module::workers() const {
+    return d->nWorkers;
+}
+
+
 /**
  * this is the real work function
  * 
@@ -1535,9 +1761,11 @@ module_state module::wait_for_state_change(module_state eWorkingState) const {
  * 
  * 1) as long we are READY: wait
  * 2) exit if not RUNNING
- * 3) get a key (if input Pipe has been specified)
+ * 3) get up to batch_size keys (if input Pipe has been specified)
  * 4) invoke process()
- * 5) write key (if process return true)
+ * 5) write keys (if process return true)
+ *    with async_io set, keys are read ahead and written in separate
+ *    I/O threads while the next workload is processed
  * 6) return to 1
  * 
  * You may overwrite this method. But this changes module operation
@@ -1548,8 +1776,10 @@ void module::work() {
     qkd::module::module_state eState = qkd::module::module_state::STATE_NEW;
 
     qkd::utility::debug() << "working on incoming keys started";
+    d->start_io();
+    d->start_workers();
     
-    // main worker loop: get key, create context, process, forward, and check for termination
+    // main worker loop: get keys, create context, process, forward, and check for termination
     do {
         
         d->bProcessing = false;
@@ -1558,124 +1788,53 @@ void module::work() {
         while (eState == qkd::module::module_state::STATE_READY) eState = wait_for_state_change(eState);
         if (eState != qkd::module::module_state::STATE_RUNNING) break;
 
-        // get a key
-        qkd::key::key cKey = qkd::key::key::null();
-        if (is_synchronizing()) {
-            try {
-                synchronize();
-                cKey = d->cStash->pick();
-            }
-            catch (std::exception const & e) {
-                qkd::utility::debug() << "Caugth exception while key-sync: " << e.what();
-                cKey = qkd::key::key::null();
-            }
+        // get the next keys
+        workload cWorkload;
+        uint64_t nKeys = read_workload(cWorkload);
+        if (nKeys == 0) {
+            if (get_state() != qkd::module::module_state::STATE_RUNNING) break;
+            continue;
         }
-        if (!cKey.is_null()) {
-            qkd::utility::debug() << "key #" << cKey.id() << " is present at peer - picked";
+
+        if (d->pooled()) {
+            
+            // workers process and forward the keys
+            d->dispatch(cWorkload);
         }
         else {
-            
-            if (!read(cKey)) {
 
-                if (get_state() != qkd::module::module_state::STATE_RUNNING) break;
-                continue;
-            }
-            
-            if (!accept(cKey)) {
-                qkd::utility::debug() << "key " << cKey.id() << " is not accepted by this module";
-                continue;
-            }
+            // call the module working method
+            d->bProcessing = true;
+            process(cWorkload);
+            d->cLastProcessedKey = std::chrono::system_clock::now();
             
             eState = get_state();
             while (eState == qkd::module::module_state::STATE_READY) eState = wait_for_state_change(eState);
             if (eState != qkd::module::module_state::STATE_RUNNING) break;
             
-            if (is_synchronizing()) {
-                d->cStash->push(cKey);
-                continue;
-            }
-        }
-        
-        d->bProcessing = true;
-        
-        // create crypto context for retrieved key
-        qkd::crypto::crypto_context cIncomingContext = qkd::crypto::context::null_context();
-        qkd::crypto::crypto_context cOutgoingContext = qkd::crypto::context::null_context();
-        try {
-            if (!cKey.meta().sCryptoSchemeIncoming.empty()) {
-                qkd::crypto::scheme cScheme(cKey.meta().sCryptoSchemeIncoming);
-                cIncomingContext = qkd::crypto::engine::create(cScheme);
-            }
-        }
-        catch (...) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
-                    << ": failed to create incoming crypto context for key";
-        }
-        try {
-            if (!cKey.meta().sCryptoSchemeOutgoing.empty()) {
-                qkd::crypto::scheme cScheme(cKey.meta().sCryptoSchemeOutgoing);
-                cOutgoingContext = qkd::crypto::engine::create(cScheme);
-            }
-        }
-        catch (...) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
-                    << ": failed to create outgoing crypto context for key";
-        }
+            // forward all keys processed
+            if (!d->forward(cWorkload)) break;
 
-        // call the module working method
-        workload cWorkload = { qkd::module::work(cKey, cIncomingContext, cOutgoingContext) };
-        process(cWorkload);
-        d->cLastProcessedKey = std::chrono::system_clock::now();
-        
-        eState = get_state();
-        while (eState == qkd::module::module_state::STATE_READY) eState = wait_for_state_change(eState);
-        if (eState != qkd::module::module_state::STATE_RUNNING) break;
-        
-        // forward all keys processed
-        for (auto & w : cWorkload) {
-            if (w.bForward) {
-                
-                w.cKey.meta().sCryptoSchemeIncoming = w.cIncomingContext->scheme().str();
-                w.cKey.meta().sCryptoSchemeOutgoing = w.cOutgoingContext->scheme().str();
-                if (w.cKey.meta().sCryptoSchemeIncoming == "null") w.cKey.meta().sCryptoSchemeIncoming = "";
-                if (w.cKey.meta().sCryptoSchemeOutgoing == "null") w.cKey.meta().sCryptoSchemeOutgoing = "";
-
-                bool bWrittenToNextModule = false;
-                do {
-
-                    // the write might fail for EINTR or EAGAIN --> wait or break processing loop
-                    // other errors are turned into severe exception
-                    bWrittenToNextModule = write(w.cKey, w.nPath);
-                    if (!bWrittenToNextModule ) {
-                        if (get_state() != qkd::module::module_state::STATE_RUNNING) break;
-                        qkd::utility::debug() << "failed to write key to next module in pipe.";
-                        std::this_thread::yield();
-                    }
-                    else {
-                        d->cLastProcessedKey = std::chrono::system_clock::now();
-                    }
-
-                } while (!bWrittenToNextModule);
-
-                if (get_state() != qkd::module::module_state::STATE_RUNNING) break;
-            }
+            d->bProcessing = false;
+            d->cLastProcessedKey = std::chrono::system_clock::now();
         }
-
-        d->bProcessing = false;
-        d->cLastProcessedKey = std::chrono::system_clock::now();
         
         // check for exit
         if (d->nTerminateAfter != 0) {
 
-            d->nTerminateAfter--;
+            d->nTerminateAfter -= std::min<uint64_t>(nKeys, d->nTerminateAfter);
             if (d->nTerminateAfter == 0) {
                 qkd::utility::debug() << "reached maximum number of keys to process - winding down";
+                d->drain();
+                d->stop_io(true);
                 terminate();
             }
         }
         
     } while (is_working_state(eState));
     
+    d->stop_workers();
+    d->stop_io(false);
     qkd::utility::debug() << "working on incoming keys suspended";
 
     d->bProcessing = false;
@@ -32,8 +32,15 @@
 // incs
 
 
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <boost/format.hpp>
 
+#include <zmq.h>
+
 #include <qkd/module/module.h>
 #include <qkd/utility/syslog.h>
 
@@ -42,6 +49,16 @@
 using namespace qkd::module;
 
 
+// ------------------------------------------------------------
+// defs
+
+// maximum number of peer messages held in the mailbox
+#define PEER_MAILBOX_SIZE       4096
+
+// number of finished key ids remembered to drop late peer messages
+#define PEER_FINISHED_KEYS      4096
+
+
 // ------------------------------------------------------------
 // code
 
@@ -52,7 +69,7 @@ using namespace qkd::module;
  * @param   cParentModule       the parent module of this inner module
  * @param   sId                 module id
  */
-module::module_internal::module_internal(module * cParentModule, std::string sId) : cModule(cParentModule), sId(sId), nStartTimeStamp(0), cStash(nullptr) { 
+module::module_internal::module_internal(module * cParentModule, std::string sId) : cModule(cParentModule), sId(sId), nStartTimeStamp(0), cStash(nullptr), bWriting(false) { 
     
     // default values
     
@@ -68,6 +85,22 @@ module::module_internal::module_internal(module * cParentModule, std::string sId
 
     nTerminateAfter = 0;
     
+    nBatchSize = 1;
+    nBatchTimeout = 100;
+    bAsyncIO = false;
+    bIORunning = false;
+    nWorkers = 1;
+    bPoolRunning = false;
+    nJobsDispatched = 0;
+    nJobsForwarded = 0;
+    bForwarding = false;
+    bPeerDemux = false;
+    bPeerRunning = false;
+    nPeerWakeup[0] = -1;
+    nPeerWakeup[1] = -1;
+    nPeerMailboxSize = 0;
+    nPeerMailboxSequence = 0;
+    
     cConListen = new qkd::module::connection(connection_type::LISTEN);
     cConPeer = new qkd::module::connection(connection_type::PEER);
     cConPipeIn = new qkd::module::connection(connection_type::PIPE_IN);
@@ -157,6 +190,10 @@ void module::module_internal::debug_config() {
     qkd::utility::debug() << "  synchronize_keys: " << (cModule->synchronize_keys() ? "true" : "false");
     qkd::utility::debug() << "   synchronize_ttl: " << cModule->synchronize_ttl();
     qkd::utility::debug() << "   terminate_after: " << cModule->terminate_after();
+    qkd::utility::debug() << "        batch_size: " << cModule->batch_size();
+    qkd::utility::debug() << "     batch_timeout: " << cModule->batch_timeout();
+    qkd::utility::debug() << "          async_io: " << (cModule->async_io() ? "true" : "false");
+    qkd::utility::debug() << "           workers: " << cModule->workers();
 }
 
 
@@ -227,6 +264,170 @@ void module::module_internal::debug_key_push(qkd::key::key const & cKey) {
 }
 
 
+/**
+ * file a message received from the peer into the mailbox
+ * 
+ * Messages for keys already finished are dropped. Messages 
+ * waiting longer than the synchronize TTL are removed and a 
+ * full mailbox makes room by dropping the oldest message. 
+ * Call with cPeerMutex held.
+ * 
+ * @param   cMessage    the message received
+ */
+void module::module_internal::deliver(qkd::module::message const & cMessage) {
+    
+    if (cPeerFinished.find(cMessage.key_id()) != cPeerFinished.end()) {
+        qkd::utility::debug() << "dropping peer message for finished key " << cMessage.key_id();
+        return;
+    }
+    
+    auto cNow = std::chrono::steady_clock::now();
+    auto cTTL = std::chrono::seconds(std::max<qulonglong>(cModule->synchronize_ttl(), 1));
+    
+    // walk the messages in order of arrival: the ones taken already are skipped
+    while (!cPeerMailboxOrder.empty()) {
+        
+        auto iter = cPeerMailbox.find(cPeerMailboxOrder.front().first);
+        if ((iter == cPeerMailbox.end()) || ((*iter).second.front().nSequence != cPeerMailboxOrder.front().second)) {
+            cPeerMailboxOrder.pop_front();
+            continue;
+        }
+        
+        bool bExpired = ((cNow - (*iter).second.front().cReceived) > cTTL);
+        if (!bExpired && (nPeerMailboxSize < PEER_MAILBOX_SIZE)) break;
+        
+        if (bExpired) {
+            qkd::utility::debug() << "dropping peer message for key " << (*iter).first << " - not picked up within " << cTTL.count() << " seconds";
+        }
+        else {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                    << ": peer mailbox full - dropping oldest message for key " << (*iter).first;
+        }
+        
+        (*iter).second.pop_front();
+        if ((*iter).second.empty()) cPeerMailbox.erase(iter);
+        cPeerMailboxOrder.pop_front();
+        nPeerMailboxSize--;
+    }
+    
+    peer_mail cMail = { nPeerMailboxSequence++, cNow, cMessage };
+    cPeerMailbox[cMessage.key_id()].push_back(cMail);
+    cPeerMailboxOrder.push_back(std::make_pair(cMessage.key_id(), cMail.nSequence));
+    nPeerMailboxSize++;
+}
+
+
+/**
+ * hand the keys of a workload to the worker pool
+ * 
+ * This blocks while too many keys are in flight.
+ * 
+ * @param   cWorkload   the workload to process
+ */
+void module::module_internal::dispatch(qkd::module::workload const & cWorkload) {
+    
+    std::unique_lock<std::mutex> cLock(cPoolMutex);
+    for (auto const & w : cWorkload) {
+        while (bPoolRunning && (nJobsDispatched - nJobsForwarded >= 2 * cWorkerThreads.size())) cPoolCondition.wait(cLock);
+        cJobs.push_back(std::make_pair(nJobsDispatched++, w));
+        bProcessing = true;
+        cPoolCondition.notify_all();
+    }
+}
+
+
+/**
+ * wait until all keys handed to the worker pool have been forwarded
+ */
+void module::module_internal::drain() {
+    std::unique_lock<std::mutex> cLock(cPoolMutex);
+    while (bPoolRunning && (nJobsForwarded != nJobsDispatched)) cPoolCondition.wait(cLock);
+}
+
+
+/**
+ * write all keys of a workload which are to be forwarded
+ * 
+ * With async I/O running this hands the keys to the writer thread
+ * once the previous workload has been written and returns at once.
+ * 
+ * @param   cWorkload   the workload processed
+ * @return  false, if the module left the RUNNING state while writing
+ */
+bool module::module_internal::forward(qkd::module::workload & cWorkload) {
+    
+    if (!cWriterThread.joinable()) {
+        for (auto & w : cWorkload) {
+            if (w.bForward && !forward(w)) return false;
+        }
+        return true;
+    }
+
+    {
+        // double buffering: wait for the previous workload, then hand over
+        std::unique_lock<std::mutex> cLock(cIOMutex);
+        while (bWriting || !cKeysToWrite.empty()) cIOCondition.wait(cLock);
+        for (auto & w : cWorkload) {
+            if (w.bForward) cKeysToWrite.push_back(w);
+        }
+        cIOCondition.notify_all();
+    }
+    
+    return (get_state() == module_state::STATE_RUNNING);
+}
+
+
+/**
+ * write a single key to the next module, retrying while RUNNING
+ * 
+ * @param   w           the work item to write
+ * @return  false, if the module left the RUNNING state before the key has been written
+ */
+bool module::module_internal::forward(qkd::module::work & w) {
+    
+    qkd::crypto::scheme cSchemeIncoming = w.cIncomingContext->scheme();
+    qkd::crypto::scheme cSchemeOutgoing = w.cOutgoingContext->scheme();
+    w.cKey.meta().sCryptoSchemeIncoming = (cSchemeIncoming.null() ? "" : cSchemeIncoming.binary());
+    w.cKey.meta().sCryptoSchemeOutgoing = (cSchemeOutgoing.null() ? "" : cSchemeOutgoing.binary());
+
+    // the write might fail for EINTR or EAGAIN --> wait or break processing loop
+    // other errors are turned into severe exception
+    while (!cModule->write(w.cKey, w.nPath)) {
+        if (get_state() != module_state::STATE_RUNNING) return false;
+        qkd::utility::debug() << "failed to write key to next module in pipe.";
+        std::this_thread::yield();
+    }
+    cLastProcessedKey = std::chrono::system_clock::now();
+
+    return (get_state() == module_state::STATE_RUNNING);
+}
+
+
+/**
+ * a worker is done with a key: drop its messages left and any arriving later
+ * 
+ * Call with cPeerMutex held.
+ * 
+ * @param   nKeyId      the key id finished
+ */
+void module::module_internal::finish_key(qkd::key::key_id nKeyId) {
+    
+    auto iter = cPeerMailbox.find(nKeyId);
+    if (iter != cPeerMailbox.end()) {
+        nPeerMailboxSize -= (*iter).second.size();
+        cPeerMailbox.erase(iter);
+        if (nPeerMailboxSize == 0) cPeerMailboxOrder.clear();
+    }
+    
+    if (!cPeerFinished.insert(nKeyId).second) return;
+    cPeerFinishedOrder.push_back(nKeyId);
+    if (cPeerFinishedOrder.size() > PEER_FINISHED_KEYS) {
+        cPeerFinished.erase(cPeerFinishedOrder.front());
+        cPeerFinishedOrder.pop_front();
+    }
+}
+
+
 /**
  * get the current module state
  * 
@@ -238,6 +439,188 @@ module_state module::module_internal::get_state() const {
 }
 
 
+/**
+ * pick a key read ahead by the reader thread
+ * 
+ * This waits a short while for a key to arrive.
+ * 
+ * @param   cKey        this will receive the key
+ * @return  true, if a key has been picked
+ */
+bool module::module_internal::pick_read_key(qkd::key::key & cKey) {
+    
+    std::unique_lock<std::mutex> cLock(cIOMutex);
+    if (cKeysRead.empty()) cIOCondition.wait_for(cLock, std::chrono::milliseconds(50));
+    if (cKeysRead.empty()) return false;
+    
+    cKey = cKeysRead.front();
+    cKeysRead.pop_front();
+    cIOCondition.notify_all();
+    
+    return true;
+}
+
+
+/**
+ * peer thread: the only one touching the peer socket while the worker pool runs
+ * 
+ * 0MQ sockets must not be used by several threads at once. This
+ * thread sends the messages the workers queue and files all messages
+ * received into the mailbox. In between it blocks on the socket and 
+ * on a pipe the workers write to when they queue a message.
+ */
+void module::module_internal::peer() {
+    
+    qkd::module::connection * cCon = (cModule->is_alice() ? cConPeer : cConListen);
+    void * cSocket = nullptr;
+    if ((cCon->paths().size() == 1) && !cCon->paths().front()->is_void()) cSocket = cCon->paths().front()->socket();
+    
+    std::unique_lock<std::mutex> cLock(cPeerMutex);
+    while (bPeerRunning) {
+        
+        // send what the workers have queued
+        while (!cPeerOutbox.empty()) {
+            
+            peer_send * cSend = cPeerOutbox.front();
+            cPeerOutbox.pop_front();
+            
+            cLock.unlock();
+            try {
+                cSend->bSent = cSend->cCon->send_message(*cSend->cMessage, cSend->nPath);
+            }
+            catch (...) {
+                cSend->cError = std::current_exception();
+            }
+            cLock.lock();
+            
+            cSend->bDone = true;
+            cPeerCondition.notify_all();
+        }
+        
+        // file all what has arrived
+        if (cSocket) {
+            
+            std::list<qkd::module::message> cReceived;
+            std::exception_ptr cError;
+            cLock.unlock();
+            try {
+                qkd::module::message cMessage;
+                while (cCon->recv_message(cMessage, false)) cReceived.push_back(cMessage);
+            }
+            catch (...) {
+                cError = std::current_exception();
+            }
+            cLock.lock();
+            
+            for (auto const & cMessage : cReceived) deliver(cMessage);
+            if (cError) cPeerError = cError;
+            if (!cReceived.empty() || cError) cPeerCondition.notify_all();
+        }
+        
+        if (!bPeerRunning || !cPeerOutbox.empty()) continue;
+        
+        // wait for the peer or a worker
+        cLock.unlock();
+        zmq_pollitem_t cItems[2] = { { nullptr, nPeerWakeup[0], ZMQ_POLLIN, 0 }, { cSocket, 0, ZMQ_POLLIN, 0 } };
+        int nPoll = zmq_poll(cItems, (cSocket ? 2 : 1), -1);
+        if ((nPoll == -1) && (zmq_errno() != EINTR)) {
+            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ 
+                    << ": failed to wait for peer messages: " << strerror(zmq_errno());
+            cLock.lock();
+            bPeerRunning = false;
+            break;
+        }
+        if (cItems[0].revents & ZMQ_POLLIN) {
+            char cDrain[64];
+            while (::read(nPeerWakeup[0], cDrain, sizeof(cDrain)) > 0);
+        }
+        cLock.lock();
+    }
+    
+    // whoever still waits is served no more
+    for (auto cSend : cPeerOutbox) cSend->bDone = true;
+    cPeerOutbox.clear();
+    cPeerCondition.notify_all();
+}
+
+
+/**
+ * reader thread: reads keys ahead while processing
+ */
+void module::module_internal::reader() {
+    
+    while (bIORunning) {
+        
+        if (get_state() != module_state::STATE_RUNNING) {
+            cModule->rest();
+            continue;
+        }
+        
+        // read ahead at most one workload
+        {
+            std::unique_lock<std::mutex> cLock(cIOMutex);
+            while (bIORunning && (cKeysRead.size() >= std::max<uint64_t>(nBatchSize, 1))) cIOCondition.wait(cLock);
+        }
+        if (!bIORunning) break;
+        
+        qkd::key::key cKey;
+        if (!cModule->read(cKey) || cKey.is_null()) continue;
+        
+        std::lock_guard<std::mutex> cLock(cIOMutex);
+        cKeysRead.push_back(cKey);
+        cIOCondition.notify_all();
+    }
+}
+
+
+/**
+ * receive a message from the peer
+ * 
+ * While the worker pool runs several keys talk to the peer at once.
+ * Then messages for other keys are kept until their worker asks.
+ * A worker waits at most the synchronize TTL for its message.
+ * 
+ * @param   cCon        the connection to receive from
+ * @param   nKeyId      the key id the message is expected for
+ * @param   cMessage    this will receive the message
+ * @return  true, if we have received a message
+ */
+bool module::module_internal::recv_message(qkd::module::connection * cCon, qkd::key::key_id nKeyId, qkd::module::message & cMessage) {
+    
+    if (!bPeerDemux) return cCon->recv_message(cMessage);
+    
+    // the peer thread fills the mailbox
+    auto cDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(std::max<qulonglong>(cModule->synchronize_ttl(), 1));
+    std::unique_lock<std::mutex> cLock(cPeerMutex);
+    while (!cModule->is_dying_state()) {
+        
+        if (cPeerError) {
+            std::exception_ptr cError = cPeerError;
+            cPeerError = nullptr;
+            std::rethrow_exception(cError);
+        }
+        
+        auto iter = cPeerMailbox.find(nKeyId);
+        if (iter != cPeerMailbox.end()) {
+            cMessage = (*iter).second.front().cMessage;
+            (*iter).second.pop_front();
+            if ((*iter).second.empty()) cPeerMailbox.erase(iter);
+            nPeerMailboxSize--;
+            if (nPeerMailboxSize == 0) cPeerMailboxOrder.clear();
+            return true;
+        }
+        if (!bPeerRunning) break;
+        
+        if (cPeerCondition.wait_until(cLock, cDeadline) == std::cv_status::timeout) {
+            qkd::utility::debug() << "no peer message for key " << nKeyId << " within " << cModule->synchronize_ttl() << " seconds";
+            break;
+        }
+    }
+    
+    return false;
+}
+
+
 /**
  * clean any resources left
  */
@@ -254,6 +637,32 @@ void module::module_internal::release() {
 }
 
 
+/**
+ * send a message to the peer
+ * 
+ * @param   cCon        the connection to send on
+ * @param   cMessage    the message to send
+ * @param   nPath       path index to send
+ * @return  true, if successfully sent
+ */
+bool module::module_internal::send_message(qkd::module::connection * cCon, qkd::module::message & cMessage, int nPath) {
+    
+    if (!bPeerDemux) return cCon->send_message(cMessage, nPath);
+    
+    // let the peer thread send: it owns the socket
+    peer_send cSend = { cCon, &cMessage, nPath, false, false, nullptr };
+    std::unique_lock<std::mutex> cLock(cPeerMutex);
+    if (!bPeerRunning) return false;
+    
+    cPeerOutbox.push_back(&cSend);
+    wake_peer();
+    while (!cSend.bDone) cPeerCondition.wait(cLock);
+    
+    if (cSend.cError) std::rethrow_exception(cSend.cError);
+    return cSend.bSent;
+}
+
+
 /**
  * set a new module state
  * 
@@ -262,9 +671,138 @@ void module::module_internal::release() {
  * @param   eNewState       the new module state
  */
 void module::module_internal::set_state(module_state eNewState) {
-    std::unique_lock<std::mutex> cLock(cStateMutex);
-    eState = eNewState;
-    cStateCondition.notify_all();
+    
+    {
+        std::unique_lock<std::mutex> cLock(cStateMutex);
+        eState = eNewState;
+        cStateCondition.notify_all();
+    }
+    
+    // workers waiting for peer messages check for dying states
+    std::lock_guard<std::mutex> cLock(cPeerMutex);
+    cPeerCondition.notify_all();
+}
+
+
+/**
+ * start the I/O threads (if async I/O is set)
+ */
+void module::module_internal::start_io() {
+    
+    if (!bAsyncIO) return;
+    
+    bIORunning = true;
+    bWriting = false;
+    
+    // void input yields NULL keys to be processed and stdin 
+    // blocks without timeout: these are read in the worker
+    auto const & cPaths = cConPipeIn->paths();
+    bool bReadAhead = !cPaths.empty() && std::none_of(cPaths.begin(), cPaths.end(), 
+            [](path_ptr const & p) { return p->is_void() || p->is_stdin(); });
+    
+    if (bReadAhead) cReaderThread = std::thread([this]() { reader(); });
+    cWriterThread = std::thread([this]() { writer(); });
+}
+
+
+/**
+ * start the worker pool (if workers is set and the module is reentrant)
+ */
+void module::module_internal::start_workers() {
+    
+    if (nWorkers <= 1) return;
+    if (!cModule->is_reentrant()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ 
+                << ": module is not reentrant - ignoring workers = " << nWorkers;
+        return;
+    }
+    
+    nJobsDispatched = 0;
+    nJobsForwarded = 0;
+    bForwarding = false;
+    bPoolRunning = true;
+    
+    if (pipe2(nPeerWakeup, O_NONBLOCK | O_CLOEXEC) == -1) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ 
+                << ": failed to create peer wakeup pipe: " << strerror(errno) << " - not using workers";
+        bPoolRunning = false;
+        return;
+    }
+    bPeerRunning = true;
+    bPeerDemux = true;
+    cPeerThread = std::thread([this]() { peer(); });
+    
+    for (uint64_t i = 0; i < nWorkers; ++i) {
+        cWorkerThreads.push_back(std::thread([this]() { worker(); }));
+    }
+}
+
+
+/**
+ * stop and join the I/O threads
+ * 
+ * @param   bFlush      write all pending keys before stopping
+ */
+void module::module_internal::stop_io(bool bFlush) {
+    
+    {
+        std::unique_lock<std::mutex> cLock(cIOMutex);
+        if (bFlush && cWriterThread.joinable()) {
+            while (bWriting || !cKeysToWrite.empty()) cIOCondition.wait(cLock);
+        }
+        bIORunning = false;
+        cIOCondition.notify_all();
+    }
+    
+    if (cReaderThread.joinable()) cReaderThread.join();
+    if (cWriterThread.joinable()) cWriterThread.join();
+    
+    cKeysRead.clear();
+    cKeysToWrite.clear();
+}
+
+
+/**
+ * stop and join the worker pool
+ * 
+ * Keys not yet processed are dropped.
+ */
+void module::module_internal::stop_workers() {
+    
+    {
+        std::lock_guard<std::mutex> cLock(cPoolMutex);
+        bPoolRunning = false;
+        cPoolCondition.notify_all();
+    }
+    
+    // workers waiting on the peer give up once the peer thread is gone
+    if (cPeerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> cLock(cPeerMutex);
+            bPeerRunning = false;
+            cPeerCondition.notify_all();
+        }
+        wake_peer();
+        cPeerThread.join();
+    }
+    
+    for (auto & cThread : cWorkerThreads) cThread.join();
+    cWorkerThreads.clear();
+    
+    bPeerDemux = false;
+    cJobs.clear();
+    cJobsDone.clear();
+    cPeerMailbox.clear();
+    cPeerMailboxOrder.clear();
+    nPeerMailboxSize = 0;
+    cPeerFinished.clear();
+    cPeerFinishedOrder.clear();
+    cPeerError = nullptr;
+    
+    for (auto & nFD : nPeerWakeup) {
+        if (nFD != -1) close(nFD);
+        nFD = -1;
+    }
 }
 
 
@@ -284,3 +822,95 @@ module_state module::module_internal::wait_for_state_change(module_state eWorkin
     while (eWorkingState == eState) cStateCondition.wait(cLock);
     return eState;
 }
+
+
+/**
+ * wake the peer thread
+ */
+void module::module_internal::wake_peer() {
+    
+    // a full pipe will wake the peer thread anyway
+    char cWakeup = 0;
+    if (::write(nPeerWakeup[1], &cWakeup, 1) == -1) return;
+}
+
+
+/**
+ * worker thread: processes keys of the worker pool
+ */
+void module::module_internal::worker() {
+    
+    while (true) {
+        
+        uint64_t nJob = 0;
+        qkd::module::workload cWorkload;
+        {
+            std::unique_lock<std::mutex> cLock(cPoolMutex);
+            while (bPoolRunning && cJobs.empty()) cPoolCondition.wait(cLock);
+            if (!bPoolRunning) break;
+            nJob = cJobs.front().first;
+            cWorkload.push_back(cJobs.front().second);
+            cJobs.pop_front();
+        }
+        
+        qkd::key::key_id nKeyId = cWorkload.front().cKey.id();
+        cModule->process(cWorkload);
+        cLastProcessedKey = std::chrono::system_clock::now();
+        
+        // drop peer messages left for this key (key id 0 is key-sync)
+        if (nKeyId != 0) {
+            std::lock_guard<std::mutex> cLock(cPeerMutex);
+            finish_key(nKeyId);
+        }
+        
+        // forward in the order the keys have been read: whoever 
+        // is forwarding right now picks up our result too
+        std::unique_lock<std::mutex> cLock(cPoolMutex);
+        cJobsDone[nJob] = cWorkload;
+        if (bForwarding) continue;
+        
+        bForwarding = true;
+        while (!cJobsDone.empty() && ((*cJobsDone.begin()).first == nJobsForwarded)) {
+            
+            qkd::module::workload cForward;
+            cForward.swap((*cJobsDone.begin()).second);
+            cJobsDone.erase(cJobsDone.begin());
+            
+            cLock.unlock();
+            forward(cForward);
+            cLock.lock();
+            
+            nJobsForwarded++;
+            cPoolCondition.notify_all();
+        }
+        bForwarding = false;
+        if (nJobsForwarded == nJobsDispatched) bProcessing = false;
+    }
+}
+
+
+/**
+ * writer thread: writes processed keys while processing
+ */
+void module::module_internal::writer() {
+    
+    while (true) {
+        
+        qkd::module::workload cWorkload;
+        {
+            std::unique_lock<std::mutex> cLock(cIOMutex);
+            while (bIORunning && cKeysToWrite.empty()) cIOCondition.wait(cLock);
+            if (cKeysToWrite.empty()) break;
+            cWorkload.swap(cKeysToWrite);
+            bWriting = true;
+        }
+        
+        for (auto & w : cWorkload) {
+            if (!forward(w)) break;
+        }
+        
+        std::lock_guard<std::mutex> cLock(cIOMutex);
+        bWriting = false;
+        cIOCondition.notify_all();
+    }
+}
@@ -36,10 +36,15 @@
 // incs
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <exception>
+#include <list>
 #include <map>
 #include <queue>
+#include <set>
 #include <thread>
+#include <vector>
 
 #include <qkd/module/connection.h>
 #include <qkd/module/module.h>
@@ -110,6 +115,11 @@ public:
 
     std::chrono::system_clock::time_point cLastProcessedKey;    /**< timestamp of last processed key */
     
+    std::atomic<uint64_t> nBatchSize;           /**< maximum number of keys in a workload */
+    std::atomic<uint64_t> nBatchTimeout;        /**< milliseconds to wait for more keys to fill a workload */
+    std::atomic<bool> bAsyncIO;                 /**< read and write keys in separate I/O threads */
+    std::atomic<uint64_t> nWorkers;             /**< number of threads processing keys concurrently */
+    
     
     // ---- methods ---
     
@@ -184,6 +194,34 @@ public:
     void debug_message(bool bSent, qkd::module::message const & cMessage);
     
     
+    /**
+     * hand the keys of a workload to the worker pool
+     * 
+     * This blocks while too many keys are in flight.
+     * 
+     * @param   cWorkload   the workload to process
+     */
+    void dispatch(qkd::module::workload const & cWorkload);
+    
+    
+    /**
+     * wait until all keys handed to the worker pool have been forwarded
+     */
+    void drain();
+    
+    
+    /**
+     * write all keys of a workload which are to be forwarded
+     * 
+     * With async I/O running this hands the keys to the writer thread
+     * once the previous workload has been written and returns at once.
+     * 
+     * @param   cWorkload   the workload processed
+     * @return  false, if the module left the RUNNING state while writing
+     */
+    bool forward(qkd::module::workload & cWorkload);
+    
+    
     /**
      * get the current module state
      * 
@@ -192,10 +230,90 @@ public:
     module_state get_state() const;
     
     
+    /**
+     * pick a key read ahead by the reader thread
+     * 
+     * This waits a short while for a key to arrive.
+     * 
+     * @param   cKey        this will receive the key
+     * @return  true, if a key has been picked
+     */
+    bool pick_read_key(qkd::key::key & cKey);
+
+
+    /**
+     * check if keys are processed by a worker pool
+     * 
+     * @return  true, if the worker pool is running
+     */
+    inline bool pooled() const { return !cWorkerThreads.empty(); }
+    
+    
+    /**
+     * check if keys are read ahead by the reader thread
+     * 
+     * @return  true, if the reader thread is running
+     */
+    inline bool reading_ahead() const { return cReaderThread.joinable(); }
+    
+    
+    /**
+     * receive a message from the peer
+     * 
+     * While the worker pool runs several keys talk to the peer at once.
+     * Then messages for other keys are kept until their worker asks.
+     * 
+     * @param   cCon        the connection to receive from
+     * @param   nKeyId      the key id the message is expected for
+     * @param   cMessage    this will receive the message
+     * @return  true, if we have received a message
+     */
+    bool recv_message(qkd::module::connection * cCon, qkd::key::key_id nKeyId, qkd::module::message & cMessage);
+    
+    
     /**
      * cleans any resources left
      */
     void release();
+
+    
+    /**
+     * send a message to the peer
+     * 
+     * @param   cCon        the connection to send on
+     * @param   cMessage    the message to send
+     * @param   nPath       path index to send
+     * @return  true, if successfully sent
+     */
+    bool send_message(qkd::module::connection * cCon, qkd::module::message & cMessage, int nPath);
+
+
+    /**
+     * start the I/O threads (if async I/O is set)
+     */
+    void start_io();
+    
+    
+    /**
+     * start the worker pool (if workers is set and the module is reentrant)
+     */
+    void start_workers();
+    
+    
+    /**
+     * stop and join the I/O threads
+     * 
+     * @param   bFlush      write all pending keys before stopping
+     */
+    void stop_io(bool bFlush);
+
+    
+    /**
+     * stop and join the worker pool
+     * 
+     * Keys not yet processed are dropped.
+     */
+    void stop_workers();
     
     
     /**
@@ -224,6 +342,130 @@ public:
 
 private:
     
+    
+    /**
+     * write a single key to the next module, retrying while RUNNING
+     * 
+     * @param   w           the work item to write
+     * @return  false, if the module left the RUNNING state before the key has been written
+     */
+    bool forward(qkd::module::work & w);
+    
+    
+    /**
+     * file a message received from the peer into the mailbox
+     * 
+     * Messages for keys already finished are dropped. Messages 
+     * waiting longer than the synchronize TTL are removed and a 
+     * full mailbox makes room by dropping the oldest message. 
+     * Call with cPeerMutex held.
+     * 
+     * @param   cMessage    the message received
+     */
+    void deliver(qkd::module::message const & cMessage);
+    
+    
+    /**
+     * a worker is done with a key: drop its messages left and any arriving later
+     * 
+     * Call with cPeerMutex held.
+     * 
+     * @param   nKeyId      the key id finished
+     */
+    void finish_key(qkd::key::key_id nKeyId);
+    
+    
+    /**
+     * peer thread: the only one touching the peer socket while the worker pool runs
+     */
+    void peer();
+    
+    
+    /**
+     * reader thread: reads keys ahead while processing
+     */
+    void reader();
+    
+    
+    /**
+     * wake the peer thread
+     */
+    void wake_peer();
+    
+    
+    /**
+     * worker thread: processes keys of the worker pool
+     */
+    void worker();
+    
+    
+    /**
+     * writer thread: writes processed keys while processing
+     */
+    void writer();
+    
+    
+    std::thread cReaderThread;                          /**< reads keys ahead */
+    std::thread cWriterThread;                          /**< writes processed keys */
+    std::atomic<bool> bIORunning;                       /**< I/O threads shall keep on running */
+    std::mutex cIOMutex;                                /**< guards the I/O queues */
+    std::condition_variable cIOCondition;               /**< signals changes on the I/O queues */
+    std::list<qkd::key::key> cKeysRead;                 /**< keys read ahead */
+    qkd::module::workload cKeysToWrite;                 /**< keys waiting to be written */
+    bool bWriting;                                      /**< writer thread is currently writing */
+    
+    std::vector<std::thread> cWorkerThreads;            /**< the worker pool */
+    std::atomic<bool> bPoolRunning;                     /**< worker pool shall keep on running */
+    std::mutex cPoolMutex;                              /**< guards the worker pool queues */
+    std::condition_variable cPoolCondition;             /**< signals changes on the worker pool queues */
+    std::list<std::pair<uint64_t, qkd::module::work>> cJobs;        /**< keys waiting for a worker */
+    std::map<uint64_t, qkd::module::workload> cJobsDone;            /**< processed keys waiting to be forwarded in order */
+    uint64_t nJobsDispatched;                           /**< number of keys handed to the worker pool */
+    uint64_t nJobsForwarded;                            /**< number of keys forwarded by the worker pool */
+    bool bForwarding;                                   /**< a worker is currently forwarding keys */
+    
+    /**
+     * a message a worker wants the peer thread to send
+     */
+    class peer_send {
+    
+    public:
+        
+        qkd::module::connection * cCon;                 /**< the connection to send on */
+        qkd::module::message * cMessage;                /**< the message to send */
+        int nPath;                                      /**< path index to send */
+        bool bDone;                                     /**< the peer thread is done with it */
+        bool bSent;                                     /**< the message has been sent */
+        std::exception_ptr cError;                      /**< error thrown on sending */
+    };
+    
+    /**
+     * a message received from the peer waiting for its worker
+     */
+    class peer_mail {
+    
+    public:
+        
+        uint64_t nSequence;                             /**< number of the message in order of arrival */
+        std::chrono::steady_clock::time_point cReceived;    /**< when the message arrived */
+        qkd::module::message cMessage;                  /**< the message received */
+    };
+    
+    std::atomic<bool> bPeerDemux;                       /**< peer messages are delivered by key id */
+    std::thread cPeerThread;                            /**< owns the peer socket while the worker pool runs */
+    bool bPeerRunning;                                  /**< peer thread shall keep on running */
+    int nPeerWakeup[2];                                 /**< pipe to wake the peer thread */
+    std::mutex cPeerMutex;                              /**< guards the mailbox and the outbox */
+    std::condition_variable cPeerCondition;             /**< signals new messages in the mailbox and sent messages */
+    std::map<qkd::key::key_id, std::list<peer_mail>> cPeerMailbox;                  /**< messages received by key id */
+    std::list<std::pair<qkd::key::key_id, uint64_t>> cPeerMailboxOrder;             /**< key id and sequence number of the messages in order of arrival */
+    uint64_t nPeerMailboxSize;                          /**< number of messages in the mailbox */
+    uint64_t nPeerMailboxSequence;                      /**< sequence number of the next message filed */
+    std::list<peer_send *> cPeerOutbox;                 /**< messages waiting to be sent */
+    std::set<qkd::key::key_id> cPeerFinished;           /**< the last keys finished by the workers */
+    std::list<qkd::key::key_id> cPeerFinishedOrder;     /**< cPeerFinished in order of finishing */
+    std::exception_ptr cPeerError;                      /**< receive error to pass to the next waiting worker */
+    
     module_state eState;                                /**< the state of the module */
     mutable std::mutex cStateMutex;                     /**< state modification mutex */
     mutable std::condition_variable cStateCondition;    /**< state modification condition */
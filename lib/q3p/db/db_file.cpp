@@ -31,15 +31,21 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
+#include <vector>
+
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 // ait
 #include <qkd/exception/db_error.h>
 #include <qkd/q3p/db.h>
+#include <qkd/utility/checksum.h>
 #include <qkd/utility/syslog.h>
 
 #include "db_file.h"
@@ -49,10 +55,46 @@ using namespace qkd;
 using namespace qkd::q3p;
 
 
+// ------------------------------------------------------------
+// defs
+
+#define JOURNAL_MAGIC       0x4a503351      /**< "Q3PJ": start of a journal */
+
+
 // ------------------------------------------------------------
 // decls
 
 
+/**
+ * a list of page aligned [begin, end) offsets into the file
+ */
+typedef std::vector<std::pair<uint64_t, uint64_t>> page_ranges;
+
+
+/**
+ * add a range of bytes to a list of page ranges
+ * 
+ * The range is widened to page boundaries and merged with
+ * the last range if they overlap. Ranges must be added in
+ * ascending order.
+ * 
+ * @param   cRanges     the ranges to add to
+ * @param   nBegin      offset of the first byte
+ * @param   nEnd        offset after the last byte
+ */
+static void add_range(page_ranges & cRanges, uint64_t nBegin, uint64_t nEnd);
+
+
+/**
+ * checksum of journal records
+ * 
+ * @param   cRecords    the journal records
+ * @param   nCount      number of uint32_t in cRecords
+ * @return  the crc32 of the records
+ */
+static uint32_t journal_checksum(uint32_t const * cRecords, uint64_t nCount);
+
+
 /**
  * total size of the file
  * 
@@ -68,6 +110,48 @@ static inline uint64_t file_size(qkd::q3p::db const & cDB);
 // code
 
 
+/**
+ * add a range of bytes to a list of page ranges
+ * 
+ * The range is widened to page boundaries and merged with
+ * the last range if they overlap. Ranges must be added in
+ * ascending order.
+ * 
+ * @param   cRanges     the ranges to add to
+ * @param   nBegin      offset of the first byte
+ * @param   nEnd        offset after the last byte
+ */
+void add_range(page_ranges & cRanges, uint64_t nBegin, uint64_t nEnd) {
+    
+    static uint64_t const nPageSize = sysconf(_SC_PAGESIZE);
+    
+    nBegin -= nBegin % nPageSize;
+    nEnd += (nPageSize - nEnd % nPageSize) % nPageSize;
+    
+    if (!cRanges.empty() && (cRanges.back().second >= nBegin)) {
+        if (cRanges.back().second < nEnd) cRanges.back().second = nEnd;
+        return;
+    }
+    
+    cRanges.push_back(std::pair<uint64_t, uint64_t>(nBegin, nEnd));
+}
+
+
+/**
+ * keys have been modified
+ * 
+ * @param   nKeyId      the ID of the first key changed
+ * @param   nCount      number of keys changed
+ */
+void db_file::changed(qkd::key::key_id nKeyId, uint64_t nCount) {
+    
+    // not yet opened: reset() or journal replay
+    if (m_cDirty.bits() == 0) return;
+    
+    for (uint64_t i = 0; i < nCount; i++) m_cDirty.set(nKeyId - min_id() + i);
+}
+
+
 /**
  * close the key DB
  */
@@ -79,11 +163,14 @@ void db_file::close_internal() {
     
     if (meta()) munmap(meta(), file_size(*this));
     ::close(m_nFD);
+    if (m_nJournalFD > 0) ::close(m_nJournalFD);
     
     data() = nullptr;
     meta() = nullptr;
+    m_cDirty = db_index();
     
     m_nFD = 0;
+    m_nJournalFD = 0;
 }
 
 
@@ -108,8 +195,10 @@ void db_file::init(QString sURL) {
     
     data() = nullptr;
     meta() = nullptr;
+    m_cDirty = db_index();
     
     m_nFD = 0;
+    m_nJournalFD = 0;
     
     std::string sFileName = QUrl(sURL, QUrl::TolerantMode).toLocalFile().toStdString();
 
@@ -122,6 +211,14 @@ void db_file::init(QString sURL) {
         throw qkd::exception::db_error("failed to open keystore DB file");
     }
     
+    std::string sJournalFileName = sFileName + ".journal";
+    m_nJournalFD = ::open(sJournalFileName.c_str(), O_RDWR | O_CREAT, 0666);
+    if (m_nJournalFD == -1) {
+        std::string sError = strerror(errno);
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed opening journal of file DB at \"" << sJournalFileName << "\": " << sError;
+        throw qkd::exception::db_error("failed to open keystore DB journal");
+    }
+    
     if (ftruncate(m_nFD, file_size(*this))) {
         std::string sError = strerror(errno);
         qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to map file DB at \"" << sURL.toStdString() << "\": " << sError;
@@ -138,24 +235,158 @@ void db_file::init(QString sURL) {
     meta() = (unsigned char *)cData;
     data() = meta() + amount();
     
+    uint64_t nReplayed = replay_journal();
+    if (nReplayed) {
+        qkd::utility::syslog::info() << "replayed " << nReplayed << " meta data records from journal of file DB at \"" << sURL.toStdString() << "\"";
+    }
+    
+    m_cDirty = db_index(amount());
     reset();
     
     qkd::utility::syslog::info() << "opened file DB at \"" << sURL.toStdString() << "\"";
 }
 
 
+/**
+ * checksum of journal records
+ * 
+ * @param   cRecords    the journal records
+ * @param   nCount      number of uint32_t in cRecords
+ * @return  the crc32 of the records
+ */
+uint32_t journal_checksum(uint32_t const * cRecords, uint64_t nCount) {
+    
+    qkd::utility::checksum cAlgorithm = qkd::utility::checksum_algorithm::create("crc32");
+    cAlgorithm << qkd::utility::memory::duplicate((qkd::utility::memory::value_t const *)cRecords, nCount * sizeof(uint32_t));
+    
+    qkd::utility::memory cChecksum;
+    cAlgorithm >> cChecksum;
+    
+    uint32_t nChecksum = 0;
+    memcpy(&nChecksum, cChecksum.get(), std::min<uint64_t>(sizeof(nChecksum), cChecksum.size()));
+    return nChecksum;
+}
+
+
+/**
+ * replay a journal left over by a crashed sync
+ * 
+ * The journal is:
+ * 
+ *      JOURNAL_MAGIC, N, (key slot, meta data) * N, crc32
+ * 
+ * all as uint32_t. An incomplete journal has not been committed
+ * and is dropped.
+ * 
+ * @return  number of meta data records replayed
+ */
+uint64_t db_file::replay_journal() {
+    
+    struct stat cStat;
+    if (fstat(m_nJournalFD, &cStat) == -1) return 0;
+    if (cStat.st_size == 0) return 0;
+    
+    uint64_t nWords = cStat.st_size / sizeof(uint32_t);
+    std::vector<uint32_t> cJournal(nWords);
+    ssize_t nRead = pread(m_nJournalFD, cJournal.data(), nWords * sizeof(uint32_t), 0);
+    
+    // check if the journal has been committed
+    bool bCommitted = (nRead == (ssize_t)cStat.st_size) && (nWords >= 3);
+    bCommitted = bCommitted && (cJournal[0] == JOURNAL_MAGIC);
+    bCommitted = bCommitted && (nWords == 3 + 2 * (uint64_t)cJournal[1]);
+    bCommitted = bCommitted && (cJournal[nWords - 1] == journal_checksum(cJournal.data() + 2, nWords - 3));
+    
+    uint64_t nReplayed = 0;
+    if (bCommitted) {
+        
+        for (uint64_t i = 2; i + 1 < nWords - 1; i += 2) {
+            if (cJournal[i] >= amount()) continue;
+            meta()[cJournal[i]] = (unsigned char)cJournal[i + 1];
+            nReplayed++;
+        }
+        
+        if (msync(meta(), amount(), MS_SYNC) == -1) {
+            std::string sError = strerror(errno);
+            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to sync replayed journal: " << sError;
+            throw qkd::exception::db_error("failed to sync keystore DB journal");
+        }
+    }
+    else {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "dropping uncommitted journal of file DB";
+    }
+    
+    if ((ftruncate(m_nJournalFD, 0) == -1) || (fdatasync(m_nJournalFD) == -1)) {
+        std::string sError = strerror(errno);
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to truncate journal: " << sError;
+        throw qkd::exception::db_error("failed to truncate keystore DB journal");
+    }
+    
+    return nReplayed;
+}
+
+
 /**
  * sync and flushes the DB to disk
+ * 
+ * Only the pages of keys changed since the last sync are 
+ * flushed. The meta data is written to the journal first.
  */
 void db_file::sync_internal() {
     
     if (!meta()) return;
     
-    int nError = msync(meta(), file_size(*this), MS_SYNC);
-    if (nError == -1) {
+    uint64_t nSlot = m_cDirty.next(0);
+    if (nSlot >= m_cDirty.bits()) return;
+    
+    // collect the dirty pages and the journal
+    page_ranges cDataPages;
+    page_ranges cMetaPages;
+    std::vector<uint32_t> cJournal = { JOURNAL_MAGIC, 0 };
+    while (nSlot < m_cDirty.bits()) {
+        
+        uint64_t nEnd = m_cDirty.next_clear(nSlot);
+        add_range(cMetaPages, nSlot, nEnd);
+        add_range(cDataPages, amount() + nSlot * quantum(), amount() + nEnd * quantum());
+        for (uint64_t i = nSlot; i < nEnd; i++) {
+            cJournal.push_back(i);
+            cJournal.push_back(meta()[i] & FLAG_PERSISTENT);
+        }
+        
+        nSlot = m_cDirty.next(nEnd);
+    }
+    cJournal[1] = (cJournal.size() - 2) / 2;
+    cJournal.push_back(journal_checksum(cJournal.data() + 2, cJournal.size() - 2));
+    
+    bool bSynced = true;
+    
+    // 1. key material
+    for (auto const & cRange : cDataPages) {
+        bSynced = bSynced && (msync(meta() + cRange.first, cRange.second - cRange.first, MS_SYNC) == 0);
+    }
+    
+    // 2. commit journal
+    if (bSynced) {
+        ssize_t nJournalSize = cJournal.size() * sizeof(uint32_t);
+        bSynced = (ftruncate(m_nJournalFD, 0) == 0);
+        bSynced = bSynced && (pwrite(m_nJournalFD, cJournal.data(), nJournalSize, 0) == nJournalSize);
+        bSynced = bSynced && (fdatasync(m_nJournalFD) == 0);
+    }
+    
+    // 3. meta data
+    for (auto const & cRange : cMetaPages) {
+        bSynced = bSynced && (msync(meta() + cRange.first, cRange.second - cRange.first, MS_SYNC) == 0);
+    }
+    
+    // 4. checkpoint
+    bSynced = bSynced && (ftruncate(m_nJournalFD, 0) == 0) && (fdatasync(m_nJournalFD) == 0);
+    
+    if (!bSynced) {
         std::string sError = strerror(errno);
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to sync file DB to disk: " << sError;
+        return;
     }
+    
+    m_cDirty = db_index(amount());
 }
 
 
@@ -75,6 +75,20 @@ namespace q3p {
  *                         E ... key is in eventual sync
  * 
  *     key material ... 32 bytes (256 bits) for each key in a row
+ * 
+ * Changed keys are tracked and sync() flushes only the pages
+ * touched since the last sync. Next to the DB file a journal 
+ * "<file>.journal" holds the persistent meta data of the changed 
+ * keys while a sync is in progress:
+ * 
+ *      1. flush the key material of the changed keys
+ *      2. write and flush the journal (commit)
+ *      3. flush the meta data of the changed keys
+ *      4. truncate the journal
+ * 
+ * A journal found when opening the DB stems from a crash between
+ * 2. and 4. and is replayed on the meta table. Thus a key flagged 
+ * valid by the last sync has its key material on disk.
  */
 class db_file : public db_ram {
     
@@ -90,7 +104,7 @@ public:
      * 
      * @param   sURL        url of the DB to create
      */
-    db_file(QString sURL) : db_ram(sURL), m_nFD(0) {};
+    db_file(QString sURL) : db_ram(sURL), m_nFD(0), m_nJournalFD(0) {};
     
     
     /**
@@ -110,6 +124,15 @@ public:
 private:
     
     
+    /**
+     * keys have been modified
+     * 
+     * @param   nKeyId      the ID of the first key changed
+     * @param   nCount      number of keys changed
+     */
+    void changed(qkd::key::key_id nKeyId, uint64_t nCount);
+    
+    
     /**
      * close the key DB
      */
@@ -153,16 +176,36 @@ private:
     uint64_t quantum_internal() const { return (256 / 8); };
     
 
+    /**
+     * replay a journal left over by a crashed sync
+     * 
+     * @return  number of meta data records replayed
+     */
+    uint64_t replay_journal();
+    
+
     /**
      * sync and flushes the DB to disk
      */
     void sync_internal();
     
     
+    /**
+     * keys changed since the last sync
+     */
+    db_index m_cDirty;
+    
+    
     /**
      * fd of the file
      */
     int m_nFD;
+    
+    
+    /**
+     * fd of the journal
+     */
+    int m_nJournalFD;
 
 };
   
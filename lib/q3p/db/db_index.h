@@ -0,0 +1,224 @@
+/*
+ * db_index.h
+ *
+ * A hierarchical bitmap index over the slots of a key DB
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_Q3P_DB_DB_INDEX_H_
+#define __QKD_Q3P_DB_DB_INDEX_H_
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <vector>
+
+#include <inttypes.h>
+
+
+// ------------------------------------------------------------
+// decls
+
+
+namespace qkd {
+
+namespace q3p {
+
+
+/**
+ * A hierarchical bitmap marking DB slots.
+ *
+ * Level 0 holds one bit per slot. Each further level holds one
+ * bit per word of the level below, set if that word is not zero.
+ * Finding the next set bit from any position touches at most two
+ * words per level, thus O(log64 size).
+ */
+class db_index {
+
+
+public:
+
+
+    /**
+     * ctor
+     *
+     * @param   nBits       number of slots
+     * @param   bSet        initial value of all slots
+     */
+    explicit db_index(uint64_t nBits = 0, bool bSet = false) : m_nBits(nBits) {
+        uint64_t nLevelBits = nBits;
+        do {
+            uint64_t nWords = (nLevelBits + 63) / 64;
+            m_cLevels.push_back(std::vector<uint64_t>(nWords, bSet ? ~uint64_t(0) : 0));
+            if (bSet && (nLevelBits % 64)) m_cLevels.back().back() = (uint64_t(1) << (nLevelBits % 64)) - 1;
+            nLevelBits = nWords;
+        } while (m_cLevels.back().size() > 1);
+    }
+
+
+    /**
+     * number of slots
+     *
+     * @return  number of slots indexed
+     */
+    inline uint64_t bits() const { return m_nBits; }
+
+
+    /**
+     * clear a slot
+     *
+     * @param   nPos        the slot
+     */
+    inline void clear(uint64_t nPos) {
+        for (auto & cLevel : m_cLevels) {
+            uint64_t & nWord = cLevel[nPos / 64];
+            nWord &= ~(uint64_t(1) << (nPos % 64));
+            if (nWord) break;
+            nPos /= 64;
+        }
+    }
+
+
+    /**
+     * get a slot
+     *
+     * @param   nPos        the slot
+     * @return  true, if the slot is set
+     */
+    inline bool get(uint64_t nPos) const { return ((m_cLevels[0][nPos / 64] >> (nPos % 64)) & 1) != 0; }
+
+
+    /**
+     * find the next set slot
+     *
+     * @param   nPos        first slot to consider
+     * @return  the first set slot >= nPos (or bits() if there is none)
+     */
+    inline uint64_t next(uint64_t nPos) const {
+
+        if (nPos >= m_nBits) return m_nBits;
+
+        // climb up until a set bit at or after nPos shows up
+        uint64_t nLevel = 0;
+        while (true) {
+
+            std::vector<uint64_t> const & cLevel = m_cLevels[nLevel];
+            if (nPos / 64 >= cLevel.size()) return m_nBits;
+
+            uint64_t nWord = cLevel[nPos / 64] & (~uint64_t(0) << (nPos % 64));
+            if (nWord) {
+                nPos = (nPos / 64) * 64 + __builtin_ctzll(nWord);
+                break;
+            }
+
+            if (nLevel + 1 == m_cLevels.size()) return m_nBits;
+            nPos = nPos / 64 + 1;
+            nLevel++;
+        }
+
+        // descend to the lowest set bit of the word found
+        while (nLevel > 0) {
+            nLevel--;
+            nPos = nPos * 64 + __builtin_ctzll(m_cLevels[nLevel][nPos]);
+        }
+
+        return nPos;
+    }
+
+
+    /**
+     * find the next cleared slot
+     *
+     * @param   nPos        first slot to consider
+     * @return  the first cleared slot >= nPos (or bits() if there is none)
+     */
+    inline uint64_t next_clear(uint64_t nPos) const {
+
+        std::vector<uint64_t> const & cLevel = m_cLevels[0];
+        while (nPos < m_nBits) {
+            uint64_t nWord = ~cLevel[nPos / 64] & (~uint64_t(0) << (nPos % 64));
+            if (nWord) {
+                nPos = (nPos / 64) * 64 + __builtin_ctzll(nWord);
+                break;
+            }
+            nPos = (nPos / 64 + 1) * 64;
+        }
+
+        return (nPos < m_nBits ? nPos : m_nBits);
+    }
+
+
+    /**
+     * set a slot
+     *
+     * @param   nPos        the slot
+     */
+    inline void set(uint64_t nPos) {
+        for (auto & cLevel : m_cLevels) {
+            uint64_t & nWord = cLevel[nPos / 64];
+            bool bWasEmpty = (nWord == 0);
+            nWord |= (uint64_t(1) << (nPos % 64));
+            if (!bWasEmpty) break;
+            nPos /= 64;
+        }
+    }
+
+
+    /**
+     * set or clear a slot
+     *
+     * @param   nPos        the slot
+     * @param   bValue      the new value
+     */
+    inline void set(uint64_t nPos, bool bValue) {
+        if (bValue) set(nPos);
+        else clear(nPos);
+    }
+
+
+private:
+
+
+    /**
+     * number of slots
+     */
+    uint64_t m_nBits;
+
+
+    /**
+     * the bitmap levels: 0 is the slot level
+     */
+    std::vector<std::vector<uint64_t>> m_cLevels;
+
+};
+
+
+}
+
+}
+
+#endif
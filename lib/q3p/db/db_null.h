@@ -209,6 +209,17 @@ private:
     qkd::key::key get_internal(UNUSED qkd::key::key_id nKeyId) const { return qkd::key::key::null(); };
     
 
+    /**
+     * copy the key material of consecutive keys into a buffer
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cBuffer     the buffer receiving nCount * quantum() bytes
+     * @return  number of keys copied
+     */
+    uint64_t get_range_internal(UNUSED qkd::key::key_id nKeyId, UNUSED uint64_t nCount, UNUSED unsigned char * cBuffer) const { return 0; };
+    
+
     /**
      * inits the key-DB
      * 
@@ -248,6 +259,16 @@ private:
     qkd::key::key_id insert_internal(UNUSED qkd::key::key cKey) { return 0; };
     
 
+    /**
+     * inserts a bunch of key material into the DB
+     * 
+     * @param   cData       nCount * quantum() bytes of key material
+     * @param   nCount      number of keys in cData
+     * @return  the IDs of the new keys (in the order of cData)
+     */
+    qkd::key::key_vector insert_range_internal(UNUSED unsigned char const * cData, UNUSED uint64_t nCount) { return qkd::key::key_vector(); };
+    
+
     /**
      * return a key counter associated with the key
      * 
@@ -370,6 +391,17 @@ private:
     void set_internal(UNUSED qkd::key::key const & cKey) {};
     
 
+    /**
+     * set the key material of consecutive keys in the DB
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cData       nCount * quantum() bytes of key material
+     * @return  number of keys set
+     */
+    uint64_t set_range_internal(UNUSED qkd::key::key_id nKeyId, UNUSED uint64_t nCount, UNUSED unsigned char const * cData) { return 0; };
+    
+
     /**
      * sets a new key count value
      * 
@@ -31,6 +31,8 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
+
 // ait
 #include <qkd/common_macros.h>
 #include <qkd/q3p/db.h>
@@ -48,6 +50,21 @@ using namespace qkd::q3p;
 // code
 
 
+/**
+ * keys have been modified
+ * 
+ * This is called whenever the key material or the persistent
+ * meta data of consecutive keys changed. Subclasses writing the 
+ * DB to disk use this to flush only the dirty parts.
+ * 
+ * @param   nKeyId      the ID of the first key changed
+ * @param   nCount      number of keys changed
+ */
+void db_ram::changed(UNUSED qkd::key::key_id nKeyId, UNUSED uint64_t nCount) {
+    // nothing to persist for a memory only DB
+}
+
+
 /**
  * close the key DB
  */
@@ -63,6 +80,9 @@ void db_ram::close_internal() {
     
     m_nCount = 0;
     m_nCountRealSync = 0;
+    
+    m_cIndexSpare = db_index();
+    m_cIndexValid = db_index();
 
     if (m_cKeyData) delete [] m_cKeyData;
     if (m_cKeyMetaData) delete [] m_cKeyMetaData;
@@ -117,9 +137,12 @@ void db_ram::del_internal(qkd::key::key_id nKeyId) {
     // remember if this is a new key
     unsigned char & cKeyMeta = m_cKeyMetaData[nKeyId - min_id()];
     bool bNewKey = ((cKeyMeta & FLAG_VALID) == 0);
+    if (!bNewKey && ((cKeyMeta & FLAG_REAL_SYNC) == FLAG_REAL_SYNC)) m_nCountRealSync--;
     
     cKeyMeta = 0;
     memset(m_cKeyData + quantum() * (nKeyId - min_id()), 0, quantum());
+    index(nKeyId);
+    changed(nKeyId, 1);
         
     if (!bNewKey) m_nCount--;
 }
@@ -160,30 +183,28 @@ qkd::key::key_vector db_ram::find_continuous_internal(uint64_t nBytes, uint32_t
     qkd::key::key_vector cKeys;
     
     // how many keys do we need?
-    uint32_t nKeysNeeded = nBytes / quantum();
+    uint64_t nKeysNeeded = nBytes / quantum();
     if (nBytes % quantum()) nKeysNeeded++;
+    if (nKeysNeeded == 0) return cKeys;
     
-    // search!
-    for (qkd::key::key_id i = min_id(); i < max_id(); i++) {
-        
-        // invalid key?
-        if ((m_cKeyMetaData[i - min_id()] & (FLAG_VALID | FLAG_COUNTER)) != FLAG_VALID) {
-            cKeys.clear();
-            continue;
-        }
+    // search: jump from one run of free valid keys to the next
+    uint64_t nSlot = m_cIndexValid.next(0);
+    while (nSlot < amount()) {
         
-        // add key
-        cKeys.push_back(i);
+        uint64_t nRunEnd = m_cIndexValid.next_clear(nSlot);
+        if (nRunEnd - nSlot >= nKeysNeeded) break;
         
-        // enough?
-        if (cKeys.size() == nKeysNeeded) break;
+        nSlot = m_cIndexValid.next(nRunEnd);
     }
     
     // check if we found enough keys
-    if (cKeys.size() != nKeysNeeded) return qkd::key::key_vector();
+    if (nSlot >= amount()) return cKeys;
+    
+    cKeys.reserve(nKeysNeeded);
+    for (uint64_t i = 0; i < nKeysNeeded; i++) cKeys.push_back(min_id() + nSlot + i);
     
     // reserve keys
-    if (cKeys.size()) set_key_count(cKeys, nCount);
+    set_key_count(cKeys, nCount);
     
     return cKeys;
 }
@@ -207,27 +228,18 @@ qkd::key::key_vector db_ram::find_spare_internal(uint64_t nBytes, uint32_t nCoun
     
     // check quantum
     if (nBytes % quantum()) return cKeyIds;
+    cKeyIds.reserve(nBytes / quantum());
     
-    // search key Ids
-    qkd::key::key_id nKeyPick = min_id();
-    while (nBytes > 0) {
-        
-        nKeyPick++;
-        nKeyPick %= amount();
+    // search key Ids: an invalid key with no counter data is ok
+    // (the very first slot is not handed out)
+    for (uint64_t nSlot = m_cIndexSpare.next(1); (nBytes > 0) && (nSlot < amount()); nSlot = m_cIndexSpare.next(nSlot + 1)) {
         
-        // reached same position again: end
-        if (nKeyPick == min_id()) break;
+        // apply count
+        if (nCount) set_key_count(min_id() + nSlot, nCount);
         
-        // an invalid key with no counter data is ok
-        if ((m_cKeyMetaData[nKeyPick - min_id()] & (FLAG_VALID | FLAG_COUNTER)) == 0) {
-            
-            // apply count
-            if (nCount) set_key_count(nKeyPick, nCount);
-            
-            // hit: invalid key is spare key
-            cKeyIds.push_back(nKeyPick);
-            nBytes -= quantum();
-        }
+        // hit: invalid key is spare key
+        cKeyIds.push_back(min_id() + nSlot);
+        nBytes -= quantum();
     }
     
     return cKeyIds;
@@ -252,32 +264,39 @@ qkd::key::key_vector db_ram::find_valid_internal(uint64_t nBytes, uint32_t nCoun
     
     // check quantum
     if (nBytes % quantum()) return cKeyIds;
+    if (!opened()) return cKeyIds;
+    cKeyIds.reserve(nBytes / quantum());
+    
+    // search key Ids: start after the last pick, wrap around
+    // and stop right before the last pick again
+    uint64_t nLastPicked = m_nKeyLastPickedValid - min_id();
+    bool bWrapped = false;
+    uint64_t nSlot = m_cIndexValid.next(nLastPicked + 1);
+    if (nSlot >= amount()) {
+        nSlot = m_cIndexValid.next(0);
+        bWrapped = true;
+    }
     
-    // search key Ids
-    qkd::key::key_id nKeyPick = m_nKeyLastPickedValid;
-    while (nBytes > 0) {
-        
-        nKeyPick++;
-        nKeyPick %= amount();
+    while ((nBytes > 0) && (nSlot < amount())) {
         
         // reached same position again: end
-        if (nKeyPick == m_nKeyLastPickedValid) break;
+        if (bWrapped && (nSlot >= nLastPicked)) break;
+        
+        // apply count
+        if (nCount) set_key_count(min_id() + nSlot, nCount);
+        
+        // hit: a valid key with no counter data
+        cKeyIds.push_back(min_id() + nSlot);
+        nBytes -= quantum();
+        m_nKeyLastPickedValid = min_id() + nSlot;
         
-        // an valid key with no counter data is ok
-        if ((m_cKeyMetaData[nKeyPick - min_id()] & (FLAG_VALID | FLAG_COUNTER)) == FLAG_VALID) {
-
-            // apply count
-            if (nCount) set_key_count(nKeyPick, nCount);
-            
-            // hit: invalid key is spare key
-            cKeyIds.push_back(nKeyPick);
-            nBytes -= quantum();
+        nSlot = m_cIndexValid.next(nSlot + 1);
+        if (!bWrapped && (nSlot >= amount())) {
+            nSlot = m_cIndexValid.next(0);
+            bWrapped = true;
         }
     }
     
-    // remember last pick position
-    m_nKeyLastPickedValid = nKeyPick;
-    
     return cKeyIds;
 }
 
@@ -306,6 +325,35 @@ qkd::key::key db_ram::get_internal(qkd::key::key_id nKeyId) const {
 }
 
 
+/**
+ * copy the key material of consecutive keys into a buffer
+ * 
+ * The copy stops at the first key which is not valid.
+ * 
+ * @param   nKeyId      the ID of the first key
+ * @param   nCount      number of keys
+ * @param   cBuffer     the buffer receiving nCount * quantum() bytes
+ * @return  number of keys copied
+ */
+uint64_t db_ram::get_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char * cBuffer) const {
+    
+    // sanity check
+    if (!opened()) return 0;
+    if (nKeyId < min_id()) return 0;
+    if (nKeyId >= max_id()) return 0;
+    nCount = std::min<uint64_t>(nCount, max_id() - nKeyId);
+    
+    // length of the valid run
+    unsigned char const * cMeta = m_cKeyMetaData + (nKeyId - min_id());
+    uint64_t nValid = 0;
+    while ((nValid < nCount) && ((cMeta[nValid] & FLAG_VALID) == FLAG_VALID)) nValid++;
+    
+    memcpy(cBuffer, m_cKeyData + quantum() * (nKeyId - min_id()), quantum() * nValid);
+    
+    return nValid;
+}
+
+
 /**
  * return a key counter associated with the key
  * 
@@ -318,6 +366,19 @@ uint32_t db_ram::key_count_internal(qkd::key::key_id nKeyId) const {
 }
 
 
+/**
+ * update the slot indices of a key from its meta data
+ * 
+ * @param   nKeyId      the ID of the key
+ */
+void db_ram::index(qkd::key::key_id nKeyId) {
+    uint64_t nSlot = nKeyId - min_id();
+    unsigned char nMeta = m_cKeyMetaData[nSlot] & (FLAG_VALID | FLAG_COUNTER);
+    m_cIndexValid.set(nSlot, nMeta == FLAG_VALID);
+    m_cIndexSpare.set(nSlot, nMeta == 0);
+}
+
+
 /**
  * inits the key-DB
  * 
@@ -381,15 +442,13 @@ qkd::key::key_id db_ram::insert_internal(qkd::key::key cKey) {
     // sanity check
     if (cKey.size() != quantum()) return 0;
     
-    // get the last one picked
-    qkd::key::key_id nKeyId = m_nKeyLastInserted + 1;
-    while (m_nKeyLastInserted != nKeyId) {
-        if ((m_cKeyMetaData[nKeyId - min_id()] & FLAG_VALID) != FLAG_VALID) break;
-        nKeyId++;
-        if (nKeyId == max_id()) nKeyId = min_id();
-    }
+    // get the next spare after the last one picked
+    uint64_t nSlot = m_cIndexSpare.next(m_nKeyLastInserted - min_id() + 1);
+    if (nSlot >= amount()) nSlot = m_cIndexSpare.next(0);
     
     // found?
+    if (nSlot >= amount()) return 0;
+    qkd::key::key_id nKeyId = min_id() + nSlot;
     if (m_nKeyLastInserted == nKeyId) return 0;
     
     // insert key
@@ -407,6 +466,54 @@ qkd::key::key_id db_ram::insert_internal(qkd::key::key cKey) {
 }
 
 
+/**
+ * inserts a bunch of key material into the DB
+ * 
+ * @param   cData       nCount * quantum() bytes of key material
+ * @param   nCount      number of keys in cData
+ * @return  the IDs of the new keys (in the order of cData)
+ */
+qkd::key::key_vector db_ram::insert_range_internal(unsigned char const * cData, uint64_t nCount) {
+    
+    qkd::key::key_vector cKeyIds;
+    
+    // sanity check
+    if (!opened()) return cKeyIds;
+    cKeyIds.reserve(nCount);
+    
+    // as with insert_internal: continue after the last inserted key
+    uint64_t nSlot = m_cIndexSpare.next(m_nKeyLastInserted - min_id() + 1);
+    bool bWrapped = false;
+    
+    while (cKeyIds.size() < nCount) {
+        
+        if (nSlot >= amount()) {
+            if (bWrapped) break;
+            nSlot = m_cIndexSpare.next(0);
+            bWrapped = true;
+            continue;
+        }
+        
+        // fill the run of spare keys with one copy
+        uint64_t nRun = std::min<uint64_t>(m_cIndexSpare.next_clear(nSlot) - nSlot, nCount - cKeyIds.size());
+        memcpy(m_cKeyData + quantum() * nSlot, cData + quantum() * cKeyIds.size(), quantum() * nRun);
+        for (uint64_t i = 0; i < nRun; i++) {
+            m_cKeyMetaData[nSlot + i] = FLAG_VALID;
+            m_cIndexSpare.clear(nSlot + i);
+            m_cIndexValid.set(nSlot + i);
+            cKeyIds.push_back(min_id() + nSlot + i);
+        }
+        m_nCount += nRun;
+        m_nKeyLastInserted = min_id() + nSlot + nRun - 1;
+        changed(min_id() + nSlot, nRun);
+        
+        nSlot = m_cIndexSpare.next(nSlot + nRun);
+    }
+    
+    return cKeyIds;
+}
+
+
 /**
  * opened DB flag
  * 
@@ -444,13 +551,37 @@ void db_ram::reset_internal() {
     m_nKeyLastPickedSpare = 0;
     m_nKeyLastPickedValid = 0;
     
-    // clear meta data
+    // clear meta data: 8 keys at once
     m_nCount = 0;
     m_nCountRealSync = 0;
-    for (qkd::key::key_id nKeyId = min_id(); nKeyId < max_id(); nKeyId++) {
-        m_cKeyMetaData[nKeyId - min_id()] &= FLAG_PERSISTENT;
-        if ((m_cKeyMetaData[nKeyId - min_id()] & FLAG_VALID) == FLAG_VALID) m_nCount++;
-        if ((m_cKeyMetaData[nKeyId - min_id()] & (FLAG_VALID | FLAG_REAL_SYNC)) == (FLAG_VALID | FLAG_REAL_SYNC)) m_nCountRealSync++;
+    m_cIndexValid = db_index(amount());
+    m_cIndexSpare = db_index(amount(), true);
+    
+    static uint64_t const nFlagPersistent = 0x0101010101010101ull * FLAG_PERSISTENT;
+    static uint64_t const nFlagValid = 0x0101010101010101ull * FLAG_VALID;
+    
+    uint64_t nSlot = 0;
+    for ( ; nSlot + 8 <= amount(); nSlot += 8) {
+        
+        uint64_t nMeta;
+        memcpy(&nMeta, m_cKeyMetaData + nSlot, 8);
+        nMeta &= nFlagPersistent;
+        memcpy(m_cKeyMetaData + nSlot, &nMeta, 8);
+        
+        // FLAG_REAL_SYNC is the bit right below FLAG_VALID
+        uint64_t nValid = nMeta & nFlagValid;
+        m_nCount += __builtin_popcountll(nValid);
+        m_nCountRealSync += __builtin_popcountll(nValid & (nMeta << 1));
+        
+        // blocks without any valid key are spare already
+        if (nValid == 0) continue;
+        for (uint64_t i = 0; i < 8; i++) index(min_id() + nSlot + i);
+    }
+    for ( ; nSlot < amount(); nSlot++) {
+        m_cKeyMetaData[nSlot] &= FLAG_PERSISTENT;
+        if ((m_cKeyMetaData[nSlot] & FLAG_VALID) == FLAG_VALID) m_nCount++;
+        if ((m_cKeyMetaData[nSlot] & (FLAG_VALID | FLAG_REAL_SYNC)) == (FLAG_VALID | FLAG_REAL_SYNC)) m_nCountRealSync++;
+        index(min_id() + nSlot);
     }
 }
 
@@ -506,6 +637,7 @@ void db_ram::set_eventual_sync_internal(qkd::key::key_id nKeyId) {
     // remove the real flag and set the eventual flag
     m_cKeyMetaData[nKeyId - min_id()] &= ~FLAG_REAL_SYNC; 
     m_cKeyMetaData[nKeyId - min_id()] |= FLAG_EVENTUAL_SYNC;
+    changed(nKeyId, 1);
 }
 
 
@@ -524,6 +656,7 @@ void db_ram::set_injected_internal(qkd::key::key_id nKeyId) {
     
     // remove the real flag and set the eventual flag
     m_cKeyMetaData[nKeyId - min_id()] |= FLAG_INJECTED;
+    changed(nKeyId, 1);
 }
 
 
@@ -565,15 +698,57 @@ void db_ram::set_internal(qkd::key::key const & cKey) {
     // remember if this is a new key
     unsigned char & cKeyMeta = m_cKeyMetaData[cKey.id() - min_id()];
     bool bNewKey = ((cKeyMeta & FLAG_VALID) == 0);
+    if (!bNewKey && ((cKeyMeta & FLAG_REAL_SYNC) == FLAG_REAL_SYNC)) m_nCountRealSync--;
     
     // set the key material
     cKeyMeta = FLAG_VALID;
     memcpy(m_cKeyData + quantum() * (cKey.id() - min_id()), cKey.data().get(), quantum());
+    index(cKey.id());
+    changed(cKey.id(), 1);
     
     if (bNewKey) m_nCount++;
 }
 
 
+/**
+ * set the key material of consecutive keys in the DB
+ * 
+ * @param   nKeyId      the ID of the first key
+ * @param   nCount      number of keys
+ * @param   cData       nCount * quantum() bytes of key material
+ * @return  number of keys set
+ */
+uint64_t db_ram::set_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char const * cData) {
+    
+    // sanity check
+    if (!opened()) return 0;
+    if (nKeyId < min_id()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "refused to set key with id " << nKeyId << ": minimum key id is: " << min_id();
+        return 0;
+    }
+    if (nKeyId >= max_id()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "refused to set key with id " << nKeyId << ": maximum key id is: " << max_id() - 1;
+        return 0;
+    }
+    nCount = std::min<uint64_t>(nCount, max_id() - nKeyId);
+    
+    // fix meta data and counters
+    unsigned char * cMeta = m_cKeyMetaData + (nKeyId - min_id());
+    for (uint64_t i = 0; i < nCount; i++) {
+        if ((cMeta[i] & FLAG_VALID) == 0) m_nCount++;
+        else if ((cMeta[i] & FLAG_REAL_SYNC) == FLAG_REAL_SYNC) m_nCountRealSync--;
+        cMeta[i] = FLAG_VALID;
+        index(nKeyId + i);
+    }
+    
+    // set the key material
+    memcpy(m_cKeyData + quantum() * (nKeyId - min_id()), cData, quantum() * nCount);
+    changed(nKeyId, nCount);
+    
+    return nCount;
+}
+
+
 /**
  * sets a new key count value
  * 
@@ -590,6 +765,7 @@ void db_ram::set_key_count_internal(qkd::key::key_id nKeyId, uint32_t nCount) {
     // max is FLAG_COUNTER
     unsigned char nBitMask = std::min<unsigned char>(nCount, FLAG_COUNTER);
     m_cKeyMetaData[nKeyId - min_id()] = (m_cKeyMetaData[nKeyId - min_id()] & FLAG_PERSISTENT) | nBitMask;
+    index(nKeyId);
 }
 
 
@@ -625,6 +801,7 @@ void db_ram::set_real_sync_internal(qkd::key::key_id nKeyId) {
     // remove the eventual flag and set the real flag
     m_cKeyMetaData[nKeyId - min_id()] &= ~FLAG_EVENTUAL_SYNC; 
     m_cKeyMetaData[nKeyId - min_id()] |= FLAG_REAL_SYNC;
+    changed(nKeyId, 1);
 }
 
 
@@ -44,6 +44,8 @@
 #include <qkd/key/key.h>
 #include <qkd/q3p/db.h>
 
+#include "db_index.h"
+
 
 // ------------------------------------------------------------
 // defs
@@ -107,6 +109,19 @@ public:
 protected:
     
     
+    /**
+     * keys have been modified
+     * 
+     * This is called whenever the key material or the persistent
+     * meta data of consecutive keys changed. Subclasses writing the 
+     * DB to disk use this to flush only the dirty parts.
+     * 
+     * @param   nKeyId      the ID of the first key changed
+     * @param   nCount      number of keys changed
+     */
+    virtual void changed(qkd::key::key_id nKeyId, uint64_t nCount);
+    
+    
     /**
      * get the data of the DB
      * 
@@ -247,6 +262,27 @@ private:
     qkd::key::key get_internal(qkd::key::key_id nKeyId) const;
     
 
+    /**
+     * copy the key material of consecutive keys into a buffer
+     * 
+     * The copy stops at the first key which is not valid.
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cBuffer     the buffer receiving nCount * quantum() bytes
+     * @return  number of keys copied
+     */
+    uint64_t get_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char * cBuffer) const;
+    
+
+    /**
+     * update the slot indices of a key from its meta data
+     * 
+     * @param   nKeyId      the ID of the key
+     */
+    void index(qkd::key::key_id nKeyId);
+    
+
     /**
      * inits the key-DB
      * 
@@ -286,6 +322,16 @@ private:
     qkd::key::key_id insert_internal(qkd::key::key cKey);
     
 
+    /**
+     * inserts a bunch of key material into the DB
+     * 
+     * @param   cData       nCount * quantum() bytes of key material
+     * @param   nCount      number of keys in cData
+     * @return  the IDs of the new keys (in the order of cData)
+     */
+    qkd::key::key_vector insert_range_internal(unsigned char const * cData, uint64_t nCount);
+    
+
     /**
      * return a key counter associated with the key
      * 
@@ -408,6 +454,17 @@ private:
     void set_internal(qkd::key::key const & cKey);
     
 
+    /**
+     * set the key material of consecutive keys in the DB
+     * 
+     * @param   nKeyId      the ID of the first key
+     * @param   nCount      number of keys
+     * @param   cData       nCount * quantum() bytes of key material
+     * @return  number of keys set
+     */
+    uint64_t set_range_internal(qkd::key::key_id nKeyId, uint64_t nCount, unsigned char const * cData);
+    
+
     /**
      * sets a new key count value
      * 
@@ -469,6 +526,18 @@ private:
     unsigned char * m_cKeyData;
 
 
+    /**
+     * index of spare keys: not valid and no counter
+     */
+    db_index m_cIndexSpare;
+
+
+    /**
+     * index of valid keys with no counter
+     */
+    db_index m_cIndexValid;
+
+
     /**
      * key id last added
      */
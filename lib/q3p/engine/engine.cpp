@@ -31,10 +31,19 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <thread>
+#include <vector>
+
+#include <string.h>
 
 // Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEventLoop>
+#include <QtCore/QThread>
 #include <QtCore/QTimer>
 #include <QtDBus/QDBusConnection>
 #include <QtNetwork/QTcpServer>
@@ -55,6 +64,7 @@
 
 #include "socket_error_strings.h"
 
+#include "protocol/acquire.h"
 #include "protocol/data.h"
 #include "protocol/handshake.h"
 #include "protocol/load.h"
@@ -76,11 +86,74 @@ using namespace qkd::q3p;
 #define MODULE_DESCRIPTION      "This is the qkd-keystore QKD Module."
 #define MODULE_ORGANISATION     "(C)opyright 2012-2016 AIT Austrian Institute of Technology, http://www.ait.ac.at"
 
+#define MAX_PICKUP_KEYS         1024        /**< maximum number of pipeline keys waiting for STORE */
+#define SYNC_TIMEOUTS           4           /**< number of timer runs between syncs of the common store */
+#define ACQUIRE_POLL_MSEC       10          /**< acquire_keys() on the engine's thread: maximum time between checks */
+#define ACQUIRE_RETRY_MSEC      50          /**< acquire_keys(): pause before asking the slave again after a refusal */
+#define ACQUIRE_GRANT_SEC       60          /**< seconds keys granted by the master wait for the application (slave) */
+
 
 // ------------------------------------------------------------
 // decl
 
 
+/**
+ * acquire_keys() statistics of a single application
+ */
+class acquire_statistics {
+    
+    
+public:
+    
+    
+    /**
+     * ctor
+     */
+    acquire_statistics() : nRequests(0), nFailed(0), nLatencyTotal(0), nLatencyMax(0) {};
+    
+    uint64_t nRequests;                             /**< number of requests */
+    uint64_t nFailed;                               /**< number of requests failed */
+    uint64_t nLatencyTotal;                         /**< sum of all request latencies in microseconds */
+    uint64_t nLatencyMax;                           /**< maximum request latency in microseconds */
+};
+
+
+/**
+ * an acquire_keys() request sent to the slave (master)
+ */
+class pending_request {
+    
+    
+public:
+    
+    
+    /**
+     * ctor
+     */
+    pending_request() : nAppId(0), nSequence(0), bAnswered(false), bGranted(false), bAbandoned(false) {};
+    
+    uint64_t nAppId;                                /**< the application id */
+    uint64_t nSequence;                             /**< the number of the call of the application */
+    qkd::key::key_vector cKeys;                     /**< the application buffer keys reserved */
+    bool bAnswered;                                 /**< the slave answered */
+    bool bGranted;                                  /**< the slave reserved the keys */
+    bool bAbandoned;                                /**< the acquire_keys() call gave up waiting */
+};
+
+
+/**
+ * keys committed by the master for an application (slave)
+ */
+class granted_keys {
+    
+    
+public:
+    
+    qkd::key::key_vector cKeys;                     /**< the application buffer keys reserved */
+    std::chrono::steady_clock::time_point nGranted; /**< when the master committed the keys */
+};
+
+
 /**
  * the engine pimpl
  */
@@ -104,6 +177,10 @@ public:
         
         m_bMaster = false;
         m_bSlave = false;
+        m_bCompactKeyIds = false;
+        m_bAcquireSupported = false;
+        m_bDataBatch = false;
+        m_bRefillPending = false;
         
         m_eLinkState = engine_state::ENGINE_INIT;
         
@@ -111,7 +188,9 @@ public:
         
         m_cServer = nullptr;
         m_cSocket = nullptr;
+        m_nRecvSize = 0;
         
+        m_cProtocol.cAcquire = nullptr;
         m_cProtocol.cData = nullptr;
         m_cProtocol.cHandshake = nullptr;
         m_cProtocol.cLoad = nullptr;
@@ -119,8 +198,14 @@ public:
         m_cProtocol.cStore = nullptr;
         
         m_nChannelId = 0;
+        m_nShmSize = 0;
         
         m_cTimer = nullptr;
+        m_nTimeouts = 0;
+        
+        m_nAcquireTicket = 0;
+        m_nAcquireEpoch = 0;
+        m_nAcquireCalls = 0;
     };
     
     QDBusConnection m_cDBus;                        /**< the DBus connection used */
@@ -131,13 +216,18 @@ public:
     
     bool m_bMaster;                                 /**< master flag */
     bool m_bSlave;                                  /**< slave flag */
+    bool m_bCompactKeyIds;                          /**< key id sets are sent as ranges */
+    bool m_bAcquireSupported;                       /**< the peer speaks the ACQUIRE protocol */
+    bool m_bDataBatch;                              /**< the peer takes several packets in one DATA message */
+    bool m_bRefillPending;                          /**< a refill of the buffers has been scheduled */
     
     engine_state m_eLinkState;                      /**< engine state */
     
     bool m_bConnected;                              /**< connected flag */
     QTcpServer * m_cServer;                         /**< listen server */
     QAbstractSocket * m_cSocket;                    /**< connection to peer */
-    QByteArray m_cRecvBuffer;                       /**< the data received so far but not yet managed */
+    std::vector<char> m_cRecvBuffer;                /**< the data received so far but not yet managed */
+    uint64_t m_nRecvSize;                           /**< number of bytes used in m_cRecvBuffer */
     
     bool m_bReconnect;                              /**< flag to reconnect */
     QHostAddress m_cPeerAddress;                    /**< peer address we connected to */
@@ -148,6 +238,7 @@ public:
      */
     struct {
         
+        protocol::acquire * cAcquire;               /**< acquire protocol */
         protocol::protocol * cData;                 /**< data protocol */
         protocol::protocol * cHandshake;            /**< handshake protocol */
         protocol::protocol * cLoad;                 /**< load protocol */
@@ -160,6 +251,7 @@ public:
     qkd::q3p::nic m_cNIC;                           /**< network interface "card" */
     std::string m_sNICIP4Local;                     /**< local IP4 address */
     std::string m_sNICIP4Remote;                    /**< remote IP4 address */
+    uint64_t m_nShmSize;                            /**< size of the shared memory key ring (0: use the MQ) */
     
     
     // TODO: Stefan
@@ -186,6 +278,29 @@ public:
     qkd::key::key m_cInitialSecret;                 /**< the initial secret */
     
     QTimer * m_cTimer;                              /**< timer for protocol checks */
+    uint64_t m_nTimeouts;                           /**< number of timer runs so far */
+    
+    
+    /**
+     * the pickup store: keys read from the pipeline waiting for STORE
+     */
+    std::map<qkd::key::key_id, qkd::key::key> m_cPickupStore;
+    mutable std::mutex m_cPickupMutex;              /**< pickup store guard: process() runs in the module worker */
+    
+    
+    /**
+     * the acquire_keys() wait queues: sequence numbers in order of arrival per application
+     */
+    std::map<uint64_t, std::list<uint64_t>> m_cAcquireQueue;
+    std::map<uint64_t, uint64_t> m_cAcquireSequence;                /**< sequence number of the next call per application */
+    uint64_t m_nAcquireEpoch;                       /**< bumped on disconnect: the sequence numbers restart */
+    uint64_t m_nAcquireTicket;                      /**< next ticket handed out */
+    uint64_t m_nAcquireCalls;                       /**< number of DBus acquire() calls served on threads of their own */
+    std::condition_variable m_cAcquireCondition;    /**< wakes acquire_keys() waiters on charge changes and peer answers */
+    std::map<uint64_t, acquire_statistics> m_cAcquireStatistics;    /**< statistics per application */
+    std::map<uint64_t, pending_request> m_cAcquireRequests;         /**< requests sent to the slave by ticket (master) */
+    std::map<uint64_t, std::map<uint64_t, granted_keys>> m_cAcquireGrants;      /**< keys committed by the master per application and sequence number (slave) */
+    mutable std::mutex m_cAcquireMutex;             /**< guards the acquire_keys() data */
 
 };
 
@@ -200,6 +315,17 @@ public:
 static engine_map g_cEngines;
 
 
+/**
+ * guards g_cEngines: engines may run on their own threads
+ */
+static std::recursive_mutex g_cEnginesMutex;
+
+
+// fwd
+static QByteArray acquire_material(qkd::q3p::engine_instance * cEngine, uint64_t nAppId, uint64_t nBytes, uint64_t nTimeout);
+static void acquire_wait(std::unique_lock<std::mutex> & cLock, std::condition_variable & cCondition, std::chrono::high_resolution_clock::time_point const & nUntil, bool bEngineThread);
+
+
 // ------------------------------------------------------------
 // code
 
@@ -253,6 +379,12 @@ engine_instance::engine_instance(QString const & sNode, QString const & sId) : q
  * dtor
  */
 engine_instance::~engine_instance() {
+    
+    // let the DBus acquire() calls still waiting give up
+    std::unique_lock<std::mutex> cLock(d->m_cAcquireMutex);
+    d->m_nAcquireEpoch++;
+    d->m_cAcquireCondition.notify_all();
+    while (d->m_nAcquireCalls) d->m_cAcquireCondition.wait(cLock);
 }
 
 
@@ -286,32 +418,429 @@ bool engine_instance::accept(qkd::key::key const & cKey) const {
 
 
 /**
- * request keys from the application buffer
+ * request keys from the application buffer (DBus)
+ * 
+ * This is acquire_keys() for DBus clients. The engine's thread 
+ * does not wait for the key material: the call is served on a 
+ * thread of its own which sends the DBus reply once done.
  * 
- * the given key material is extracted from the application buffers
- * on both sides based on the given application identifier and size.
+ * @param   nAppId          the application id
+ * @param   nBytes          number of bytes requested
+ * @param   nTimeout        timeout in milliseconds
+ * @return  the key material (empty on failure)
+ */
+QByteArray engine_instance::acquire(qulonglong nAppId, qulonglong nBytes, qulonglong nTimeout) {
+    
+    if (!calledFromDBus()) return acquire_material(this, nAppId, nBytes, nTimeout);
+    
+    setDelayedReply(true);
+    QDBusConnection cConnection = QDBusContext::connection();
+    QDBusMessage cMessage = QDBusContext::message();
+    {
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        d->m_nAcquireCalls++;
+    }
+    
+    std::thread([this, cConnection, cMessage, nAppId, nBytes, nTimeout]() {
+        
+        QByteArray cKeyMaterial = acquire_material(this, nAppId, nBytes, nTimeout);
+        QDBusConnection(cConnection).send(cMessage.createReply(QVariant(cKeyMaterial)));
+        
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        d->m_nAcquireCalls--;
+        d->m_cAcquireCondition.notify_all();
+    }).detach();
+    
+    return QByteArray();
+}
+
+
+/**
+ * the slave answered an ACQUIRE request (master)
  * 
- * The method returns successfully if the requested key material has
- * been placed into the cKeys object on both sides (local and remote).
+ * This is called by the ACQUIRE protocol. If the waiting
+ * acquire_keys() call gave up already the keys are released.
+ * 
+ * @param   nTicket         the request ticket
+ * @param   bGranted        the slave reserved the keys
+ * @return  true, if the keys are handed out (and the slave is to commit)
+ */
+bool engine_instance::acquire_answer(uint64_t nTicket, bool bGranted) {
+    
+    std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+    
+    auto iter = d->m_cAcquireRequests.find(nTicket);
+    if (iter == d->m_cAcquireRequests.end()) return false;
+    
+    if ((*iter).second.bAbandoned) {
+        application_buffer()->set_key_count((*iter).second.cKeys, 0);
+        d->m_cAcquireRequests.erase(iter);
+        return false;
+    }
+    
+    (*iter).second.bAnswered = true;
+    (*iter).second.bGranted = bGranted;
+    d->m_cAcquireCondition.notify_all();
+    
+    return bGranted;
+}
+
+
+/**
+ * drop keys granted by the master the application never picked up (slave)
+ */
+void engine_instance::acquire_expire() {
+    
+    qkd::key::key_vector cExpired;
+    auto nNow = std::chrono::steady_clock::now();
+    
+    {
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        for (auto iter = d->m_cAcquireGrants.begin(); iter != d->m_cAcquireGrants.end(); ) {
+            
+            auto & cGrants = (*iter).second;
+            for (auto iterGrant = cGrants.begin(); iterGrant != cGrants.end(); ) {
+                
+                if (std::chrono::duration_cast<std::chrono::seconds>(nNow - (*iterGrant).second.nGranted).count() <= ACQUIRE_GRANT_SEC) {
+                    ++iterGrant;
+                    continue;
+                }
+                
+                qkd::utility::syslog::info() << "dropped " << (*iterGrant).second.cKeys.size() << " application keys for app #" << (*iter).first << " - not picked up for " << ACQUIRE_GRANT_SEC << " seconds";
+                cExpired.insert(cExpired.end(), (*iterGrant).second.cKeys.begin(), (*iterGrant).second.cKeys.end());
+                iterGrant = cGrants.erase(iterGrant);
+            }
+            
+            if (cGrants.empty()) iter = d->m_cAcquireGrants.erase(iter);
+            else ++iter;
+        }
+    }
+    
+    if (cExpired.empty()) return;
+    application_buffer()->del(cExpired);
+    application_buffer()->emit_charge_change(0, cExpired.size());
+}
+
+
+/**
+ * acquire protocol failed
+ * 
+ * @param   nReason     reason why it failed (protocol::protocol_error code)
+ */
+void engine_instance::acquire_failed(uint8_t nReason) {
+    std::string sError = qkd::q3p::protocol::protocol::protocol_error_description((qkd::q3p::protocol::protocol_error)nReason).toStdString();
+    qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "ACQUIRE protocol failed! Reason: " << nReason << " - " << sError;
+}
+
+
+/**
+ * the master committed keys for an application (slave)
+ * 
+ * This is called by the ACQUIRE protocol. The keys are handed
+ * out with the acquire_keys() call of the application with the
+ * same sequence number. If this call gave up already the keys
+ * are dropped: the master handed them out.
+ * 
+ * @param   nAppId          the application id
+ * @param   nSequence       the number of the call of the application
+ * @param   cKeys           the application buffer keys (reserved)
+ */
+void engine_instance::acquire_grant(uint64_t nAppId, uint64_t nSequence, qkd::key::key_vector const & cKeys) {
+    
+    {
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        
+        bool bGone = (nSequence < d->m_cAcquireSequence[nAppId]);
+        auto iter = d->m_cAcquireQueue.find(nAppId);
+        if (bGone && (iter != d->m_cAcquireQueue.end())) {
+            bGone = (std::find((*iter).second.begin(), (*iter).second.end(), nSequence) == (*iter).second.end());
+        }
+        
+        if (!bGone) {
+            granted_keys & cGrant = d->m_cAcquireGrants[nAppId][nSequence];
+            cGrant.cKeys = cKeys;
+            cGrant.nGranted = std::chrono::steady_clock::now();
+            d->m_cAcquireCondition.notify_all();
+            return;
+        }
+    }
+    
+    qkd::utility::syslog::info() << "dropped " << cKeys.size() << " application keys for app #" << nAppId << " - call #" << nSequence << " gave up already";
+    application_buffer()->del(cKeys);
+    application_buffer()->emit_charge_change(0, cKeys.size());
+}
+
+
+/**
+ * request keys from the application buffer
+ * 
+ * the given key material is extracted from the application buffer.
+ * The keys are agreed with the peer by the ACQUIRE protocol: the
+ * calls of an application are numbered on both sides (starting
+ * with 0 on each connection). The master picks the keys and sends
+ * the number of the call along, the slave hands the very same keys
+ * to its call with this number. Hence the n-th request of an 
+ * application on the master gets the same key material as the n-th 
+ * request of this application on the slave, even if calls in 
+ * between failed on either side.
+ * 
+ * Concurrent callers of the same application are served in the
+ * order of their arrival. A caller waits until the keys are agreed
+ * with the peer or the timeout has passed. Called on the engine's 
+ * own thread this runs a local event loop while waiting, so the 
+ * engine still talks to the peer and refills the application buffer.
  * 
  * the number of bytes requested must be a multiple of the application
  * buffer key quantum (usually 32 bits == 4 bytes).
  * 
  * the method fails:
  *  - if we lack a peer and/or if we have insufficient key material left in the application buffer
- *  - if the peer didn't acquire keys within the timeout
+ *  - if the peer does not support the ACQUIRE protocol
+ *  - if the key material did not arrive within the timeout
+ *  - on the slave: if the master handed out a different amount of key material for the request
  * 
  * @param   cKeys           this will receive the key material (any previous content will be zapped)
  * @param   nAppId          the application id: this identifies the request on both sides
  * @param   nBytes          number of bytes requested
- * @param   nTimeout        timeout in millisecond to wait for peer to acquire as well
+ * @param   nTimeout        timeout in millisecond to wait for key material
  * @return  true, if successful
  */
-bool engine_instance::acquire_keys(UNUSED qkd::key::key_ring & cKeys, UNUSED uint64_t nAppId, UNUSED uint64_t nBytes, UNUSED std::chrono::milliseconds nTimeout) {
+bool engine_instance::acquire_keys(qkd::key::key_ring & cKeys, uint64_t nAppId, uint64_t nBytes, std::chrono::milliseconds nTimeout) {
+    
+    auto nStart = std::chrono::high_resolution_clock::now();
+    auto nDeadline = nStart + nTimeout;
+    cKeys = qkd::key::key_ring(nBytes);
+    
+    qkd::key::key_vector cKeyIds;
+    uint64_t nDiscarded = 0;
+    
+    std::unique_lock<std::mutex> cLock(d->m_cAcquireMutex);
+    
+    bool bValid = connected() && acquire_supported() && (nBytes > 0) && ((nBytes % application_buffer()->quantum()) == 0);
+    bool bEngineThread = (QThread::currentThread() == QObject::thread());
+    
+    // number the call and wait in line
+    uint64_t nEpoch = d->m_nAcquireEpoch;
+    uint64_t nSequence = (bValid ? d->m_cAcquireSequence[nAppId]++ : 0);
+    uint64_t nTicket = d->m_nAcquireTicket++;
+    std::list<uint64_t> & cQueue = d->m_cAcquireQueue[nAppId];
+    if (bValid) cQueue.push_back(nSequence);
+    
+    bool bPending = false;
+    auto nRetry = nStart;
+    
+    while (bValid) {
+        
+        auto nNow = std::chrono::high_resolution_clock::now();
+        
+        // disconnected meanwhile: the numbering restarts
+        if (d->m_nAcquireEpoch != nEpoch) break;
+        
+        if (master()) {
+            
+            // the slave answered our request
+            if (bPending && d->m_cAcquireRequests[nTicket].bAnswered) {
+                
+                bool bGranted = d->m_cAcquireRequests[nTicket].bGranted;
+                d->m_cAcquireRequests.erase(nTicket);
+                bPending = false;
+                if (bGranted) break;
+                
+                // the slave lacks some of the keys: try again shortly
+                application_buffer()->set_key_count(cKeyIds, 0);
+                cKeyIds.clear();
+                nRetry = nNow + std::chrono::milliseconds(ACQUIRE_RETRY_MSEC);
+                if (!connected()) break;
+            }
+            
+            // first in line: reserve the keys and ask the slave to do the same
+            if (!bPending && (cQueue.front() == nSequence) && (nNow >= nRetry)) {
+                
+                cKeyIds = application_buffer()->find_valid(nBytes, 1);
+                if (cKeyIds.size() * application_buffer()->quantum() == nBytes) {
+                    
+                    pending_request & cRequest = d->m_cAcquireRequests[nTicket];
+                    cRequest.nAppId = nAppId;
+                    cRequest.nSequence = nSequence;
+                    cRequest.cKeys = cKeyIds;
+                    bPending = true;
+                    
+                    // the socket is served on the engine's thread
+                    QMetaObject::invokeMethod(this, "acquire_request", Qt::QueuedConnection, Q_ARG(qulonglong, nTicket));
+                }
+                else {
+                    application_buffer()->set_key_count(cKeyIds, 0);
+                    cKeyIds.clear();
+                }
+            }
+        }
+        else {
+            
+            // pick the keys the master committed for this very call
+            auto iter = d->m_cAcquireGrants.find(nAppId);
+            auto iterGrant = (iter != d->m_cAcquireGrants.end() ? (*iter).second.find(nSequence) : std::map<uint64_t, granted_keys>::iterator());
+            if ((iter != d->m_cAcquireGrants.end()) && (iterGrant != (*iter).second.end())) {
+                
+                cKeyIds = (*iterGrant).second.cKeys;
+                (*iter).second.erase(iterGrant);
+                if ((*iter).second.empty()) d->m_cAcquireGrants.erase(iter);
+                
+                if (cKeyIds.size() * application_buffer()->quantum() != nBytes) {
+                    qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                            << "master handed out " << cKeyIds.size() * application_buffer()->quantum() 
+                            << " bytes for app #" << nAppId << " but " << nBytes << " bytes requested: keys discarded";
+                    application_buffer()->del(cKeyIds);
+                    nDiscarded = cKeyIds.size();
+                    cKeyIds.clear();
+                }
+                break;
+            }
+        }
+        
+        if (nNow >= nDeadline) break;
+        auto nUntil = nDeadline;
+        if (!bPending && (nRetry > nNow)) nUntil = std::min(nUntil, nRetry);
+        acquire_wait(cLock, d->m_cAcquireCondition, nUntil, bEngineThread);
+    }
+    
+    // gave up waiting for the slave: the answer releases the keys
+    if (bPending) {
+        if (d->m_cAcquireRequests[nTicket].bAnswered) d->m_cAcquireRequests.erase(nTicket);
+        else d->m_cAcquireRequests[nTicket].bAbandoned = true;
+        cKeyIds.clear();
+    }
+    
+    // leave the line and let the next one try
+    if (bValid) cQueue.erase(std::find(cQueue.begin(), cQueue.end(), nSequence));
+    if (cQueue.empty()) d->m_cAcquireQueue.erase(nAppId);
+    d->m_cAcquireCondition.notify_all();
+    
+    // grab the key material
+    if (!cKeyIds.empty()) {
+        
+        qkd::utility::memory cKeyMaterial(nBytes);
+        uint64_t nKeysCopied = application_buffer()->get_range(cKeyIds, cKeyMaterial.get());
+        if (nKeysCopied == cKeyIds.size()) {
+            cKeys << qkd::key::key(cKeyIds.front(), cKeyMaterial);
+        }
+        else {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to read agreed keys for app #" << nAppId << ": keys discarded";
+        }
+        
+        // agreed with the peer: gone on both sides
+        application_buffer()->del(cKeyIds);
+        if (cKeys.empty()) {
+            nDiscarded += cKeyIds.size();
+            cKeyIds.clear();
+        }
+    }
+    
+    // record statistics
+    uint64_t nLatency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - nStart).count();
+    acquire_statistics & cStatistics = d->m_cAcquireStatistics[nAppId];
+    cStatistics.nRequests++;
+    if (cKeyIds.empty()) cStatistics.nFailed++;
+    cStatistics.nLatencyTotal += nLatency;
+    cStatistics.nLatencyMax = std::max(cStatistics.nLatencyMax, nLatency);
+    
+    cLock.unlock();
+    
+    // this triggers a refill on the engine's thread
+    if (cKeyIds.size() + nDiscarded) application_buffer()->emit_charge_change(0, cKeyIds.size() + nDiscarded);
+    
+    return !cKeyIds.empty();
+}
+
 
-    // TODO; code me
+/**
+ * latency statistics of acquire_keys() per application
+ * 
+ * The return list is a series of strings each one of
+ * the format:
+ * 
+ *      APPID;REQUESTS;FAILED;AVERAGE;MAXIMUM;
+ * 
+ * with latencies given in microseconds.
+ * 
+ * @return  a list of statistics, one per application
+ */
+QStringList engine_instance::acquire_latency() const {
     
-    return false;
+    QStringList cList;
+    
+    std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+    for (auto const & iter : d->m_cAcquireStatistics) {
+        
+        std::stringstream ss;
+        ss << iter.first << ";";
+        ss << iter.second.nRequests << ";";
+        ss << iter.second.nFailed << ";";
+        ss << (iter.second.nRequests ? iter.second.nLatencyTotal / iter.second.nRequests : 0) << ";";
+        ss << iter.second.nLatencyMax << ";";
+        cList << QString::fromStdString(ss.str());
+    }
+    
+    return cList;
+}
+
+
+/**
+ * send an ACQUIRE request to the slave (master)
+ * 
+ * acquire_keys() queues this call to the engine's thread.
+ * 
+ * @param   nTicket     the request ticket
+ */
+void engine_instance::acquire_request(qulonglong nTicket) {
+    
+    uint64_t nAppId = 0;
+    uint64_t nSequence = 0;
+    qkd::key::key_vector cKeys;
+    
+    {
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        
+        auto iter = d->m_cAcquireRequests.find(nTicket);
+        if (iter == d->m_cAcquireRequests.end()) return;
+        
+        // the caller gave up before we got here
+        if ((*iter).second.bAbandoned) {
+            application_buffer()->set_key_count((*iter).second.cKeys, 0);
+            d->m_cAcquireRequests.erase(iter);
+            return;
+        }
+        
+        // lost the peer meanwhile
+        if (!d->m_cProtocol.cAcquire) {
+            (*iter).second.bAnswered = true;
+            (*iter).second.bGranted = false;
+            d->m_cAcquireCondition.notify_all();
+            return;
+        }
+        
+        nAppId = (*iter).second.nAppId;
+        nSequence = (*iter).second.nSequence;
+        cKeys = (*iter).second.cKeys;
+    }
+    
+    d->m_cProtocol.cAcquire->request(nTicket, nAppId, nSequence, cKeys);
+}
+
+
+/**
+ * acquire protocol succeeded
+ */
+void engine_instance::acquire_success() {
+}
+
+
+/**
+ * check if the peer supports the ACQUIRE protocol
+ * 
+ * @return  true, if application keys can be agreed with the peer
+ */
+bool engine_instance::acquire_supported() const {
+    return d->m_bAcquireSupported;
 }
 
 
@@ -427,6 +956,26 @@ qkd::q3p::channel const & engine_instance::channel(uint16_t nChannelId) const {
 }
 
 
+/**
+ * the charge of a buffer or the common store changed
+ * 
+ * This wakes acquire_keys() waiters and schedules a refill of the
+ * buffers. Many charge changes in a row result in a single refill.
+ */
+void engine_instance::charge_change() {
+    
+    // wake acquire_keys() waiters
+    {
+        std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+        d->m_cAcquireCondition.notify_all();
+    }
+    
+    if (d->m_bRefillPending) return;
+    d->m_bRefillPending = true;
+    QTimer::singleShot(0, this, SLOT(refill()));
+}
+
+
 /**
  * returns a string describing the current charge states of the buffers
  * 
@@ -463,9 +1012,18 @@ std::string engine_instance::charge_string() const {
 
 /**
  * closes an engine
+ * 
+ * If the engine runs on a thread of its own, this
+ * is carried out on that thread and blocks until done.
  */
 void engine_instance::close() {
     
+    // the engine may live on a thread of its own: close it there
+    if (QThread::currentThread() != QObject::thread()) {
+        QMetaObject::invokeMethod(this, "close", Qt::BlockingQueuedConnection);
+        return;
+    }
+    
     // wind down module thread
     interrupt_worker();
     std::this_thread::yield();
@@ -477,7 +1035,13 @@ void engine_instance::close() {
     // unmount database
     close_db();
 
+    // hand the closed engine back to the main thread: it is destroyed there
+    if (QCoreApplication::instance() && (QObject::thread() != QCoreApplication::instance()->thread())) {
+        moveToThread(QCoreApplication::instance()->thread());
+    }
+
     // unregister ourselves
+    std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
     auto iter = g_cEngines.find(d->m_sLinkId);
     if (iter != g_cEngines.end()) unregister_engine((*iter).second);
 }
@@ -489,9 +1053,16 @@ void engine_instance::close() {
 void engine_instance::close_all() {
     
     // kick the head of the container until empty
-    while (g_cEngines.size()) {
-        engine_map::iterator iter = g_cEngines.begin();
-        (*iter).second->close();
+    while (true) {
+        
+        engine cEngine;
+        {
+            std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
+            if (g_cEngines.empty()) break;
+            cEngine = (*g_cEngines.begin()).second;
+        }
+        
+        cEngine->close();
     }
 }
 
@@ -548,6 +1119,16 @@ key_db const & engine_instance::common_store() const {
 }
 
 
+/**
+ * check if key id sets are sent as ranges
+ * 
+ * @return  true, if key id sets are sent as ranges
+ */
+bool engine_instance::compact_key_ids() const {
+    return d->m_bCompactKeyIds;
+}
+
+
 /**
  * configure the IPSec connection
  * 
@@ -693,6 +1274,16 @@ engine engine_instance::create(QString const & sNode, QString const & sId) {
 }
 
 
+/**
+ * check if several packets are sent in a single DATA message
+ * 
+ * @return  true, if the peer takes DATA batches
+ */
+bool engine_instance::data_batch() const {
+    return d->m_bDataBatch;
+}
+
+
 /**
  * data protocol failed
  * 
@@ -736,36 +1327,152 @@ void engine_instance::disconnect() {
     interrupt_worker();
     join();
 
-    shutdown_nic();
-    shutdown_mq();
-    
-    if (d->m_cProtocol.cData) d->m_cProtocol.cData->deleteLater();
-    d->m_cProtocol.cData = nullptr;
-    if (d->m_cProtocol.cLoad) d->m_cProtocol.cLoad->deleteLater();
-    d->m_cProtocol.cLoad = nullptr;
-    if (d->m_cProtocol.cLoadRequest) d->m_cProtocol.cLoadRequest->deleteLater();
-    d->m_cProtocol.cLoadRequest = nullptr;
-    if (d->m_cProtocol.cStore) d->m_cProtocol.cStore->deleteLater();
-    d->m_cProtocol.cStore = nullptr;
-    
-    shutdown_buffers();
-    
-    if (d->m_cSocket) {
-        d->m_cSocket->disconnectFromHost();
-        delete d->m_cSocket;
-        d->m_cSocket = nullptr;
+    shutdown_nic();
+    shutdown_mq();
+    
+    if (d->m_cProtocol.cData) d->m_cProtocol.cData->deleteLater();
+    d->m_cProtocol.cData = nullptr;
+    if (d->m_cProtocol.cLoad) d->m_cProtocol.cLoad->deleteLater();
+    d->m_cProtocol.cLoad = nullptr;
+    if (d->m_cProtocol.cLoadRequest) d->m_cProtocol.cLoadRequest->deleteLater();
+    d->m_cProtocol.cLoadRequest = nullptr;
+    if (d->m_cProtocol.cStore) d->m_cProtocol.cStore->deleteLater();
+    d->m_cProtocol.cStore = nullptr;
+    if (d->m_cProtocol.cAcquire) d->m_cProtocol.cAcquire->deleteLater();
+    d->m_cProtocol.cAcquire = nullptr;
+    
+    shutdown_buffers();
+    
+    if (d->m_cSocket) {
+        d->m_cSocket->disconnectFromHost();
+        delete d->m_cSocket;
+        d->m_cSocket = nullptr;
+    }
+    
+    shutdown_channels();
+    
+    d->m_nRecvSize = 0;
+    d->m_bConnected = false;
+    
+    emit connection_lost();
+    calculate_state();
+}
+
+
+/**
+ * dispatch a message received from the peer
+ * 
+ * @param   cMessage        the message received
+ */
+void engine_instance::dispatch(qkd::q3p::message & cMessage) {
+    
+    if (qkd::utility::debug::enabled()) qkd::utility::debug() << "<Q3P-RECV>" << cMessage.str();
+    
+    qkd::q3p::protocol::protocol_type eProtocol = (qkd::q3p::protocol::protocol_type)cMessage.protocol_id();
+    
+    if (cMessage.channel_id()) {
+        
+        qkd::q3p::channel cChannel = channel(cMessage.channel_id());
+        if (cChannel.id() == 0) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on channel: " << cMessage.channel_id() << " which is currently not configured or setup: message silently discarded.";
+            return;
+        }
+
+        qkd::q3p::channel_error eChannelError = cChannel.decode(cMessage);
+        if (eChannelError != qkd::q3p::channel_error::CHANNEL_ERROR_NO_ERROR) {
+            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " 
+                    << "failed to decode message on channel #" << cChannel.id() 
+                    << " decoding message returned: " << (unsigned int)eChannelError 
+                    << " (" << qkd::q3p::channel::channel_error_description(eChannelError) << ")";
+            return;
+        }
+    }
+    else {
+        
+        // on channel 0 only handshake is allowed
+        if (eProtocol != qkd::q3p::protocol::protocol_type::PROTOCOL_HANDSHAKE) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on channel 0 which is NOT related to HANDSHAKE protocol: message silently discarded.";
+            return;
+        }
+    }
+    
+    switch (eProtocol) {
+        
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_HANDSHAKE:
+        
+        // handshake
+        if (!d->m_cProtocol.cHandshake) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for HANDSHAKE ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cHandshake->recv(cMessage);
+        
+        break;
+
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_LOAD:
+        
+        // load
+        if (!d->m_cProtocol.cLoad) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for LOAD ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cLoad->recv(cMessage);
+
+        break;
+
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_LOAD_REQUEST:
+        
+        // load-request
+        if (!d->m_cProtocol.cLoadRequest) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for LOAD-REQUEST ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cLoadRequest->recv(cMessage);
+        
+        break;
+        
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_STORE:
+        
+        // store
+        if (!d->m_cProtocol.cStore) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for STORE ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cStore->recv(cMessage);
+        
+        break;
+
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_DATA:
+        
+        // data
+        if (!d->m_cProtocol.cData) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for DATA ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cData->recv(cMessage);
+        
+        break;
+
+    case qkd::q3p::protocol::protocol_type::PROTOCOL_ACQUIRE:
+        
+        // acquire
+        if (!d->m_cProtocol.cAcquire) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for ACQUIRE ... but I'm not ready for this right now.";
+            return;
+        }
+        d->m_cProtocol.cAcquire->recv(cMessage);
+        
+        break;
+
+        
+    default:
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on protocol " << qkd::q3p::protocol::protocol::protocol_id_name((uint8_t)eProtocol) << " but don't know what to do. this is a bug. Go tell Oliver.";
     }
-    
-    shutdown_channels();
-    
-    d->m_cRecvBuffer = QByteArray();
-    d->m_bConnected = false;
-    
-    emit connection_lost();
-    calculate_state();
 }
 
 
+
+
 /**
  * the current (next) encryption scheme for incoming messages
  * 
@@ -789,9 +1496,10 @@ QString engine_instance::encryption_scheme_outgoing() const {
 /**
  * list of known engines
  * 
- * @return  the list of known engine instance
+ * @return  a copy of the list of known engine instance
  */
-engine_map const & engine_instance::engines() {
+engine_map engine_instance::engines() {
+    std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
     return g_cEngines;
 }
 
@@ -803,6 +1511,7 @@ engine_map const & engine_instance::engines() {
  * @return  an engine
  */
 engine engine_instance::get(QString const & sId) {
+    std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
     auto iter = g_cEngines.find(sId);
     return (*iter).second;
 }
@@ -994,6 +1703,7 @@ void engine_instance::handshake_success() {
     d->m_cProtocol.cLoad = new protocol::load(d->m_cSocket, this);
     d->m_cProtocol.cLoadRequest = new protocol::load_request(d->m_cSocket, this);
     d->m_cProtocol.cStore = new protocol::store(d->m_cSocket, this);
+    d->m_cProtocol.cAcquire = new protocol::acquire(d->m_cSocket, this);
     
     // connect slots
     QObject::connect(d->m_cProtocol.cData, SIGNAL(failed(uint8_t)), SLOT(data_failed(uint8_t)));
@@ -1004,6 +1714,8 @@ void engine_instance::handshake_success() {
     QObject::connect(d->m_cProtocol.cLoadRequest, SIGNAL(success()), SLOT(load_request_success()));
     QObject::connect(d->m_cProtocol.cStore, SIGNAL(failed(uint8_t)), SLOT(store_failed(uint8_t)));
     QObject::connect(d->m_cProtocol.cStore, SIGNAL(success()), SLOT(store_success()));
+    QObject::connect(d->m_cProtocol.cAcquire, SIGNAL(failed(uint8_t)), SLOT(acquire_failed(uint8_t)));
+    QObject::connect(d->m_cProtocol.cAcquire, SIGNAL(success()), SLOT(acquire_success()));
         
     // setup ipsec
     setup_ipsec();
@@ -1076,34 +1788,28 @@ void engine_instance::inject(QByteArray cSecretBits) {
         return;
     }
     
-    qkd::key::key_ring cKeyRing(d->m_cCommonStoreDB->quantum());
-    qkd::key::key cKey(0, qkd::utility::memory::duplicate((unsigned char *)cSecretBits.data(), cSecretBits.size()));
-    cKeyRing << cKey;
+    // copy whole quanta straight into the DB
+    uint64_t nQuantum = d->m_cCommonStoreDB->quantum();
+    uint64_t nQuanta = cSecretBits.size() / nQuantum;
     
-    uint64_t nKeysInserted = 0;
-    for (auto & cKey : cKeyRing) {
-        
-        if (cKey.size() == d->m_cCommonStoreDB->quantum()) {
-            
-            qkd::key::key_id nKeyId = d->m_cCommonStoreDB->insert(cKey);
-            if (nKeyId != 0) {
-                
-                d->m_cCommonStoreDB->set_injected(nKeyId);
-                d->m_cCommonStoreDB->set_real_sync(nKeyId);
-                nKeysInserted++;
-            }
-            else {
-                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to injected key into database";
-            }
-        }
-        else {
-            
-            if (qkd::utility::debug::enabled()) {
-                QString sMessage = QString("dropping %1 bytes of key material - not a key quantum (%2 bytes)").arg(cKey.size()).arg(d->m_cCommonStoreDB->quantum());
-                qkd::utility::debug() << sMessage.toStdString();
-            }
+    qkd::key::key_vector cKeyIds;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(d->m_cCommonStoreDB->mutex());
+        cKeyIds = d->m_cCommonStoreDB->insert_range((unsigned char const *)cSecretBits.data(), nQuanta);
+        for (auto nKeyId : cKeyIds) {
+            d->m_cCommonStoreDB->set_injected(nKeyId);
+            d->m_cCommonStoreDB->set_real_sync(nKeyId);
         }
     }
+    uint64_t nKeysInserted = cKeyIds.size();
+    
+    if (nKeysInserted < nQuanta) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to inject " << (nQuanta - nKeysInserted) << " keys into database: database full";
+    }
+    if ((cSecretBits.size() % nQuantum) && qkd::utility::debug::enabled()) {
+        QString sMessage = QString("dropping %1 bytes of key material - not a key quantum (%2 bytes)").arg(cSecretBits.size() % nQuantum).arg(nQuantum);
+        qkd::utility::debug() << sMessage.toStdString();
+    }
         
     auto nStop = std::chrono::high_resolution_clock::now();
     auto nTimeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(nStop - nStart);
@@ -1426,6 +2132,9 @@ void engine_instance::open_db(QString sURL) {
     }
     
     uint64_t nKeyCount = d->m_cCommonStoreDB->count();
+    
+    // refill as soon as new keys arrive
+    QObject::connect(d->m_cCommonStoreDB.get(), SIGNAL(charge_change(qulonglong, qulonglong, qulonglong)), this, SLOT(charge_change()));
 
     auto nStop = std::chrono::high_resolution_clock::now();
     auto nTimeDiff = std::chrono::duration_cast<std::chrono::milliseconds>(nStop - nStart);
@@ -1470,6 +2179,67 @@ key_db const & engine_instance::outgoing_buffer() const {
 }
 
 
+/**
+ * the ids of the pipeline keys waiting in the pickup store
+ * 
+ * keys read from the QKD pipeline are kept in the pickup store
+ * until the STORE protocol moved them into the common store
+ * 
+ * @return  the ids of the keys in the pickup store (ascending)
+ */
+qkd::key::key_vector engine_instance::pickup_keys() const {
+    
+    std::lock_guard<std::mutex> cLock(d->m_cPickupMutex);
+    
+    qkd::key::key_vector cKeyIds;
+    cKeyIds.reserve(d->m_cPickupStore.size());
+    for (auto const & cPickup : d->m_cPickupStore) cKeyIds.push_back(cPickup.first);
+    
+    return cKeyIds;
+}
+
+
+/**
+ * place a pipeline key into the pickup store
+ * 
+ * if the pickup store is full, the oldest key is dropped
+ * 
+ * @param   cKey        the key to place
+ */
+void engine_instance::pickup_put(qkd::key::key const & cKey) {
+    
+    std::lock_guard<std::mutex> cLock(d->m_cPickupMutex);
+    
+    d->m_cPickupStore[cKey.id()] = cKey;
+    if (d->m_cPickupStore.size() > MAX_PICKUP_KEYS) {
+        
+        auto iter = d->m_cPickupStore.begin();
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "pickup store full: dropping key #" << (*iter).first;
+        d->m_cPickupStore.erase(iter);
+    }
+}
+
+
+/**
+ * remove a pipeline key from the pickup store
+ * 
+ * @param   nKeyId      the id of the key
+ * @return  the key removed (or qkd::key::key::null() if not present)
+ */
+qkd::key::key engine_instance::pickup_take(qkd::key::key_id nKeyId) {
+    
+    std::lock_guard<std::mutex> cLock(d->m_cPickupMutex);
+    
+    auto iter = d->m_cPickupStore.find(nKeyId);
+    if (iter == d->m_cPickupStore.end()) return qkd::key::key::null();
+    
+    qkd::key::key cKey = (*iter).second;
+    d->m_cPickupStore.erase(iter);
+    
+    return cKey;
+}
+
+
 /**
  * this is called whenever we have a key read from the qkd pipeline
  * 
@@ -1478,7 +2248,11 @@ key_db const & engine_instance::outgoing_buffer() const {
  * @param   cOutgoingContext        outgoing crypto context
  * @return  true, if the key is to be pushed to the output pipe
  */
-bool engine_instance::process(UNUSED qkd::key::key & cKey, UNUSED qkd::crypto::crypto_context & cIncomingContext, UNUSED qkd::crypto::crypto_context & cOutgoingContext) {
+bool engine_instance::process(qkd::key::key & cKey, UNUSED qkd::crypto::crypto_context & cIncomingContext, UNUSED qkd::crypto::crypto_context & cOutgoingContext) {
+    
+    // the key is moved into the common store by the STORE protocol later on
+    if (db_opened()) pickup_put(cKey);
+    
     return false;
 }
 
@@ -1492,17 +2266,26 @@ bool engine_instance::process(UNUSED qkd::key::key & cKey, UNUSED qkd::crypto::c
  * The protocols which are run:
  * 1. LOAD from the CommonStore keys into the buffers
  * 2. STORE from the PickupStores into the CommonStore
+ * 3. ACQUIRE timeouts and expired application key grants
+ * 
+ * Every SYNC_TIMEOUTS runs the changes on the CommonStore
+ * are flushed to disk.
  * 
  * You may trigger this call also via DBus
  */
 void engine_instance::q3p_timeout() {
     
+    d->m_nTimeouts++;
+    if (db_opened() && ((d->m_nTimeouts % SYNC_TIMEOUTS) == 0)) d->m_cCommonStoreDB->sync();
+    
     if (connected()) {
     
         if (d->m_cProtocol.cLoad) d->m_cProtocol.cLoad->run();
         if (d->m_cProtocol.cLoadRequest) d->m_cProtocol.cLoadRequest->run();
         if (d->m_cProtocol.cStore) d->m_cProtocol.cStore->run();
+        if (d->m_cProtocol.cAcquire) d->m_cProtocol.cAcquire->run();
         if (d->m_cMQ.get()) d->m_cMQ->produce();
+        acquire_expire();
     }
     else {
         
@@ -1532,6 +2315,7 @@ void engine_instance::recv_data(qkd::utility::memory const & cData) {
  */
 bool engine_instance::register_engine(engine cEngine) {
     
+    std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
     engine_map::iterator cIter = g_cEngines.find(cEngine->link_id());
     if (cIter == g_cEngines.end()) {
         g_cEngines.insert(std::pair<QString, qkd::q3p::engine>(cEngine->link_id(), cEngine));
@@ -1542,6 +2326,25 @@ bool engine_instance::register_engine(engine cEngine) {
 }
     
     
+/**
+ * refill the buffers from the common store
+ * 
+ * This runs LOAD and LOAD-REQUEST as soon as key material
+ * got consumed instead of waiting for the next timer tick.
+ * The message queue (or shared memory ring) is fed right 
+ * away with the keys arrived in the application buffer.
+ */
+void engine_instance::refill() {
+    
+    d->m_bRefillPending = false;
+    if (!connected()) return;
+    
+    if (d->m_cProtocol.cLoad) d->m_cProtocol.cLoad->run();
+    if (d->m_cProtocol.cLoadRequest) d->m_cProtocol.cLoadRequest->run();
+    if (d->m_cMQ.get()) d->m_cMQ->produce();
+}
+
+
 /**
  * register this object on the DBus
  * 
@@ -1591,6 +2394,19 @@ QStringList engine_instance::remote_modules() {
  * @param   cData       the data to send
  */
 void engine_instance::send_data(qkd::utility::memory const & cData) {
+    send_data(std::list<qkd::utility::memory>(1, cData));
+}
+
+
+/**
+ * send a batch of packets to the peer
+ * 
+ * All packets are sent in a single DATA message if the peer
+ * takes DATA batches. Else each packet is sent on its own.
+ * 
+ * @param   cPackets    the packets to send
+ */
+void engine_instance::send_data(std::list<qkd::utility::memory> const & cPackets) {
     
     if (!d->m_bConnected) {
         qkd::utility::debug() << "refused to send data when not connected";
@@ -1598,15 +2414,33 @@ void engine_instance::send_data(qkd::utility::memory const & cData) {
     }
     
     if (!d->m_cProtocol.cData) {
-        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "tried to send data (" << cData.size() << " bytes), I'm connected - but I lack a DATA protocol instance. This must not happen. This is a bug. Sorry";
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "tried to send data (" << cPackets.size() << " packets), I'm connected - but I lack a DATA protocol instance. This must not happen. This is a bug. Sorry";
+        return;
+    }
+    
+    if (cPackets.empty()) return;
+    
+    // a peer without DATA batches reads a single packet per message
+    if (!d->m_bDataBatch && (cPackets.size() > 1)) {
+        for (auto const & cPacket : cPackets) send_data(std::list<qkd::utility::memory>(1, cPacket));
         return;
     }
 
     qkd::q3p::message cMessage(true, true);
-    cMessage << cData;
+    uint64_t nBytes = 0;
+    for (auto const & cPacket : cPackets) {
+        cMessage << cPacket;
+        nBytes += cPacket.size();
+    }
     
-    // TODO: check for results: might be insufficient key material in the KS
-    d->m_cProtocol.cData->send(cMessage);
+    // lacking key material to encrypt and authenticate we drop: 
+    // IP traffic does not care for a lost datagram, it cares for stale ones
+    qkd::q3p::protocol::protocol_error eError = d->m_cProtocol.cData->send(cMessage);
+    if (eError != qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                << "dropped " << cPackets.size() << " packets (" << nBytes << " bytes) to peer: " 
+                << (eError == qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_CHANNEL ? "insufficient key material" : "failed to send");
+    }
 }
 
 
@@ -1657,7 +2491,7 @@ void engine_instance::server_new() {
     QObject::connect(d->m_cSocket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(socket_error(QAbstractSocket::SocketError)));
     QObject::connect(d->m_cSocket, SIGNAL(readyRead()), SLOT(socket_ready_read()));
     
-    d->m_cRecvBuffer = QByteArray();
+    d->m_nRecvSize = 0;
     
     d->m_cProtocol.cHandshake = new protocol::handshake(d->m_cSocket, this);
     QObject::connect(d->m_cProtocol.cHandshake, SIGNAL(failed(uint8_t)), SLOT(handshake_failed(uint8_t)));
@@ -1702,6 +2536,36 @@ void engine_instance::set_authentication_scheme_outgoing(QString const & sScheme
 }
 
 
+/**
+ * set if the peer supports the ACQUIRE protocol
+ * 
+ * @param   bSupported      both sides support the ACQUIRE protocol
+ */
+void engine_instance::set_acquire_supported(bool bSupported) {
+    d->m_bAcquireSupported = bSupported;
+}
+
+
+/**
+ * set if key id sets are sent as ranges
+ * 
+ * @param   bCompact        both sides support key id ranges
+ */
+void engine_instance::set_compact_key_ids(bool bCompact) {
+    d->m_bCompactKeyIds = bCompact;
+}
+
+
+/**
+ * set if several packets are sent in a single DATA message
+ * 
+ * @param   bBatch          both sides support DATA batches
+ */
+void engine_instance::set_data_batch(bool bBatch) {
+    d->m_bDataBatch = bBatch;
+}
+
+
 /**
  * set a new encryption scheme for incoming
  * 
@@ -1781,6 +2645,20 @@ void engine_instance::set_nic_ip4_remote(std::string const & sIP4) {
 }
 
 
+/**
+ * set the size of the shared memory key ring
+ * 
+ * If not 0 application keys are delivered via a shared
+ * memory ring (see qkd::q3p::shm_ring) instead of the 
+ * message queue. This takes effect on the next connect.
+ * 
+ * @param   nSize   size of the ring in bytes (0 for the message queue)
+ */
+void engine_instance::set_shm_size(uint64_t nSize) {
+    d->m_nShmSize = nSize;
+}
+
+
 /**
  * sets the slave role on the keystore
  * 
@@ -1815,6 +2693,11 @@ void engine_instance::setup_buffers() {
     d->m_cOutgoingDB = qkd::q3p::db::open("ram://");
     d->m_cApplicationDB = qkd::q3p::db::open("ram://");
     
+    // refill as soon as keys are consumed
+    QObject::connect(d->m_cIncomingDB.get(), SIGNAL(charge_change(qulonglong, qulonglong, qulonglong)), this, SLOT(charge_change()));
+    QObject::connect(d->m_cOutgoingDB.get(), SIGNAL(charge_change(qulonglong, qulonglong, qulonglong)), this, SLOT(charge_change()));
+    QObject::connect(d->m_cApplicationDB.get(), SIGNAL(charge_change(qulonglong, qulonglong, qulonglong)), this, SLOT(charge_change()));
+    
     new DatabaseAdaptor(d->m_cIncomingDB.get());
     QString sIncomingDBObjectPath = d->m_sDBusObjectPath + "/IncomingBuffer";
     bool bSuccess = d->m_cDBus.registerObject(sIncomingDBObjectPath, d->m_cIncomingDB.get());
@@ -1928,6 +2811,22 @@ void engine_instance::shutdown_buffers() {
     d->m_cIncomingDB = qkd::q3p::db::open("ram://");
     d->m_cOutgoingDB = qkd::q3p::db::open("ram://");
     d->m_cApplicationDB = qkd::q3p::db::open("ram://");
+    
+    // reservations of the application buffer are gone: fail pending acquire_keys() calls
+    std::lock_guard<std::mutex> cLock(d->m_cAcquireMutex);
+    for (auto iter = d->m_cAcquireRequests.begin(); iter != d->m_cAcquireRequests.end(); ) {
+        if ((*iter).second.bAbandoned) {
+            iter = d->m_cAcquireRequests.erase(iter);
+            continue;
+        }
+        (*iter).second.bAnswered = true;
+        (*iter).second.bGranted = false;
+        ++iter;
+    }
+    d->m_cAcquireGrants.clear();
+    d->m_cAcquireSequence.clear();
+    d->m_nAcquireEpoch++;
+    d->m_cAcquireCondition.notify_all();
 }
     
     
@@ -1973,6 +2872,16 @@ void engine_instance::shutdown_nic() {
 }
     
     
+/**
+ * return the size of the shared memory key ring
+ * 
+ * @return  size of the shared memory key ring (0 if the message queue is used)
+ */
+uint64_t engine_instance::shm_size() const {
+    return d->m_nShmSize;
+}
+    
+    
 /**
  * check if we are the slave keystore
  * 
@@ -2002,7 +2911,7 @@ void engine_instance::socket_connected() {
     QString sMessage = QString("connected to \"%1:%2\" - running handshake").arg(d->m_cSocket->peerAddress().toString()).arg(d->m_cSocket->peerPort());
     qkd::utility::syslog::info() << sMessage.toStdString();
 
-    d->m_cRecvBuffer = QByteArray();
+    d->m_nRecvSize = 0;
     
     d->m_cProtocol.cHandshake = new protocol::handshake(d->m_cSocket, this);
     QObject::connect(d->m_cProtocol.cHandshake, SIGNAL(failed(uint8_t)), SLOT(handshake_failed(uint8_t)));
@@ -2065,6 +2974,8 @@ void engine_instance::socket_error(QAbstractSocket::SocketError eSocketError) {
     d->m_cProtocol.cLoadRequest = nullptr;
     if (d->m_cProtocol.cStore) d->m_cProtocol.cStore->deleteLater();
     d->m_cProtocol.cStore = nullptr;
+    if (d->m_cProtocol.cAcquire) d->m_cProtocol.cAcquire->deleteLater();
+    d->m_cProtocol.cAcquire = nullptr;
     
     shutdown_buffers();
     
@@ -2082,116 +2993,46 @@ void engine_instance::socket_error(QAbstractSocket::SocketError eSocketError) {
 /**
  * we have data available on the socket
  * 
- * this is the main single peer receive packet handler
+ * this is the main single peer receive packet handler:
+ * all bytes available are appended to the receive buffer
+ * and all complete messages in there are dispatched.
  */
 void engine_instance::socket_ready_read() {
 
     if (!d->m_cSocket) return;
     
-    d->m_cRecvBuffer.append(d->m_cSocket->readAll());
-
-    qkd::q3p::message cMessage;
-    qkd::q3p::protocol::protocol_type eProtocol;
-    qkd::q3p::protocol::protocol_error eError = qkd::q3p::protocol::protocol::recv(d->m_cRecvBuffer, cMessage, eProtocol);
-    if (eError != qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_NO_ERROR) {
-        
-        // if we lack some additional data, we call this data parsing method soon again
-        if (eError == qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_PENDING) QTimer::singleShot(250, this, SLOT(socket_ready_read()));
-        return;
-    }
-
-    // if we still have some bytes left in the read buffer, than 
-    // we got presumably more than 1 message: call parsing soon again
-    if (d->m_cRecvBuffer.size()) QTimer::singleShot(0, this, SLOT(socket_ready_read()));
-    
-    qkd::utility::debug() << "<Q3P-RECV>" << cMessage.str();
-    
-    if (cMessage.channel_id()) {
-        
-        qkd::q3p::channel cChannel = channel(cMessage.channel_id());
-        if (cChannel.id() == 0) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on channel: " << cMessage.channel_id() << " which is currently not configured or setup: message silently discarded.";
-            return;
-        }
-
-        qkd::q3p::channel_error eChannelError = cChannel.decode(cMessage);
-        if (eChannelError != qkd::q3p::channel_error::CHANNEL_ERROR_NO_ERROR) {
-            qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " 
-                    << "failed to decode message on channel #" << cChannel.id() 
-                    << " decoding message returned: " << (unsigned int)eChannelError 
-                    << " (" << qkd::q3p::channel::channel_error_description(eChannelError) << ")";
-            return;
-        }
-    }
-    else {
-        
-        // on channel 0 only handshake is allowed
-        if (eProtocol != qkd::q3p::protocol::protocol_type::PROTOCOL_HANDSHAKE) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on channel 0 which is NOT related to HANDSHAKE protocol: message silently discarded.";
-            return;
-        }
+    // read straight behind the bytes still pending
+    qint64 nAvailable = d->m_cSocket->bytesAvailable();
+    if (nAvailable > 0) {
+        if (d->m_cRecvBuffer.size() < d->m_nRecvSize + nAvailable) d->m_cRecvBuffer.resize(d->m_nRecvSize + nAvailable);
+        qint64 nRead = d->m_cSocket->read(d->m_cRecvBuffer.data() + d->m_nRecvSize, nAvailable);
+        if (nRead > 0) d->m_nRecvSize += nRead;
     }
     
-    switch (eProtocol) {
-        
-    case qkd::q3p::protocol::protocol_type::PROTOCOL_HANDSHAKE:
-        
-        // handshake
-        if (!d->m_cProtocol.cHandshake) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for HANDSHAKE ... but I'm not ready for this right now.";
-            return;
-        }
-        d->m_cProtocol.cHandshake->recv(cMessage);
-        
-        break;
-
-    case qkd::q3p::protocol::protocol_type::PROTOCOL_LOAD:
-        
-        // load
-        if (!d->m_cProtocol.cLoad) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for LOAD ... but I'm not ready for this right now.";
-            return;
-        }
-        d->m_cProtocol.cLoad->recv(cMessage);
-
-        break;
-
-    case qkd::q3p::protocol::protocol_type::PROTOCOL_LOAD_REQUEST:
-        
-        // load-request
-        if (!d->m_cProtocol.cLoadRequest) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for LOAD-REQUEST ... but I'm not ready for this right now.";
-            return;
-        }
-        d->m_cProtocol.cLoadRequest->recv(cMessage);
+    // drain all complete messages
+    uint64_t nPos = 0;
+    while (nPos < d->m_nRecvSize) {
         
-        break;
-        
-    case qkd::q3p::protocol::protocol_type::PROTOCOL_STORE:
-        
-        // store
-        if (!d->m_cProtocol.cStore) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for STORE ... but I'm not ready for this right now.";
-            return;
-        }
-        d->m_cProtocol.cStore->recv(cMessage);
-        
-        break;
-
-    case qkd::q3p::protocol::protocol_type::PROTOCOL_DATA:
+        qkd::q3p::message cMessage;
+        qkd::q3p::protocol::protocol_type eProtocol;
+        uint64_t nConsumed = 0;
+        qkd::q3p::protocol::protocol_error eError = qkd::q3p::protocol::protocol::recv(d->m_cRecvBuffer.data() + nPos, d->m_nRecvSize - nPos, nConsumed, cMessage, eProtocol);
+        nPos += nConsumed;
         
-        // data
-        if (!d->m_cProtocol.cData) {
-            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message for DATA ... but I'm not ready for this right now.";
-            return;
-        }
-        d->m_cProtocol.cData->recv(cMessage);
+        // the rest is an incomplete message: wait for the next readyRead()
+        if (eError == qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_PENDING) break;
+        if (eError != qkd::q3p::protocol::protocol_error::PROTOCOL_ERROR_NO_ERROR) continue;
         
-        break;
-
+        dispatch(cMessage);
         
-    default:
-        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "got message on protocol " << qkd::q3p::protocol::protocol::protocol_id_name((uint8_t)eProtocol) << " but don't know what to do. this is a bug. Go tell Oliver.";
+        // the connection may have been reset meanwhile
+        if (d->m_nRecvSize < nPos) return;
+    }
+    
+    // move the incomplete rest to the front
+    if (nPos) {
+        memmove(d->m_cRecvBuffer.data(), d->m_cRecvBuffer.data() + nPos, d->m_nRecvSize - nPos);
+        d->m_nRecvSize -= nPos;
     }
 }
 
@@ -2220,6 +3061,58 @@ void engine_instance::store_success() {
  * @param   cEngine     engine to unregister
  */
 void engine_instance::unregister_engine(engine cEngine) {
+    std::lock_guard<std::recursive_mutex> cLock(g_cEnginesMutex);
     engine_map::iterator cIter = g_cEngines.find(cEngine->link_id());
     if (cIter != g_cEngines.end()) g_cEngines.erase(cIter);
 }
+
+
+/**
+ * run acquire_keys() and concat the key material
+ * 
+ * @param   cEngine         the engine
+ * @param   nAppId          the application id
+ * @param   nBytes          number of bytes requested
+ * @param   nTimeout        timeout in milliseconds
+ * @return  the key material (empty on failure)
+ */
+QByteArray acquire_material(qkd::q3p::engine_instance * cEngine, uint64_t nAppId, uint64_t nBytes, uint64_t nTimeout) {
+    
+    qkd::key::key_ring cKeys;
+    if (!cEngine->acquire_keys(cKeys, nAppId, nBytes, std::chrono::milliseconds(nTimeout))) return QByteArray();
+    
+    QByteArray cKeyMaterial;
+    for (auto const & cKey : cKeys) cKeyMaterial.append((char const *)cKey.data().get(), cKey.data().size());
+    
+    return cKeyMaterial;
+}
+
+
+/**
+ * wait for a change of the acquire_keys() data
+ * 
+ * Off the engine's thread this waits on the condition. On the 
+ * engine's thread a local event loop serves the peer and the 
+ * buffer refills for a short while instead.
+ * 
+ * @param   cLock           the locked acquire_keys() mutex
+ * @param   cCondition      the acquire_keys() condition
+ * @param   nUntil          point in time to wait at most
+ * @param   bEngineThread   called on the engine's thread
+ */
+void acquire_wait(std::unique_lock<std::mutex> & cLock, std::condition_variable & cCondition, std::chrono::high_resolution_clock::time_point const & nUntil, bool bEngineThread) {
+    
+    if (!bEngineThread) {
+        cCondition.wait_until(cLock, nUntil);
+        return;
+    }
+    
+    int64_t nWait = std::chrono::duration_cast<std::chrono::milliseconds>(nUntil - std::chrono::high_resolution_clock::now()).count() + 1;
+    if (nWait <= 0) return;
+    
+    cLock.unlock();
+    QEventLoop cLoop;
+    QTimer::singleShot(std::min<int64_t>(nWait, ACQUIRE_POLL_MSEC), &cLoop, SLOT(quit()));
+    cLoop.exec();
+    cLock.lock();
+}
@@ -35,10 +35,18 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
 #include <thread>
+#include <vector>
+#include <errno.h>
 #include <signal.h>
+#include <string.h>
 #include <fcntl.h>
+#include <poll.h>
  
 #include <arpa/inet.h>
 #include <linux/if.h>
@@ -52,10 +60,20 @@
 #include <qkd/utility/syslog.h>
 
 #include "netlink.h"
+#include "../protocol/protocol.h"
 
 using namespace qkd::q3p;
 
 
+// ------------------------------------------------------------
+// defs
+
+#define NIC_BATCH_LATENCY_US    100                 /**< max. time in microseconds to wait for further packets of a batch */
+#define NIC_BATCH_SIZE          (1024 * 1024)       /**< max. number of bytes of packets sent in one DATA message */
+#define NIC_MAX_PACKET_SIZE     (1024 * 64)         /**< max. size of a single packet read from the TUN/TAP */
+#define NIC_MAX_QUEUES          4                   /**< max. number of TUN/TAP queues (and reader threads) */
+
+
 // ------------------------------------------------------------
 // decl
 
@@ -72,11 +90,12 @@ public:
     /**
      * ctor
      */
-    nic_data(): nFD(0) {};
+    nic_data() {};
     
-    int nFD;                        /**< tun/tap file descriptor */
-    std::atomic<bool> bRun;         /**< run flag */
-    std::thread cReaderThread;      /**< the reader thread */
+    std::vector<int> cFD;                       /**< tun/tap file descriptors: one per queue */
+    std::atomic<bool> bRun;                     /**< run flag */
+    std::vector<std::thread> cReaderThreads;    /**< the reader threads: one per queue */
+    std::mutex cSendMutex;                      /**< serializes the readers sending to the engine */
 };
 
 
@@ -101,11 +120,12 @@ in_addr_t get_current_ip4(std::string const & sDevice);
 /**
  * get up the tun (from tun/tap) device
  * 
- * @param   nDeviceFD       device file descriptor
+ * @param   cDeviceFD       device file descriptors (one per queue)
  * @param   sDeviceName     name of new device
+ * @param   nQueues         number of queues wanted
  * @return  true, if device has been successully setup
  */
-bool init_tun(int & nDeviceFD, std::string & sDeviceName);
+bool init_tun(std::vector<int> & cDeviceFD, std::string & sDeviceName, unsigned int nQueues);
 
 
 /**
@@ -151,13 +171,16 @@ nic_instance::nic_instance(qkd::q3p::engine_instance * cEngine) : QObject(), m_c
     }
     
     d = std::shared_ptr<qkd::q3p::nic_instance::nic_data>(new qkd::q3p::nic_instance::nic_data());    
-    d->nFD = 0;
+    
+    unsigned int nQueues = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)NIC_MAX_QUEUES));
     
     // get up q3pX
-    if (init_tun(d->nFD, m_sName)) {
+    if (init_tun(d->cFD, m_sName, nQueues)) {
     
         d->bRun = true;
-        d->cReaderThread = std::thread([this]{ reader(); });
+        for (auto nFD : d->cFD) {
+            d->cReaderThreads.push_back(std::thread([this, nFD]{ reader(nFD); }));
+        }
         
         emit device_ready(QString::fromStdString(m_sName));
     }
@@ -171,13 +194,15 @@ nic_instance::~nic_instance() {
     
     del_ip4_route();
 
-    if (d->cReaderThread.get_id() != std::thread::id()) {
-        d->bRun = false;
-        pthread_kill(d->cReaderThread.native_handle(), SIGCHLD);
-        if (d->cReaderThread.joinable()) d->cReaderThread.join();
+    d->bRun = false;
+    for (auto & cReaderThread : d->cReaderThreads) {
+        if (cReaderThread.get_id() != std::thread::id()) {
+            pthread_kill(cReaderThread.native_handle(), SIGCHLD);
+            if (cReaderThread.joinable()) cReaderThread.join();
+        }
     }
     
-    close(d->nFD);
+    for (auto nFD : d->cFD) close(nFD);
 }
 
 
@@ -309,17 +334,64 @@ bool nic_instance::del_ip4_route() {
  * 
  * read data from local user applications and send them
  * to the peer instance
+ * 
+ * Packets are collected into batches: after the first packet
+ * of a batch has been read we wait at most NIC_BATCH_LATENCY_US
+ * microseconds for more. A batch is sent as a single DATA message.
+ * 
+ * @param   nFD         the file descriptor of the queue to read
  */
-void nic_instance::reader() {
-
-    char cBuffer[1024 * 64];
-    uint64_t nSize;
-    while (d->bRun && ((nSize = read(d->nFD, cBuffer, 1024 * 64)) > 0 )) {
+void nic_instance::reader(int nFD) {
+    
+    uint64_t nBatchSize = std::min<uint64_t>(NIC_BATCH_SIZE, qkd::q3p::protocol::protocol::max_size() / 2);
+    if (nBatchSize < NIC_MAX_PACKET_SIZE) nBatchSize = NIC_MAX_PACKET_SIZE;
+    qkd::utility::memory cBatch(nBatchSize);
 
-        if (nSize == (uint64_t)-1) continue;
+    pollfd cPollFD;
+    cPollFD.fd = nFD;
+    cPollFD.events = POLLIN;
+    
+    while (d->bRun) {
+        
+        // block for the first packet
+        ssize_t nSize = read(nFD, cBatch.get(), NIC_MAX_PACKET_SIZE);
+        if (nSize == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                poll(&cPollFD, 1, 100);
+                continue;
+            }
+        }
+        if (nSize <= 0) {
+            if (d->bRun) {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " 
+                        << "stopped reading from TUN/TAP: " << (nSize == 0 ? "end of file" : strerror(errno));
+            }
+            break;
+        }
+        
+        std::list<qkd::utility::memory> cPackets;
+        cPackets.push_back(cBatch.slice(0, nSize));
+        uint64_t nPosition = nSize;
         
-        qkd::utility::memory cPayload = qkd::utility::memory::wrap((qkd::utility::memory::value_t *)cBuffer, nSize);
-        m_cEngine->send_data(cPayload);
+        // collect more packets within the latency budget
+        auto cDeadline = std::chrono::steady_clock::now() + std::chrono::microseconds(NIC_BATCH_LATENCY_US);
+        while (d->bRun && (nPosition + NIC_MAX_PACKET_SIZE <= cBatch.size())) {
+            
+            auto nLeft = std::chrono::duration_cast<std::chrono::nanoseconds>(cDeadline - std::chrono::steady_clock::now()).count();
+            if (nLeft <= 0) break;
+            timespec cTimeout = { 0, (long)nLeft };
+            if (ppoll(&cPollFD, 1, &cTimeout, nullptr) <= 0) break;
+            
+            nSize = read(nFD, cBatch.get() + nPosition, NIC_MAX_PACKET_SIZE);
+            if (nSize <= 0) break;
+            
+            cPackets.push_back(cBatch.slice(nPosition, nSize));
+            nPosition += nSize;
+        }
+        
+        std::lock_guard<std::mutex> cLock(d->cSendMutex);
+        m_cEngine->send_data(cPackets);
     }
 }
 
@@ -334,12 +406,12 @@ void nic_instance::reader() {
  */
 void nic_instance::write(qkd::utility::memory const & cData) {
 
-    if (d->nFD <= 0) {
+    if (d->cFD.empty()) {
         if (qkd::utility::debug::enabled()) qkd::utility::debug() << "failed to write " << cData.size() << " bytes to TUN/TAP: no device present.";
         return;
     }
     
-    uint64_t nSize = ::write(d->nFD, cData.get(), cData.size());
+    uint64_t nSize = ::write(d->cFD.front(), cData.get(), cData.size());
     if (nSize != cData.size()) {
         qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "nic in trouble: failed to pass received data to the kernel";
     }
@@ -464,32 +536,62 @@ bool set_current_ip4(std::string const & sDevice, in_addr_t nIP4) {
 /**
  * get up the tun (from tun/tap) device
  * 
- * @param   nDeviceFD       device file descriptor
+ * If the kernel supports multi-queue TUN devices we open
+ * nQueues queues, otherwise a single one.
+ * 
+ * @param   cDeviceFD       device file descriptors (one per queue)
  * @param   sDeviceName     name of new device
+ * @param   nQueues         number of queues wanted
  * @return  true, if device has been successully setup
  */
-bool init_tun(int & nDeviceFD, std::string & sDeviceName) {
+bool init_tun(std::vector<int> & cDeviceFD, std::string & sDeviceName, unsigned int nQueues) {
     
-    nDeviceFD = ::open("/dev/net/tun", O_RDWR);
-    if (nDeviceFD < 0) {
-        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "could not access /dev/net/tun: " << strerror(errno);
-        return false;
-    }
+    cDeviceFD.clear();
     
-    struct ifreq cIFReq;
-    memset(&cIFReq, 0, sizeof(cIFReq));
-    cIFReq.ifr_flags = IFF_TUN;
+    short nFlags = IFF_TUN;
+#ifdef IFF_MULTI_QUEUE
+    if (nQueues > 1) nFlags |= IFF_MULTI_QUEUE;
+#else
+    nQueues = 1;
+#endif
     
-    strncpy(cIFReq.ifr_name, "q3p%d", IFNAMSIZ);
-    if (ioctl(nDeviceFD, TUNSETIFF, (void *)&cIFReq) == -1) {
-        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "could not create TUN device: " << strerror(errno);
-        close(nDeviceFD);
-        nDeviceFD = 0;
-        return false;
+    std::string sName = "q3p%d";
+    while (cDeviceFD.size() < nQueues) {
+    
+        int nDeviceFD = ::open("/dev/net/tun", O_RDWR);
+        if (nDeviceFD < 0) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "could not access /dev/net/tun: " << strerror(errno);
+            break;
+        }
+        
+        struct ifreq cIFReq;
+        memset(&cIFReq, 0, sizeof(cIFReq));
+        cIFReq.ifr_flags = nFlags;
+        
+        strncpy(cIFReq.ifr_name, sName.c_str(), IFNAMSIZ);
+        if (ioctl(nDeviceFD, TUNSETIFF, (void *)&cIFReq) == -1) {
+            
+            // no multi-queue support: fall back to a single queue
+            if (cDeviceFD.empty() && (nFlags != IFF_TUN)) {
+                close(nDeviceFD);
+                nFlags = IFF_TUN;
+                nQueues = 1;
+                continue;
+            }
+            
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "could not create TUN device: " << strerror(errno);
+            close(nDeviceFD);
+            break;
+        }
+        
+        sName = cIFReq.ifr_name;
+        cDeviceFD.push_back(nDeviceFD);
     }
     
-    sDeviceName = cIFReq.ifr_name;
-    qkd::utility::syslog::info() << "created TUN device: " << sDeviceName;
+    if (cDeviceFD.empty()) return false;
+    
+    sDeviceName = sName;
+    qkd::utility::syslog::info() << "created TUN device: " << sDeviceName << " with " << cDeviceFD.size() << " queue(s)";
     
     return true;
 }
@@ -31,7 +31,9 @@
 // ------------------------------------------------------------
 // incs
 
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -40,6 +42,7 @@
 // ait
 #include <qkd/q3p/engine.h>
 #include <qkd/q3p/mq.h>
+#include <qkd/q3p/shm.h>
 #include <qkd/utility/debug.h>
 #include <qkd/utility/syslog.h>
 
@@ -63,6 +66,12 @@ using namespace qkd::q3p;
 #define MAX_KEYSIZE_IN_QUEUE        8192ul
 
 
+/**
+ * maximum of bytes placed into the shared memory ring in one go
+ */
+#define MAX_BYTES_PER_SHM_WRITE     65536ul
+
+
 // ------------------------------------------------------------
 // decl
 
@@ -98,6 +107,12 @@ public:
      * maximum size of a key in the queue
      */
     uint64_t nMaxKeySize;
+    
+    
+    /**
+     * the shared memory ring (if used instead of the queue)
+     */
+    qkd::q3p::shm cShm;
 };
 
 
@@ -152,6 +167,16 @@ mq_instance::mq_instance(qkd::q3p::engine_instance * cEngine) : QObject(), m_cEn
     if (d->nMQDescriptor == -1) {
         qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to init MQ '" << m_sName << "': " << strerror(errno);
     }
+    
+    // shared memory instead?
+    if (engine()->shm_size()) {
+        try {
+            d->cShm = qkd::q3p::shm_ring::create(m_sName, engine()->shm_size());
+        }
+        catch (std::exception & cException) {
+            qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to init shared memory key ring '" << m_sName << "': " << cException.what();
+        }
+    }
 }
 
 
@@ -171,6 +196,11 @@ void mq_instance::produce() {
 
     if (m_bPaused) return;
     
+    if (d->cShm) {
+        produce_shm();
+        return;
+    }
+    
     // check how many keys we should produce
     struct mq_attr cAttr;
     memset(&cAttr, 0, sizeof(cAttr));
@@ -182,6 +212,7 @@ void mq_instance::produce() {
     // TODO: sync ourselves with the peer based on roles and key-ids
 
     uint64_t nKeysConsumed = 0;
+    std::vector<unsigned char> cMQKey(d->nMaxKeySize);
     for (uint64_t i = 0; i < nKeysToProduce; i++) {
         
         // fetch as much keys from the application
@@ -190,13 +221,12 @@ void mq_instance::produce() {
         
         if (cKeys.empty()) break;
         
-        qkd::key::key_ring cMQKeyRing(d->nMaxKeySize);
-        for (auto & nKeyId : cKeys) {
-            qkd::key::key cKey = engine()->application_buffer()->get(nKeyId);
-            cMQKeyRing << cKey;
-        }
+        // copy the key material straight out of the buffer
+        cMQKey.resize(std::max<uint64_t>(d->nMaxKeySize, cKeys.size() * engine()->application_buffer()->quantum()));
+        uint64_t nKeysCopied = engine()->application_buffer()->get_range(cKeys, cMQKey.data());
+        uint64_t nMQKeySize = std::min<uint64_t>(nKeysCopied * engine()->application_buffer()->quantum(), d->nMaxKeySize);
 
-        int nError = mq_send(d->nMQDescriptor, (char const *)cMQKeyRing.at(0).data().get(), cMQKeyRing.at(0).size(), 0);
+        int nError = mq_send(d->nMQDescriptor, (char const *)cMQKey.data(), nMQKeySize, 0);
         if (nError) {
             
             // placing into the queue failed ... unmark the keys
@@ -220,10 +250,59 @@ void mq_instance::produce() {
 }
 
 
+/**
+ * fill the shared memory ring with keys
+ */
+void mq_instance::produce_shm() {
+    
+    uint64_t nQuantum = engine()->application_buffer()->quantum();
+    uint64_t nKeysConsumed = 0;
+    
+    while (true) {
+        
+        // the free area right at the write position of the ring
+        uint64_t nSize = 0;
+        unsigned char * cArea = d->cShm->write_begin(nSize);
+        nSize = std::min<uint64_t>(nSize - (nSize % nQuantum), MAX_BYTES_PER_SHM_WRITE);
+        if (nSize == 0) break;
+        
+        qkd::key::key_vector cKeys = engine()->application_buffer()->find_valid(nSize, 1);
+        if (cKeys.empty()) break;
+        
+        // copy the key material straight into the shared memory
+        uint64_t nKeysCopied = engine()->application_buffer()->get_range(cKeys, cArea);
+        d->cShm->commit(nKeysCopied * nQuantum);
+        
+        // delete the keys shipped and unmark the others
+        qkd::key::key_vector cKeysShipped(cKeys.begin(), cKeys.begin() + nKeysCopied);
+        qkd::key::key_vector cKeysLeft(cKeys.begin() + nKeysCopied, cKeys.end());
+        engine()->application_buffer()->del(cKeysShipped);
+        engine()->application_buffer()->set_key_count(cKeysLeft, 0);
+        nKeysConsumed += nKeysCopied;
+        
+        if (nKeysCopied < cKeys.size()) break;
+    }
+    
+    if (nKeysConsumed) {
+        engine()->application_buffer()->emit_charge_change(0, nKeysConsumed);
+        if (qkd::utility::debug::enabled()) {
+            qkd::utility::debug() << "consumed " << nKeysConsumed << " keys for shared memory named '" << m_sName << "'";
+            qkd::utility::debug() << "current charges: " << engine()->charge_string();            
+        }
+    }
+}
+
+
 /**
  * purge the message queue
  */
 void mq_instance::purge() {
+    
+    if (d->cShm) {
+        d->cShm->purge();
+        emit purged();
+        return;
+    }
  
     bool bOldPaused = paused();
     m_bPaused = true;
@@ -275,3 +354,13 @@ void mq_instance::resume() {
     emit mode_changed(m_bPaused);
     produce();
 }
+
+
+/**
+ * check if keys are delivered via a shared memory ring
+ * 
+ * @return  true, if keys go into shared memory instead of a message queue
+ */
+bool mq_instance::shared_memory() const {
+    return (d->cShm.get() != nullptr);
+}
@@ -0,0 +1,447 @@
+/*
+ * acquire.cpp
+ *
+ * implement the Q3P KeyStore to Q3P KeyStore ACQUIRE protocol
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <chrono>
+
+// ait
+#include <qkd/q3p/engine.h>
+#include <qkd/utility/debug.h>
+#include <qkd/utility/syslog.h>
+
+#include "acquire.h"
+
+
+using namespace qkd::q3p::protocol;
+
+
+// ------------------------------------------------------------
+// defs
+
+
+#define TIMEOUT_SEC         5           /**< timeout in seconds for an acquire response */
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * remember messages and keys asked for
+ */
+class qkd::q3p::protocol::acquire::acquire_message_instance {
+    
+    
+public:
+    
+    
+    /**
+     * the message sent
+     */
+    qkd::q3p::message cMessage;
+    
+    uint64_t nTicket;                   /**< the request ticket of the engine (master) */
+    uint64_t nAppId;                    /**< the application id */
+    uint64_t nSequence;                 /**< the number of the call of the application */
+    qkd::key::key_vector cKeys;         /**< the application buffer keys */
+};
+
+
+/**
+ * the acquire pimpl
+ */
+class qkd::q3p::protocol::acquire::acquire_data {
+    
+    
+public:
+    
+    
+    /**
+     * ctor
+     */
+    acquire_data() { };
+    
+    
+    /**
+     * messages we sent and didn't get an answer yet (master)
+     */
+    std::map<uint32_t, acquire::acquire_message> cSent;
+    
+    
+    /**
+     * keys reserved on behalf of an ACQUIRE message waiting for COMMIT or ABORT (slave)
+     */
+    std::map<uint32_t, acquire::acquire_message> cPending;
+    
+};
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * ctor
+ *
+ * @param   cSocket     the socket we operate on
+ * @param   cEngine     the parent engine
+ * @throws  protocol_no_engine
+ */
+acquire::acquire(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine) : protocol(cSocket, cEngine) {
+    // pimpl
+    d = std::shared_ptr<qkd::q3p::protocol::acquire::acquire_data>(new qkd::q3p::protocol::acquire::acquire_data());
+}
+
+
+/**
+ * tell the slave the outcome of an ACQUIRE
+ *
+ * @param   nMessageId      id of the ACQUIRE message
+ * @param   bCommit         send ACQUIRE-COMMIT (else ACQUIRE-ABORT)
+ */
+void acquire::finish(uint32_t nMessageId, bool bCommit) {
+    
+    qkd::q3p::message cFinishMessage(true, false);
+    cFinishMessage << std::string(bCommit ? "ACQUIRE-COMMIT" : "ACQUIRE-ABORT");
+    cFinishMessage << nMessageId;
+    protocol_error eError = send(cFinishMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to send " << (bCommit ? "ACQUIRE-COMMIT" : "ACQUIRE-ABORT") << " for ACQUIRE message #" << nMessageId;
+    }
+}
+
+
+/**
+ * process a message received
+ *
+ * @param   cMessage        the message read
+ * @return  an protocol error variable
+ */
+protocol_error acquire::recv_internal(qkd::q3p::message & cMessage) {
+    
+    // sanity check
+    if (!engine()) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "ACQUIRE protocol without an engine! This is a bug.";
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ENGINE);
+        return protocol_error::PROTOCOL_ERROR_ENGINE;
+    }
+    
+    // set the read position
+    cMessage.seek_payload();
+    
+    // extract the very first string
+    std::string sText;
+    try {
+        cMessage >> sText;
+    }
+    catch (...) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET);
+        return protocol_error::PROTOCOL_ERROR_SOCKET;
+    }
+    
+    protocol_error eError = protocol_error::PROTOCOL_ERROR_NOT_IMPLEMENTED;
+    
+    // received an ACQUIRE command
+    if (sText == "ACQUIRE") eError = recv_ACQUIRE(cMessage);
+    
+    // received an ACQUIRE ACKNOWLEDGEMENT command
+    if (sText == "ACQUIRE-ACK") eError = recv_ACQUIRE_ACK(cMessage);
+    
+    // the master decided on an ACQUIRE
+    if (sText == "ACQUIRE-COMMIT") eError = recv_ACQUIRE_FINISH(cMessage, true);
+    if (sText == "ACQUIRE-ABORT") eError = recv_ACQUIRE_FINISH(cMessage, false);
+    
+    return eError;
+}
+
+
+/**
+ * process a message "ACQUIRE" received
+ *
+ * @param   cMessage        the message read
+ * @return  an protocol error variable
+ */
+protocol_error acquire::recv_ACQUIRE(qkd::q3p::message & cMessage) {
+    
+    // an "ACQUIRE" may be only received by the slave
+    if (!engine()->slave()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    acquire_message cPending = std::shared_ptr<acquire_message_instance>(new acquire_message_instance);
+    cPending->nTicket = 0;
+    try {
+        cMessage >> cPending->nAppId;
+        cMessage >> cPending->nSequence;
+        pop_keys(cMessage, cPending->cKeys);
+    }
+    catch (...) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET);
+        return protocol_error::PROTOCOL_ERROR_SOCKET;
+    }
+    
+    // reserve the very same keys as the master did:
+    // all or nothing and none of them in use
+    key_db & cApplicationBuffer = engine()->application_buffer();
+    bool bGranted = !cPending->cKeys.empty();
+    {
+        std::lock_guard<std::recursive_mutex> cLock(cApplicationBuffer->mutex());
+        for (auto nKeyId : cPending->cKeys) {
+            bGranted = bGranted && cApplicationBuffer->valid(nKeyId) && (cApplicationBuffer->key_count(nKeyId) == 0);
+        }
+        if (bGranted) cApplicationBuffer->set_key_count(cPending->cKeys, 1);
+    }
+    if (bGranted) d->cPending[cMessage.id()] = cPending;
+    
+    // create answer packet
+    qkd::q3p::message cAckMessage(true, false);
+    cAckMessage << std::string("ACQUIRE-ACK");
+    cAckMessage << cMessage.id();
+    cAckMessage << (uint8_t)(bGranted ? 1 : 0);
+    
+    // flush to peer
+    protocol_error eError = send(cAckMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        emit failed((uint8_t)eError);
+        return eError;
+    }
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug()
+            << (bGranted ? "reserved" : "refused") << " application keys for app #" << cPending->nAppId
+            << ": " << cPending->cKeys.size() << "; current charges: " << engine()->charge_string();
+    }
+    
+    // DONE!
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * process a message "ACQUIRE-ACK" received
+ *
+ * @param   cMessage        the message read
+ * @return  an protocol error variable
+ */
+protocol_error acquire::recv_ACQUIRE_ACK(qkd::q3p::message & cMessage) {
+    
+    // an "ACQUIRE-ACK" may be only received by the master
+    if (!engine()->master()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    // this is an acknowledgement ... for which sent message?
+    uint32_t nMessageId = 0;
+    uint8_t nGranted = 0;
+    try {
+        cMessage >> nMessageId;
+        cMessage >> nGranted;
+    }
+    catch (...) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET);
+        return protocol_error::PROTOCOL_ERROR_SOCKET;
+    }
+    
+    // look up original message
+    auto iter = d->cSent.find(nMessageId);
+    if (iter == d->cSent.end()) {
+        
+        // we gave up on this one already: the peer must not keep the keys
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "received an acknowledgement for an unsent or timed out ACQUIRE protocol message.";
+        if (nGranted) finish(nMessageId, false);
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    acquire_message cAcquireMessage = (*iter).second;
+    d->cSent.erase(iter);
+    
+    // hand out the keys locally only if the application still waits
+    bool bCommit = engine()->acquire_answer(cAcquireMessage->nTicket, (nGranted != 0));
+    if (nGranted) finish(nMessageId, bCommit);
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug()
+            << (bCommit ? "acquired" : "failed to acquire") << " application keys for app #" << cAcquireMessage->nAppId
+            << ": " << cAcquireMessage->cKeys.size() << "; current charges: " << engine()->charge_string();
+    }
+    
+    // DONE!
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * process a message "ACQUIRE-COMMIT" or "ACQUIRE-ABORT" received
+ *
+ * @param   cMessage        the message read
+ * @param   bCommit         true for "ACQUIRE-COMMIT"
+ * @return  an protocol error variable
+ */
+protocol_error acquire::recv_ACQUIRE_FINISH(qkd::q3p::message & cMessage, bool bCommit) {
+    
+    // an "ACQUIRE-COMMIT" or "ACQUIRE-ABORT" may be only received by the slave
+    if (!engine()->slave()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    uint32_t nMessageId = 0;
+    try {
+        cMessage >> nMessageId;
+    }
+    catch (...) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET);
+        return protocol_error::PROTOCOL_ERROR_SOCKET;
+    }
+    
+    auto iter = d->cPending.find(nMessageId);
+    if ((iter == d->cPending.end()) && !bCommit) {
+        
+        // we refused this one: nothing to roll back
+        if (qkd::utility::debug::enabled()) qkd::utility::debug() << "ignoring ACQUIRE-ABORT for unknown ACQUIRE message #" << nMessageId;
+        emit success();
+        return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+    }
+    if (iter == d->cPending.end()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "received an ACQUIRE-COMMIT for an unknown ACQUIRE protocol message.";
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    acquire_message cPending = (*iter).second;
+    d->cPending.erase(iter);
+    
+    // the keys stay reserved until the application picks them up
+    if (bCommit) engine()->acquire_grant(cPending->nAppId, cPending->nSequence, cPending->cKeys);
+    else engine()->application_buffer()->set_key_count(cPending->cKeys, 0);
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug()
+            << (bCommit ? "committed" : "aborted") << " application keys for app #" << cPending->nAppId
+            << ": " << cPending->cKeys.size() << "; current charges: " << engine()->charge_string();
+    }
+    
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * ask the slave to reserve keys for an application (master)
+ *
+ * The outcome is reported with engine_instance::acquire_answer().
+ *
+ * @param   nTicket     the request ticket of the engine
+ * @param   nAppId      the application id
+ * @param   nSequence   the number of the call of the application
+ * @param   cKeys       the application buffer keys reserved
+ */
+void acquire::request(uint64_t nTicket, uint64_t nAppId, uint64_t nSequence, qkd::key::key_vector const & cKeys) {
+    
+    // sanity check
+    if (!engine()) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "ACQUIRE protocol without an engine! This is a bug.";
+        return;
+    }
+    
+    acquire_message cAcquireMessage = std::shared_ptr<acquire_message_instance>(new acquire_message_instance);
+    cAcquireMessage->nTicket = nTicket;
+    cAcquireMessage->nAppId = nAppId;
+    cAcquireMessage->nSequence = nSequence;
+    cAcquireMessage->cKeys = cKeys;
+    
+    // prepare ACQUIRE message
+    cAcquireMessage->cMessage = qkd::q3p::message(true, false);
+    cAcquireMessage->cMessage << std::string("ACQUIRE");
+    cAcquireMessage->cMessage << nAppId;
+    cAcquireMessage->cMessage << nSequence;
+    push_keys(cAcquireMessage->cMessage, cKeys);
+    
+    // flush to peer
+    protocol_error eError = send(cAcquireMessage->cMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        engine()->acquire_answer(nTicket, false);
+        emit failed((uint8_t)eError);
+        return;
+    }
+    
+    // register message
+    d->cSent.insert(std::pair<uint32_t, acquire_message>(cAcquireMessage->cMessage.id(), cAcquireMessage));
+}
+
+
+/**
+ * protocol starts
+ *
+ * Requests are issued with request(): this only
+ * starts the timeout checks.
+ */
+void acquire::run_internal() {
+}
+
+
+/**
+ * timer event: check for timeout
+ */
+void acquire::timeout_internal() {
+    
+    // check all messages sent
+    std::list<uint32_t> cMessagesTooOld;
+    
+    // check if a sent message is too old
+    for (auto iter = d->cSent.begin();  iter != d->cSent.end(); iter++) {
+        if (std::chrono::duration_cast<std::chrono::seconds>((*iter).second->cMessage.age()).count() > TIMEOUT_SEC) cMessagesTooOld.push_back((*iter).first);
+    }
+    
+    // any to remove?
+    if (cMessagesTooOld.empty()) return;
+    
+    // the peer missed some messages: the peer must not keep the keys and neither do we
+    for (auto & nMessageId : cMessagesTooOld) {
+        
+        finish(nMessageId, false);
+        engine()->acquire_answer(d->cSent[nMessageId]->nTicket, false);
+        d->cSent.erase(nMessageId);
+        
+        // tell the environment
+        qkd::utility::syslog::info() << "dropped pending ACQUIRE message #" << nMessageId << " - peer didn't react";
+    }
+}
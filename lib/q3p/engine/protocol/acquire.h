@@ -0,0 +1,243 @@
+/*
+ * acquire.h
+ *
+ * this is the Q3P KeyStore to KeyStore ACQUIRE protocol
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __QKD_Q3P_PROTOCOL_ACQUIRE_H_
+#define __QKD_Q3P_PROTOCOL_ACQUIRE_H_
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <memory>
+
+// Qt
+#include <QtCore/QObject>
+#include <QtNetwork/QAbstractSocket>
+
+// ait
+#include "protocol.h"
+
+
+// ------------------------------------------------------------
+// decls
+
+
+namespace qkd {
+    
+namespace q3p {    
+
+namespace protocol {    
+
+    
+/**
+ * This is the Q3P KeyStore to KeyStore ACQUIRE Protocol.
+ *
+ * The ACQUIRE protocol agrees on the application buffer keys handed
+ * out by engine_instance::acquire_keys() on both sides. The master
+ * picks the keys, the slave hands them to the request of the same
+ * application with the same sequence number.
+ *
+ * It is:
+ *
+ *  Master                                               Slave
+ *    |                                                    |
+ *    | MsgId-M-1, "ACQUIRE", AppId, Seq, App-Key+, AUTH   |
+ *    |----------------------------------------------->    |
+ *    |                                                    |
+ *    |               MsgId-S-1, "ACQUIRE-ACK", MsgId-M-1, |
+ *    |                                       Result, AUTH |
+ *    |     <----------------------------------------------|
+ *    |                                                    |
+ *    | MsgId-M-2, "ACQUIRE-COMMIT", MsgId-M-1, AUTH       |
+ *    |   or                                               |
+ *    | MsgId-M-2, "ACQUIRE-ABORT", MsgId-M-1, AUTH        |
+ *    |----------------------------------------------->    |
+ *    |                                                    |
+ *
+ * Particles:
+ *
+ *    MsgId-M-1         Message ID 1 of the Master
+ *    MsgId-S-1         Message ID 1 of the Slave
+ *
+ *    "ACQUIRE"         a string stating "ACQUIRE"
+ *    "ACQUIRE-ACK"     a string stating "ACQUIRE"-Acknowledgment
+ *    "ACQUIRE-COMMIT"  a string stating the master handed out the keys
+ *    "ACQUIRE-ABORT"   a string stating the master released the keys
+ *    AppId             the application id of the request
+ *    Seq               the number of the request of the application
+ *    App-Key           a key id in the application buffer
+ *    Result            1 if the slave reserved all keys, 0 otherwise
+ *    AUTH              authentication tag
+ *
+ * Steps (short and brief):
+ *
+ *  A.  An application asks the master for key material. The master
+ *      reserves keys in its application buffer and sends their ids
+ *      along with the number of the request.
+ *
+ *  B.  The slave reserves the very same keys if it has all of them and
+ *      none is in use. It responds with the result.
+ *
+ *  C.  If the slave reserved the keys and the application is still
+ *      waiting the master hands out the keys and sends "ACQUIRE-COMMIT".
+ *      Else the master releases the keys (and retries on a refusal).
+ *      If the slave reserved the keys but the application gave up the
+ *      master sends "ACQUIRE-ABORT".
+ *
+ *  D.  On "ACQUIRE-COMMIT" the slave queues the keys for the request
+ *      of the application with the same number. If this request gave
+ *      up already the keys are dropped. On "ACQUIRE-ABORT" the slave
+ *      releases them.
+ */
+class acquire : public protocol {
+    
+    
+    Q_OBJECT
+    
+    
+public:
+    
+    
+    /**
+     * ctor
+     *
+     * @param   cSocket     the socket we operate on
+     * @param   cEngine     the parent engine
+     * @throws  protocol_no_engine
+     */
+    acquire(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine);
+    
+    
+    /**
+     * ask the slave to reserve keys for an application (master)
+     *
+     * The outcome is reported with engine_instance::acquire_answer().
+     *
+     * @param   nTicket     the request ticket of the engine
+     * @param   nAppId      the application id
+     * @param   nSequence   the number of the call of the application
+     * @param   cKeys       the application buffer keys reserved
+     */
+    void request(uint64_t nTicket, uint64_t nAppId, uint64_t nSequence, qkd::key::key_vector const & cKeys);
+    
+    
+private:
+    
+    
+    // fwd
+    class acquire_message_instance;
+    
+    
+    /**
+     * a smart pointer for acquire messages
+     */
+    typedef std::shared_ptr<acquire_message_instance> acquire_message;
+    
+    
+    /**
+     * tell the slave the outcome of an ACQUIRE
+     *
+     * @param   nMessageId      id of the ACQUIRE message
+     * @param   bCommit         send ACQUIRE-COMMIT (else ACQUIRE-ABORT)
+     */
+    void finish(uint32_t nMessageId, bool bCommit);
+    
+    
+    /**
+     * process a message received
+     *
+     * @param   cMessage        the message read
+     * @return  an protocol error variable
+     */
+    protocol_error recv_internal(qkd::q3p::message & cMessage);
+    
+    
+    /**
+     * process a message "ACQUIRE" received
+     *
+     * @param   cMessage        the message read
+     * @return  an protocol error variable
+     */
+    protocol_error recv_ACQUIRE(qkd::q3p::message & cMessage);
+    
+    
+    /**
+     * process a message "ACQUIRE-ACK" received
+     *
+     * @param   cMessage        the message read
+     * @return  an protocol error variable
+     */
+    protocol_error recv_ACQUIRE_ACK(qkd::q3p::message & cMessage);
+    
+    
+    /**
+     * process a message "ACQUIRE-COMMIT" or "ACQUIRE-ABORT" received
+     *
+     * @param   cMessage        the message read
+     * @param   bCommit         true for "ACQUIRE-COMMIT"
+     * @return  an protocol error variable
+     */
+    protocol_error recv_ACQUIRE_FINISH(qkd::q3p::message & cMessage, bool bCommit);
+    
+    
+    /**
+     * protocol starts
+     */
+    void run_internal();
+    
+    
+    /**
+     * timer event: check for timeout
+     */
+    void timeout_internal();
+    
+    
+    /**
+     * get the protocol type
+     *
+     * @return  the protocol type
+     */
+    protocol_type protocol_id_internal() const { return protocol_type::PROTOCOL_ACQUIRE; };
+    
+    
+    // pimpl
+    class acquire_data;
+    std::shared_ptr<acquire_data> d;
+};
+  
+
+}
+
+}
+
+}
+
+
+#endif
@@ -31,6 +31,8 @@
 // ------------------------------------------------------------
 // incs
 
+#include <stdexcept>
+
 // ait
 #include <qkd/q3p/engine.h>
 #include <qkd/utility/syslog.h>
@@ -70,12 +72,18 @@ protocol_error data::recv_internal(qkd::q3p::message & cMessage) {
         return protocol_error::PROTOCOL_ERROR_ENGINE;
     }
     
-    // get the payload
-    qkd::utility::memory cPayload;
-    cMessage >> cPayload;
-    
-    // write to the NIC
-    engine()->recv_data(cPayload);
+    // the payload is a batch of packets: write each to the NIC
+    try {
+        while (!cMessage.eof()) {
+            qkd::utility::memory cPayload;
+            cMessage.pop_shared(cPayload);
+            engine()->recv_data(cPayload);
+        }
+    }
+    catch (std::out_of_range const & cException) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "DATA message with malformed payload: " << cException.what();
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
 
     return protocol_error::PROTOCOL_ERROR_NO_ERROR;
 }
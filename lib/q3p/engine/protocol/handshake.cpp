@@ -50,6 +50,11 @@ using namespace qkd::q3p::protocol;
 
 #define TIMEOUT_SEC         5           /**< timeout in seconds for a handshake response */
 
+#define FEATURE_KEY_ID_RANGES   0x00000001      /**< key id sets are sent as ranges */
+#define FEATURE_ACQUIRE         0x00000002      /**< application keys are agreed with the ACQUIRE protocol */
+#define FEATURE_DATA_BATCH      0x00000004      /**< a DATA message may carry several packets */
+#define FEATURES                (FEATURE_KEY_ID_RANGES | FEATURE_ACQUIRE | FEATURE_DATA_BATCH)   /**< the features we support */
+
 
 
 // ------------------------------------------------------------
@@ -324,6 +329,13 @@ protocol_error handshake::recv_internal(qkd::q3p::message & cMessage) {
             return protocol_error::PROTOCOL_ERROR_CONFIG;
         }
         
+        // feature flags: older peers do not send any
+        uint32_t nPeerFeatures = 0;
+        if (!cMessage.eof()) cMessage >> nPeerFeatures;
+        engine()->set_compact_key_ids((FEATURES & nPeerFeatures & FEATURE_KEY_ID_RANGES) != 0);
+        engine()->set_acquire_supported((FEATURES & nPeerFeatures & FEATURE_ACQUIRE) != 0);
+        engine()->set_data_batch((FEATURES & nPeerFeatures & FEATURE_DATA_BATCH) != 0);
+        
     }
     catch (...) {
         emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
@@ -375,6 +387,7 @@ void handshake::run_internal() {
     cMessage << (uint64_t)engine()->application_buffer()->min_id();         // application specs: min_id
     cMessage << (uint64_t)engine()->application_buffer()->max_id();         // application specs: max_id
     cMessage << (uint64_t)engine()->application_buffer()->quantum();        // application specs: quantum
+    cMessage << (uint32_t)FEATURES;                                         // features supported
 
     qkd::utility::debug() << "local configuration:\n" << 
         "\t      master: " << engine()->master() << "\n" <<
@@ -399,7 +412,8 @@ void handshake::run_internal() {
         "\t application: \n" <<
         "\t          min-id: " << engine()->incoming_buffer()->min_id() << "\n" <<
         "\t          max-id: " << engine()->incoming_buffer()->max_id() << "\n" <<
-        "\t         quantum: " << engine()->incoming_buffer()->quantum();
+        "\t         quantum: " << engine()->incoming_buffer()->quantum() << "\n" <<
+        "\t    features: " << FEATURES;
         
     // flush to peer
     eError = send(cMessage);
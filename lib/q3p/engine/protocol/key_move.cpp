@@ -31,8 +31,9 @@
 // ------------------------------------------------------------
 // incs
 
+#include <vector>
+
 // ait
-#include <qkd/key/key_ring.h>
 #include <qkd/q3p/engine.h>
 #include <qkd/utility/syslog.h>
 
@@ -77,6 +78,7 @@ qkd::key::key_vector key_move::copy_buffer(qkd::key::key_vector const & cCommonS
     uint64_t nCommonStoreToBufferRatio = engine()->common_store()->quantum() / cBuffer->quantum();
     
     uint64_t nBufferKeyIndex = 0;
+    std::vector<unsigned char> cKeyMaterial(engine()->common_store()->quantum());
     
     // iterate over the common store keys
     for (auto & nKeyId : cCommonStoreKeys) {
@@ -85,27 +87,18 @@ qkd::key::key_vector key_move::copy_buffer(qkd::key::key_vector const & cCommonS
         if ((cBufferKeys.size() - nBufferKeyIndex) < nCommonStoreToBufferRatio) break;
         
         // find key in the common store
-        qkd::key::key cKey = engine()->common_store()->get(nKeyId);
-        if (cKey == qkd::key::key::null()) {
+        if (engine()->common_store()->get_range(nKeyId, 1, cKeyMaterial.data()) != 1) {
             qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "copy key from common store to buffer peer mismatch: unknown common store keyid.";
         }
         else {
             
             // place key in buffer
-            qkd::key::key_ring cKeyRing(cBuffer->quantum());
-            cKeyRing << cKey;
+            qkd::key::key_vector cBufferKeysAssigned(cBufferKeys.begin() + nBufferKeyIndex, cBufferKeys.begin() + nBufferKeyIndex + nCommonStoreToBufferRatio);
+            cBuffer->set_range(cBufferKeysAssigned, cKeyMaterial.data());
+            cBuffer->set_key_count(cBufferKeysAssigned, 1);
+            for (auto nBufferKeyId : cBufferKeysAssigned) cBuffer->set_eventual_sync(nBufferKeyId);
             
-            // walk over the ring 
-            for (unsigned int i = 0; i < cKeyRing.size(); i++) {
-                
-                // create the buffer key
-                qkd::key::key cKey(cBufferKeys.at(nBufferKeyIndex), cKeyRing.at(i).data());
-                cBuffer->set(cKey);
-                cBuffer->set_key_count(cKey.id(), 1);
-                cBuffer->set_eventual_sync(cKey.id());
-                
-                nBufferKeyIndex++;
-            }
+            nBufferKeyIndex += nCommonStoreToBufferRatio;
 
             // delete from common store
             engine()->common_store()->set_key_count(nKeyId, 1);
@@ -185,6 +178,7 @@ qkd::key::key_vector key_move::move_buffer(qkd::key::key_vector const & cCommonS
     uint64_t nCommonStoreToBufferRatio = engine()->common_store()->quantum() / cBuffer->quantum();
     
     uint64_t nBufferKeyIndex = 0;
+    std::vector<unsigned char> cKeyMaterial(engine()->common_store()->quantum());
     
     // iterate over the common store keys
     for (auto & nKeyId : cCommonStoreKeys) {
@@ -193,27 +187,18 @@ qkd::key::key_vector key_move::move_buffer(qkd::key::key_vector const & cCommonS
         if ((cBufferKeys.size() - nBufferKeyIndex) < nCommonStoreToBufferRatio) break;
         
         // find key in the common store
-        qkd::key::key cKey = engine()->common_store()->get(nKeyId);
-        if (cKey == qkd::key::key::null()) {
+        if (engine()->common_store()->get_range(nKeyId, 1, cKeyMaterial.data()) != 1) {
             qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "move key from common store to buffer peer mismatch: unknown common store keyid.";
         }
         else {
             
             // place key in buffer
-            qkd::key::key_ring cKeyRing(cBuffer->quantum());
-            cKeyRing << cKey;
+            qkd::key::key_vector cBufferKeysAssigned(cBufferKeys.begin() + nBufferKeyIndex, cBufferKeys.begin() + nBufferKeyIndex + nCommonStoreToBufferRatio);
+            cBuffer->set_range(cBufferKeysAssigned, cKeyMaterial.data());
+            cBuffer->set_key_count(cBufferKeysAssigned, 0);
+            for (auto nBufferKeyId : cBufferKeysAssigned) cBuffer->set_real_sync(nBufferKeyId);
             
-            // walk over the ring 
-            for (unsigned int i = 0; i < cKeyRing.size(); i++) {
-                
-                // create the buffer key
-                qkd::key::key cKey(cBufferKeys.at(nBufferKeyIndex), cKeyRing.at(i).data());
-                cBuffer->set(cKey);
-                cBuffer->set_key_count(cKey.id(), 0);
-                cBuffer->set_real_sync(cKey.id());
-                
-                nBufferKeyIndex++;
-            }
+            nBufferKeyIndex += nCommonStoreToBufferRatio;
 
             // delete from common store
             engine()->common_store()->del(nKeyId);
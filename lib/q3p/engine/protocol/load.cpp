@@ -69,6 +69,17 @@ using namespace qkd::q3p::protocol;
 static const double g_nSated = 0.90;
 
 
+/**
+ * maximum number of LOAD messages in flight
+ * 
+ * The master does not wait for a LOAD-ACK before
+ * issuing the next LOAD. This way the buffers are refilled
+ * at the speed of the link and not at the speed of the
+ * round trip time.
+ */
+static const unsigned int g_nWindow = 8;
+
+
 // ------------------------------------------------------------
 // decl
 
@@ -92,6 +103,9 @@ public:
     
     qkd::key::key_vector cIncomingBufferKeys;                       /**< new keys in incoming */
     qkd::key::key_vector cApplicationBufferKeys;                    /**< new keys in application */
+    
+    uint64_t nIncomingBufferKeysCopied = 0;                         /**< keys of cIncomingBufferKeys copied in advance */
+    uint64_t nApplicationBufferKeysCopied = 0;                      /**< keys of cApplicationBufferKeys copied in advance */
 };
 
 
@@ -101,6 +115,10 @@ public:
 typedef std::shared_ptr<load_message_instance> load_message;
 
 
+// fwd
+static void release(qkd::q3p::engine_instance * cEngine, load_message const & cLoadMessage);
+
+
 /**
  * the load pimpl
  */
@@ -120,6 +138,31 @@ public:
      * messages we sent and didn't get an answer yet 
      */
     std::map<uint32_t, load_message> cSent;     
+    
+    
+    /**
+     * ids of the messages in cSent in the order sent
+     */
+    std::list<uint32_t> cSentOrder;
+    
+    
+    /**
+     * sum up the keys reserved by the LOADs in flight
+     * 
+     * @param   nCommonStore        common store keys reserved
+     * @param   nIncoming           incoming buffer keys reserved but not charged yet
+     * @param   nApplication        application buffer keys reserved but not charged yet
+     */
+    void reserved(uint64_t & nCommonStore, uint64_t & nIncoming, uint64_t & nApplication) const {
+        nCommonStore = 0;
+        nIncoming = 0;
+        nApplication = 0;
+        for (auto const & cEntry : cSent) {
+            nCommonStore += cEntry.second->cCommonStoreKeysForIncoming.size() + cEntry.second->cCommonStoreKeysForApplication.size();
+            nIncoming += cEntry.second->cIncomingBufferKeys.size() - cEntry.second->nIncomingBufferKeysCopied;
+            nApplication += cEntry.second->cApplicationBufferKeys.size() - cEntry.second->nApplicationBufferKeysCopied;
+        }
+    }
    
 };
 
@@ -218,14 +261,14 @@ protocol_error load::recv_LOAD(qkd::q3p::message & cMessage) {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cCommonStoreKeysForIncoming;
+        pop_keys(cMessage, cCommonStoreKeysForIncoming);
         
         cMessage >> sText;
         if (sText != "I") {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cIncomingBufferKeys;
+        pop_keys(cMessage, cIncomingBufferKeys);
         
         // grab the keys for the application
         cMessage >> sText;
@@ -240,14 +283,14 @@ protocol_error load::recv_LOAD(qkd::q3p::message & cMessage) {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cCommonStoreKeysForApplication;
+        pop_keys(cMessage, cCommonStoreKeysForApplication);
         
         cMessage >> sText;
         if (sText != "A") {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cApplicationBufferKeys;
+        pop_keys(cMessage, cApplicationBufferKeys);
 
     }
     catch (...) { 
@@ -266,11 +309,11 @@ protocol_error load::recv_LOAD(qkd::q3p::message & cMessage) {
     
     // place outgoing keys moved
     cAckMessage << std::string("OUTGOING");
-    cAckMessage << cMovedToOutgoing;
+    push_keys(cAckMessage, cMovedToOutgoing);
     
     // place application keys moved
     cAckMessage << std::string("APPLICAT");
-    cAckMessage << cMovedToApplication;
+    push_keys(cAckMessage, cMovedToApplication);
     
     // flush to peer
     protocol_error eError = send(cAckMessage);
@@ -353,7 +396,7 @@ protocol_error load::recv_LOAD_ACK(qkd::q3p::message & cMessage) {
         }
         
         // extract the set of keys moved
-        cMessage >> cMovedToIncoming;
+        pop_keys(cMessage, cMovedToIncoming);
 
         // grab the keys for the application
         cMessage >> sText;
@@ -363,7 +406,7 @@ protocol_error load::recv_LOAD_ACK(qkd::q3p::message & cMessage) {
         }
         
         // extract the set of keys moved to the app buffer
-        cMessage >> cMovedToApplication;
+        pop_keys(cMessage, cMovedToApplication);
     }
     catch (...) { 
         emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
@@ -415,6 +458,22 @@ protocol_error load::recv_LOAD_ACK(qkd::q3p::message & cMessage) {
     // remove pending message
     d->cSent.erase(nMessageId);
     
+    // the slave answers in order: any LOAD sent before this one
+    // still pending has been rejected and won't be answered anymore
+    while (!d->cSentOrder.empty()) {
+        
+        uint32_t nSentMessageId = d->cSentOrder.front();
+        d->cSentOrder.pop_front();
+        if (nSentMessageId == nMessageId) break;
+        
+        auto iter = d->cSent.find(nSentMessageId);
+        if (iter == d->cSent.end()) continue;
+        
+        release(engine(), (*iter).second);
+        d->cSent.erase(iter);
+        qkd::utility::syslog::info() << "dropped pending LOAD message #" << nSentMessageId << " - peer skipped it";
+    }
+    
     // DONE!
     emit success();
     
@@ -436,8 +495,8 @@ void load::run_internal() {
     // this is a master only step here
     if (!engine()->master()) return;
 
-    // if we have still messages ongoing: do not proceed - wait for responses
-    if (d->cSent.size()) return;
+    // window full: do not proceed - wait for responses
+    if (d->cSent.size() >= g_nWindow) return;
 
     // for ease of reading the next lines
     key_db & cCommonStore = engine()->common_store();
@@ -458,26 +517,39 @@ void load::run_internal() {
     //        the outgoing buffer
     //      - the charge of the application buffer 
     //        may not exceed any charge of the incoming or outgoing buffer
+    //
+    // The keys reserved by the LOADs in flight are accounted for: the 
+    // buffer keys copied in advance are part of the buffer charges, 
+    // the others are added here. The common store keys stay valid 
+    // until the LOAD-ACK and are taken off the common store charge.
+    uint64_t nReservedCommonStore = 0;
+    uint64_t nReservedIncoming = 0;
+    uint64_t nReservedApplication = 0;
+    d->reserved(nReservedCommonStore, nReservedIncoming, nReservedApplication);
+    uint64_t nChargeIncoming = std::min(cIncomingBuffer->count() + nReservedIncoming, cIncomingBuffer->amount());
+    uint64_t nChargeApplication = std::min(cApplicationBuffer->count() + nReservedApplication, cApplicationBuffer->amount());
     
     // how many keys in buffer list for each common store key?
     uint64_t nCommonStoreToBufferRatio = cCommonStore->quantum() / cIncomingBuffer->quantum();
     
     // check number of keys needed: incoming buffer
-    uint64_t nKeysIncoming = cIncomingBuffer->amount() - cIncomingBuffer->count();
-    if (cIncomingBuffer->count() > cIncomingBuffer->amount() * g_nSated) nKeysIncoming = 0;
-    if (cIncomingBuffer->count() > cOutgoingBuffer->count()) nKeysIncoming = 0;
+    uint64_t nKeysIncoming = cIncomingBuffer->amount() - nChargeIncoming;
+    if (nChargeIncoming > cIncomingBuffer->amount() * g_nSated) nKeysIncoming = 0;
+    if (nChargeIncoming > cOutgoingBuffer->count()) nKeysIncoming = 0;
 
     // check number of keys needed: application buffer (may not exceed incoming & outgoing buffers)
-    uint64_t nKeysApplication = cApplicationBuffer->amount() - cApplicationBuffer->count();
-    if (cApplicationBuffer->count() > cApplicationBuffer->amount() * g_nSated) nKeysApplication = 0;
-    if (cApplicationBuffer->count() >= (cIncomingBuffer->count() + nKeysIncoming)) nKeysApplication = 0;
-    if (cApplicationBuffer->count() >= cOutgoingBuffer->count()) nKeysApplication = 0;
+    uint64_t nKeysApplication = cApplicationBuffer->amount() - nChargeApplication;
+    if (nChargeApplication > cApplicationBuffer->amount() * g_nSated) nKeysApplication = 0;
+    if (nChargeApplication >= (nChargeIncoming + nKeysIncoming)) nKeysApplication = 0;
+    if (nChargeApplication >= cOutgoingBuffer->count()) nKeysApplication = 0;
     
     // do we need keys at all?
     if ((nKeysIncoming + nKeysApplication) == 0) return;
     
     // how many bytes are to spend for each buffer
-    uint64_t nBytesAvailable = (cCommonStore->count() / 3) * cCommonStore->quantum();
+    uint64_t nCommonStoreKeys = cCommonStore->count();
+    nCommonStoreKeys -= std::min(nCommonStoreKeys, nReservedCommonStore);
+    uint64_t nBytesAvailable = (nCommonStoreKeys / 3) * cCommonStore->quantum();
     if (nBytesAvailable == 0) return;
     
     // check against available key material in the common store
@@ -560,16 +632,16 @@ void load::run_internal() {
     // place incoming keys
     cLoadMessage->cMessage << std::string("INCOMING");
     cLoadMessage->cMessage << std::string("C");
-    cLoadMessage->cMessage << cLoadMessage->cCommonStoreKeysForIncoming;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cCommonStoreKeysForIncoming);
     cLoadMessage->cMessage << std::string("I");
-    cLoadMessage->cMessage << cLoadMessage->cIncomingBufferKeys;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cIncomingBufferKeys);
     
     // place application keys
     cLoadMessage->cMessage << std::string("APPLICAT");
     cLoadMessage->cMessage << std::string("C");
-    cLoadMessage->cMessage << cLoadMessage->cCommonStoreKeysForApplication;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cCommonStoreKeysForApplication);
     cLoadMessage->cMessage << std::string("A");
-    cLoadMessage->cMessage << cLoadMessage->cApplicationBufferKeys;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cApplicationBufferKeys);
 
     // flush to peer
     protocol_error eError = send(cLoadMessage->cMessage);
@@ -588,11 +660,12 @@ void load::run_internal() {
     // copy the keys in advance
     // this is needed, since the peer may already take some of the assigned
     // keys to rightout authenticate his LOAD-ACK message ... 
-    copy_incoming(cLoadMessage->cCommonStoreKeysForIncoming, cLoadMessage->cIncomingBufferKeys);
-    copy_application(cLoadMessage->cCommonStoreKeysForApplication, cLoadMessage->cApplicationBufferKeys);
+    cLoadMessage->nIncomingBufferKeysCopied = copy_incoming(cLoadMessage->cCommonStoreKeysForIncoming, cLoadMessage->cIncomingBufferKeys).size() * (cCommonStore->quantum() / cIncomingBuffer->quantum());
+    cLoadMessage->nApplicationBufferKeysCopied = copy_application(cLoadMessage->cCommonStoreKeysForApplication, cLoadMessage->cApplicationBufferKeys).size() * (cCommonStore->quantum() / cApplicationBuffer->quantum());
 
     // register message
     d->cSent.insert(std::pair<uint32_t, load_message>(cLoadMessage->cMessage.id(), cLoadMessage));
+    d->cSentOrder.push_back(cLoadMessage->cMessage.id());
 }
 
 
@@ -616,18 +689,27 @@ void load::timeout_internal() {
     for (auto & nMessageId : cMessagesTooOld) {
         
         // remove the message and clear all participating key counts in the buffers
-        load_message cLoadMessage = d->cSent[nMessageId];
-        
-        // clear keys
-        engine()->common_store()->set_key_count(cLoadMessage->cCommonStoreKeysForIncoming, 0);
-        engine()->common_store()->set_key_count(cLoadMessage->cCommonStoreKeysForApplication, 0);
-        engine()->incoming_buffer()->set_key_count(cLoadMessage->cIncomingBufferKeys, 0);
-        engine()->application_buffer()->set_key_count(cLoadMessage->cApplicationBufferKeys, 0);
+        release(engine(), d->cSent[nMessageId]);
         
         // remove from the sent message store ...
         d->cSent.erase(nMessageId);
+        d->cSentOrder.remove(nMessageId);
         
         // tell the environment
         qkd::utility::syslog::info() << "dropped pending LOAD message #" << nMessageId << " - peer didn't react";
     }
 }
+
+
+/**
+ * release the keys assigned to a LOAD message not answered
+ * 
+ * @param   cEngine         the engine
+ * @param   cLoadMessage    the message sent
+ */
+void release(qkd::q3p::engine_instance * cEngine, load_message const & cLoadMessage) {
+    cEngine->common_store()->set_key_count(cLoadMessage->cCommonStoreKeysForIncoming, 0);
+    cEngine->common_store()->set_key_count(cLoadMessage->cCommonStoreKeysForApplication, 0);
+    cEngine->incoming_buffer()->set_key_count(cLoadMessage->cIncomingBufferKeys, 0);
+    cEngine->application_buffer()->set_key_count(cLoadMessage->cApplicationBufferKeys, 0);
+}
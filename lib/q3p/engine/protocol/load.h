@@ -108,6 +108,10 @@ namespace protocol {
  *  C.  On reception of the master moves the keys from the common store
  *      to the buffers.
  * 
+ * The master does not wait for a LOAD-ACK before sending the next
+ * LOAD: up to a window of LOAD messages may be in flight. As the
+ * slave answers in order, a LOAD-ACK settles all LOADs sent before.
+ * 
  * Hence, this is not a full discussion of the protocol. Look for accompanying
  * documents about Q3P.
  */
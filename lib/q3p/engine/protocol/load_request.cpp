@@ -217,14 +217,14 @@ protocol_error load_request::recv_LOAD(UNUSED qkd::q3p::message & cMessage) {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cCommonStoreKeysForOutgoing;
+        pop_keys(cMessage, cCommonStoreKeysForOutgoing);
         
         cMessage >> sText;
         if (sText != "O") {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cOutgoingBufferKeys;
+        pop_keys(cMessage, cOutgoingBufferKeys);
         
         // grab the keys for the application
         cMessage >> sText;
@@ -239,14 +239,14 @@ protocol_error load_request::recv_LOAD(UNUSED qkd::q3p::message & cMessage) {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cCommonStoreKeysForApplication;
+        pop_keys(cMessage, cCommonStoreKeysForApplication);
         
         cMessage >> sText;
         if (sText != "A") {
             emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
             return protocol_error::PROTOCOL_ERROR_ANSWER;
         }
-        cMessage >> cApplicationBufferKeys;
+        pop_keys(cMessage, cApplicationBufferKeys);
 
     }
     catch (...) { 
@@ -265,11 +265,11 @@ protocol_error load_request::recv_LOAD(UNUSED qkd::q3p::message & cMessage) {
     
     // place outgoing keys moved
     cAckMessage << std::string("OUTGOING");
-    cAckMessage << cMovedToIncoming;
+    push_keys(cAckMessage, cMovedToIncoming);
     
     // place application keys moved
     cAckMessage << std::string("APPLICAT");
-    cAckMessage << cMovedToApplication;
+    push_keys(cAckMessage, cMovedToApplication);
     
     // flush to peer
     protocol_error eError = send(cAckMessage);
@@ -354,7 +354,7 @@ protocol_error load_request::recv_LOAD_ACK(qkd::q3p::message & cMessage) {
         }
         
         // extract the set of keys moved
-        cMessage >> cMovedToOutgoing;
+        pop_keys(cMessage, cMovedToOutgoing);
 
         // grab the keys for the application
         cMessage >> sText;
@@ -364,7 +364,7 @@ protocol_error load_request::recv_LOAD_ACK(qkd::q3p::message & cMessage) {
         }
         
         // extract the set of keys moved to the app buffer
-        cMessage >> cMovedToApplication;
+        pop_keys(cMessage, cMovedToApplication);
     }
     catch (...) { 
         emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
@@ -566,16 +566,16 @@ protocol_error load_request::recv_LOAD_REQ(UNUSED qkd::q3p::message & cMessage)
     // place incoming keys
     cLoadMessage->cMessage << std::string("OUTGOING");
     cLoadMessage->cMessage << std::string("C");
-    cLoadMessage->cMessage << cLoadMessage->cCommonStoreKeysForOutgoing;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cCommonStoreKeysForOutgoing);
     cLoadMessage->cMessage << std::string("O");
-    cLoadMessage->cMessage << cLoadMessage->cOutgoingBufferKeys;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cOutgoingBufferKeys);
     
     // place application keys
     cLoadMessage->cMessage << std::string("APPLICAT");
     cLoadMessage->cMessage << std::string("C");
-    cLoadMessage->cMessage << cLoadMessage->cCommonStoreKeysForApplication;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cCommonStoreKeysForApplication);
     cLoadMessage->cMessage << std::string("A");
-    cLoadMessage->cMessage << cLoadMessage->cApplicationBufferKeys;
+    push_keys(cLoadMessage->cMessage, cLoadMessage->cApplicationBufferKeys);
 
     // flush to peer
     protocol_error eError = send(cLoadMessage->cMessage);
@@ -53,7 +53,7 @@ using namespace qkd::q3p::protocol;
  * @param   cEngine     the parent engine
  * @throws  protocol_no_engine
  */
-protocol::protocol(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine) : QObject(cSocket), m_cEngine(cEngine), m_cSocket(cSocket) {
+protocol::protocol(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine) : QObject(cSocket), m_cEngine(cEngine), m_cSocket(cSocket), m_cTimer(nullptr) {
     if (!m_cEngine) {
         throw std::invalid_argument("q3p protocol with NULL engine");
     }
@@ -74,6 +74,21 @@ uint64_t protocol::max_size() {
 }
 
 
+/**
+ * read a set of key ids from a message
+ * 
+ * This reads the range encoding if negotiated
+ * in the handshake, the plain key vector otherwise.
+ * 
+ * @param   cMessage        the message to read from
+ * @param   cKeys           on return: the key ids read
+ */
+void protocol::pop_keys(qkd::q3p::message & cMessage, qkd::key::key_vector & cKeys) const {
+    if (engine()->compact_key_ids()) qkd::key::read_ranges(cMessage, cKeys);
+    else cMessage >> cKeys;
+}
+
+
 /**
  * give a human readable description of the error
  * 
@@ -117,48 +132,75 @@ std::string const & protocol::protocol_id_name(uint8_t nProtocolId) {
         "LOAD",
         "LOAD-REQUEST",
         "STORE",
-        "DATA"
+        "DATA",
+        "ACQUIRE"
     };
     
     // the: "Me, Oliver, forgot to name a sub-protocol of Q3P accordingly - branch"
     static const std::string sProtocolIdUnknown = "UNKNOWN";
     
     // good id
-    if (nProtocolId <= (uint8_t)protocol_type::PROTOCOL_DATA) return sProtocolIdNames[nProtocolId];
+    if (nProtocolId <= (uint8_t)protocol_type::PROTOCOL_ACQUIRE) return sProtocolIdNames[nProtocolId];
 
     // bad id --> tell Oliver, to fix that if you encounter this line!
     return sProtocolIdUnknown;
 }
 
 
+/**
+ * write a set of key ids to a message
+ * 
+ * This writes the range encoding if negotiated
+ * in the handshake, the plain key vector otherwise.
+ * 
+ * @param   cMessage        the message to write to
+ * @param   cKeys           the key ids to write
+ */
+void protocol::push_keys(qkd::q3p::message & cMessage, qkd::key::key_vector const & cKeys) const {
+    if (engine()->compact_key_ids()) qkd::key::write_ranges(cMessage, cKeys);
+    else cMessage << cKeys;
+}
+
+
 /**
  * parse data from the peer
  * 
- * the read buffer is examined if it contains
- * a Q3P message. If so, the message is removed and parsed
+ * the read buffer is examined if it starts with a complete
+ * Q3P message. If so, the message is parsed and nConsumed
+ * tells the number of bytes it took. A malformed length
+ * consumes the whole buffer.
  * 
  * @param   cBuffer         read buffer which may contain a Q3P message
+ * @param   nSize           number of bytes in the read buffer
+ * @param   nConsumed       on return: number of bytes used from the buffer
  * @param   cMessage        the message read
  * @param   eProtocol       the identified protocol the received message belongs
  * @return  an protocol error variable
  */
-protocol_error protocol::recv(QByteArray & cBuffer, qkd::q3p::message & cMessage, protocol_type & eProtocol) {
+protocol_error protocol::recv(char const * cBuffer, uint64_t nSize, uint64_t & nConsumed, qkd::q3p::message & cMessage, protocol_type & eProtocol) {
+    
+    nConsumed = 0;
     
     // we need the length of the Q3P message at a minimum
-    if (cBuffer.size() < 4) return protocol_error::PROTOCOL_ERROR_PENDING;
+    if (nSize < 4) return protocol_error::PROTOCOL_ERROR_PENDING;
     
     // check the first particle: length
     uint32_t nPacketSize = 0;
-    nPacketSize = be32toh(*((uint32_t *)cBuffer.data()));
+    memcpy(&nPacketSize, cBuffer, sizeof(nPacketSize));
+    nPacketSize = be32toh(nPacketSize);
+    
+    // a packet shorter than a header: we lost track of the stream
+    if (nPacketSize < qkd::q3p::message::header_size()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "received malformed data from peer: bad packet size " << nPacketSize << " - dropping incoming bytes";
+        nConsumed = nSize;
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
 
     // don't proceed if we ain't got enough to work on
-    if ((uint32_t)cBuffer.size() < nPacketSize) return protocol_error::PROTOCOL_ERROR_PENDING;
+    if (nSize < nPacketSize) return protocol_error::PROTOCOL_ERROR_PENDING;
     
-    // cut off the first packet and leave the remaining piece intact
-    QByteArray cPacket = cBuffer.left(nPacketSize);
-    cBuffer = cBuffer.right(cBuffer.size() - nPacketSize);
-    
-    return recv_packet(cPacket, cMessage, eProtocol);
+    nConsumed = nPacketSize;
+    return recv_packet(cBuffer, nPacketSize, cMessage, eProtocol);
 }
     
     
@@ -169,16 +211,17 @@ protocol_error protocol::recv(QByteArray & cBuffer, qkd::q3p::message & cMessage
  * the socket and dispatched accordingly
  * 
  * @param   cPacket         the packet read from the socket
+ * @param   nSize           size of the packet
  * @param   cMessage        the message read
  * @param   eProtocol       the identified protocol the received message belongs
  * @return  an protocol error variable
  */
-protocol_error protocol::recv_packet(QByteArray & cPacket, qkd::q3p::message & cMessage, protocol_type & eProtocol) {
+protocol_error protocol::recv_packet(char const * cPacket, uint64_t nSize, qkd::q3p::message & cMessage, protocol_type & eProtocol) {
     
     // the cPacket IS the message
     cMessage = qkd::q3p::message();
-    cMessage.resize(cPacket.size());
-    memcpy(cMessage.get(), cPacket.data(), cPacket.size());
+    cMessage.resize(nSize);
+    memcpy(cMessage.get(), cPacket, nSize);
 
     // extract the Q3P version number
     if (cMessage.version() != 2) {
@@ -207,12 +250,14 @@ void protocol::run() {
         return; 
     } 
     
-    // activate timer
-    QTimer * cTimer = new QTimer(this);
-    connect(cTimer, SIGNAL(timeout()), SLOT(timeout()));
-    cTimer->setInterval(1000);
-    cTimer->setSingleShot(false);
-    cTimer->start();
+    // activate timer (once: run() is called again and again)
+    if (!m_cTimer) {
+        m_cTimer = new QTimer(this);
+        connect(m_cTimer, SIGNAL(timeout()), SLOT(timeout()));
+        m_cTimer->setInterval(1000);
+        m_cTimer->setSingleShot(false);
+        m_cTimer->start();
+    }
     
     run_internal(); 
 }
@@ -107,7 +107,8 @@ enum class protocol_type : uint8_t {
     PROTOCOL_LOAD,                              /**< master->slave LOAD protocol */
     PROTOCOL_LOAD_REQUEST,                      /**< slave -> master LOAD-REQUEST protocol */
     PROTOCOL_STORE,                             /**< master->slave STORE protocol */
-    PROTOCOL_DATA                               /**< DATA protocol */
+    PROTOCOL_DATA,                              /**< DATA protocol */
+    PROTOCOL_ACQUIRE                            /**< master->slave ACQUIRE protocol */
 };
 
 
@@ -181,6 +182,18 @@ public:
     static uint64_t max_size();
     
     
+    /**
+     * read a set of key ids from a message
+     * 
+     * This reads the range encoding if negotiated
+     * in the handshake, the plain key vector otherwise.
+     * 
+     * @param   cMessage        the message to read from
+     * @param   cKeys           on return: the key ids read
+     */
+    void pop_keys(qkd::q3p::message & cMessage, qkd::key::key_vector & cKeys) const;
+    
+    
     /**
      * get the protocol type
      * 
@@ -198,18 +211,34 @@ public:
     static std::string const & protocol_id_name(uint8_t nProtocolId);
     
     
+    /**
+     * write a set of key ids to a message
+     * 
+     * This writes the range encoding if negotiated
+     * in the handshake, the plain key vector otherwise.
+     * 
+     * @param   cMessage        the message to write to
+     * @param   cKeys           the key ids to write
+     */
+    void push_keys(qkd::q3p::message & cMessage, qkd::key::key_vector const & cKeys) const;
+    
+    
     /**
      * parse data from the peer
      * 
-     * the read buffer is examined if it contains
-     * a Q3P message. If so, the message is removed and parsed
+     * the read buffer is examined if it starts with a complete
+     * Q3P message. If so, the message is parsed and nConsumed
+     * tells the number of bytes it took. A malformed length
+     * consumes the whole buffer.
      * 
      * @param   cBuffer         read buffer which may contain a Q3P message
+     * @param   nSize           number of bytes in the read buffer
+     * @param   nConsumed       on return: number of bytes used from the buffer
      * @param   cMessage        the message read
      * @param   eProtocol       the identified protocol the received message belongs
      * @return  an protocol error variable
      */
-    static protocol_error recv(QByteArray & cBuffer, qkd::q3p::message & cMessage, protocol_type & eProtocol);
+    static protocol_error recv(char const * cBuffer, uint64_t nSize, uint64_t & nConsumed, qkd::q3p::message & cMessage, protocol_type & eProtocol);
     
     
     /**
@@ -306,11 +335,12 @@ private:
      * the socket and dispatched accordingly
      * 
      * @param   cPacket         the packet read from the socket
+     * @param   nSize           size of the packet
      * @param   cMessage        the message read
      * @param   eProtocol       the identified protocol the received message belongs
      * @return  an protocol error variable
      */
-    static protocol_error recv_packet(QByteArray & cPacket, qkd::q3p::message & cMessage, protocol_type & eProtocol);
+    static protocol_error recv_packet(char const * cPacket, uint64_t nSize, qkd::q3p::message & cMessage, protocol_type & eProtocol);
     
     
     /**
@@ -357,6 +387,12 @@ private:
      */
     QAbstractSocket * m_cSocket;
     
+    
+    /**
+     * the timeout timer (created on the first run)
+     */
+    QTimer * m_cTimer;
+    
 };
   
 
@@ -31,11 +31,12 @@
 // ------------------------------------------------------------
 // incs
 
-#include <iostream>
-
+#include <chrono>
+#include <set>
 
 // ait
 #include <qkd/q3p/engine.h>
+#include <qkd/utility/debug.h>
 #include <qkd/utility/syslog.h>
 
 #include "store.h"
@@ -44,6 +45,75 @@
 using namespace qkd::q3p::protocol;
 
 
+// ------------------------------------------------------------
+// defs
+
+
+#define MAX_KEYS_PER_STORE  64          /**< maximum number of pipeline keys moved with a single STORE */
+#define MAX_STORE_WAIT_SEC  60          /**< seconds a pipeline key the slave lacks is retried */
+#define PENDING_TIMEOUT_SEC 15          /**< seconds the slave waits for a STORE-COMMIT or STORE-ABORT */
+#define TIMEOUT_SEC         5           /**< timeout in seconds for a store response */
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * remember messages and keys stored
+ */
+class qkd::q3p::protocol::store::store_message_instance {
+  
+    
+public:
+    
+    
+    /**
+     * the message sent 
+     */
+    qkd::q3p::message cMessage;
+    
+    std::map<qkd::key::key_id, qkd::key::key> cPipelineKeys;                /**< the pipeline keys sent */
+    std::map<qkd::key::key_id, qkd::key::key_vector> cCommonStoreKeys;      /**< common store keys assigned to each pipeline key */
+    std::chrono::steady_clock::time_point cStored;                          /**< when the slave stored the keys */
+};
+
+
+/**
+ * the store pimpl
+ */
+class qkd::q3p::protocol::store::store_data {
+    
+    
+public:
+    
+    
+    /**
+     * ctor
+     */
+    store_data() { };
+    
+    
+    /**
+     * messages we sent and didn't get an answer yet 
+     */
+    std::map<uint32_t, store::store_message> cSent;     
+    
+    
+    /**
+     * when a pipeline key has been refused by the peer the first time (master)
+     */
+    std::map<qkd::key::key_id, std::chrono::steady_clock::time_point> cRefused;
+    
+    
+    /**
+     * keys stored on behalf of a STORE message waiting for COMMIT or ABORT (slave)
+     */
+    std::map<uint32_t, store::store_message> cPending;
+   
+};
+
+
 // ------------------------------------------------------------
 // code
 
@@ -56,6 +126,81 @@ using namespace qkd::q3p::protocol;
  * @throws  protocol_no_engine
  */
 store::store(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine) : protocol(cSocket, cEngine) {
+    // pimpl
+    d = std::shared_ptr<qkd::q3p::protocol::store::store_data>(new qkd::q3p::protocol::store::store_data());
+}
+
+
+/**
+ * finish a STORE round
+ * 
+ * pipeline keys stored by the peer turn into real sync, the
+ * others are removed from the common store and put back into
+ * the pickup store for the next round.
+ * 
+ * The peer is told with STORE-COMMIT or STORE-ABORT, so it 
+ * does the very same. If this message cannot be sent all keys
+ * are rolled back: the peer does so too once its reservation 
+ * times out.
+ * 
+ * @param   cStoreMessage       the STORE message sent
+ * @param   cStored             the pipeline keys the peer has stored
+ * @param   bCommit             send STORE-COMMIT (else STORE-ABORT)
+ */
+void store::finish(store_message const & cStoreMessage, qkd::key::key_vector const & cStored, bool bCommit) {
+    
+    key_db & cCommonStore = engine()->common_store();
+    std::set<qkd::key::key_id> cStoredSet(cStored.begin(), cStored.end());
+    
+    // tell the peer first: it holds the keys reserved until then
+    qkd::q3p::message cFinishMessage(true, false);
+    cFinishMessage << std::string(bCommit ? "STORE-COMMIT" : "STORE-ABORT");
+    cFinishMessage << cStoreMessage->cMessage.id();
+    protocol_error eError = send(cFinishMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        
+        // the peer rolls back on its own after PENDING_TIMEOUT_SEC: so do we right now
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "failed to send " << (bCommit ? "STORE-COMMIT" : "STORE-ABORT") << " for STORE message #" << cStoreMessage->cMessage.id() << " - rolling back";
+        cStoredSet.clear();
+    }
+    
+    uint64_t nDeleted = 0;
+    auto cNow = std::chrono::steady_clock::now();
+    
+    std::lock_guard<std::recursive_mutex> cLock(cCommonStore->mutex());
+    for (auto const & cAssigned : cStoreMessage->cCommonStoreKeys) {
+        
+        qkd::key::key_id nKeyId = cAssigned.first;
+        
+        if (cStoredSet.find(nKeyId) != cStoredSet.end()) {
+            
+            // present on both sides now
+            for (auto nCommonStoreKeyId : cAssigned.second) cCommonStore->set_real_sync(nCommonStoreKeyId);
+            cCommonStore->set_key_count(cAssigned.second, 0);
+            d->cRefused.erase(nKeyId);
+            continue;
+        }
+        
+        // roll back and retry later: the peer may not have seen this key yet
+        cCommonStore->del(cAssigned.second);
+        nDeleted += cAssigned.second.size();
+        
+        auto iter = d->cRefused.insert(std::make_pair(nKeyId, cNow)).first;
+        if (std::chrono::duration_cast<std::chrono::seconds>(cNow - (*iter).second).count() > MAX_STORE_WAIT_SEC) {
+            qkd::utility::syslog::info() << "dropped pipeline key #" << nKeyId << " - peer did not STORE it for " << MAX_STORE_WAIT_SEC << " seconds";
+            d->cRefused.erase(iter);
+            continue;
+        }
+        engine()->pickup_put(cStoreMessage->cPipelineKeys[nKeyId]);
+    }
+    
+    // forget about keys which left the pickup store otherwise
+    for (auto iter = d->cRefused.begin(); iter != d->cRefused.end(); ) {
+        if (std::chrono::duration_cast<std::chrono::seconds>(cNow - (*iter).second).count() > 2 * MAX_STORE_WAIT_SEC) iter = d->cRefused.erase(iter);
+        else ++iter;
+    }
+    
+    if (nDeleted) cCommonStore->emit_charge_change(0, nDeleted);
 }
 
 
@@ -63,10 +208,293 @@ store::store(QAbstractSocket * cSocket, qkd::q3p::engine_instance * cEngine) : p
  * process a message received
  * 
  * @param   cMessage        the message read
+ * @return  an protocol error variable
+ */
+protocol_error store::recv_internal(qkd::q3p::message & cMessage) {
+    
+    // sanity check
+    if (!engine()) {
+        qkd::utility::syslog::crit() << __FILENAME__ << '@' << __LINE__ << ": " << "STORE protocol without an engine! This is a bug.";
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ENGINE); 
+        return protocol_error::PROTOCOL_ERROR_ENGINE;
+    }
+
+    // set the read position
+    cMessage.seek_payload();
+
+    // extract the very first string
+    std::string sText;
+    try {
+        cMessage >> sText;
+    }
+    catch (...) { 
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
+        return protocol_error::PROTOCOL_ERROR_SOCKET; 
+    }
+    
+    protocol_error eError = protocol_error::PROTOCOL_ERROR_NOT_IMPLEMENTED;
+    
+    // received a STORE command
+    if (sText == "STORE") eError = recv_STORE(cMessage);
+    
+    // received a STORE ACKNOWLEDGEMENT command
+    if (sText == "STORE-ACK") eError = recv_STORE_ACK(cMessage);
+    
+    // the master decided on a STORE
+    if (sText == "STORE-COMMIT") eError = recv_STORE_FINISH(cMessage, true);
+    if (sText == "STORE-ABORT") eError = recv_STORE_FINISH(cMessage, false);
+    
+    return eError;
+}
+
+
+/**
+ * process a message "STORE" received
+ * 
+ * @param   cMessage        the message read
+ * @return  an protocol error variable
+ */
+protocol_error store::recv_STORE(qkd::q3p::message & cMessage) {
+
+    // a "STORE" may be only received by the slave
+    if (!engine()->slave()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    // the key mappings
+    std::list<std::pair<qkd::key::key_id, qkd::key::key_vector>> cAssignments;
+    
+    try {
+        
+        uint32_t nKeys = 0;
+        cMessage >> nKeys;
+        for (uint32_t i = 0; i < nKeys; ++i) {
+            
+            qkd::key::key_id nKeyId = 0;
+            qkd::key::key_vector cCommonStoreKeys;
+            cMessage >> nKeyId;
+            pop_keys(cMessage, cCommonStoreKeys);
+            cAssignments.push_back(std::pair<qkd::key::key_id, qkd::key::key_vector>(nKeyId, cCommonStoreKeys));
+        }
+    }
+    catch (...) { 
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
+        return protocol_error::PROTOCOL_ERROR_SOCKET; 
+    }
+    
+    key_db & cCommonStore = engine()->common_store();
+    uint64_t nQuantum = cCommonStore->quantum();
+    
+    // place the pipeline keys at the very same ids as the master did:
+    // they stay reserved until the master commits
+    store_message cPending = std::shared_ptr<store_message_instance>(new store_message_instance);
+    cPending->cStored = std::chrono::steady_clock::now();
+    qkd::key::key_vector cStored;
+    uint64_t nInserted = 0;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(cCommonStore->mutex());
+        for (auto const & cAssigned : cAssignments) {
+            
+            // not read from the pipeline yet?
+            qkd::key::key cKey = engine()->pickup_take(cAssigned.first);
+            if (cKey.is_null()) continue;
+            
+            if ((cKey.size() / nQuantum) != cAssigned.second.size()) {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "pipeline key #" << cKey.id() << " does not match the common store keys assigned by the peer - dropped";
+                continue;
+            }
+            
+            bool bFree = true;
+            for (auto nCommonStoreKeyId : cAssigned.second) bFree = bFree && !cCommonStore->valid(nCommonStoreKeyId);
+            if (!bFree) {
+                qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "common store keys assigned to pipeline key #" << cKey.id() << " by the peer are in use";
+                engine()->pickup_put(cKey);
+                continue;
+            }
+            
+            cCommonStore->set_range(cAssigned.second, cKey.data().get());
+            cCommonStore->set_key_count(cAssigned.second, 1);
+            cPending->cPipelineKeys[cKey.id()] = cKey;
+            cPending->cCommonStoreKeys[cKey.id()] = cAssigned.second;
+            
+            cStored.push_back(cAssigned.first);
+            nInserted += cAssigned.second.size();
+        }
+    }
+    if (nInserted) cCommonStore->emit_charge_change(nInserted, 0);
+    d->cPending[cMessage.id()] = cPending;
+    
+    // create answer packet
+    qkd::q3p::message cAckMessage(true, false);
+    cAckMessage << std::string("STORE-ACK");
+    cAckMessage << cMessage.id();
+    push_keys(cAckMessage, cStored);
+    
+    // flush to peer
+    protocol_error eError = send(cAckMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        emit failed((uint8_t)eError);
+        return eError;
+    }
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug() 
+            << "stored pipeline keys: " << cStored.size() << "/" << cAssignments.size() 
+            << " as " << nInserted << " cs-keys; current charges: " << engine()->charge_string();
+    }
+    
+    // DONE!
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * process a message "STORE-ACK" received
+ * 
+ * @param   cMessage        the message read
+ * @return  an protocol error variable
  */
-protocol_error store::recv_internal(UNUSED qkd::q3p::message & cMessage) {
-    std::cout << "STORE message received: implementation missing" << std::endl;
-    return protocol_error::PROTOCOL_ERROR_NOT_IMPLEMENTED;
+protocol_error store::recv_STORE_ACK(qkd::q3p::message & cMessage) {
+    
+    // a "STORE-ACK" may be only received by the master
+    if (!engine()->master()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    // this is an acknowledgement ... for which sent message?
+    uint32_t nMessageId = 0;
+    qkd::key::key_vector cStored;
+    try {
+        cMessage >> nMessageId;
+        pop_keys(cMessage, cStored);
+    }
+    catch (...) { 
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
+        return protocol_error::PROTOCOL_ERROR_SOCKET; 
+    }
+    
+    // look up original message
+    if (d->cSent.find(nMessageId) == d->cSent.end()) {
+        
+        // huh? received an acknowledgement for message we didn't sent?
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "received an acknowledgement for an unsent STORE protocol message.";
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER); 
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    finish(d->cSent[nMessageId], cStored, true);
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug() 
+            << "stored pipeline keys: " << cStored.size() << "/" << d->cSent[nMessageId]->cPipelineKeys.size() 
+            << "; current charges: " << engine()->charge_string();
+    }
+    
+    // remove pending message
+    d->cSent.erase(nMessageId);
+    
+    // DONE!
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * process a message "STORE-COMMIT" or "STORE-ABORT" received
+ * 
+ * @param   cMessage        the message read
+ * @param   bCommit         true for "STORE-COMMIT"
+ * @return  an protocol error variable
+ */
+protocol_error store::recv_STORE_FINISH(qkd::q3p::message & cMessage, bool bCommit) {
+    
+    // a "STORE-COMMIT" or "STORE-ABORT" may be only received by the slave
+    if (!engine()->slave()) {
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER);
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    
+    uint32_t nMessageId = 0;
+    try {
+        cMessage >> nMessageId;
+    }
+    catch (...) { 
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_SOCKET); 
+        return protocol_error::PROTOCOL_ERROR_SOCKET; 
+    }
+    
+    auto iter = d->cPending.find(nMessageId);
+    if ((iter == d->cPending.end()) && !bCommit) {
+        
+        // the STORE never made it to us: nothing to roll back
+        if (qkd::utility::debug::enabled()) qkd::utility::debug() << "ignoring STORE-ABORT for unknown STORE message #" << nMessageId;
+        emit success();
+        return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+    }
+    if (iter == d->cPending.end()) {
+        qkd::utility::syslog::warning() << __FILENAME__ << '@' << __LINE__ << ": " << "received a " << (bCommit ? "STORE-COMMIT" : "STORE-ABORT") << " for an unknown STORE protocol message.";
+        emit failed((uint8_t)protocol_error::PROTOCOL_ERROR_ANSWER); 
+        return protocol_error::PROTOCOL_ERROR_ANSWER;
+    }
+    store_message cPending = (*iter).second;
+    d->cPending.erase(iter);
+    
+    if (bCommit) {
+        
+        key_db & cCommonStore = engine()->common_store();
+        std::lock_guard<std::recursive_mutex> cLock(cCommonStore->mutex());
+        for (auto const & cAssigned : cPending->cCommonStoreKeys) {
+            for (auto nCommonStoreKeyId : cAssigned.second) cCommonStore->set_real_sync(nCommonStoreKeyId);
+            cCommonStore->set_key_count(cAssigned.second, 0);
+        }
+    }
+    else {
+        
+        // the master rolled back: so do we and wait for the next STORE
+        rollback(cPending);
+    }
+    
+    // debug
+    if (qkd::utility::debug::enabled()) {
+        qkd::utility::debug() 
+            << (bCommit ? "committed" : "aborted") << " pipeline keys: " << cPending->cPipelineKeys.size() 
+            << "; current charges: " << engine()->charge_string();
+    }
+    
+    emit success();
+    
+    return protocol_error::PROTOCOL_ERROR_NO_ERROR;
+}
+
+
+/**
+ * roll back the keys stored on behalf of a STORE message (slave)
+ * 
+ * The common store keys are removed and the pipeline keys
+ * are put back into the pickup store for the next STORE.
+ * 
+ * @param   cPending            the STORE message pending
+ */
+void store::rollback(store_message const & cPending) {
+    
+    key_db & cCommonStore = engine()->common_store();
+    uint64_t nDeleted = 0;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(cCommonStore->mutex());
+        for (auto const & cAssigned : cPending->cCommonStoreKeys) {
+            cCommonStore->del(cAssigned.second);
+            nDeleted += cAssigned.second.size();
+            engine()->pickup_put(cPending->cPipelineKeys[cAssigned.first]);
+        }
+    }
+    if (nDeleted) cCommonStore->emit_charge_change(0, nDeleted);
 }
 
 
@@ -83,6 +511,77 @@ void store::run_internal() {
     
     // this is a master only protocol
     if (!engine()->master()) return;
+    
+    // if we have still messages ongoing: do not proceed - wait for responses
+    if (d->cSent.size()) return;
+    
+    qkd::key::key_vector cPickupKeys = engine()->pickup_keys();
+    if (cPickupKeys.empty()) return;
+    if (cPickupKeys.size() > MAX_KEYS_PER_STORE) cPickupKeys.resize(MAX_KEYS_PER_STORE);
+    
+    key_db & cCommonStore = engine()->common_store();
+    uint64_t nQuantum = cCommonStore->quantum();
+    
+    // setup the message to send
+    store_message cStoreMessage = std::shared_ptr<store_message_instance>(new store_message_instance);
+    
+    // cut the pipeline keys into quanta and insert them in one go: 
+    // they stay reserved until the peer acknowledged them
+    uint64_t nInserted = 0;
+    {
+        std::lock_guard<std::recursive_mutex> cLock(cCommonStore->mutex());
+        for (auto nKeyId : cPickupKeys) {
+            
+            qkd::key::key cKey = engine()->pickup_take(nKeyId);
+            if (cKey.is_null()) continue;
+            
+            uint64_t nQuanta = cKey.size() / nQuantum;
+            if (nQuanta == 0) {
+                if (qkd::utility::debug::enabled()) {
+                    qkd::utility::debug() << "dropping pipeline key #" << nKeyId << " of " << cKey.size() << " bytes - less than a key quantum (" << nQuantum << " bytes)";
+                }
+                continue;
+            }
+            
+            qkd::key::key_vector cCommonStoreKeys = cCommonStore->insert_range(cKey.data().get(), nQuanta);
+            
+            // common store full: try again next round
+            if (cCommonStoreKeys.size() < nQuanta) {
+                cCommonStore->del(cCommonStoreKeys);
+                engine()->pickup_put(cKey);
+                break;
+            }
+            
+            cCommonStore->set_key_count(cCommonStoreKeys, 1);
+            cStoreMessage->cPipelineKeys[nKeyId] = cKey;
+            cStoreMessage->cCommonStoreKeys[nKeyId] = cCommonStoreKeys;
+            nInserted += nQuanta;
+        }
+    }
+    
+    // still something to send?
+    if (cStoreMessage->cPipelineKeys.empty()) return;
+    cCommonStore->emit_charge_change(nInserted, 0);
+    
+    // prepare STORE message
+    cStoreMessage->cMessage = qkd::q3p::message(true, false);
+    cStoreMessage->cMessage << std::string("STORE");
+    cStoreMessage->cMessage << (uint32_t)cStoreMessage->cCommonStoreKeys.size();
+    for (auto const & cAssigned : cStoreMessage->cCommonStoreKeys) {
+        cStoreMessage->cMessage << cAssigned.first;
+        push_keys(cStoreMessage->cMessage, cAssigned.second);
+    }
+    
+    // flush to peer
+    protocol_error eError = send(cStoreMessage->cMessage);
+    if (eError != protocol_error::PROTOCOL_ERROR_NO_ERROR) {
+        finish(cStoreMessage, qkd::key::key_vector(), false);
+        emit failed((uint8_t)eError);
+        return;
+    }
+    
+    // register message
+    d->cSent.insert(std::pair<uint32_t, store_message>(cStoreMessage->cMessage.id(), cStoreMessage));
 }
 
 
@@ -90,6 +589,39 @@ void store::run_internal() {
  * timer event: check for timeout
  */
 void store::timeout_internal() {
-    // no timeout
+    
+    // slave: roll back keys the master never decided on
+    auto cNow = std::chrono::steady_clock::now();
+    for (auto iter = d->cPending.begin(); iter != d->cPending.end(); ) {
+        
+        if (std::chrono::duration_cast<std::chrono::seconds>(cNow - (*iter).second->cStored).count() <= PENDING_TIMEOUT_SEC) {
+            ++iter;
+            continue;
+        }
+        
+        qkd::utility::syslog::info() << "rolled back pending STORE message #" << (*iter).first << " - peer did neither commit nor abort";
+        rollback((*iter).second);
+        iter = d->cPending.erase(iter);
+    }
+    
+    // check all messages sent
+    std::list<uint32_t> cMessagesTooOld;
+    
+    // check if a sent message is too old
+    for (auto iter = d->cSent.begin();  iter != d->cSent.end(); iter++) {
+        if (std::chrono::duration_cast<std::chrono::seconds>((*iter).second->cMessage.age()).count() > TIMEOUT_SEC) cMessagesTooOld.push_back((*iter).first);
+    }
+    
+    // any to remove?
+    if (cMessagesTooOld.empty()) return;
+    
+    // the peer missed some messages: roll back the keys of these on both sides
+    for (auto & nMessageId : cMessagesTooOld) {
+        
+        finish(d->cSent[nMessageId], qkd::key::key_vector(), false);
+        d->cSent.erase(nMessageId);
+        
+        // tell the environment
+        qkd::utility::syslog::info() << "dropped pending STORE message #" << nMessageId << " - peer didn't react";
+    }
 }
-
@@ -35,6 +35,8 @@
 // ------------------------------------------------------------
 // incs
 
+#include <memory>
+
 // Qt
 #include <QtCore/QObject>
 #include <QtNetwork/QAbstractSocket>
@@ -56,6 +58,72 @@ namespace protocol {
     
 /**
  * This is the Q3P KeyStore to KeyStore STORE Protocol.
+ * 
+ * The STORE protocol moves keys read from the QKD pipeline (which wait
+ * in the pickup stores on both sides) into the common store.
+ * 
+ * It is:
+ * 
+ *  Master                                               Slave
+ *    |                                                    |
+ *    | MsgId-M-1, "STORE", N,                             | 
+ *    |    N * (Pipe-Key, CS-Key+)                         |
+ *    |    AUTH                                            |
+ *    |----------------------------------------------->    |
+ *    |                                                    |
+ *    |                 MsgId-S-1, "STORE-ACK", MsgId-M-1, |
+ *    |                                         Pipe-Key*, |
+ *    |                                               AUTH |
+ *    |     <----------------------------------------------|
+ *    |                                                    |
+ *    | MsgId-M-2, "STORE-COMMIT", MsgId-M-1, AUTH         | 
+ *    |   or                                               | 
+ *    | MsgId-M-2, "STORE-ABORT", MsgId-M-1, AUTH          | 
+ *    |----------------------------------------------->    |
+ *    |                                                    |
+ *
+ * Particles:
+ * 
+ *    MsgId-M-1     Message ID 1 of the Master
+ *    MsgId-S-1     Message ID 1 of the Slave
+ * 
+ *    "STORE"       a string stating "STORE"
+ *    "STORE-ACK"   a string stating "STORE"-Acknowledgment
+ *    "STORE-COMMIT" a string stating the master committed the STORE
+ *    "STORE-ABORT" a string stating the master rolled back the STORE
+ *    N             number of pipeline keys in the message
+ * 
+ *    Pipe-Key      a key id of a key read from the QKD pipeline
+ *    CS-Key        a key id in the common store
+ *    AUTH          authentication tag
+ * 
+ * Steps (short and brief):
+ * 
+ *  A.  The master picks a batch of keys from its pickup store, cuts each 
+ *      into quantum() sized pieces and inserts them into the common store
+ *      (reserved and in eventual sync). The assigned common store ids are
+ *      sent along with the pipeline key ids in a single "STORE".
+ * 
+ *  B.  The slave places each pipeline key it has in its pickup store at
+ *      the very same common store ids (reserved) and responds with the 
+ *      list of pipeline keys stored.
+ * 
+ *  C.  On reception the master turns the acknowledged keys into real sync
+ *      and sends "STORE-COMMIT". The others are removed from the common 
+ *      store and put back into the pickup store for the next round. A 
+ *      pipeline key the slave lacks for more than a minute is dropped.
+ * 
+ *  D.  On "STORE-COMMIT" the slave turns its keys of the STORE into real
+ *      sync too.
+ * 
+ *  If the "STORE-ACK" does not arrive in time the master rolls back all
+ *  keys of the STORE and sends "STORE-ABORT". The slave then removes the 
+ *  keys it has placed and puts them back into its pickup store. Both 
+ *  common stores stay the same this way.
+ * 
+ *  If the master cannot send "STORE-COMMIT" it rolls back all keys of
+ *  the STORE as well. The slave rolls back a STORE on its own if neither
+ *  "STORE-COMMIT" nor "STORE-ABORT" arrives within 15 seconds.
  */
 class store : public protocol {
     
@@ -79,6 +147,35 @@ public:
 private:
     
     
+    // fwd
+    class store_message_instance;
+    
+    
+    /**
+     * a smart pointer for store messages
+     */
+    typedef std::shared_ptr<store_message_instance> store_message;
+    
+    
+    /**
+     * finish a STORE round
+     * 
+     * pipeline keys stored by the peer turn into real sync, the
+     * others are removed from the common store and put back into
+     * the pickup store for the next round.
+     * 
+     * The peer is told with STORE-COMMIT or STORE-ABORT, so it 
+     * does the very same. If this message cannot be sent all keys
+     * are rolled back: the peer does so too once its reservation 
+     * times out.
+     * 
+     * @param   cStoreMessage       the STORE message sent
+     * @param   cStored             the pipeline keys the peer has stored
+     * @param   bCommit             send STORE-COMMIT (else STORE-ABORT)
+     */
+    void finish(store_message const & cStoreMessage, qkd::key::key_vector const & cStored, bool bCommit);
+    
+    
     /**
      * process a message received
      * 
@@ -88,6 +185,42 @@ private:
     protocol_error recv_internal(qkd::q3p::message & cMessage);
     
     
+    /**
+     * process a message "STORE" received
+     * 
+     * @param   cMessage        the message read
+     * @return  an protocol error variable
+     */
+    protocol_error recv_STORE(qkd::q3p::message & cMessage);
+    
+    
+    /**
+     * process a message "STORE-ACK" received
+     * 
+     * @param   cMessage        the message read
+     * @return  an protocol error variable
+     */
+    protocol_error recv_STORE_ACK(qkd::q3p::message & cMessage);
+    
+    
+    /**
+     * process a message "STORE-COMMIT" or "STORE-ABORT" received
+     * 
+     * @param   cMessage        the message read
+     * @param   bCommit         true for "STORE-COMMIT"
+     * @return  an protocol error variable
+     */
+    protocol_error recv_STORE_FINISH(qkd::q3p::message & cMessage, bool bCommit);
+    
+    
+    /**
+     * roll back the keys stored on behalf of a STORE message (slave)
+     * 
+     * @param   cPending            the STORE message pending
+     */
+    void rollback(store_message const & cPending);
+    
+    
     /**
      * protocol starts
      */
@@ -108,6 +241,9 @@ private:
     protocol_type protocol_id_internal() const { return protocol_type::PROTOCOL_STORE; };
 
     
+    // pimpl
+    class store_data;
+    std::shared_ptr<store_data> d;
 };
   
 
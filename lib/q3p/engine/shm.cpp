@@ -0,0 +1,444 @@
+/*
+ * shm.cpp
+ *
+ * implement the Q3P shared memory key ring
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <new>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/futex.h>
+
+// ait
+#include <qkd/q3p/shm.h>
+
+
+using namespace qkd::q3p;
+
+
+// ------------------------------------------------------------
+// defs
+
+
+/**
+ * magic number of an initialized ring: "Q3P-SHM1"
+ */
+#define SHM_MAGIC       0x314d48532d503351ull
+
+
+/**
+ * size of the header in front of the key material
+ */
+#define SHM_HEADER_SIZE 4096ul
+
+
+// ------------------------------------------------------------
+// decl
+
+
+/**
+ * the ring header as it lies in shared memory
+ *
+ * read and write positions are byte counters since creation
+ * and live on separate cache lines.
+ */
+struct shm_header {
+
+    std::atomic<uint64_t> nMagic;                       /**< SHM_MAGIC once initialized */
+    uint64_t nCapacity;                                 /**< size of the ring: a power of 2 */
+
+    alignas(64) std::atomic<uint64_t> nWrite;           /**< bytes written so far */
+    alignas(64) std::atomic<uint64_t> nRead;            /**< bytes read so far */
+
+    alignas(64) std::atomic<uint32_t> nFutex;           /**< futex readers sleep on */
+    std::atomic<uint32_t> nWaiters;                     /**< number of sleeping readers */
+};
+
+
+static_assert(sizeof(shm_header) <= SHM_HEADER_SIZE, "shared memory ring header too big");
+
+
+/**
+ * the shm_ring pimpl
+ */
+class qkd::q3p::shm_ring::shm_ring_data {
+
+
+public:
+
+
+    /**
+     * ctor
+     */
+    shm_ring_data() : nFD(-1), nMapSize(0), cMap(nullptr), cHeader(nullptr), cData(nullptr) { };
+
+
+    /**
+     * the shared memory file descriptor
+     */
+    int nFD;
+
+
+    /**
+     * size of the mapping
+     */
+    uint64_t nMapSize;
+
+
+    /**
+     * the mapping
+     */
+    void * cMap;
+
+
+    /**
+     * the header within the mapping
+     */
+    shm_header * cHeader;
+
+
+    /**
+     * the key material within the mapping
+     */
+    unsigned char * cData;
+};
+
+
+// ------------------------------------------------------------
+// fwd
+
+
+static int futex_wait(std::atomic<uint32_t> * cFutex, uint32_t nValue, int64_t nTimeoutMS);
+static void futex_wake(std::atomic<uint32_t> * cFutex);
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * ctor
+ *
+ * @param   sName       name of the shared memory object
+ * @param   bWriter     true for the writer side
+ */
+shm_ring::shm_ring(std::string const & sName, bool bWriter) : m_sName(sName), m_bWriter(bWriter) {
+    d = std::shared_ptr<qkd::q3p::shm_ring::shm_ring_data>(new qkd::q3p::shm_ring::shm_ring_data());
+}
+
+
+/**
+ * dtor
+ *
+ * The writer removes the shared memory object.
+ */
+shm_ring::~shm_ring() {
+
+    if (d->cMap) munmap(d->cMap, d->nMapSize);
+    if (d->nFD != -1) ::close(d->nFD);
+    if (m_bWriter) shm_unlink(m_sName.c_str());
+}
+
+
+/**
+ * number of bytes ready to read
+ *
+ * @return  number of bytes of key material in the ring
+ */
+uint64_t shm_ring::available() const {
+    uint64_t nRead = d->cHeader->nRead.load(std::memory_order_acquire);
+    return d->cHeader->nWrite.load(std::memory_order_acquire) - nRead;
+}
+
+
+/**
+ * the size of the ring
+ *
+ * @return  number of bytes the ring may hold
+ */
+uint64_t shm_ring::capacity() const {
+    return d->cHeader->nCapacity;
+}
+
+
+/**
+ * finish a write started with write_begin()
+ *
+ * @param   nSize       number of bytes placed into the ring
+ */
+void shm_ring::commit(uint64_t nSize) {
+
+    if (nSize == 0) return;
+
+    d->cHeader->nWrite.fetch_add(nSize);
+
+    // only bother the kernel if someone sleeps
+    if (d->cHeader->nWaiters.load()) {
+        d->cHeader->nFutex.fetch_add(1);
+        futex_wake(&d->cHeader->nFutex);
+    }
+}
+
+
+/**
+ * create a shared memory ring (writer side)
+ *
+ * An existing ring with the same name is replaced.
+ *
+ * @param   sName       name of the shared memory object (e.g. "/link_id")
+ * @param   nCapacity   minimum number of bytes the ring should hold
+ * @return  the new ring
+ * @throws  std::runtime_error
+ */
+shm shm_ring::create(std::string const & sName, uint64_t nCapacity) {
+
+    // positions are masked: round up to a power of 2
+    uint64_t nRingSize = SHM_HEADER_SIZE;
+    while (nRingSize < nCapacity) nRingSize <<= 1;
+
+    shm cRing = shm(new shm_ring(sName, true));
+
+    shm_unlink(sName.c_str());
+    cRing->d->nFD = shm_open(sName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (cRing->d->nFD == -1) {
+        throw std::runtime_error(std::string("failed to create shared memory: ") + strerror(errno));
+    }
+
+    cRing->d->nMapSize = SHM_HEADER_SIZE + nRingSize;
+    if (ftruncate(cRing->d->nFD, cRing->d->nMapSize) == -1) {
+        throw std::runtime_error(std::string("failed to resize shared memory: ") + strerror(errno));
+    }
+
+    cRing->d->cMap = mmap(nullptr, cRing->d->nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, cRing->d->nFD, 0);
+    if (cRing->d->cMap == MAP_FAILED) {
+        cRing->d->cMap = nullptr;
+        throw std::runtime_error(std::string("failed to map shared memory: ") + strerror(errno));
+    }
+
+    cRing->d->cHeader = new (cRing->d->cMap) shm_header();
+    cRing->d->cData = (unsigned char *)cRing->d->cMap + SHM_HEADER_SIZE;
+
+    cRing->d->cHeader->nCapacity = nRingSize;
+    cRing->d->cHeader->nWrite = 0;
+    cRing->d->cHeader->nRead = 0;
+    cRing->d->cHeader->nFutex = 0;
+    cRing->d->cHeader->nWaiters = 0;
+    cRing->d->cHeader->nMagic.store(SHM_MAGIC, std::memory_order_release);
+
+    return cRing;
+}
+
+
+/**
+ * number of bytes which can be written
+ *
+ * @return  number of bytes free in the ring
+ */
+uint64_t shm_ring::free() const {
+    return capacity() - available();
+}
+
+
+/**
+ * wait on a futex in shared memory
+ *
+ * @param   cFutex          the futex
+ * @param   nValue          the value expected
+ * @param   nTimeoutMS      timeout in milliseconds (< 0 for no timeout)
+ * @return  result of the futex syscall
+ */
+int futex_wait(std::atomic<uint32_t> * cFutex, uint32_t nValue, int64_t nTimeoutMS) {
+
+    struct timespec cTimeout;
+    struct timespec * cTimeoutPtr = nullptr;
+    if (nTimeoutMS >= 0) {
+        cTimeout.tv_sec = nTimeoutMS / 1000;
+        cTimeout.tv_nsec = (nTimeoutMS % 1000) * 1000000;
+        cTimeoutPtr = &cTimeout;
+    }
+
+    return syscall(SYS_futex, (uint32_t *)cFutex, FUTEX_WAIT, nValue, cTimeoutPtr, nullptr, 0);
+}
+
+
+/**
+ * wake all waiting on a futex in shared memory
+ *
+ * @param   cFutex          the futex
+ */
+void futex_wake(std::atomic<uint32_t> * cFutex) {
+    syscall(SYS_futex, (uint32_t *)cFutex, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+/**
+ * open an existing shared memory ring (reader side)
+ *
+ * @param   sName       name of the shared memory object (e.g. "/link_id")
+ * @return  the ring
+ * @throws  std::runtime_error
+ */
+shm shm_ring::open(std::string const & sName) {
+
+    shm cRing = shm(new shm_ring(sName, false));
+
+    cRing->d->nFD = shm_open(sName.c_str(), O_RDWR, 0);
+    if (cRing->d->nFD == -1) {
+        throw std::runtime_error(std::string("failed to open shared memory: ") + strerror(errno));
+    }
+
+    struct stat cStat;
+    if (fstat(cRing->d->nFD, &cStat) == -1) {
+        throw std::runtime_error(std::string("failed to stat shared memory: ") + strerror(errno));
+    }
+    if ((uint64_t)cStat.st_size <= SHM_HEADER_SIZE) {
+        throw std::runtime_error("shared memory is not a Q3P key ring");
+    }
+
+    cRing->d->nMapSize = cStat.st_size;
+    cRing->d->cMap = mmap(nullptr, cRing->d->nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, cRing->d->nFD, 0);
+    if (cRing->d->cMap == MAP_FAILED) {
+        cRing->d->cMap = nullptr;
+        throw std::runtime_error(std::string("failed to map shared memory: ") + strerror(errno));
+    }
+
+    cRing->d->cHeader = (shm_header *)cRing->d->cMap;
+    cRing->d->cData = (unsigned char *)cRing->d->cMap + SHM_HEADER_SIZE;
+
+    if (cRing->d->cHeader->nMagic.load(std::memory_order_acquire) != SHM_MAGIC) {
+        throw std::runtime_error("shared memory is not a Q3P key ring");
+    }
+    if (cRing->d->cHeader->nCapacity + SHM_HEADER_SIZE != cRing->d->nMapSize) {
+        throw std::runtime_error("shared memory key ring has wrong size");
+    }
+
+    return cRing;
+}
+
+
+/**
+ * drop all key material in the ring
+ */
+void shm_ring::purge() {
+
+    uint64_t nRead = d->cHeader->nRead.load(std::memory_order_acquire);
+    while (!d->cHeader->nRead.compare_exchange_weak(nRead, d->cHeader->nWrite.load(std::memory_order_acquire))) {}
+}
+
+
+/**
+ * read key material from the ring
+ *
+ * This does not block.
+ *
+ * @param   cBuffer     the buffer to fill
+ * @param   nSize       maximum number of bytes to read
+ * @return  number of bytes read
+ */
+uint64_t shm_ring::read(unsigned char * cBuffer, uint64_t nSize) {
+
+    uint64_t nMask = capacity() - 1;
+    uint64_t nRead = d->cHeader->nRead.load(std::memory_order_acquire);
+
+    while (true) {
+
+        uint64_t nBytes = std::min<uint64_t>(nSize, d->cHeader->nWrite.load(std::memory_order_acquire) - nRead);
+        if (nBytes == 0) return 0;
+
+        // copy in at most two parts: up to the end of the ring and from its start
+        uint64_t nOffset = nRead & nMask;
+        uint64_t nFirst = std::min<uint64_t>(nBytes, capacity() - nOffset);
+        memcpy(cBuffer, d->cData + nOffset, nFirst);
+        memcpy(cBuffer + nFirst, d->cData, nBytes - nFirst);
+
+        // claim the bytes: another reader or a purge may have been faster
+        if (d->cHeader->nRead.compare_exchange_weak(nRead, nRead + nBytes, std::memory_order_acq_rel)) return nBytes;
+    }
+}
+
+
+/**
+ * wait until there is enough key material in the ring
+ *
+ * @param   nSize           number of bytes needed
+ * @param   nTimeoutMS      timeout in milliseconds (< 0 for no timeout)
+ * @return  true, if at least nSize bytes are available
+ */
+bool shm_ring::wait(uint64_t nSize, int64_t nTimeoutMS) {
+
+    auto cDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max<int64_t>(nTimeoutMS, 0));
+
+    while (available() < nSize) {
+
+        int64_t nLeftMS = -1;
+        if (nTimeoutMS >= 0) {
+            nLeftMS = std::chrono::duration_cast<std::chrono::milliseconds>(cDeadline - std::chrono::steady_clock::now()).count();
+            if (nLeftMS <= 0) return false;
+        }
+
+        // announce us before the final check: commit() wakes us then
+        uint32_t nFutex = d->cHeader->nFutex.load();
+        d->cHeader->nWaiters.fetch_add(1);
+        if (available() < nSize) futex_wait(&d->cHeader->nFutex, nFutex, nLeftMS);
+        d->cHeader->nWaiters.fetch_sub(1);
+    }
+
+    return true;
+}
+
+
+/**
+ * start writing into the ring
+ *
+ * This returns the largest free contiguous area of the ring.
+ * The caller places the key material there and calls commit().
+ *
+ * @param   nSize       on return: number of bytes free at the pointer
+ * @return  the start of the free area
+ */
+unsigned char * shm_ring::write_begin(uint64_t & nSize) {
+
+    uint64_t nWrite = d->cHeader->nWrite.load(std::memory_order_relaxed);
+    uint64_t nOffset = nWrite & (capacity() - 1);
+
+    nSize = std::min<uint64_t>(free(), capacity() - nOffset);
+    return d->cData + nOffset;
+}
@@ -33,6 +33,7 @@
 
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 
 #include <boost/format.hpp>
 
@@ -62,6 +63,28 @@ void wrapped_memory_deleter(UNUSED qkd::utility::memory::value_t * p);
 // code
 
 
+/**
+ * creates a memory object by adopting a memory area
+ * 
+ * @param   cData       memory to be adopted
+ * @param   nSize       size of memory
+ * @param   cRelease    called with cData on release
+ * @return  a memory object
+ */
+memory memory::adopt(value_t * cData, uint64_t nSize, std::function<void(value_t *)> cRelease) {
+    
+    if (!cData) return memory(0);
+    
+    qkd::utility::memory cMemory;
+    cMemory.m_cMemory = boost::shared_array<value_t>(cData, cRelease);
+    cMemory.m_bShallow = true;
+    cMemory.m_nSize = nSize;
+    cMemory.m_nInitialSize = nSize;
+    
+    return cMemory;
+}
+
+
 /**
  * give a hex representation of the memory
  *
@@ -307,6 +330,30 @@ void memory::reserve(uint64_t nSize) {
 }
 
 
+/**
+ * get a part of the memory without copying
+ * 
+ * @param   nOffset     offset of the part
+ * @param   nSize       size of the part
+ * @return  a memory object referring to the part
+ * @throws  std::out_of_range
+ */
+memory memory::slice(uint64_t nOffset, uint64_t nSize) const {
+    
+    if ((nOffset > size()) || (nSize > size() - nOffset)) throw std::out_of_range("memory slice out-of-range");
+    if (nSize == 0) return memory(0);
+    
+    // aliasing: share ownership with the whole memory area
+    qkd::utility::memory cMemory;
+    cMemory.m_cMemory = boost::shared_array<value_t>(m_cMemory, m_cMemory.get() + nOffset);
+    cMemory.m_bShallow = true;
+    cMemory.m_nSize = nSize;
+    cMemory.m_nInitialSize = nSize;
+    
+    return cMemory;
+}
+
+
 /**
  * creates a memory object by wrapping a memory area
  * this DOES NOT take ownership of the memory.
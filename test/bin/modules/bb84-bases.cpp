@@ -0,0 +1,267 @@
+/*
+ * bb84-bases.cpp
+ *
+ * This is a test file.
+ *
+ * TEST: test the base tables and sifting of qkd-sifting-bb84
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * The AIT QKD Software Suite is distributed in the hope that it will
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if defined(__GNUC__) || defined(__GNUCPP__)
+#   define UNUSED   __attribute__((unused))
+#else
+#   define UNUSED
+#endif
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <vector>
+
+// include the all-in-one header
+#include <qkd/qkd.h>
+
+#include "../../../bin/modules/qkd-sifting-bb84/bases.h"
+
+
+// ------------------------------------------------------------
+// code
+
+
+/**
+ * create a base table with valid and invalid bases
+ *
+ * @param   nSize       size of the base table in bytes
+ * @param   nValid      percentage of valid bases
+ * @return  a base table
+ */
+qkd::utility::memory random_bases(uint64_t nSize, int nValid) {
+
+    qkd::utility::memory cBases(nSize);
+    for (uint64_t i = 0; i < nSize; i++) {
+        unsigned char nByte = 0;
+        for (int j = 0; j < 4; j++) {
+            unsigned char nBase = static_cast<unsigned char>(bb84_base::BB84_BASE_INVALID);
+            if ((rand() % 100) < nValid) nBase = 1 + (rand() % 2);
+            nByte = (nByte << 2) | nBase;
+        }
+        cBases[i] = nByte;
+    }
+
+    return cBases;
+}
+
+
+/**
+ * create a quantum table with single clicks or no clicks only
+ *
+ * @param   nSize       size of the quantum table in bytes
+ * @return  a quantum table
+ */
+qkd::utility::memory random_quantum_table(uint64_t nSize) {
+
+    static unsigned char const nEvents[] = { 0x0, 0x1, 0x2, 0x4, 0x8 };
+
+    qkd::utility::memory cQuantumTable(nSize);
+    for (uint64_t i = 0; i < nSize; i++) {
+        cQuantumTable[i] = (nEvents[rand() % 5] << 4) | nEvents[rand() % 5];
+    }
+
+    return cQuantumTable;
+}
+
+
+/**
+ * sift the key bits event by event
+ *
+ * Only works on quantum tables with single clicks.
+ *
+ * @param   cBits           the key bits
+ * @param   bAlice          act as alice
+ * @param   cBases          the bases
+ * @param   cQuantumTable   the quantum event table
+ */
+void reference_bits(std::vector<bool> & cBits, bool bAlice, qkd::utility::memory const & cBases, qkd::utility::memory const & cQuantumTable) {
+
+    for (uint64_t i = 0; i < cQuantumTable.size() * 2; i++) {
+
+        unsigned char nBase = (cBases[i / 4] >> (6 - (i % 4) * 2)) & 0x03;
+        if (nBase == static_cast<unsigned char>(bb84_base::BB84_BASE_INVALID)) continue;
+
+        unsigned char nEvent = cQuantumTable[i / 2];
+        if (i % 2) nEvent &= 0x0F;
+        else nEvent >>= 4;
+
+        bool bBit = ((nEvent & 0x05) != 0);
+        cBits.push_back(bAlice ? bBit : !bBit);
+    }
+}
+
+
+/**
+ * check bases_to_bits() against the reference
+ *
+ * @param   nSize           size of the quantum table in bytes
+ * @param   nPosition       bits already sifted
+ */
+void test_bases_to_bits(uint64_t nSize, uint64_t nPosition) {
+
+    for (int nRole = 0; nRole < 2; nRole++) {
+
+        bool bAlice = (nRole == 0);
+
+        qkd::utility::memory cQuantumTable = random_quantum_table(nSize);
+        qkd::utility::memory cBases = quantum_table_to_base_table(cQuantumTable);
+        mask_different_bases(cBases, random_bases(cBases.size(), 75));
+
+        // some key bits already there
+        std::vector<bool> cExpected;
+        std::vector<unsigned char> cBits((nPosition + 7) / 8);
+        for (uint64_t i = 0; i < nPosition; i++) {
+            bool bBit = (rand() % 2);
+            cExpected.push_back(bBit);
+            if (bBit) cBits[i / 8] |= (1 << (i % 8));
+        }
+        reference_bits(cExpected, bAlice, cBases, cQuantumTable);
+
+        uint64_t nNewPosition = nPosition;
+        double nBaseRatio = -1.0;
+        bases_to_bits(cBits, nNewPosition, nBaseRatio, bAlice, cBases, cQuantumTable);
+
+        assert(nNewPosition == cExpected.size());
+        assert(cBits.size() == (nNewPosition + 7) / 8);
+        for (uint64_t i = 0; i < nNewPosition; i++) {
+            assert((((cBits[i / 8] >> (i % 8)) & 1) != 0) == cExpected[i]);
+        }
+
+        if (cBases.size() == 0) assert(nBaseRatio == 0.0);
+        else assert(nBaseRatio == (nNewPosition - nPosition) / (double)(cBases.size() * 4));
+    }
+}
+
+
+/**
+ * check a compress and decompress round trip
+ *
+ * @param   cBases      the base table
+ */
+void test_compression(qkd::utility::memory const & cBases) {
+
+    qkd::utility::memory cCompressed = compress_base_table(cBases);
+    qkd::utility::memory cDecompressed = decompress_base_table(cCompressed, cBases.size());
+    assert(cDecompressed.size() == cBases.size());
+    assert(cDecompressed.equal(cBases));
+
+    // truncated data is refused
+    if (cBases.size() > 0 && cCompressed.size() > 1) {
+        qkd::utility::memory cTruncated = qkd::utility::memory::duplicate(cCompressed.get(), cCompressed.size() - 1);
+        assert(decompress_base_table(cTruncated, cBases.size()).size() == 0);
+    }
+}
+
+
+int test() {
+
+    srand(42);
+
+    // odd and even sizes, empty tables and tables with the last base nibble alone
+    uint64_t nSizes[] = { 0, 1, 2, 3, 7, 8, 31, 1000, 1001 };
+    for (auto nSize : nSizes) {
+        test_bases_to_bits(nSize, 0);
+        test_bases_to_bits(nSize, 5);
+        test_bases_to_bits(nSize, 67);
+    }
+
+    // no valid base at all: no bits
+    {
+        qkd::utility::memory cQuantumTable(99);
+        cQuantumTable.fill(0);
+        qkd::utility::memory cBases = quantum_table_to_base_table(cQuantumTable);
+        std::vector<unsigned char> cBits;
+        uint64_t nPosition = 0;
+        double nBaseRatio = -1.0;
+        bases_to_bits(cBits, nPosition, nBaseRatio, true, cBases, cQuantumTable);
+        assert(nPosition == 0);
+        assert(cBits.size() == 0);
+        assert(nBaseRatio == 0.0);
+    }
+
+    // double clicks in a single base yield a (diced) bit each
+    {
+        qkd::utility::memory cQuantumTable(99);
+        cQuantumTable.fill(0x33);
+        qkd::utility::memory cBases = quantum_table_to_base_table(cQuantumTable);
+        std::vector<unsigned char> cBits;
+        uint64_t nPosition = 0;
+        double nBaseRatio = -1.0;
+        bases_to_bits(cBits, nPosition, nBaseRatio, false, cBases, cQuantumTable);
+        assert(nPosition == 99 * 2);
+        assert(cBits.size() == (99 * 2 + 7) / 8);
+    }
+
+    // compression: empty, all-equal and random base tables
+    for (auto nSize : nSizes) {
+
+        qkd::utility::memory cBases(nSize);
+
+        cBases.fill(0x00);
+        test_compression(cBases);
+        cBases.fill(0x55);
+        test_compression(cBases);
+        cBases.fill(0xAA);
+        test_compression(cBases);
+
+        // gaps of more than 127 bases need multi byte varints
+        test_compression(random_bases(nSize, 1));
+        test_compression(random_bases(nSize, 20));
+        test_compression(random_bases(nSize, 100));
+    }
+
+    // all invalid: count only
+    {
+        qkd::utility::memory cBases(1001);
+        cBases.fill(0x00);
+        assert(compress_base_table(cBases).size() == 1);
+    }
+
+    // more valid bases than the table holds
+    {
+        qkd::utility::memory cBases(3);
+        cBases.fill(0x55);
+        assert(decompress_base_table(compress_base_table(cBases), 2).size() == 0);
+    }
+
+    return 0;
+}
+
+
+int main(UNUSED int argc, UNUSED char** argv) {
+    return test();
+}
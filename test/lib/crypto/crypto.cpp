@@ -438,6 +438,17 @@ int test() {
     qkd::utility::memory cTag_E = cEvHash96_Scheme_E->finalize(cKeyFinal);
     
     assert(cTag_A.equal(cTag_E));
+    
+    // binary schemes
+    qkd::crypto::scheme cScheme_2_Binary(cScheme_2.binary());
+    assert(cScheme_2_Binary.str() == cScheme_2.str());
+    qkd::crypto::crypto_context cEvHash96_Scheme_F = qkd::crypto::engine::create(cScheme_2_Binary);
+    cEvHash96_Scheme_F << cMemB;
+    qkd::utility::memory cTag_F = cEvHash96_Scheme_F->finalize(cKeyFinal);
+    
+    assert(cTag_A.equal(cTag_F));
+    assert(qkd::crypto::scheme(qkd::crypto::scheme("xor").binary()).str() == "xor");
+    assert(qkd::crypto::scheme(std::string("\x01\x06evhash\x00", 9)).name().empty());
    
 
     // --- concatenate tags ---
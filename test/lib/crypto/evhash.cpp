@@ -43,6 +43,7 @@
 #include <inttypes.h>
 
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -277,7 +278,56 @@ int test() {
 }
 
 
+int test_throughput() {
+
+    unsigned int const nBits[] = { 32, 64, 96, 128, 256 };
+    uint64_t const nBufferSize = 1024 * 1024;
+    unsigned int const nBufferLoop = 64;
+
+    qkd::utility::memory cInputData(nBufferSize);
+    for (uint64_t i = 0; i < nBufferSize; ++i) cInputData.get()[i] = (unsigned char)(i * 7 + (i >> 8));
+
+    for (auto nBit : nBits) {
+
+        qkd::key::key cKeyInit(200 + nBit, qkd::utility::memory(nBit / 8));
+        qkd::key::key cKeyFinal(300 + nBit, qkd::utility::memory(nBit / 8));
+        for (unsigned int i = 0; i < nBit / 8; ++i) {
+            cKeyInit.data().get()[i] = (unsigned char)(i * 13 + 1);
+            cKeyFinal.data().get()[i] = (unsigned char)(i * 17 + 3);
+        }
+
+        std::chrono::high_resolution_clock::time_point nStart = std::chrono::high_resolution_clock::now();
+        qkd::crypto::crypto_context cEvHash = qkd::crypto::engine::create("evhash", cKeyInit);
+        for (unsigned int i = 0; i < nBufferLoop; i++) cEvHash << cInputData;
+        std::chrono::high_resolution_clock::time_point nStop = std::chrono::high_resolution_clock::now();
+        qkd::utility::memory cTag = cEvHash->finalize(cKeyFinal);
+
+        uint64_t nNanoSec = std::chrono::duration_cast<std::chrono::nanoseconds>(nStop - nStart).count();
+        std::cout << "evhash-" << nBit << " throughput: " 
+                << (double)(nBufferSize * nBufferLoop) / nNanoSec << " GB/s" << std::endl;
+
+        // the same data in odd pieces must give the same tag
+        qkd::crypto::crypto_context cEvHashPieces = qkd::crypto::engine::create("evhash", cKeyInit);
+        for (unsigned int i = 0; i < nBufferLoop; i++) {
+            uint64_t nPosition = 0;
+            for (uint64_t nPiece = 1; nPosition < nBufferSize; nPiece = (nPiece * 3 + 1) % 1001) {
+                uint64_t nSize = std::min(nPiece, nBufferSize - nPosition);
+                cEvHashPieces << qkd::utility::memory::wrap(cInputData.get() + nPosition, nSize);
+                nPosition += nSize;
+            }
+        }
+        assert(cEvHashPieces->finalize(cKeyFinal).equal(cTag));
+    }
+
+    return 0;
+}
+
+
 int main(UNUSED int argc, UNUSED char** argv) {
-    return test();
+    
+    int nResult = test();
+    if (nResult) return nResult;
+    
+    return test_throughput();
 }
 
@@ -252,6 +252,25 @@ int test() {
     
     assert((((9 + 1) << 3) + 7) == nId);
     
+    // key id ranges
+    qkd::key::key_vector cKeyIdsA;
+    for (qkd::key::key_id i = 1000; i < 2000; ++i) cKeyIdsA.push_back(i);
+    cKeyIdsA.push_back(5);
+    cKeyIdsA.push_back(0xffffffff);
+    cKeyIdsA.push_back(7);
+    cKeyIdsA.push_back(7);
+    qkd::utility::buffer cBufferRanges;
+    qkd::key::write_ranges(cBufferRanges, cKeyIdsA);
+    qkd::key::write_ranges(cBufferRanges, qkd::key::key_vector());
+    assert(cBufferRanges.size() < 32);
+    cBufferRanges.reset();
+    qkd::key::key_vector cKeyIdsB;
+    qkd::key::read_ranges(cBufferRanges, cKeyIdsB);
+    assert(cKeyIdsA == cKeyIdsB);
+    qkd::key::read_ranges(cBufferRanges, cKeyIdsB);
+    assert(cKeyIdsB.empty());
+    assert(cBufferRanges.eof());
+    
     return 0;
 }
 
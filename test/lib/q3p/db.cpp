@@ -0,0 +1,201 @@
+/*
+ * db.cpp
+ * 
+ * This is a test file.
+ *
+ * TEST: test the qkd::q3p::db range access
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute 
+ * it and/or modify it under the terms of the GNU General Public License 
+ * as published by the Free Software Foundation, either version 3 of 
+ * the License, or (at your option) any later version.
+ * 
+ * The AIT QKD Software Suite is distributed in the hope that it will 
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty 
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite. 
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if defined(__GNUC__) || defined(__GNUCPP__)
+#   define UNUSED   __attribute__((unused))
+#else
+#   define UNUSED
+#endif
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <string.h>
+
+// include the all-in-one header
+#include <qkd/qkd.h>
+
+
+// ------------------------------------------------------------
+// code
+
+
+int test() {
+
+    // create a RAM DB with keys of 4 bytes
+    qkd::q3p::key_db cDB = qkd::q3p::db::open("ram://");
+    assert(cDB->opened());
+    assert(cDB->quantum() == 4);
+    assert(cDB->count() == 0);
+    
+    // insert 1000 keys in one go
+    std::vector<unsigned char> cData(1000 * cDB->quantum());
+    for (uint64_t i = 0; i < cData.size(); i++) cData[i] = (unsigned char)(i * 7);
+    qkd::key::key_vector cKeys = cDB->insert_range(cData.data(), 1000);
+    assert(cKeys.size() == 1000);
+    assert(cDB->count() == 1000);
+    
+    // each key holds its quantum of the data
+    for (uint64_t i = 0; i < cKeys.size(); i++) {
+        qkd::key::key cKey = cDB->get(cKeys[i]);
+        assert(memcmp(cKey.data().get(), cData.data() + i * cDB->quantum(), cDB->quantum()) == 0);
+    }
+    
+    // read them back at once
+    std::vector<unsigned char> cRead(cData.size());
+    assert(cDB->get_range(cKeys, cRead.data()) == 1000);
+    assert(cRead == cData);
+    
+    // a hole stops a range
+    cDB->del(cKeys[500]);
+    assert(cDB->count() == 999);
+    assert(cDB->get_range(cKeys[0], 1000, cRead.data()) == 500);
+    
+    // the next insert picks a spare place
+    qkd::key::key_vector cNext = cDB->insert_range(cData.data(), 1);
+    assert(cNext.size() == 1);
+    assert(cDB->valid(cNext[0]));
+    assert(cDB->count() == 1000);
+    
+    // overwrite a range
+    std::vector<unsigned char> cZero(10 * cDB->quantum(), 0);
+    assert(cDB->set_range(cKeys[10], 10, cZero.data()) == 10);
+    assert(cDB->count() == 1000);
+    assert(cDB->get_range(cKeys[10], 10, cRead.data()) == 10);
+    assert(memcmp(cRead.data(), cZero.data(), cZero.size()) == 0);
+    
+    // the real sync counter follows every mutator
+    cDB->set_real_sync(cKeys[30]);
+    cDB->set_real_sync(cKeys[31]);
+    cDB->set_real_sync(cKeys[32]);
+    assert(cDB->count_real_sync() == 3);
+    cDB->set(qkd::key::key(cKeys[30], qkd::utility::memory(cDB->quantum())));
+    assert(cDB->count_real_sync() == 2);
+    cDB->del(cKeys[31]);
+    assert(cDB->count_real_sync() == 1);
+    assert(cDB->set_range(cKeys[32], 1, cZero.data()) == 1);
+    assert(cDB->count_real_sync() == 0);
+    cDB->set(qkd::key::key(cKeys[31], qkd::utility::memory(cDB->quantum())));
+    assert(cDB->count() == 1000);
+    assert(cDB->count_real_sync() == 0);
+    
+    // a continuous run of valid keys is reserved
+    qkd::key::key_vector cRun = cDB->find_continuous(20 * cDB->quantum(), 1);
+    assert(cRun.size() == 20);
+    for (uint64_t i = 0; i < cRun.size(); i++) {
+        assert(cRun[i] == cRun[0] + i);
+        assert(cDB->key_count(cRun[i]) == 1);
+    }
+    
+    // valid keys found skip the reserved ones
+    qkd::key::key_vector cValid = cDB->find_valid(100 * cDB->quantum(), 1);
+    assert(cValid.size() == 100);
+    for (auto & nKeyId : cValid) {
+        assert(cDB->valid(nKeyId));
+        assert((nKeyId < cRun.front()) || (nKeyId > cRun.back()));
+    }
+    
+    // spare keys are not valid and not handed out twice
+    qkd::key::key_vector cSpare = cDB->find_spare(10 * cDB->quantum(), 1);
+    assert(cSpare.size() == 10);
+    for (auto & nKeyId : cSpare) assert(!cDB->valid(nKeyId));
+    qkd::key::key_vector cSpareNext = cDB->find_spare(10 * cDB->quantum(), 1);
+    assert(cSpareNext.size() == 10);
+    for (auto & nKeyId : cSpareNext) assert(std::find(cSpare.begin(), cSpare.end(), nKeyId) == cSpare.end());
+    
+    // the hole is spare again after a reset
+    cDB->reset();
+    assert(cDB->count() == 1000);
+    assert(cDB->key_count(cRun[0]) == 0);
+    cSpare = cDB->find_spare(cDB->quantum());
+    assert(cSpare.size() == 1);
+    assert(cSpare[0] == cKeys[500]);
+    
+    // all free valid keys are found
+    cValid = cDB->find_valid(1000 * cDB->quantum());
+    assert(cValid.size() == 1000);
+    
+    return 0;
+}
+
+
+int test_file() {
+    
+    // create a file DB in the current folder
+    boost::filesystem::path cPath = qkd::utility::environment::current_path();
+    cPath /= "q3p_db_test.db";
+    boost::filesystem::remove(cPath);
+    std::string sJournal = cPath.string() + ".journal";
+    std::string sURL = std::string("file://") + cPath.string();
+    
+    qkd::q3p::key_db cDB = qkd::q3p::db::open(QString::fromStdString(sURL));
+    assert(cDB->opened());
+    assert(cDB->count() == 0);
+    
+    std::vector<unsigned char> cData(100 * cDB->quantum());
+    for (uint64_t i = 0; i < cData.size(); i++) cData[i] = (unsigned char)(i * 3);
+    qkd::key::key_vector cKeys = cDB->insert_range(cData.data(), 100);
+    assert(cKeys.size() == 100);
+    cDB->set_real_sync(cKeys[5]);
+    
+    // a sync leaves no journal
+    cDB->sync();
+    assert(boost::filesystem::file_size(sJournal) == 0);
+    cDB->close();
+    
+    // reopen: keys and flags survived
+    cDB = qkd::q3p::db::open(QString::fromStdString(sURL));
+    assert(cDB->count() == 100);
+    assert(cDB->count_real_sync() == 1);
+    assert(cDB->real_sync(cKeys[5]));
+    std::vector<unsigned char> cRead(cData.size());
+    assert(cDB->get_range(cKeys, cRead.data()) == 100);
+    assert(cRead == cData);
+    cDB->close();
+    
+    boost::filesystem::remove(cPath);
+    boost::filesystem::remove(sJournal);
+    
+    return 0;
+}
+
+
+int main(UNUSED int argc, UNUSED char** argv) {
+    int nResult = test();
+    if (nResult) return nResult;
+    return test_file();
+}
@@ -0,0 +1,122 @@
+/*
+ * shm.cpp
+ * 
+ * This is a test file.
+ *
+ * TEST: test the qkd::q3p::shm_ring shared memory key ring
+ *
+ * Author: Oliver Maurhart, <oliver.maurhart@ait.ac.at>
+ *
+ * Copyright (C) 2012-2016 AIT Austrian Institute of Technology
+ * AIT Austrian Institute of Technology GmbH
+ * Donau-City-Strasse 1 | 1220 Vienna | Austria
+ * http://www.ait.ac.at
+ *
+ * This file is part of the AIT QKD Software Suite.
+ *
+ * The AIT QKD Software Suite is free software: you can redistribute 
+ * it and/or modify it under the terms of the GNU General Public License 
+ * as published by the Free Software Foundation, either version 3 of 
+ * the License, or (at your option) any later version.
+ * 
+ * The AIT QKD Software Suite is distributed in the hope that it will 
+ * be useful, but WITHOUT ANY WARRANTY; without even the implied warranty 
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with the AIT QKD Software Suite. 
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if defined(__GNUC__) || defined(__GNUCPP__)
+#   define UNUSED   __attribute__((unused))
+#else
+#   define UNUSED
+#endif
+
+
+// ------------------------------------------------------------
+// incs
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+
+// include the all-in-one header
+#include <qkd/qkd.h>
+
+
+// ------------------------------------------------------------
+// code
+
+
+int test() {
+
+    // the writer creates, the reader opens
+    qkd::q3p::shm cWriter = qkd::q3p::shm_ring::create("/qkd_test_shm", 10000);
+    qkd::q3p::shm cReader = qkd::q3p::shm_ring::open("/qkd_test_shm");
+    assert(cWriter->capacity() >= 10000);
+    assert(cReader->capacity() == cWriter->capacity());
+    assert(cReader->available() == 0);
+    assert(cWriter->free() == cWriter->capacity());
+    
+    // nothing to read yet
+    unsigned char cBuffer[1000];
+    assert(cReader->read(cBuffer, sizeof(cBuffer)) == 0);
+    assert(!cReader->wait(1, 10));
+    
+    // write and read back
+    uint64_t nSize = 0;
+    unsigned char * cArea = cWriter->write_begin(nSize);
+    assert(nSize == cWriter->capacity());
+    for (uint64_t i = 0; i < 100; i++) cArea[i] = (unsigned char)i;
+    cWriter->commit(100);
+    assert(cReader->wait(100, 0));
+    assert(cReader->read(cBuffer, 60) == 60);
+    assert(cReader->read(cBuffer + 60, sizeof(cBuffer)) == 40);
+    for (uint64_t i = 0; i < 100; i++) assert(cBuffer[i] == (unsigned char)i);
+    
+    // purge
+    cWriter->write_begin(nSize);
+    cWriter->commit(10);
+    cWriter->purge();
+    assert(cReader->available() == 0);
+    
+    // stream through the ring with a reader thread waiting for data
+    uint64_t const nTotal = 16 * cWriter->capacity() + 123;
+    std::thread cThread([&]() {
+        uint64_t nWritten = 0;
+        while (nWritten < nTotal) {
+            unsigned char * cArea = cWriter->write_begin(nSize);
+            nSize = std::min<uint64_t>(nSize, nTotal - nWritten);
+            if (nSize == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (uint64_t i = 0; i < nSize; i++) cArea[i] = (unsigned char)((nWritten + i) * 7);
+            cWriter->commit(nSize);
+            nWritten += nSize;
+        }
+    });
+    uint64_t nRead = 0;
+    while (nRead < nTotal) {
+        assert(cReader->wait(1, 1000));
+        uint64_t nBytes = cReader->read(cBuffer, std::min<uint64_t>(sizeof(cBuffer), nTotal - nRead));
+        for (uint64_t i = 0; i < nBytes; i++) assert(cBuffer[i] == (unsigned char)((nRead + i) * 7));
+        nRead += nBytes;
+    }
+    cThread.join();
+    assert(cReader->available() == 0);
+    
+    return 0;
+}
+
+
+int main(UNUSED int argc, UNUSED char** argv) {
+    return test();
+}
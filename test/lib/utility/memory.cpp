@@ -229,6 +229,19 @@ int test() {
     assert(cMemoryA.size() == 16);
     assert(cMemoryA.as_hex() == "abcd0123abcd0123abcdef0123456789");
     
+    // slices: in range and out of range (with overflowing sizes)
+    assert(cMemoryA.slice(8, 8).as_hex() == "abcdef0123456789");
+    assert(cMemoryA.slice(16, 0).size() == 0);
+    bool bThrown = false;
+    try { cMemoryA.slice(8, 9); } catch (std::out_of_range &) { bThrown = true; }
+    assert(bThrown);
+    bThrown = false;
+    try { cMemoryA.slice(17, 0); } catch (std::out_of_range &) { bThrown = true; }
+    assert(bThrown);
+    bThrown = false;
+    try { cMemoryA.slice(8, UINT64_MAX - 4); } catch (std::out_of_range &) { bThrown = true; }
+    assert(bThrown);
+    
     // canonical test: read a file and check the canonical representation
     std::ifstream cFileCanonical("../test-data/shared-secret", std::ios::in | std::ios::binary);
     assert(cFileCanonical.is_open());